@@ -357,6 +357,23 @@ Helper Functions
 		vint CopyStream(stream::IStream& inputStream, stream::IStream& outputStream)
 		{
 			vint totalSize = 0;
+			const void* borrowed = nullptr;
+			if (inputStream.AcquireRead(borrowed, 0) != -1)
+			{
+				// write content directly from the input stream when it supports borrowing
+				while (true)
+				{
+					vint copied = inputStream.AcquireRead(borrowed, 65536);
+					if (copied == 0)
+					{
+						break;
+					}
+					totalSize += outputStream.Write(const_cast<void*>(borrowed), copied);
+					inputStream.CommitRead(copied);
+				}
+				return totalSize;
+			}
+
 			while (true)
 			{
 				char buffer[1024];
@@ -387,18 +404,17 @@ Helper Functions
 					encoderStream.Write(&buffer[0], size);
 				}
 
-				compressedStream.SeekFromBegin(0);
-				{
-					{
-						vint32_t bufferSize = (vint32_t)size;
-						outputStream.Write(&bufferSize, (vint)sizeof(bufferSize));
-					}
-					{
-						vint32_t compressedSize = (vint32_t)compressedStream.Size();
-						outputStream.Write(&compressedSize, (vint)sizeof(compressedSize));
-					}
-					CopyStream(compressedStream, outputStream);
-				}
+				// write both headers and the compressed content in one operation
+				vint32_t bufferSize = (vint32_t)size;
+				vint32_t compressedSize = (vint32_t)compressedStream.Size();
+				StreamBuffer frame[3];
+				frame[0].buffer = &bufferSize;
+				frame[0].size = (vint)sizeof(bufferSize);
+				frame[1].buffer = &compressedSize;
+				frame[1].size = (vint)sizeof(compressedSize);
+				frame[2].buffer = compressedStream.GetInternalBuffer();
+				frame[2].size = (vint)compressedStream.Size();
+				outputStream.WriteV(frame, 3);
 			}
 		}
 
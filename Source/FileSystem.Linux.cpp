@@ -6,6 +6,7 @@ Licensed under https://github.com/vczh-libraries/License
 #include "FileSystem.h"
 #include "Locale.h"
 #include "Stream/FileStream.h"
+#include "Stream/AsyncFile.h"
 #include "Stream/MemoryWrapperStream.h"
 #include "Stream/Accessor.h"
 #include "Stream/EncodingStream.h"
@@ -22,6 +23,10 @@ namespace vl
 	namespace stream
 	{
 		extern Ptr<IFileStreamImpl>		CreateOSFileStreamImpl(const WString& fileName, FileStream::AccessRight accessRight);
+		extern Ptr<IAsyncFileImpl>		CreateThreadPoolAsyncFileImpl(const WString& fileName, FileStream::AccessRight accessRight);
+#if !defined VCZH_APPLE
+		extern Ptr<IAsyncFileImpl>		CreateUringAsyncFileImpl(const WString& fileName, FileStream::AccessRight accessRight);
+#endif
 	}
 
 	namespace filesystem
@@ -262,6 +267,17 @@ LinuxFileSystemImpl
 			{
 				return stream::CreateOSFileStreamImpl(fileName, accessRight);
 			}
+
+			Ptr<stream::IAsyncFileImpl> GetAsyncFileImpl(const WString& fileName, stream::FileStream::AccessRight accessRight) const override
+			{
+#if !defined VCZH_APPLE
+				if (auto impl = stream::CreateUringAsyncFileImpl(fileName, accessRight))
+				{
+					return impl;
+				}
+#endif
+				return stream::CreateThreadPoolAsyncFileImpl(fileName, accessRight);
+			}
 		};
 
 /***********************************************************************
@@ -6,6 +6,7 @@ Licensed under https://github.com/vczh-libraries/License
 #include "FileSystem.h"
 #include "Locale.h"
 #include "Stream/FileStream.h"
+#include "Stream/AsyncFile.h"
 #include "Stream/MemoryWrapperStream.h"
 #include "Stream/Accessor.h"
 #include "Stream/EncodingStream.h"
@@ -24,6 +25,7 @@ namespace vl
 	namespace stream
 	{
 		extern Ptr<IFileStreamImpl>		CreateOSFileStreamImpl(const WString& fileName, FileStream::AccessRight accessRight);
+		extern Ptr<IAsyncFileImpl>		CreateThreadPoolAsyncFileImpl(const WString& fileName, FileStream::AccessRight accessRight);
 	}
 
 	namespace filesystem
@@ -282,6 +284,11 @@ WindowsFileSystemImpl
 			{
 				return stream::CreateOSFileStreamImpl(fileName, accessRight);
 			}
+
+			Ptr<stream::IAsyncFileImpl> GetAsyncFileImpl(const WString& fileName, stream::FileStream::AccessRight accessRight) const override
+			{
+				return stream::CreateThreadPoolAsyncFileImpl(fileName, accessRight);
+			}
 		};
 
 		IFileSystemImpl* GetOSFileSystemImpl()
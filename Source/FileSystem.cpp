@@ -193,25 +193,34 @@ File
 
 		bool File::ReadAllTextWithEncodingTesting(WString& text, stream::BomEncoder::Encoding& encoding, bool& containsBom)
 		{
-			Array<unsigned char> buffer;
+			// mapped pages are tested and decoded in place, the file is read to a buffer only when it cannot be mapped
+			auto fileStream = Ptr(new FileStream(filePath.GetFullPath(), FileStream::ReadOnlyMapped));
+			if (!fileStream->IsAvailable())
 			{
-				FileStream fileStream(filePath.GetFullPath(), FileStream::ReadOnly);
-				if (!fileStream.IsAvailable()) return false;
-				if (fileStream.Size() == 0)
-				{
-					text = L"";
-					encoding = BomEncoder::Mbcs;
-					containsBom = false;
-					return true;
-				}
+				fileStream = Ptr(new FileStream(filePath.GetFullPath(), FileStream::ReadOnly));
+				if (!fileStream->IsAvailable()) return false;
+			}
+			if (fileStream->Size() == 0)
+			{
+				text = L"";
+				encoding = BomEncoder::Mbcs;
+				containsBom = false;
+				return true;
+			}
 
-				buffer.Resize((vint)fileStream.Size());
-				vint count = fileStream.Read(&buffer[0], buffer.Count());
+			Array<unsigned char> buffer;
+			vint size = (vint)fileStream->Size();
+			const void* content = nullptr;
+			if (fileStream->AcquireRead(content, size) != size)
+			{
+				buffer.Resize(size);
+				vint count = fileStream->Read(&buffer[0], buffer.Count());
 				CHECK_ERROR(count == buffer.Count(), L"vl::filesystem::File::ReadAllTextWithEncodingTesting(WString&, BomEncoder::Encoding&, bool&)#Failed to read the whole file.");
+				content = &buffer[0];
 			}
-			TestEncoding(&buffer[0], buffer.Count(), encoding, containsBom);
+			TestEncoding((unsigned char*)content, size, encoding, containsBom);
 
-			MemoryWrapperStream memoryStream(&buffer[0], buffer.Count());
+			MemoryWrapperStream memoryStream(const_cast<void*>(content), size);
 			if (containsBom)
 			{
 				BomDecoder decoder;
@@ -319,7 +328,7 @@ File
 
 			{
 				EncoderStream encoderStream(fileStream, *encoder);
-				StreamWriter writer(encoderStream);
+				StreamWriter writer(encoderStream, 65536);
 				writer.WriteString(text);
 			}
 			delete encoder;
@@ -354,7 +363,7 @@ File
 
 			{
 				EncoderStream encoderStream(fileStream, *encoder);
-				StreamWriter writer(encoderStream);
+				StreamWriter writer(encoderStream, 65536);
 				for (auto line : lines)
 				{
 					writer.WriteLine(line);
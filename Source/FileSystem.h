@@ -11,6 +11,11 @@ Licensed under https://github.com/vczh-libraries/License
 
 namespace vl
 {
+	namespace stream
+	{
+		class IAsyncFileImpl;
+	}
+
 	namespace filesystem
 	{
 		/// <summary>Absolute file path.</summary>
@@ -228,6 +233,7 @@ namespace vl
 			
 			// Stream operations
 			virtual Ptr<stream::IFileStreamImpl> GetFileStreamImpl(const WString& fileName, stream::FileStream::AccessRight accessRight) const = 0;
+			virtual Ptr<stream::IAsyncFileImpl> GetAsyncFileImpl(const WString& fileName, stream::FileStream::AccessRight accessRight) const = 0;
 		};
 
 		extern void InjectFileSystemImpl(IFileSystemImpl* impl);
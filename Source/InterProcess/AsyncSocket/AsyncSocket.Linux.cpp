@@ -232,6 +232,7 @@ RingRuntime
 		bool								workerStarted = false;
 		bool								stopRequested = false;
 		EventObject							eventWorkerStopped;
+		ThreadStartOptions					workerOptions;
 
 		vuint64_t ReserveOperationIdLocked()
 		{
@@ -478,9 +479,10 @@ RingRuntime
 			Stop();
 		}
 
-		static Ptr<RingRuntime> Create(bool startWorker)
+		static Ptr<RingRuntime> Create(bool startWorker, const ThreadStartOptions& workerOptions)
 		{
 			auto result = Ptr(new RingRuntime);
+			result->workerOptions = workerOptions;
 			if (startWorker)
 			{
 				result->Start(result);
@@ -497,7 +499,7 @@ RingRuntime
 				auto worker = Thread::CreateAndStart(Func<void()>([retainedRuntime]()
 				{
 					retainedRuntime->WorkerLoop();
-				}), true);
+				}), true, workerOptions);
 				CHECK_ERROR(worker != nullptr, ERROR_MESSAGE_PREFIX L"Failed to start the io_uring completion worker.");
 				workerStarted = true;
 			}
@@ -2225,9 +2227,9 @@ AsyncSocketServer::Impl
 		Ptr<ServerState>					state;
 
 	public:
-		Impl(vint _port)
+		Impl(vint _port, const ThreadStartOptions& completionThreadOptions)
 			: port(_port)
-			, runtime(RingRuntime::Create(false))
+			, runtime(RingRuntime::Create(false, completionThreadOptions))
 			, state(Ptr(new ServerState(runtime, _port)))
 		{
 		}
@@ -2262,12 +2264,12 @@ AsyncSocketServer::Impl
 AsyncSocketServer
 ***********************************************************************/
 
-	AsyncSocketServer::AsyncSocketServer(vint port)
+	AsyncSocketServer::AsyncSocketServer(vint port, const ThreadStartOptions& completionThreadOptions)
 	{
-#define ERROR_MESSAGE_PREFIX L"vl::inter_process::async_tcp_socket::linux_socket::AsyncSocketServer::AsyncSocketServer(vint)#"
+#define ERROR_MESSAGE_PREFIX L"vl::inter_process::async_tcp_socket::linux_socket::AsyncSocketServer::AsyncSocketServer(vint, const ThreadStartOptions&)#"
 		CHECK_ERROR(1 <= port && port <= 65535, ERROR_MESSAGE_PREFIX L"The port must be in 1..65535.");
 #undef ERROR_MESSAGE_PREFIX
-		impl = new Impl(port);
+		impl = new Impl(port, completionThreadOptions);
 	}
 
 	AsyncSocketServer::~AsyncSocketServer()
@@ -2303,14 +2305,16 @@ AsyncSocketClient::Impl
 	{
 	private:
 		vint								port = 0;
+		ThreadStartOptions					completionThreadOptions;
 		Ptr<RingRuntime>					runtime;
 		Ptr<ConnectionState>				state;
 		Ptr<AsyncSocketConnection>		connection;
 
 	public:
-		Impl(vint _port)
+		Impl(vint _port, const ThreadStartOptions& _completionThreadOptions)
 			: port(_port)
-			, runtime(RingRuntime::Create(true))
+			, completionThreadOptions(_completionThreadOptions)
+			, runtime(RingRuntime::Create(true, _completionThreadOptions))
 			, state(Ptr(new ConnectionState(runtime, true, _port)))
 			, connection(Ptr(new AsyncSocketConnection(state)))
 		{
@@ -2326,6 +2330,11 @@ AsyncSocketClient::Impl
 			return port;
 		}
 
+		const ThreadStartOptions& GetCompletionThreadOptions()
+		{
+			return completionThreadOptions;
+		}
+
 		void Stop()
 		{
 			connection->Stop();
@@ -2352,12 +2361,12 @@ AsyncSocketClient::Impl
 AsyncSocketClient
 ***********************************************************************/
 
-	AsyncSocketClient::AsyncSocketClient(vint port)
+	AsyncSocketClient::AsyncSocketClient(vint port, const ThreadStartOptions& completionThreadOptions)
 	{
-#define ERROR_MESSAGE_PREFIX L"vl::inter_process::async_tcp_socket::linux_socket::AsyncSocketClient::AsyncSocketClient(vint)#"
+#define ERROR_MESSAGE_PREFIX L"vl::inter_process::async_tcp_socket::linux_socket::AsyncSocketClient::AsyncSocketClient(vint, const ThreadStartOptions&)#"
 		CHECK_ERROR(1 <= port && port <= 65535, ERROR_MESSAGE_PREFIX L"The port must be in 1..65535.");
 #undef ERROR_MESSAGE_PREFIX
-		impl = new Impl(port);
+		impl = new Impl(port, completionThreadOptions);
 	}
 
 	AsyncSocketClient::~AsyncSocketClient()
@@ -2372,7 +2381,7 @@ AsyncSocketClient
 
 	Ptr<IAsyncSocketClient> AsyncSocketClient::CreateSameEndpointClient()
 	{
-		return Ptr(new AsyncSocketClient(GetPort()));
+		return Ptr(new AsyncSocketClient(GetPort(), impl->GetCompletionThreadOptions()));
 	}
 
 	IAsyncSocketConnection* AsyncSocketClient::GetConnection()
@@ -22,7 +22,10 @@ namespace vl::inter_process::async_tcp_socket::linux_socket
 		Impl*								impl = nullptr;
 
 	public:
-		AsyncSocketServer(vint port);
+		/// <summary>Create a server.</summary>
+		/// <param name="port">The port.</param>
+		/// <param name="completionThreadOptions">Options to start the io_uring completion thread, for example, to keep network threads away from processors used by compute threads.</param>
+		AsyncSocketServer(vint port, const ThreadStartOptions& completionThreadOptions = {});
 		~AsyncSocketServer();
 
 		vint								GetPort() override;
@@ -38,7 +41,10 @@ namespace vl::inter_process::async_tcp_socket::linux_socket
 		Impl*								impl = nullptr;
 
 	public:
-		AsyncSocketClient(vint port);
+		/// <summary>Create a client. <see cref="CreateSameEndpointClient"/> creates clients with the same options.</summary>
+		/// <param name="port">The port.</param>
+		/// <param name="completionThreadOptions">Options to start the io_uring completion thread, for example, to keep network threads away from processors used by compute threads.</param>
+		AsyncSocketClient(vint port, const ThreadStartOptions& completionThreadOptions = {});
 		~AsyncSocketClient();
 
 		vint								GetPort() override;
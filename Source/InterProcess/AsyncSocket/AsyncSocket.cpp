@@ -45,6 +45,240 @@ IAsyncSocketCallback
 	{
 	}
 
+/***********************************************************************
+AsyncSocketAwaitableConnection::ReadAwaiter
+***********************************************************************/
+
+	AsyncSocketAwaitableConnection::ReadAwaiter::ReadAwaiter(AsyncSocketAwaitableConnection* _owner, vuint8_t* _buffer, vint _size)
+		: owner(_owner)
+		, buffer(_buffer)
+		, size(_size)
+	{
+	}
+
+	bool AsyncSocketAwaitableConnection::ReadAwaiter::await_ready()
+	{
+		CS_LOCK(owner->lockState)
+		{
+			received = owner->TakePendingBytes(buffer, size);
+			return received > 0 || owner->disconnected;
+		}
+		return false;
+	}
+
+	bool AsyncSocketAwaitableConnection::ReadAwaiter::await_suspend(std::coroutine_handle<> _handle)
+	{
+		CS_LOCK(owner->lockState)
+		{
+			// bytes could arrive between await_ready and await_suspend
+			received = owner->TakePendingBytes(buffer, size);
+			if (received > 0 || owner->disconnected)
+			{
+				return false;
+			}
+			CHECK_ERROR(!owner->reader, L"vl::inter_process::async_tcp_socket::AsyncSocketAwaitableConnection::ReadAsync(vuint8_t*, vint)#Only one read could be pending.");
+			handle = _handle;
+			owner->reader = this;
+		}
+		return true;
+	}
+
+	vint AsyncSocketAwaitableConnection::ReadAwaiter::await_resume()
+	{
+		return received;
+	}
+
+/***********************************************************************
+AsyncSocketAwaitableConnection::WriteAwaiter
+***********************************************************************/
+
+	AsyncSocketAwaitableConnection::WriteAwaiter::WriteAwaiter(AsyncSocketAwaitableConnection* _owner, Ptr<AsyncSocketBuffer> _buffer)
+		: owner(_owner)
+		, buffer(_buffer)
+	{
+	}
+
+	bool AsyncSocketAwaitableConnection::WriteAwaiter::await_ready()
+	{
+		return false;
+	}
+
+	bool AsyncSocketAwaitableConnection::WriteAwaiter::await_suspend(std::coroutine_handle<> _handle)
+	{
+		auto connection = owner->connection;
+		auto sending = buffer;
+		CS_LOCK(owner->lockState)
+		{
+			if (owner->disconnected)
+			{
+				return false;
+			}
+			CHECK_ERROR(!owner->writer, L"vl::inter_process::async_tcp_socket::AsyncSocketAwaitableConnection::WriteAsync(Ptr<AsyncSocketBuffer>)#Only one write could be pending.");
+			handle = _handle;
+			owner->writer = this;
+		}
+
+		// the coroutine could resume and destroy this awaiter before WriteAsync returns
+		connection->WriteAsync(sending);
+		return true;
+	}
+
+	bool AsyncSocketAwaitableConnection::WriteAwaiter::await_resume()
+	{
+		return succeeded;
+	}
+
+/***********************************************************************
+AsyncSocketAwaitableConnection
+***********************************************************************/
+
+	vint AsyncSocketAwaitableConnection::TakePendingBytes(vuint8_t* buffer, vint size)
+	{
+		vint available = pendingEnd - pendingBegin;
+		if (available == 0) return 0;
+		vint taking = available < size ? available : size;
+		memcpy(buffer, &pendingBytes[pendingBegin], taking);
+		pendingBegin += taking;
+		if (pendingBegin == pendingEnd)
+		{
+			pendingBegin = 0;
+			pendingEnd = 0;
+		}
+		return taking;
+	}
+
+	void AsyncSocketAwaitableConnection::AppendPendingBytes(const vuint8_t* buffer, vint size)
+	{
+		if (pendingBegin > 0)
+		{
+			memmove(&pendingBytes[0], &pendingBytes[pendingBegin], pendingEnd - pendingBegin);
+			pendingEnd -= pendingBegin;
+			pendingBegin = 0;
+		}
+		if (pendingEnd + size > pendingBytes.Count())
+		{
+			vint capacity = pendingBytes.Count() * 2;
+			pendingBytes.Resize(capacity < pendingEnd + size ? pendingEnd + size : capacity);
+		}
+		memcpy(&pendingBytes[pendingEnd], buffer, size);
+		pendingEnd += size;
+	}
+
+	AsyncSocketAwaitableConnection::AsyncSocketAwaitableConnection(IAsyncSocketConnection* _connection)
+	{
+		CHECK_ERROR(_connection, L"AsyncSocketAwaitableConnection requires a valid async socket connection.");
+		_connection->InstallCallback(this);
+	}
+
+	AsyncSocketAwaitableConnection::~AsyncSocketAwaitableConnection()
+	{
+		if (connection)
+		{
+			connection->InstallCallback(nullptr);
+		}
+	}
+
+	IAsyncSocketConnection* AsyncSocketAwaitableConnection::GetConnection()
+	{
+		return connection;
+	}
+
+	bool AsyncSocketAwaitableConnection::IsDisconnected()
+	{
+		CS_LOCK(lockState)
+		{
+			return disconnected;
+		}
+		return true;
+	}
+
+	AsyncSocketAwaitableConnection::ReadAwaiter AsyncSocketAwaitableConnection::ReadAsync(vuint8_t* buffer, vint size)
+	{
+		CHECK_ERROR(buffer && size > 0, L"vl::inter_process::async_tcp_socket::AsyncSocketAwaitableConnection::ReadAsync(vuint8_t*, vint)#The buffer must not be empty.");
+		return ReadAwaiter(this, buffer, size);
+	}
+
+	AsyncSocketAwaitableConnection::WriteAwaiter AsyncSocketAwaitableConnection::WriteAsync(Ptr<AsyncSocketBuffer> buffer)
+	{
+		CHECK_ERROR(buffer, L"vl::inter_process::async_tcp_socket::AsyncSocketAwaitableConnection::WriteAsync(Ptr<AsyncSocketBuffer>)#The buffer must not be null.");
+		return WriteAwaiter(this, buffer);
+	}
+
+	void AsyncSocketAwaitableConnection::OnRead(const vuint8_t* buffer, vint size)
+	{
+		ReadAwaiter* resuming = nullptr;
+		CS_LOCK(lockState)
+		{
+			if (reader)
+			{
+				resuming = reader;
+				reader = nullptr;
+				resuming->received = size < resuming->size ? size : resuming->size;
+				memcpy(resuming->buffer, buffer, resuming->received);
+				buffer += resuming->received;
+				size -= resuming->received;
+			}
+			if (size > 0)
+			{
+				AppendPendingBytes(buffer, size);
+			}
+		}
+
+		// resume on the socket thread, this adapter could be destroyed by the coroutine
+		if (resuming)
+		{
+			resuming->handle.resume();
+		}
+	}
+
+	void AsyncSocketAwaitableConnection::OnWriteCompleted(Ptr<AsyncSocketBuffer> buffer)
+	{
+		WriteAwaiter* resuming = nullptr;
+		CS_LOCK(lockState)
+		{
+			if (writer && writer->buffer == buffer)
+			{
+				resuming = writer;
+				writer = nullptr;
+				resuming->succeeded = true;
+			}
+		}
+
+		if (resuming)
+		{
+			resuming->handle.resume();
+		}
+	}
+
+	void AsyncSocketAwaitableConnection::OnDisconnected()
+	{
+		std::coroutine_handle<> resumingReader, resumingWriter;
+		CS_LOCK(lockState)
+		{
+			disconnected = true;
+			if (reader)
+			{
+				resumingReader = reader->handle;
+				reader->received = 0;
+				reader = nullptr;
+			}
+			if (writer)
+			{
+				resumingWriter = writer->handle;
+				writer->succeeded = false;
+				writer = nullptr;
+			}
+		}
+
+		if (resumingReader) resumingReader.resume();
+		if (resumingWriter) resumingWriter.resume();
+	}
+
+	void AsyncSocketAwaitableConnection::OnInstalled(IAsyncSocketConnection* _connection)
+	{
+		connection = _connection;
+	}
+
 /***********************************************************************
 NetworkProtocolCallbackDomain::CallbackFrame
 ***********************************************************************/
@@ -114,6 +114,98 @@ namespace vl::inter_process::async_tcp_socket
 	extern Ptr<IAsyncSocketServer>			CreateDefaultAsyncSocketServer(vint port);
 	extern Ptr<IAsyncSocketClient>			CreateDefaultAsyncSocketClient(vint port);
 
+/***********************************************************************
+AsyncSocketAwaitableConnection
+***********************************************************************/
+
+	/// <summary>
+	/// Adapts an asynchronous byte stream to awaitable reads and writes for coroutines returning <see cref="Task`1"/>.
+	/// A suspended coroutine resumes directly on the socket thread completing the operation.
+	/// The adapter installs itself as the callback of the connection, the caller still begins the reading loop.
+	/// </summary>
+	class AsyncSocketAwaitableConnection
+		: public Object
+		, public virtual IAsyncSocketCallback
+	{
+	public:
+		/// <summary>Awaiter of <see cref="ReadAsync"/>, the result is the number of bytes read, 0 means the connection is stopped.</summary>
+		class ReadAwaiter
+		{
+			friend class AsyncSocketAwaitableConnection;
+		private:
+			AsyncSocketAwaitableConnection*		owner;
+			vuint8_t*						buffer;
+			vint							size;
+			vint							received = 0;
+			std::coroutine_handle<>			handle;
+
+			ReadAwaiter(AsyncSocketAwaitableConnection* _owner, vuint8_t* _buffer, vint _size);
+		public:
+			bool							await_ready();
+			bool							await_suspend(std::coroutine_handle<> _handle);
+			vint							await_resume();
+		};
+
+		/// <summary>Awaiter of <see cref="WriteAsync"/>, the result is false if the connection stops before the buffer is sent.</summary>
+		class WriteAwaiter
+		{
+			friend class AsyncSocketAwaitableConnection;
+		private:
+			AsyncSocketAwaitableConnection*		owner;
+			Ptr<AsyncSocketBuffer>			buffer;
+			bool							succeeded = false;
+			std::coroutine_handle<>			handle;
+
+			WriteAwaiter(AsyncSocketAwaitableConnection* _owner, Ptr<AsyncSocketBuffer> _buffer);
+		public:
+			bool							await_ready();
+			bool							await_suspend(std::coroutine_handle<> _handle);
+			bool							await_resume();
+		};
+
+	private:
+		IAsyncSocketConnection*				connection = nullptr;
+
+		// covers pendingBytes, pendingBegin, pendingEnd, reader, writer, disconnected
+		CriticalSection					lockState;
+		collections::Array<vuint8_t>	pendingBytes;
+		vint							pendingBegin = 0;
+		vint							pendingEnd = 0;
+		ReadAwaiter*					reader = nullptr;
+		WriteAwaiter*					writer = nullptr;
+		bool							disconnected = false;
+
+		vint							TakePendingBytes(vuint8_t* buffer, vint size);
+		void							AppendPendingBytes(const vuint8_t* buffer, vint size);
+
+	public:
+		/// <summary>Create the adapter and install it as the callback of the connection.</summary>
+		/// <param name="_connection">The connection.</param>
+		AsyncSocketAwaitableConnection(IAsyncSocketConnection* _connection);
+		~AsyncSocketAwaitableConnection();
+
+		/// <summary>Get the connection.</summary>
+		/// <returns>The connection.</returns>
+		IAsyncSocketConnection*				GetConnection();
+		/// <summary>Test if the connection is stopped.</summary>
+		/// <returns>Returns true if the connection is stopped.</returns>
+		bool								IsDisconnected();
+		/// <summary>Read received bytes, bytes arriving when no coroutine is reading are buffered. Only one read could be pending.</summary>
+		/// <returns>The awaiter.</returns>
+		/// <param name="buffer">The buffer to receive bytes, it must stay alive until the awaiter resumes.</param>
+		/// <param name="size">The size of the buffer, it must be positive.</param>
+		ReadAwaiter							ReadAsync(vuint8_t* buffer, vint size);
+		/// <summary>Send a buffer. Only one write could be pending.</summary>
+		/// <returns>The awaiter.</returns>
+		/// <param name="buffer">The buffer to send.</param>
+		WriteAwaiter						WriteAsync(Ptr<AsyncSocketBuffer> buffer);
+
+		void								OnRead(const vuint8_t* buffer, vint size) override;
+		void								OnWriteCompleted(Ptr<AsyncSocketBuffer> buffer) override;
+		void								OnDisconnected() override;
+		void								OnInstalled(IAsyncSocketConnection* _connection) override;
+	};
+
 /***********************************************************************
 NetworkProtocolConnection
 ***********************************************************************/
@@ -4,6 +4,7 @@ Licensed under https://github.com/vczh-libraries/License
 ***********************************************************************/
 
 #include <string.h>
+#include <wchar.h>
 #include "Accessor.h"
 
 namespace vl
@@ -34,6 +35,213 @@ namespace vl
 		template<typename T>
 		constexpr const T* VEMPTYSTR = VEMPTYSTR_<T>::Value;
 
+		template<typename T>
+		const T* FindTextChar(const T* begin, const T* end, T c)
+		{
+			if (begin == end)
+			{
+				return end;
+			}
+
+			const T* found = nullptr;
+			if constexpr (sizeof(T) == sizeof(char))
+			{
+				found = (const T*)memchr(begin, (int)c, end - begin);
+			}
+			else if constexpr (sizeof(T) == sizeof(wchar_t))
+			{
+				found = (const T*)wmemchr((const wchar_t*)begin, (wchar_t)c, end - begin);
+			}
+			else
+			{
+				for (found = begin; found < end && *found != c; found++);
+			}
+			return found ? found : end;
+		}
+
+		template<typename T>
+		class TextBuilder_
+		{
+		protected:
+			T*							buffer = nullptr;
+			vint						length = 0;
+			vint						capacity = 0;
+
+		public:
+			NOT_COPYABLE(TextBuilder_);
+			TextBuilder_() = default;
+
+			~TextBuilder_()
+			{
+				delete[] buffer;
+			}
+
+			void Append(const T* chars, vint count)
+			{
+				if (count == 0)
+				{
+					return;
+				}
+
+				if (length + count + 1 > capacity)
+				{
+					// the first append allocates the exact size, so a string from one block wastes no memory
+					vint newCapacity = capacity == 0 ? count + 1 : capacity * 2;
+					if (newCapacity < length + count + 1)
+					{
+						newCapacity = length + count + 1;
+					}
+					T* newBuffer = new T[newCapacity];
+					if (length > 0)
+					{
+						memcpy(newBuffer, buffer, length * sizeof(T));
+					}
+					delete[] buffer;
+					buffer = newBuffer;
+					capacity = newCapacity;
+				}
+				memcpy(buffer + length, chars, count * sizeof(T));
+				length += count;
+			}
+
+			void RemoveLastCR()
+			{
+				if (length > 0 && buffer[length - 1] == L'\r')
+				{
+					length--;
+				}
+			}
+
+			ObjectString<T> Build()
+			{
+				if (length == 0)
+				{
+					return VEMPTYSTR<T>;
+				}
+				else if (length * 2 < capacity)
+				{
+					return ObjectString<T>::CopyFrom(buffer, length);
+				}
+				else
+				{
+					buffer[length] = 0;
+					auto result = ObjectString<T>::TakeOver(buffer, length);
+					buffer = nullptr;
+					length = 0;
+					capacity = 0;
+					return result;
+				}
+			}
+		};
+
+/***********************************************************************
+StreamSpanReader
+***********************************************************************/
+
+		void StreamSpanReader::PrepareMode()
+		{
+			if (mode == Mode::Unknown)
+			{
+				const void* borrowed = nullptr;
+				if (stream->AcquireRead(borrowed, 0) != -1)
+				{
+					mode = Mode::Borrow;
+				}
+				else if (stream->CanPeek() && stream->CanSeek())
+				{
+					mode = Mode::Peek;
+				}
+				else
+				{
+					mode = Mode::Read;
+				}
+			}
+		}
+
+		StreamSpanReader::StreamSpanReader(IStream& _stream, vint _block)
+			: stream(&_stream)
+			, block(_block > 0 ? _block : 65536)
+		{
+		}
+
+		vint StreamSpanReader::Acquire(const void*& _buffer, vint _size)
+		{
+			CHECK_ERROR(_size >= 0, L"StreamSpanReader::Acquire(const void*&, vint)#Argument size cannot be negative.");
+			PrepareMode();
+			if (mode == Mode::Borrow)
+			{
+				return stream->AcquireRead(_buffer, _size);
+			}
+
+			if (_size > block)
+			{
+				_size = block;
+			}
+
+			vint buffered = bufferEnd - bufferStart;
+			if (buffered < _size)
+			{
+				// peeking is given back by seeking, but reading takes content away from the stream, so only read what is requested
+				vint capacity = mode == Mode::Peek ? block : _size;
+				if (buffer.Count() < capacity)
+				{
+					buffer.Resize(capacity);
+				}
+
+				// move content that has not been consumed to the beginning and fill the rest
+				char* data = &buffer[0];
+				if (bufferStart > 0)
+				{
+					memmove(data, data + bufferStart, buffered);
+					bufferStart = 0;
+					bufferEnd = buffered;
+				}
+
+				if (mode == Mode::Peek)
+				{
+					bufferEnd = stream->Peek(data, capacity);
+				}
+				else
+				{
+					vint read = stream->Read(data + bufferEnd, _size - buffered);
+					if (read > 0)
+					{
+						bufferEnd += read;
+					}
+				}
+				buffered = bufferEnd - bufferStart;
+			}
+
+			if (_size > buffered)
+			{
+				_size = buffered;
+			}
+			_buffer = buffer.Count() > 0 ? &buffer[0] + bufferStart : nullptr;
+			return _size;
+		}
+
+		bool StreamSpanReader::CanReadAhead()
+		{
+			PrepareMode();
+			return mode != Mode::Read;
+		}
+
+		void StreamSpanReader::Commit(vint _size)
+		{
+			if (mode == Mode::Borrow)
+			{
+				stream->CommitRead(_size);
+				return;
+			}
+
+			CHECK_ERROR(0 <= _size && _size <= bufferEnd - bufferStart, L"StreamSpanReader::Commit(vint)#Argument size out of range.");
+			bufferStart += _size;
+			if (mode == Mode::Peek)
+			{
+				stream->Seek(_size);
+			}
+		}
+
 /***********************************************************************
 TextReader_<T>
 ***********************************************************************/
@@ -59,78 +267,34 @@ TextReader_<T>
 		template<typename T>
 		ObjectString<T> TextReader_<T>::ReadLine()
 		{
-			ObjectString<T> result;
-			auto buffer = new T[65537];
-			buffer[0] = 0;
-			vint i = 0;
+			TextBuilder_<T> builder;
 			while (true)
 			{
 				T c = ReadChar();
 				if (c == L'\n' || c == 0)
 				{
-					buffer[i] = 0;
-					result += buffer;
-					buffer[0] = 0;
-					i = 0;
 					break;
 				}
-				else
-				{
-					if (i == 65536)
-					{
-						buffer[i] = 0;
-						result += buffer;
-						buffer[0] = 0;
-						i = 0;
-					}
-					buffer[i++] = c;
-				}
-			}
-			result += buffer;
-			delete[] buffer;
-			if (result.Length() > 0 && result[result.Length() - 1] == L'\r')
-			{
-				return result.Left(result.Length() - 1);
-			}
-			else
-			{
-				return result;
+				builder.Append(&c, 1);
 			}
+			builder.RemoveLastCR();
+			return builder.Build();
 		}
 
 		template<typename T>
 		ObjectString<T> TextReader_<T>::ReadToEnd()
 		{
-			ObjectString<T> result;
-			auto buffer = new T[65537];
-			buffer[0] = 0;
-			vint i = 0;
+			TextBuilder_<T> builder;
 			while (true)
 			{
 				T c = ReadChar();
 				if (c == 0)
 				{
-					buffer[i] = 0;
-					result += buffer;
-					buffer[0] = 0;
-					i = 0;
 					break;
 				}
-				else
-				{
-					if (i == 65536)
-					{
-						buffer[i] = 0;
-						result += buffer;
-						buffer[0] = 0;
-						i = 0;
-					}
-					buffer[i++] = c;
-				}
+				builder.Append(&c, 1);
 			}
-			result += buffer;
-			delete[] buffer;
-			return result;
+			return builder.Build();
 		}
 
 /***********************************************************************
@@ -140,9 +304,9 @@ TextWriter_<T>
 		template<typename T>
 		void TextWriter_<T>::WriteString(const T* string, vint charCount)
 		{
-			while (*string)
+			for (vint i = 0; i < charCount; i++)
 			{
-				WriteChar(*string++);
+				WriteChar(string[i]);
 			}
 		}
 
@@ -210,6 +374,53 @@ TextWriter_<T>
 			WriteString(VCRLF<T>, 2);
 		}
 
+		template<typename T>
+		void TextWriter_<T>::WriteInteger(vint64_t number)
+		{
+			if (number < 0)
+			{
+				WriteChar((T)L'-');
+				WriteUnsignedInteger(0 - (vuint64_t)number);
+			}
+			else
+			{
+				WriteUnsignedInteger((vuint64_t)number);
+			}
+		}
+
+		template<typename T>
+		void TextWriter_<T>::WriteUnsignedInteger(vuint64_t number)
+		{
+			T buffer[20];
+			T* reading = buffer + 20;
+			do
+			{
+				*--reading = (T)(L'0' + number % 10);
+				number /= 10;
+			} while (number > 0);
+			WriteString(reading, buffer + 20 - reading);
+		}
+
+		template<typename T>
+		void TextWriter_<T>::WriteDouble(double number)
+		{
+			// format the same as ftoa
+			char buffer[320];
+			_gcvt_s(buffer, 320, number, 30);
+			vint len = (vint)strlen(buffer);
+			if (buffer[len - 1] == '.')
+			{
+				len--;
+			}
+
+			T chars[320];
+			for (vint i = 0; i < len; i++)
+			{
+				chars[i] = (T)buffer[i];
+			}
+			WriteString(chars, len);
+		}
+
 /***********************************************************************
 StringReader_<T>
 ***********************************************************************/
@@ -306,11 +517,107 @@ StreamReader_<T>
 ***********************************************************************/
 
 		template<typename T>
-		StreamReader_<T>::StreamReader_(IStream& _stream)
+		bool StreamReader_<T>::FillBuffer(vint expected)
+		{
+			if (!stream)
+			{
+				return false;
+			}
+
+			// all available characters are consumed when this function is called
+			if (borrowed)
+			{
+				spanReader.Commit(charCount * sizeof(T));
+			}
+			borrowed = false;
+			chars = nullptr;
+			charCount = 0;
+			current = 0;
+			copiedBytes = 0;
+
+			// when content is read away from the stream, do not read more than the caller needs
+			vint capacity = block;
+			if (expected < block / (vint)sizeof(T) && !spanReader.CanReadAhead())
+			{
+				capacity = expected * sizeof(T);
+			}
+
+			const void* data = nullptr;
+			vint size = spanReader.Acquire(data, capacity);
+			if (size >= (vint)sizeof(T) && (vuint)data % alignof(T) == 0)
+			{
+				borrowed = true;
+				chars = (const T*)data;
+				charCount = size / sizeof(T);
+				return true;
+			}
+
+			// copy characters when borrowed content is not aligned, or when a character is split between blocks
+			if (size == 0)
+			{
+				stream = nullptr;
+				return false;
+			}
+
+			vint copyingChars = ((size < capacity ? size : capacity) + sizeof(T) - 1) / sizeof(T);
+			if (copied.Count() < copyingChars)
+			{
+				copied.Resize(copyingChars);
+			}
+
+			char* target = (char*)&copied[0];
+			vint bytes = 0;
+			while (size > 0)
+			{
+				vint copying = size < capacity - bytes ? size : capacity - bytes;
+				memcpy(target + bytes, data, copying);
+				spanReader.Commit(copying);
+				bytes += copying;
+
+				vint remain = bytes % sizeof(T);
+				if (bytes >= (vint)sizeof(T) && remain == 0)
+				{
+					break;
+				}
+				size = spanReader.Acquire(data, sizeof(T) - remain);
+			}
+
+			// a character broken by the end of the stream is filled with 0
+			vint padding = (sizeof(T) - bytes % sizeof(T)) % sizeof(T);
+			memset(target + bytes, 0, padding);
+			chars = &copied[0];
+			charCount = (bytes + padding) / sizeof(T);
+			copiedBytes = bytes;
+			return true;
+		}
+
+		template<typename T>
+		StreamReader_<T>::StreamReader_(IStream& _stream, vint _block)
 			: stream(&_stream)
+			, spanReader(_stream, _block)
+			, block((_block > (vint)sizeof(T) ? _block : 65536) / sizeof(T) * sizeof(T))
 		{
 		}
 
+		template<typename T>
+		StreamReader_<T>::~StreamReader_()
+		{
+			// give back characters that are borrowed but not consumed
+			if (borrowed)
+			{
+				spanReader.Commit(current * sizeof(T));
+			}
+			else if (stream && stream->CanPeek() && stream->CanSeek())
+			{
+				// copied characters have been committed, seek back to characters that are not consumed
+				vint unconsumed = copiedBytes - current * (vint)sizeof(T);
+				if (unconsumed > 0)
+				{
+					stream->Seek(-unconsumed);
+				}
+			}
+		}
+
 		template<typename T>
 		bool StreamReader_<T>::IsEnd()
 		{
@@ -320,23 +627,73 @@ StreamReader_<T>
 		template<typename T>
 		T StreamReader_<T>::ReadChar()
 		{
-			if (stream)
+			if (current < charCount || FillBuffer(1))
+			{
+				return chars[current++];
+			}
+			return 0;
+		}
+
+		template<typename T>
+		ObjectString<T> StreamReader_<T>::ReadString(vint length)
+		{
+			TextBuilder_<T> builder;
+			while (length > 0 && (current < charCount || FillBuffer(length)))
 			{
-				T buffer = 0;
-				if (stream->Read(&buffer, sizeof(buffer)) == 0)
+				const T* begin = chars + current;
+				const T* end = begin + (charCount - current < length ? charCount - current : length);
+				const T* stop = FindTextChar(begin, end, (T)0);
+				builder.Append(begin, stop - begin);
+				if (stop != end)
 				{
-					stream = nullptr;
-					return 0;
+					current = stop - chars + 1;
+					break;
 				}
-				else
+				current = end - chars;
+				length -= end - begin;
+			}
+			return builder.Build();
+		}
+
+		template<typename T>
+		ObjectString<T> StreamReader_<T>::ReadLine()
+		{
+			TextBuilder_<T> builder;
+			while (current < charCount || FillBuffer(block / sizeof(T)))
+			{
+				const T* begin = chars + current;
+				const T* end = chars + charCount;
+				const T* stop = FindTextChar(begin, FindTextChar(begin, end, (T)L'\n'), (T)0);
+				builder.Append(begin, stop - begin);
+				if (stop != end)
 				{
-					return buffer;
+					current = stop - chars + 1;
+					break;
 				}
+				current = charCount;
 			}
-			else
+			builder.RemoveLastCR();
+			return builder.Build();
+		}
+
+		template<typename T>
+		ObjectString<T> StreamReader_<T>::ReadToEnd()
+		{
+			TextBuilder_<T> builder;
+			while (current < charCount || FillBuffer(block / sizeof(T)))
 			{
-				return 0;
+				const T* begin = chars + current;
+				const T* end = chars + charCount;
+				const T* stop = FindTextChar(begin, end, (T)0);
+				builder.Append(begin, stop - begin);
+				if (stop != end)
+				{
+					current = stop - chars + 1;
+					break;
+				}
+				current = charCount;
 			}
+			return builder.Build();
 		}
 
 /***********************************************************************
@@ -344,21 +701,88 @@ StreamWriter_<T>
 ***********************************************************************/
 
 		template<typename T>
-		StreamWriter_<T>::StreamWriter_(IStream& _stream)
-			:stream(&_stream)
+		void StreamWriter_<T>::PrepareBuffer(vint count)
 		{
+			// grow geometrically from a small buffer, so that a writer for a short text does not allocate a whole block
+			vint capacity = buffer.Count() * 2;
+			if (capacity < 256) capacity = 256;
+			if (capacity < count) capacity = count;
+			if (capacity > block) capacity = block;
+			buffer.Resize(capacity);
+		}
+
+		template<typename T>
+		StreamWriter_<T>::StreamWriter_(IStream& _stream, vint _block)
+			: stream(&_stream)
+			, block(_block > 0 ? _block / sizeof(T) : 0)
+		{
+		}
+
+		template<typename T>
+		StreamWriter_<T>::~StreamWriter_()
+		{
+			Flush();
+		}
+
+		template<typename T>
+		void StreamWriter_<T>::Flush()
+		{
+			if (used > 0)
+			{
+				stream->Write(&buffer[0], used * sizeof(T));
+				used = 0;
+			}
 		}
 
 		template<typename T>
 		void StreamWriter_<T>::WriteChar(T c)
 		{
-			stream->Write(&c, sizeof(c));
+			if (block == 0)
+			{
+				stream->Write(&c, sizeof(c));
+				return;
+			}
+
+			if (used == buffer.Count())
+			{
+				if (buffer.Count() < block)
+				{
+					PrepareBuffer(used + 1);
+				}
+				else
+				{
+					Flush();
+				}
+			}
+			(&buffer[0])[used++] = c;
 		}
 
 		template<typename T>
 		void StreamWriter_<T>::WriteString(const T* string, vint charCount)
 		{
-			stream->Write((void*)string, charCount * sizeof(*string));
+			if (used + charCount > buffer.Count())
+			{
+				if (used + charCount > block)
+				{
+					Flush();
+					if (charCount >= block)
+					{
+						// a string larger than the buffer is written directly
+						stream->Write((void*)string, charCount * sizeof(*string));
+						return;
+					}
+				}
+				if (used + charCount > buffer.Count())
+				{
+					PrepareBuffer(used + charCount);
+				}
+			}
+
+			if (charCount > 0)
+			{
+				memcpy(&buffer[used], string, charCount * sizeof(T));
+				used += charCount;
+			}
 		}
 
 /***********************************************************************
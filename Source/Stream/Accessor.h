@@ -14,6 +14,62 @@ namespace vl
 	namespace stream
 	{
 
+/***********************************************************************
+Buffer Related
+***********************************************************************/
+
+		/// <summary>
+		/// Borrow content from any <b>readable</b> stream, to parse content in place instead of copying it to another buffer for each call.
+		/// It uses [M:vl.stream.IStream.AcquireRead] and [M:vl.stream.IStream.CommitRead] if the stream supports borrowing.
+		/// Otherwise it peeks into an internal buffer if the stream is <b>peekable</b> and <b>seekable</b>,
+		/// or reads into an internal buffer and keeps content that has not been consumed.
+		/// </summary>
+		/// <remarks>
+		/// The internal buffer is allocated on the first <see cref="Acquire"/> if the stream does not support borrowing.
+		/// When the stream is read to an internal buffer, no more than the requested size is read from the stream for each <see cref="Acquire"/>,
+		/// but content that has not been consumed is lost after the reader is destroyed.
+		/// Do not call other methods of the stream when the reader is alive.
+		/// </remarks>
+		class StreamSpanReader : public Object
+		{
+		protected:
+			enum class Mode
+			{
+				Unknown,
+				Borrow,
+				Peek,
+				Read,
+			};
+
+			IStream*					stream;
+			vint						block;				// maximum size of buffer in bytes
+			Mode						mode = Mode::Unknown;
+			collections::Array<char>	buffer;
+			vint						bufferStart = 0;
+			vint						bufferEnd = 0;
+
+			void						PrepareMode();
+		public:
+			NOT_COPYABLE(StreamSpanReader);
+			/// <summary>Create a reader.</summary>
+			/// <param name="_stream">The stream to read.</param>
+			/// <param name="_block">Size of the internal buffer, it is the maximum size of content for each <see cref="Acquire"/> if the stream does not support borrowing.</param>
+			StreamSpanReader(IStream& _stream, vint _block = 65536);
+			~StreamSpanReader() = default;
+
+			/// <summary>Borrow content from the current position without stepping forward.</summary>
+			/// <returns>Returns the size of the borrowed content, which could be smaller than "_size" even if the stream has more data. Returns 0 if a stream has no more data to read.</returns>
+			/// <param name="_buffer">Receives the pointer to the borrowed content, which is valid until the next call to <see cref="Acquire"/> or <see cref="Commit"/>.</param>
+			/// <param name="_size">The maximum size of the content to borrow.</param>
+			vint						Acquire(const void*& _buffer, vint _size);
+			/// <summary>Test if content acquired but not consumed stays in the stream after the reader is destroyed.</summary>
+			/// <returns>Returns true if the stream supports borrowing, or it is <b>peekable</b> and <b>seekable</b>.</returns>
+			bool						CanReadAhead();
+			/// <summary>Step forward after borrowing content.</summary>
+			/// <param name="_size">The size of the consumed content, which must not be larger than the size returned from the last <see cref="Acquire"/>.</param>
+			void						Commit(vint _size);
+		};
+
 /***********************************************************************
 Text Related
 ***********************************************************************/
@@ -77,6 +133,16 @@ Text Related
 			/// <summary>Write a string with a CRLF.</summary>
 			/// <param name="string">The string to write.</param>
 			virtual void				WriteLine(const ObjectString<T>& string);
+
+			/// <summary>Write a signed integer in decimal, the same as <see cref="i64tow"/> but without creating a string.</summary>
+			/// <param name="number">The integer to write.</param>
+			void						WriteInteger(vint64_t number);
+			/// <summary>Write an unsigned integer in decimal, the same as <see cref="u64tow"/> but without creating a string.</summary>
+			/// <param name="number">The integer to write.</param>
+			void						WriteUnsignedInteger(vuint64_t number);
+			/// <summary>Write a floating point number, the same as <see cref="ftow"/> but without creating a string.</summary>
+			/// <param name="number">The number to write.</param>
+			void						WriteDouble(double number);
 		};
 
 		/// <summary>Text reader from a string.</summary>
@@ -107,9 +173,20 @@ Text Related
 		/// </summary>
 		/// <typeparam name="T">The character type.</typeparam>
 		/// <remarks>
+		/// <p>
 		/// To specify the encoding in the input stream,
 		/// you are recommended to create a <see cref="DecoderStream"/> with a <see cref="UtfGeneralDecoder"/> implementation,
 		/// like <see cref="BomDecoder"/>, <see cref="MbcsDecoder"/>, <see cref="Utf16Decoder"/>, <see cref="Utf16BEDecoder"/> or <see cref="Utf8Decoder"/>.
+		/// </p>
+		/// <p>
+		/// Characters are read in blocks through a <see cref="StreamSpanReader"/>,
+		/// they are borrowed from the stream without copying if the stream supports [M:vl.stream.IStream.AcquireRead] and the content is aligned.
+		/// Content read from the stream but not consumed is given back to the stream after the reader is destroyed.
+		/// If the stream supports neither borrowing nor <b>peeking</b> and <b>seeking</b>,
+		/// <see cref="ReadChar"/> and <see cref="ReadString"/> read no more than the requested characters,
+		/// but <see cref="ReadLine"/> and <see cref="ReadToEnd"/> read in blocks and content after the last returned character is lost.
+		/// Do not call other methods of the stream when the reader is alive.
+		/// </p>
 		/// </remarks>
 		/// <example output="false"><![CDATA[
 		/// int main()
@@ -126,13 +203,28 @@ Text Related
 		{
 		protected:
 			IStream*					stream;
+			StreamSpanReader			spanReader;
+			vint						block;				// maximum size of each FillBuffer in bytes
+			collections::Array<T>		copied;				// characters that are not aligned or across borrowed blocks, allocated on the first copy
+			const T*					chars = nullptr;	// available characters, borrowed from spanReader or pointing to copied
+			vint						charCount = 0;
+			vint						current = 0;
+			bool						borrowed = false;
+			vint						copiedBytes = 0;	// bytes committed to spanReader for characters in copied
+
+			bool						FillBuffer(vint expected);
 		public:
 			/// <summary>Create a text reader.</summary>
 			/// <param name="_stream">The stream to read.</param>
-			StreamReader_(IStream& _stream);
+			/// <param name="_block">Maximum size of content read from the stream at a time in bytes.</param>
+			StreamReader_(IStream& _stream, vint _block = 65536);
+			~StreamReader_();
 
 			bool						IsEnd();
 			T							ReadChar();
+			ObjectString<T>				ReadString(vint length);
+			ObjectString<T>				ReadLine();
+			ObjectString<T>				ReadToEnd();
 		};
 
 		/// <summary>
@@ -140,9 +232,18 @@ Text Related
 		/// </summary>
 		/// <typeparam name="T">The character type.</typeparam>
 		/// <remarks>
+		/// <p>
 		/// To specify the encoding in the input stream,
 		/// you are recommended to create a <see cref="EncoderStream"/> with a <see cref="UtfGeneralEncoder"/> implementation,
 		/// like <see cref="BomEncoder"/>, <see cref="MbcsEncoder"/>, <see cref="Utf16Encoder"/>, <see cref="Utf16BEEncoder"/> or <see cref="Utf8Encoder"/>.
+		/// </p>
+		/// <p>
+		/// By default characters are written to the stream immediately.
+		/// When a buffer size is specified, characters are collected in an internal buffer and written to the stream in blocks,
+		/// when the buffer is full, when <see cref="Flush"/> is called, or when the writer is destroyed.
+		/// The buffer is allocated on the first write, and grows until it reaches the specified size.
+		/// Do not read the stream before a buffered writer is flushed.
+		/// </p>
 		/// </remarks>
 		/// <example output="false"><![CDATA[
 		/// int main()
@@ -158,13 +259,22 @@ Text Related
 		class StreamWriter_ : public TextWriter_<T>
 		{
 		protected:
-			IStream* stream;
+			IStream*					stream;
+			vint						block;				// maximum size of buffer in characters
+			collections::Array<T>		buffer;
+			vint						used = 0;
+
+			void						PrepareBuffer(vint count);
 		public:
 			/// <summary>Create a text writer.</summary>
 			/// <param name="_stream">The stream to write.</param>
-			StreamWriter_(IStream& _stream);
+			/// <param name="_block">Maximum size of the internal buffer in bytes. Characters are written to the stream directly when it is 0.</param>
+			StreamWriter_(IStream& _stream, vint _block = 0);
+			~StreamWriter_();
 			using TextWriter_<T>::WriteString;
 
+			/// <summary>Write all characters in the internal buffer to the stream.</summary>
+			void						Flush();
 			void						WriteChar(T c);
 			void						WriteString(const T* string, vint charCount);
 		};
@@ -236,7 +346,7 @@ Helper Functions
 		{
 			MemoryStream stream(block);
 			{
-				StreamWriter writer(stream);
+				StreamWriter writer(stream, block);
 				callback(writer);
 			}
 			stream.SeekFromBegin(0);
@@ -0,0 +1,639 @@
+/***********************************************************************
+Author: Zihan Chen (vczh)
+Licensed under https://github.com/vczh-libraries/License
+***********************************************************************/
+
+#include "AsyncFile.h"
+#if defined VCZH_GCC && !defined VCZH_APPLE
+
+#include <liburing.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace vl
+{
+	namespace stream
+	{
+		namespace uring_file
+		{
+
+/***********************************************************************
+FileHandle
+***********************************************************************/
+
+			class FileHandle : public Object
+			{
+			public:
+				int							fd = -1;
+
+				~FileHandle()
+				{
+					if (fd != -1)
+					{
+						close(fd);
+					}
+				}
+			};
+
+/***********************************************************************
+FileOperation
+***********************************************************************/
+
+			// operations are only completed in the completion thread
+			class FileOperation
+			{
+			public:
+				Ptr<FileHandle>				handle;
+
+				virtual ~FileOperation() = default;
+
+				// prepare the operation, called again when the operation needs to be resubmitted
+				virtual void				Prepare(io_uring_sqe* sqe) = 0;
+				// returns true if the operation needs to be resubmitted
+				virtual bool				Complete(vint result) = 0;
+				// called instead of Prepare when the operation cannot be submitted
+				virtual void				Reject() = 0;
+			};
+
+			// io_uring limits the size of one read or write to an unsigned 32 bits integer, and Linux transfers at most 0x7FFFF000 bytes each time
+			const vint						MaxTransferSize = 0x7FFFF000;
+			const pos_t						MaxReadAheadSize = 0x40000000;
+
+			static std::exception_ptr MakeFileException(const wchar_t* message, vint errorCode)
+			{
+				return std::make_exception_ptr(AsyncFileException(message, errorCode));
+			}
+
+			class ReadOperation : public FileOperation
+			{
+			public:
+				Promise<vint>				promise;
+				pos_t						offset = 0;
+				void*						buffer = nullptr;
+				vint						size = 0;
+
+				void Prepare(io_uring_sqe* sqe) override
+				{
+					io_uring_prep_read(sqe, handle->fd, buffer, (unsigned)(size < MaxTransferSize ? size : MaxTransferSize), (__u64)offset);
+				}
+
+				bool Complete(vint result) override
+				{
+					if (result == -EINTR || result == -EAGAIN)
+					{
+						return true;
+					}
+					if (result < 0)
+					{
+						promise.SetException(MakeFileException(L"AsyncFile::ReadAsync(pos_t, void*, vint)#Failed to read the file.", -result));
+					}
+					else
+					{
+						promise.SetResult(result);
+					}
+					return false;
+				}
+
+				void Reject() override
+				{
+					promise.SetException(MakeFileException(L"AsyncFile::ReadAsync(pos_t, void*, vint)#The file is closed.", 0));
+				}
+			};
+
+			class WriteOperation : public FileOperation
+			{
+			public:
+				Promise<vint>				promise;
+				pos_t						offset = 0;
+				const char*					buffer = nullptr;
+				vint						size = 0;
+				vint						written = 0;
+
+				void Prepare(io_uring_sqe* sqe) override
+				{
+					vint remaining = size - written;
+					io_uring_prep_write(sqe, handle->fd, buffer + written, (unsigned)(remaining < MaxTransferSize ? remaining : MaxTransferSize), (__u64)(offset + written));
+				}
+
+				bool Complete(vint result) override
+				{
+					if (result == -EINTR || result == -EAGAIN)
+					{
+						return true;
+					}
+					if (result < 0)
+					{
+						promise.SetException(MakeFileException(L"AsyncFile::WriteAsync(pos_t, const void*, vint)#Failed to write the file.", -result));
+						return false;
+					}
+					if (result == 0 && written < size)
+					{
+						promise.SetException(MakeFileException(L"AsyncFile::WriteAsync(pos_t, const void*, vint)#Failed to write the whole buffer.", 0));
+						return false;
+					}
+
+					// a short write continues from where it stops
+					written += result;
+					if (written < size)
+					{
+						return true;
+					}
+					promise.SetResult(written);
+					return false;
+				}
+
+				void Reject() override
+				{
+					promise.SetException(MakeFileException(L"AsyncFile::WriteAsync(pos_t, const void*, vint)#The file is closed.", 0));
+				}
+			};
+
+			class ReadAheadBatch : public Object
+			{
+			public:
+				Promise<void>				promise;
+				std::atomic<vint>			remaining = 0;
+				std::atomic<vint>			errorCode = 0;
+			};
+
+			class ReadAheadOperation : public FileOperation
+			{
+			public:
+				Ptr<ReadAheadBatch>			batch;
+				pos_t						offset = 0;
+				pos_t						size = 0;
+
+				void Prepare(io_uring_sqe* sqe) override
+				{
+					io_uring_prep_fadvise(sqe, handle->fd, (__u64)offset, (unsigned)size, POSIX_FADV_WILLNEED);
+				}
+
+				bool Complete(vint result) override
+				{
+					if (result == -EINTR || result == -EAGAIN)
+					{
+						return true;
+					}
+					if (result < 0)
+					{
+						vint expected = 0;
+						batch->errorCode.compare_exchange_strong(expected, -result);
+					}
+					Finish();
+					return false;
+				}
+
+				void Reject() override
+				{
+					Finish();
+				}
+
+				void Finish()
+				{
+					// rejected operations are finished by the submitting thread, racing with completed ones
+					if (batch->remaining.fetch_sub(1) == 1)
+					{
+						vint errorCode = batch->errorCode;
+						if (errorCode == 0)
+						{
+							batch->promise.SetResult();
+						}
+						else
+						{
+							batch->promise.SetException(MakeFileException(L"AsyncFile::ReadAheadAsync(const AsyncFileRange*, vint)#Failed to hint the file.", errorCode));
+						}
+					}
+				}
+			};
+
+/***********************************************************************
+FileRing
+***********************************************************************/
+
+			class FileRing : public Object
+			{
+			public:
+				io_uring					ring = {};
+				CriticalSection				lock;						// covers ring submission, pendingCount and stopping
+				vint						pendingCount = 0;
+				bool						stopping = false;
+				Thread*						thread = nullptr;
+
+				// the caller holds the lock, operations are only submitted when Flush is called
+				bool QueueLocked(FileOperation* operation)
+				{
+					if (stopping)
+					{
+						return false;
+					}
+
+					auto sqe = io_uring_get_sqe(&ring);
+					if (!sqe)
+					{
+						// the submission queue is full, hand prepared operations to the kernel to make space
+						FlushLocked();
+						sqe = io_uring_get_sqe(&ring);
+						if (!sqe)
+						{
+							return false;
+						}
+					}
+
+					operation->Prepare(sqe);
+					io_uring_sqe_set_data(sqe, operation);
+					pendingCount++;
+					return true;
+				}
+
+				void FlushLocked()
+				{
+					while (io_uring_sq_ready(&ring) > 0)
+					{
+						int result = io_uring_submit(&ring);
+						if (result == -EINTR)
+						{
+							continue;
+						}
+						if (result == -EBUSY || result == -EAGAIN)
+						{
+							// the completion queue is full, the completion thread flushes again after consuming completions
+							return;
+						}
+						CHECK_ERROR(result >= 0, L"vl::stream::AsyncFile#Failed to submit operations to io_uring.");
+					}
+				}
+
+				void Submit(FileOperation* operation)
+				{
+					bool queued = false;
+					CS_LOCK(lock)
+					{
+						queued = QueueLocked(operation);
+						FlushLocked();
+					}
+					if (!queued)
+					{
+						operation->Reject();
+						delete operation;
+					}
+				}
+
+				void SubmitBatch(collections::List<FileOperation*>& operations)
+				{
+					vint queued = 0;
+					CS_LOCK(lock)
+					{
+						while (queued < operations.Count() && QueueLocked(operations[queued]))
+						{
+							queued++;
+						}
+						FlushLocked();
+					}
+					for (vint i = queued; i < operations.Count(); i++)
+					{
+						operations[i]->Reject();
+						delete operations[i];
+					}
+				}
+
+				void CompletionProc()
+				{
+					while (true)
+					{
+						io_uring_cqe* cqe = nullptr;
+						int waitResult = io_uring_wait_cqe(&ring, &cqe);
+						if (waitResult == -EINTR)
+						{
+							continue;
+						}
+						CHECK_ERROR(waitResult == 0 && cqe, L"vl::stream::AsyncFile#Failed to wait for io_uring completions.");
+
+						auto operation = (FileOperation*)io_uring_cqe_get_data(cqe);
+						vint result = (vint)cqe->res;
+						io_uring_cqe_seen(&ring, cqe);
+
+						bool resubmit = operation && operation->Complete(result);
+						bool stopped = false;
+						CS_LOCK(lock)
+						{
+							if (operation)
+							{
+								pendingCount--;
+							}
+							if (resubmit)
+							{
+								// resubmitting is still allowed when stopping, the operation has been accepted
+								auto sqe = io_uring_get_sqe(&ring);
+								if (!sqe)
+								{
+									FlushLocked();
+									sqe = io_uring_get_sqe(&ring);
+								}
+								if (sqe)
+								{
+									operation->Prepare(sqe);
+									io_uring_sqe_set_data(sqe, operation);
+									pendingCount++;
+									operation = nullptr;
+								}
+							}
+							FlushLocked();
+							stopped = stopping && pendingCount == 0;
+						}
+
+						if (operation)
+						{
+							if (resubmit)
+							{
+								operation->Reject();
+							}
+							delete operation;
+						}
+						if (stopped)
+						{
+							break;
+						}
+					}
+				}
+
+				static void CompletionThreadProc(Thread*, void* argument)
+				{
+					((FileRing*)argument)->CompletionProc();
+				}
+
+				void Stop()
+				{
+					CS_LOCK(lock)
+					{
+						stopping = true;
+
+						// wake up the completion thread with an empty operation
+						auto sqe = io_uring_get_sqe(&ring);
+						if (!sqe)
+						{
+							FlushLocked();
+							sqe = io_uring_get_sqe(&ring);
+						}
+						CHECK_ERROR(sqe, L"vl::stream::AsyncFile#Failed to stop io_uring.");
+						io_uring_prep_nop(sqe);
+						io_uring_sqe_set_data(sqe, nullptr);
+						FlushLocked();
+					}
+					thread->Wait();
+					delete thread;
+					thread = nullptr;
+					io_uring_queue_exit(&ring);
+				}
+			};
+
+			SpinLock						fileRingLock;
+			FileRing*						fileRing = nullptr;			// covered by fileRingLock
+			bool							fileRingUnavailable = false;	// covered by fileRingLock
+
+			BEGIN_GLOBAL_STORAGE_CLASS(FileRingStorage)
+			INITIALIZE_GLOBAL_STORAGE_CLASS
+			FINALIZE_GLOBAL_STORAGE_CLASS
+				FileRing* ring = nullptr;
+				SPIN_LOCK(fileRingLock)
+				{
+					ring = fileRing;
+					fileRing = nullptr;
+					fileRingUnavailable = true;
+				}
+
+				if (ring)
+				{
+					// the ring object is not deleted, operations from files opened before are rejected after it stops
+					ring->Stop();
+				}
+			END_GLOBAL_STORAGE_CLASS(FileRingStorage)
+
+			FileRing* CreateFileRing()
+			{
+				auto ring = new FileRing;
+				if (io_uring_queue_init(256, &ring->ring, 0) != 0)
+				{
+					delete ring;
+					return nullptr;
+				}
+
+				auto probe = io_uring_get_probe_ring(&ring->ring);
+				bool supported =
+					probe &&
+					io_uring_opcode_supported(probe, IORING_OP_NOP) &&
+					io_uring_opcode_supported(probe, IORING_OP_READ) &&
+					io_uring_opcode_supported(probe, IORING_OP_WRITE) &&
+					io_uring_opcode_supported(probe, IORING_OP_FADVISE);
+				if (probe)
+				{
+					io_uring_free_probe(probe);
+				}
+
+				if (supported)
+				{
+					ThreadStartOptions options;
+					options.name = L"VlAsyncFile";
+					ring->thread = Thread::CreateAndStart(&FileRing::CompletionThreadProc, ring, false, options);
+				}
+				if (!ring->thread)
+				{
+					io_uring_queue_exit(&ring->ring);
+					delete ring;
+					return nullptr;
+				}
+				return ring;
+			}
+
+			FileRing* GetFileRing()
+			{
+				FileRing* ring = nullptr;
+				SPIN_LOCK(fileRingLock)
+				{
+					if (!fileRing && !fileRingUnavailable)
+					{
+						GetFileRingStorage();
+						fileRing = CreateFileRing();
+						fileRingUnavailable = fileRing == nullptr;
+					}
+					ring = fileRing;
+				}
+				return ring;
+			}
+
+/***********************************************************************
+UringAsyncFileImpl
+***********************************************************************/
+
+			class UringAsyncFileImpl : public Object, public virtual IAsyncFileImpl
+			{
+			private:
+				FileRing*					ring;
+				WString						fileName;
+				FileStream::AccessRight		accessRight;
+				Ptr<FileHandle>				handle;
+
+				template<typename TOperation>
+				TOperation* CreateOperation()
+				{
+					auto operation = new TOperation;
+					operation->handle = handle;
+					return operation;
+				}
+
+				template<typename TOperation>
+				static auto Reject(TOperation* operation)
+				{
+					auto task = operation->promise.GetTask();
+					operation->Reject();
+					delete operation;
+					return task;
+				}
+
+			public:
+				UringAsyncFileImpl(FileRing* _ring, const WString& _fileName, FileStream::AccessRight _accessRight)
+					: ring(_ring)
+					, fileName(_fileName)
+					, accessRight(_accessRight)
+				{
+				}
+
+				~UringAsyncFileImpl()
+				{
+					Close();
+				}
+
+				bool Open() override
+				{
+					int flags = O_RDONLY;
+					switch (accessRight)
+					{
+					case FileStream::WriteOnly:
+						flags = O_WRONLY | O_CREAT | O_TRUNC;
+						break;
+					case FileStream::ReadWrite:
+						flags = O_RDWR | O_CREAT | O_TRUNC;
+						break;
+					default:;
+					}
+
+					AString fileNameA = wtoa(fileName);
+					int fd = open(fileNameA.Buffer(), flags | O_CLOEXEC, 0666);
+					if (fd == -1)
+					{
+						return false;
+					}
+					handle = Ptr(new FileHandle);
+					handle->fd = fd;
+					return true;
+				}
+
+				void Close() override
+				{
+					// submitted operations keep the file descriptor alive until they complete
+					handle = nullptr;
+				}
+
+				pos_t Size() override
+				{
+					struct stat info;
+					if (!handle || fstat(handle->fd, &info) != 0)
+					{
+						return -1;
+					}
+					return (pos_t)info.st_size;
+				}
+
+				Task<vint> ReadAsync(pos_t offset, void* buffer, vint size) override
+				{
+					auto operation = CreateOperation<ReadOperation>();
+					operation->offset = offset;
+					operation->buffer = buffer;
+					operation->size = size;
+					if (!handle) return Reject(operation);
+
+					auto task = operation->promise.GetTask();
+					ring->Submit(operation);
+					return task;
+				}
+
+				Task<vint> WriteAsync(pos_t offset, const void* buffer, vint size) override
+				{
+					auto operation = CreateOperation<WriteOperation>();
+					operation->offset = offset;
+					operation->buffer = (const char*)buffer;
+					operation->size = size;
+					if (!handle) return Reject(operation);
+					if (size == 0)
+					{
+						auto task = operation->promise.GetTask();
+						operation->promise.SetResult((vint)0);
+						delete operation;
+						return task;
+					}
+
+					auto task = operation->promise.GetTask();
+					ring->Submit(operation);
+					return task;
+				}
+
+				Task<void> ReadAheadAsync(const AsyncFileRange* ranges, vint count) override
+				{
+					auto batch = Ptr(new ReadAheadBatch);
+					auto task = batch->promise.GetTask();
+					if (!handle || count == 0)
+					{
+						if (handle)
+						{
+							batch->promise.SetResult();
+						}
+						else
+						{
+							batch->promise.SetException(MakeFileException(L"AsyncFile::ReadAheadAsync(const AsyncFileRange*, vint)#The file is closed.", 0));
+						}
+						return task;
+					}
+
+					// large ranges are split, because some versions of liburing take the size as an unsigned 32 bits integer
+					collections::List<FileOperation*> operations;
+					for (vint i = 0; i < count; i++)
+					{
+						pos_t offset = ranges[i].offset;
+						pos_t remaining = ranges[i].size;
+						do
+						{
+							pos_t size = remaining < MaxReadAheadSize ? remaining : MaxReadAheadSize;
+							auto operation = CreateOperation<ReadAheadOperation>();
+							operation->batch = batch;
+							operation->offset = offset;
+							operation->size = size;
+							operations.Add(operation);
+							offset += size;
+							remaining -= size;
+						} while (remaining > 0);
+					}
+					batch->remaining = operations.Count();
+					ring->SubmitBatch(operations);
+					return task;
+				}
+			};
+		}
+
+/***********************************************************************
+CreateUringAsyncFileImpl
+***********************************************************************/
+
+		Ptr<IAsyncFileImpl> CreateUringAsyncFileImpl(const WString& fileName, FileStream::AccessRight accessRight)
+		{
+			auto ring = uring_file::GetFileRing();
+			if (!ring)
+			{
+				return nullptr;
+			}
+			return Ptr(new uring_file::UringAsyncFileImpl(ring, fileName, accessRight));
+		}
+	}
+}
+
+#endif
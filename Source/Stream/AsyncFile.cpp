@@ -0,0 +1,295 @@
+/***********************************************************************
+Author: Zihan Chen (vczh)
+Licensed under https://github.com/vczh-libraries/License
+***********************************************************************/
+
+#include "AsyncFile.h"
+#include "../FileSystem.h"
+
+namespace vl
+{
+	namespace filesystem
+	{
+		extern IFileSystemImpl*			GetFileSystemImpl();
+	}
+
+	namespace stream
+	{
+
+/***********************************************************************
+AsyncFileException
+***********************************************************************/
+
+		AsyncFileException::AsyncFileException(const WString& _message, vint _errorCode)
+			: Exception(_message)
+			, errorCode(_errorCode)
+		{
+		}
+
+		vint AsyncFileException::GetErrorCode()const
+		{
+			return errorCode;
+		}
+
+/***********************************************************************
+ThreadPoolAsyncFileImpl
+***********************************************************************/
+
+		class ThreadPoolAsyncFileImpl : public Object, public virtual IAsyncFileImpl
+		{
+		private:
+			class FileData : public Object
+			{
+			public:
+				CriticalSection			lock;			// covers file, closed
+				Ptr<IFileStreamImpl>	file;
+				bool					closed = false;
+
+				// covers operations, draining
+				SpinLock				lockOperations;
+				collections::List<Func<void()>>	operations;
+				bool					draining = false;
+
+				void CheckOpened()
+				{
+					if (closed)
+					{
+						throw AsyncFileException(L"AsyncFile#The file is closed.", 0);
+					}
+				}
+			};
+
+			Ptr<FileData>				data;
+
+			static void Drain(Ptr<FileData> fileData)
+			{
+				while (true)
+				{
+					Func<void()> operation;
+					SPIN_LOCK(fileData->lockOperations)
+					{
+						if (fileData->operations.Count() == 0)
+						{
+							fileData->draining = false;
+							return;
+						}
+						operation = fileData->operations[0];
+						fileData->operations.RemoveAt(0);
+					}
+					operation();
+				}
+			}
+
+			static Task<vint> Enqueue(Ptr<FileData> fileData, Func<vint()> callback)
+			{
+				// operations of a file are executed one by one in the submission order
+				Promise<vint> promise;
+				Func<void()> operation = [=]()
+				{
+					try
+					{
+						promise.SetResult(callback());
+					}
+					catch (...)
+					{
+						promise.SetException(std::current_exception());
+					}
+				};
+
+				bool draining = true;
+				SPIN_LOCK(fileData->lockOperations)
+				{
+					fileData->operations.Add(operation);
+					std::swap(draining, fileData->draining);
+				}
+				if (!draining && !ThreadPoolLite::Queue([=]() { Drain(fileData); }))
+				{
+					Drain(fileData);
+				}
+				return promise.GetTask();
+			}
+
+		public:
+			ThreadPoolAsyncFileImpl(const WString& fileName, FileStream::AccessRight accessRight)
+				: data(Ptr(new FileData))
+			{
+				data->file = filesystem::GetFileSystemImpl()->GetFileStreamImpl(fileName, accessRight);
+			}
+
+			~ThreadPoolAsyncFileImpl()
+			{
+				Close();
+			}
+
+			bool Open() override
+			{
+				return data->file->Open();
+			}
+
+			void Close() override
+			{
+				CS_LOCK(data->lock)
+				{
+					if (!data->closed)
+					{
+						data->closed = true;
+						data->file->Close();
+					}
+				}
+			}
+
+			pos_t Size() override
+			{
+				CS_LOCK(data->lock)
+				{
+					return data->closed ? -1 : data->file->Size();
+				}
+				return -1;
+			}
+
+			Task<vint> ReadAsync(pos_t offset, void* buffer, vint size) override
+			{
+				auto fileData = data;
+				return Enqueue(fileData, [=]()
+				{
+					CS_LOCK(fileData->lock)
+					{
+						fileData->CheckOpened();
+						fileData->file->SeekFromBegin(offset);
+						if (fileData->file->Position() != offset)
+						{
+							return (vint)0;
+						}
+						return fileData->file->Read(buffer, size);
+					}
+					return (vint)0;
+				});
+			}
+
+			Task<vint> WriteAsync(pos_t offset, const void* buffer, vint size) override
+			{
+				auto fileData = data;
+				return Enqueue(fileData, [=]()
+				{
+					CS_LOCK(fileData->lock)
+					{
+						fileData->CheckOpened();
+						fileData->file->SeekFromBegin(offset);
+
+						// seeking stops at the end of the file, fill the gap to write at the expected offset
+						char zeros[1024] = { 0 };
+						while (fileData->file->Position() < offset)
+						{
+							pos_t gap = offset - fileData->file->Position();
+							vint written = fileData->file->Write(zeros, gap < (pos_t)sizeof(zeros) ? (vint)gap : (vint)sizeof(zeros));
+							if (written <= 0)
+							{
+								throw AsyncFileException(L"AsyncFile::WriteAsync(pos_t, const void*, vint)#Failed to extend the file.", 0);
+							}
+						}
+
+						vint written = fileData->file->Write(const_cast<void*>(buffer), size);
+						if (written != size)
+						{
+							throw AsyncFileException(L"AsyncFile::WriteAsync(pos_t, const void*, vint)#Failed to write the whole buffer.", 0);
+						}
+						return written;
+					}
+					return (vint)0;
+				});
+			}
+
+			Task<void> ReadAheadAsync(const AsyncFileRange* ranges, vint count) override
+			{
+				// there is no portable hint, reads are served by the file stream in order anyway
+				Promise<void> promise;
+				promise.SetResult();
+				return promise.GetTask();
+			}
+		};
+
+/***********************************************************************
+CreateThreadPoolAsyncFileImpl
+***********************************************************************/
+
+		Ptr<IAsyncFileImpl> CreateThreadPoolAsyncFileImpl(const WString& fileName, FileStream::AccessRight accessRight)
+		{
+			return Ptr(new ThreadPoolAsyncFileImpl(fileName, accessRight));
+		}
+
+/***********************************************************************
+AsyncFile
+***********************************************************************/
+
+		AsyncFile::AsyncFile(const WString& fileName, FileStream::AccessRight _accessRight)
+			: accessRight(_accessRight)
+		{
+			impl = filesystem::GetFileSystemImpl()->GetAsyncFileImpl(fileName, _accessRight);
+			if (!impl->Open())
+			{
+				impl = nullptr;
+			}
+		}
+
+		AsyncFile::~AsyncFile()
+		{
+			Close();
+		}
+
+		bool AsyncFile::CanRead()const
+		{
+			return impl != nullptr && (accessRight == FileStream::ReadOnly || accessRight == FileStream::ReadWrite || accessRight == FileStream::ReadOnlyMapped);
+		}
+
+		bool AsyncFile::CanWrite()const
+		{
+			return impl != nullptr && (accessRight == FileStream::WriteOnly || accessRight == FileStream::ReadWrite);
+		}
+
+		bool AsyncFile::IsAvailable()const
+		{
+			return impl != nullptr;
+		}
+
+		void AsyncFile::Close()
+		{
+			if (impl != nullptr)
+			{
+				impl->Close();
+				impl = nullptr;
+			}
+		}
+
+		pos_t AsyncFile::Size()const
+		{
+			return impl != nullptr ? impl->Size() : -1;
+		}
+
+		Task<vint> AsyncFile::ReadAsync(pos_t offset, void* buffer, vint size)
+		{
+			CHECK_ERROR(CanRead(), L"AsyncFile::ReadAsync(pos_t, void*, vint)#File is closed or operation not supported.");
+			CHECK_ERROR(offset >= 0, L"AsyncFile::ReadAsync(pos_t, void*, vint)#Argument offset cannot be negative.");
+			CHECK_ERROR(size >= 0, L"AsyncFile::ReadAsync(pos_t, void*, vint)#Argument size cannot be negative.");
+			return impl->ReadAsync(offset, buffer, size);
+		}
+
+		Task<vint> AsyncFile::WriteAsync(pos_t offset, const void* buffer, vint size)
+		{
+			CHECK_ERROR(CanWrite(), L"AsyncFile::WriteAsync(pos_t, const void*, vint)#File is closed or operation not supported.");
+			CHECK_ERROR(offset >= 0, L"AsyncFile::WriteAsync(pos_t, const void*, vint)#Argument offset cannot be negative.");
+			CHECK_ERROR(size >= 0, L"AsyncFile::WriteAsync(pos_t, const void*, vint)#Argument size cannot be negative.");
+			return impl->WriteAsync(offset, buffer, size);
+		}
+
+		Task<void> AsyncFile::ReadAheadAsync(const AsyncFileRange* ranges, vint count)
+		{
+			CHECK_ERROR(CanRead(), L"AsyncFile::ReadAheadAsync(const AsyncFileRange*, vint)#File is closed or operation not supported.");
+			CHECK_ERROR(count >= 0, L"AsyncFile::ReadAheadAsync(const AsyncFileRange*, vint)#Argument count cannot be negative.");
+			for (vint i = 0; i < count; i++)
+			{
+				CHECK_ERROR(ranges[i].offset >= 0 && ranges[i].size >= 0, L"AsyncFile::ReadAheadAsync(const AsyncFileRange*, vint)#Ranges cannot be negative.");
+			}
+			return impl->ReadAheadAsync(ranges, count);
+		}
+	}
+}
@@ -0,0 +1,120 @@
+/***********************************************************************
+Author: Zihan Chen (vczh)
+Licensed under https://github.com/vczh-libraries/License
+***********************************************************************/
+
+#ifndef VCZH_STREAM_ASYNCFILE
+#define VCZH_STREAM_ASYNCFILE
+
+#include "FileStream.h"
+#include "../Threading.h"
+
+namespace vl
+{
+	namespace stream
+	{
+		/// <summary>A range in a file.</summary>
+		struct AsyncFileRange
+		{
+			/// <summary>The offset of the range from the beginning of the file.</summary>
+			pos_t					offset = 0;
+			/// <summary>The size of the range.</summary>
+			pos_t					size = 0;
+		};
+
+		/// <summary>The exception of a failed asynchronous file operation.</summary>
+		class AsyncFileException : public Exception
+		{
+		protected:
+			vint					errorCode;
+
+		public:
+			AsyncFileException(const WString& _message, vint _errorCode);
+
+			/// <summary>Get the error code, it is errno on Linux, or 0 if the operation is rejected because the file is closed.</summary>
+			/// <returns>The error code.</returns>
+			vint					GetErrorCode()const;
+		};
+
+		/// <summary>Platform-specific asynchronous file implementation interface.</summary>
+		class IAsyncFileImpl : public virtual Interface
+		{
+		public:
+			virtual bool			Open() = 0;
+			virtual void			Close() = 0;
+			virtual pos_t			Size() = 0;
+			virtual Task<vint>		ReadAsync(pos_t offset, void* buffer, vint size) = 0;
+			virtual Task<vint>		WriteAsync(pos_t offset, const void* buffer, vint size) = 0;
+			virtual Task<void>		ReadAheadAsync(const AsyncFileRange* ranges, vint count) = 0;
+		};
+
+		/// <summary>
+		/// <p>
+		/// A file for asynchronous reading and writing at given offsets, without blocking the calling thread.
+		/// If the given file name is not working, the file could be <b>unavailable</b>.
+		/// </p>
+		/// <p>
+		/// On Linux operations are submitted to a process-wide io_uring, which is stopped by <see cref="FinalizeGlobalStorage"/>.
+		/// Operations submitted together by <see cref="ReadAheadAsync"/>, or by different threads at the same time, are batched in one system call.
+		/// A continuation or a coroutine awaiting a task resumes on the io_uring completion thread, it should not block.
+		/// </p>
+		/// <p>
+		/// On other platforms, or when io_uring is not available, operations of a file are executed one by one in the submission order by <see cref="ThreadPoolLite"/>.
+		/// </p>
+		/// </summary>
+		/// <remarks>
+		/// A failed operation completes its task with <see cref="AsyncFileException"/>.
+		/// Buffers given to operations must stay alive and unchanged until their tasks complete.
+		/// </remarks>
+		class AsyncFile : public Object
+		{
+		protected:
+			FileStream::AccessRight	accessRight;
+			Ptr<IAsyncFileImpl>		impl;
+
+		public:
+			NOT_COPYABLE(AsyncFile);
+
+			/// <summary>Open a file.</summary>
+			/// <param name="fileName">The file to operate.</param>
+			/// <param name="_accessRight">Expected operations on the file, a file is created or truncated like <see cref="FileStream"/> when it is opened to write.</param>
+			AsyncFile(const WString& fileName, FileStream::AccessRight _accessRight);
+			~AsyncFile();
+
+			/// <summary>Test if the file is opened to read.</summary>
+			/// <returns>Returns true if <see cref="ReadAsync"/> is allowed.</returns>
+			bool					CanRead()const;
+			/// <summary>Test if the file is opened to write.</summary>
+			/// <returns>Returns true if <see cref="WriteAsync"/> is allowed.</returns>
+			bool					CanWrite()const;
+			/// <summary>Test if the file is available.</summary>
+			/// <returns>Returns true if the file is opened and not closed.</returns>
+			bool					IsAvailable()const;
+			/// <summary>Close the file. Submitted operations still complete, but operations that have not been submitted to the operating system could fail.</summary>
+			void					Close();
+			/// <summary>Get the size of the file.</summary>
+			/// <returns>The size of the file, or -1 if the file is unavailable.</returns>
+			pos_t					Size()const;
+
+			/// <summary>Read from a given offset.</summary>
+			/// <returns>The task of the number of bytes read, which is 0 at the end of the file.</returns>
+			/// <param name="offset">The offset from the beginning of the file.</param>
+			/// <param name="buffer">The buffer to receive the content.</param>
+			/// <param name="size">The maximum number of bytes to read.</param>
+			Task<vint>				ReadAsync(pos_t offset, void* buffer, vint size);
+			/// <summary>Write to a given offset. The file grows if the offset is beyond the end of the file.</summary>
+			/// <returns>The task of the number of bytes written, which is always the size of the buffer.</returns>
+			/// <param name="offset">The offset from the beginning of the file.</param>
+			/// <param name="buffer">The content to write.</param>
+			/// <param name="size">The size of the content.</param>
+			Task<vint>				WriteAsync(pos_t offset, const void* buffer, vint size);
+			/// <summary>Hint the operating system to load ranges of the file into the cache for following reads. All hints are submitted in one batch.</summary>
+			/// <returns>The task completing when the operating system accepts all hints. Waiting for it is not necessary.</returns>
+			/// <param name="ranges">Ranges to load, a range with size 0 extends to the end of the file.</param>
+			/// <param name="count">The number of ranges.</param>
+			Task<void>				ReadAheadAsync(const AsyncFileRange* ranges, vint count);
+		};
+	}
+}
+
+#endif
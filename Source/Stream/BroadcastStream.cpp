@@ -111,5 +111,22 @@ BroadcastStream
 		{
 			CHECK_FAIL(L"BroadcastStream::Peek(void*, vint)#Operation not supported.");
 		}
+
+		vint BroadcastStream::WriteV(const StreamBuffer* _buffers, vint _count)
+		{
+			vint total = 0;
+			for (vint i = 0; i < _count; i++)
+			{
+				total += _buffers[i].size;
+			}
+
+			for (auto stream : streams)
+			{
+				vint written = stream->WriteV(_buffers, _count);
+				CHECK_ERROR(written == total, L"BroadcastStream::WriteV(const StreamBuffer*, vint)#Failed to copy data to the output stream.");
+			}
+			position += total;
+			return total;
+		}
 	}
 }
\ No newline at end of file
@@ -49,6 +49,7 @@ namespace vl
 			vint					Read(void* _buffer, vint _size);
 			vint					Write(void* _buffer, vint _size);
 			vint					Peek(void* _buffer, vint _size);
+			vint					WriteV(const StreamBuffer* _buffers, vint _count);
 		};
 	}
 }
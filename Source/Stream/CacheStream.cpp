@@ -303,5 +303,107 @@ CacheStream
 
 			return InternalRead(_buffer, _size);
 		}
+
+		vint CacheStream::AcquireRead(const void*& _buffer, vint _size)
+		{
+			CHECK_ERROR(CanRead(), L"CacheStream::AcquireRead(const void*&, vint)#Stream is closed or operation not supported.");
+			CHECK_ERROR(_size>=0, L"CacheStream::AcquireRead(const void*&, vint)#Argument size cannot be negative.");
+
+			// lend the cache directly, load the cache from the current position if it does not cover the current position
+			if(!(position>=start && position<start+availableLength))
+			{
+				Flush();
+				Load(position);
+			}
+
+			vint max=(vint)(start+availableLength-position);
+			if(max<0)
+			{
+				max=0;
+			}
+			if(_size>max)
+			{
+				_size=max;
+			}
+			_buffer=buffer+(position-start);
+			return _size;
+		}
+
+		void CacheStream::CommitRead(vint _size)
+		{
+			CHECK_ERROR(CanRead(), L"CacheStream::CommitRead(vint)#Stream is closed or operation not supported.");
+			CHECK_ERROR(0<=_size && position+_size<=start+availableLength, L"CacheStream::CommitRead(vint)#Argument size out of range.");
+
+			position+=_size;
+			if(operatedSize<position)
+			{
+				operatedSize=position;
+			}
+		}
+
+		vint CacheStream::WriteV(const StreamBuffer* _buffers, vint _count)
+		{
+			CHECK_ERROR(CanWrite(), L"CacheStream::WriteV(const StreamBuffer*, vint)#Stream is closed or operation not supported.");
+			vint total=0;
+			for(vint i=0;i<_count;i++)
+			{
+				CHECK_ERROR(_buffers[i].size>=0, L"CacheStream::WriteV(const StreamBuffer*, vint)#Argument size cannot be negative.");
+				total+=_buffers[i].size;
+			}
+
+			// small content is collected in the cache, and writing to a limited stream is clamped by Write
+			if(total<block || IsLimited())
+			{
+				return IStream::WriteV(_buffers, _count);
+			}
+
+			// write the dirty cache and all buffers to the target stream in one operation if they are continuous
+			collections::Array<StreamBuffer> targetBuffers(_count+1);
+			vint dirtySize=0;
+			if(dirtyLength>0 && start+dirtyStart+dirtyLength==position)
+			{
+				if(target->Position()!=start+dirtyStart)
+				{
+					target->SeekFromBegin(start+dirtyStart);
+				}
+				targetBuffers[0].buffer=buffer+dirtyStart;
+				targetBuffers[0].size=dirtyLength;
+				dirtySize=dirtyLength;
+				dirtyStart=0;
+				dirtyLength=0;
+				availableLength=0;
+			}
+			else
+			{
+				Flush();
+				if(CanSeek())
+				{
+					target->SeekFromBegin(position);
+				}
+			}
+
+			for(vint i=0;i<_count;i++)
+			{
+				targetBuffers[i+1]=_buffers[i];
+			}
+			vint written=dirtySize>0
+				?target->WriteV(&targetBuffers[0], _count+1)
+				:target->WriteV(&targetBuffers[1], _count)
+				;
+			written-=dirtySize;
+			if(written<0)
+			{
+				written=0;
+			}
+
+			// the cache is empty, move it to the current position
+			position+=written;
+			start=position;
+			if(operatedSize<position)
+			{
+				operatedSize=position;
+			}
+			return written;
+		}
 	}
 }
\ No newline at end of file
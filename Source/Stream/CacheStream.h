@@ -69,6 +69,9 @@ namespace vl
 			vint					Read(void* _buffer, vint _size);
 			vint					Write(void* _buffer, vint _size);
 			vint					Peek(void* _buffer, vint _size);
+			vint					AcquireRead(const void*& _buffer, vint _size);
+			void					CommitRead(vint _size);
+			vint					WriteV(const StreamBuffer* _buffers, vint _count);
 		};
 	}
 }
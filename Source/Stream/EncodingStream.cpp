@@ -3,6 +3,7 @@ Author: Zihan Chen (vczh)
 Licensed under https://github.com/vczh-libraries/License
 ***********************************************************************/
 
+#include <string.h>
 #include "EncodingStream.h"
 
 namespace vl
@@ -111,10 +112,15 @@ EncoderStream
 DecoderStream
 ***********************************************************************/
 
+		const vint DecoderStreamBorrowBufferSize = 65536;
+
 		DecoderStream::DecoderStream(IStream& _stream, IDecoder& _decoder)
 			:stream(&_stream)
 			,decoder(&_decoder)
 			,position(0)
+			,borrowBuffer(0)
+			,borrowStart(0)
+			,borrowEnd(0)
 		{
 			decoder->Setup(stream);
 		}
@@ -158,6 +164,10 @@ DecoderStream
 		{
 			decoder->Close();
 			stream=0;
+			delete[] borrowBuffer;
+			borrowBuffer=0;
+			borrowStart=0;
+			borrowEnd=0;
 		}
 
 		pos_t DecoderStream::Position()const
@@ -187,12 +197,34 @@ DecoderStream
 
 		vint DecoderStream::Read(void* _buffer, vint _size)
 		{
+			vint borrowed=borrowEnd-borrowStart;
+			if(borrowed>0)
+			{
+				if(borrowed>_size)
+				{
+					borrowed=_size;
+				}
+				memcpy(_buffer, borrowBuffer+borrowStart, borrowed);
+				borrowStart+=borrowed;
+				position+=borrowed;
+				if(borrowed==_size)
+				{
+					return borrowed;
+				}
+				_buffer=(char*)_buffer+borrowed;
+				_size-=borrowed;
+			}
+
 			vint result=decoder->Read(_buffer, _size);
 			if(result>=0)
 			{
 				position+=result;
 			}
-			return result;
+			if(borrowed==0)
+			{
+				return result;
+			}
+			return borrowed+(result>0?result:0);
 		}
 
 		vint DecoderStream::Write(void* _buffer, vint _size)
@@ -204,5 +236,38 @@ DecoderStream
 		{
 			CHECK_FAIL(L"DecoderStream::Peek(void*, vint)#Operation not supported.");
 		}
+
+		vint DecoderStream::AcquireRead(const void*& _buffer, vint _size)
+		{
+			CHECK_ERROR(CanRead(), L"DecoderStream::AcquireRead(const void*&, vint)#Stream is closed or operation not supported.");
+			CHECK_ERROR(_size>=0, L"DecoderStream::AcquireRead(const void*&, vint)#Argument size cannot be negative.");
+
+			// decode a block into the internal buffer when everything decoded is consumed
+			if(borrowStart==borrowEnd)
+			{
+				if(!borrowBuffer)
+				{
+					borrowBuffer=new char[DecoderStreamBorrowBufferSize];
+				}
+				vint result=decoder->Read(borrowBuffer, DecoderStreamBorrowBufferSize);
+				borrowStart=0;
+				borrowEnd=result>0?result:0;
+			}
+
+			vint max=borrowEnd-borrowStart;
+			if(_size>max)
+			{
+				_size=max;
+			}
+			_buffer=borrowBuffer+borrowStart;
+			return _size;
+		}
+
+		void DecoderStream::CommitRead(vint _size)
+		{
+			CHECK_ERROR(0<=_size && _size<=borrowEnd-borrowStart, L"DecoderStream::CommitRead(vint)#Argument size out of range.");
+			borrowStart+=_size;
+			position+=_size;
+		}
 	}
 }
@@ -56,6 +56,11 @@ Encoding Related
 			IDecoder*					decoder;
 			pos_t						position;
 
+			// decoded content for AcquireRead, which is consumed before calling the decoder again
+			char*						borrowBuffer;
+			vint						borrowStart;
+			vint						borrowEnd;
+
 		public:
 			/// <summary>Create a decoder stream.</summary>
 			/// <param name="_stream">The input stream to read.</param>
@@ -78,6 +83,8 @@ Encoding Related
 			vint						Read(void* _buffer, vint _size);
 			vint						Write(void* _buffer, vint _size);
 			vint						Peek(void* _buffer, vint _size);
+			vint						AcquireRead(const void*& _buffer, vint _size);
+			void						CommitRead(vint _size);
 		};
 	}
 }
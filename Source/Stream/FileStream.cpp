@@ -5,8 +5,20 @@ Licensed under https://github.com/vczh-libraries/License
 
 #include "FileStream.h"
 #include "../FileSystem.h"
-#if defined VCZH_GCC
+#include <stdint.h>
+#include <string.h>
+#if defined VCZH_MSVC
+#define _WINSOCKAPI_
+#include <Windows.h>
+#elif defined VCZH_GCC
 #include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #endif
 
 namespace vl
@@ -23,6 +35,27 @@ namespace vl
 		{
 			fseek(file, (long)offset, origin);
 		}
+
+		// small vectors are served by the stdio buffer
+		const vint MinVectoredFileSize = BUFSIZ;
+
+		bool PrepareFileVectors(const StreamBuffer* _buffers, vint _count, collections::Array<iovec>& vectors)
+		{
+			if (_count <= 0 || _count > IOV_MAX)
+			{
+				return false;
+			}
+
+			vint total = 0;
+			vectors.Resize(_count);
+			for (vint i = 0; i < _count; i++)
+			{
+				vectors[i].iov_base = _buffers[i].buffer;
+				vectors[i].iov_len = (size_t)_buffers[i].size;
+				total += _buffers[i].size;
+			}
+			return total >= MinVectoredFileSize;
+		}
 #endif
 
 /***********************************************************************
@@ -53,6 +86,7 @@ OSFileStreamImpl
 				switch(accessRight)
 				{
 				case FileStream::ReadOnly:
+				case FileStream::ReadOnlyMapped:
 					mode = L"rb";
 					break;
 				case FileStream::WriteOnly:
@@ -219,6 +253,264 @@ OSFileStreamImpl
 				return count;
 #endif
 			}
+
+#if defined VCZH_GCC
+			vint ReadV(const StreamBuffer* _buffers, vint _count) override
+			{
+				CHECK_ERROR(file != nullptr, L"FileStream::ReadV(const StreamBuffer*, vint)#Stream is closed, cannot perform this operation.");
+				collections::Array<iovec> vectors;
+				if (!PrepareFileVectors(_buffers, _count, vectors))
+				{
+					return -1;
+				}
+
+				// seeking discards content buffered by stdio, the file descriptor is read directly at the same position
+				long position = ftell(file);
+				fseek(file, position, SEEK_SET);
+				ssize_t read = 0;
+				do
+				{
+					read = preadv(fileno(file), &vectors[0], (int)_count, (off_t)position);
+				} while (read == -1 && errno == EINTR);
+				if (read < 0)
+				{
+					read = 0;
+				}
+				fseek(file, position + (long)read, SEEK_SET);
+				return (vint)read;
+			}
+
+			vint WriteV(const StreamBuffer* _buffers, vint _count) override
+			{
+				CHECK_ERROR(file != nullptr, L"FileStream::WriteV(const StreamBuffer*, vint)#Stream is closed, cannot perform this operation.");
+				collections::Array<iovec> vectors;
+				if (!PrepareFileVectors(_buffers, _count, vectors))
+				{
+					return -1;
+				}
+
+				// write content buffered by stdio first, the file descriptor is written directly at the same position
+				long position = ftell(file);
+				fflush(file);
+				vint total = 0;
+				vint first = 0;
+				while (first < _count)
+				{
+					ssize_t written = pwritev(fileno(file), &vectors[first], (int)(_count - first), (off_t)(position + total));
+					if (written == -1 && errno == EINTR)
+					{
+						continue;
+					}
+					if (written <= 0)
+					{
+						break;
+					}
+
+					// skip buffers that are completely written after a partial write
+					total += (vint)written;
+					while (first < _count && (size_t)written >= vectors[first].iov_len)
+					{
+						written -= (ssize_t)vectors[first].iov_len;
+						first++;
+					}
+					if (first < _count)
+					{
+						vectors[first].iov_base = (char*)vectors[first].iov_base + written;
+						vectors[first].iov_len -= (size_t)written;
+					}
+				}
+				fseek(file, position + (long)total, SEEK_SET);
+				return total;
+			}
+#endif
+		};
+
+/***********************************************************************
+OSMappedFileStreamImpl
+***********************************************************************/
+
+		class OSMappedFileStreamImpl : public Object, public virtual IFileStreamImpl
+		{
+		private:
+			WString					fileName;
+			bool					opened = false;
+			char*					buffer = nullptr;
+			pos_t					size = 0;
+			pos_t					position = 0;
+
+		public:
+			OSMappedFileStreamImpl(const WString& _fileName)
+				: fileName(_fileName)
+			{
+			}
+
+			~OSMappedFileStreamImpl()
+			{
+				Close();
+			}
+
+			bool Open() override
+			{
+#if defined VCZH_MSVC
+				HANDLE file = CreateFile(fileName.Buffer(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+				if (file == INVALID_HANDLE_VALUE)
+				{
+					return false;
+				}
+
+				LARGE_INTEGER fileSize;
+				if (GetFileType(file) != FILE_TYPE_DISK || !GetFileSizeEx(file, &fileSize) || (vuint64_t)fileSize.QuadPart > (vuint64_t)SIZE_MAX)
+				{
+					CloseHandle(file);
+					return false;
+				}
+
+				size = (pos_t)fileSize.QuadPart;
+				if (size > 0)
+				{
+					// the view keeps the file alive after both handles are closed
+					// pages are copy-on-write, so that callers like TestEncoding could modify borrowed content in place without touching the file
+					HANDLE mapping = CreateFileMapping(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+					if (mapping != NULL)
+					{
+						buffer = (char*)MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+						CloseHandle(mapping);
+					}
+				}
+				CloseHandle(file);
+#elif defined VCZH_GCC
+				AString fileNameA = wtoa(fileName);
+				int fd = open(fileNameA.Buffer(), O_RDONLY | O_CLOEXEC);
+				if (fd == -1)
+				{
+					return false;
+				}
+
+				struct stat info;
+				if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || (vuint64_t)info.st_size > (vuint64_t)SIZE_MAX)
+				{
+					close(fd);
+					return false;
+				}
+
+				size = (pos_t)info.st_size;
+				if (size > 0)
+				{
+					// the mapping keeps the file alive after the descriptor is closed
+					// pages are copy-on-write, so that callers like TestEncoding could modify borrowed content in place without touching the file
+					void* mapped = mmap(nullptr, (size_t)size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+					if (mapped != MAP_FAILED)
+					{
+						buffer = (char*)mapped;
+						madvise(mapped, (size_t)size, MADV_SEQUENTIAL);
+						madvise(mapped, (size_t)size, MADV_WILLNEED);
+					}
+				}
+				close(fd);
+#endif
+				if (size > 0 && buffer == nullptr)
+				{
+					size = 0;
+					return false;
+				}
+				opened = true;
+				position = 0;
+				return true;
+			}
+
+			void Close() override
+			{
+				if (buffer != nullptr)
+				{
+#if defined VCZH_MSVC
+					UnmapViewOfFile(buffer);
+#elif defined VCZH_GCC
+					munmap(buffer, (size_t)size);
+#endif
+					buffer = nullptr;
+				}
+				opened = false;
+				size = 0;
+				position = 0;
+			}
+
+			pos_t Position() const override
+			{
+				return opened ? position : -1;
+			}
+
+			pos_t Size() const override
+			{
+				return opened ? size : -1;
+			}
+
+			void Seek(pos_t _size) override
+			{
+				SeekFromBegin(position + _size);
+			}
+
+			void SeekFromBegin(pos_t _size) override
+			{
+				if (_size > size)
+				{
+					position = size;
+				}
+				else if (_size < 0)
+				{
+					position = 0;
+				}
+				else
+				{
+					position = _size;
+				}
+			}
+
+			void SeekFromEnd(pos_t _size) override
+			{
+				SeekFromBegin(size - _size);
+			}
+
+			vint Read(void* _buffer, vint _size) override
+			{
+				vint read = Peek(_buffer, _size);
+				position += read;
+				return read;
+			}
+
+			vint Write(void* _buffer, vint _size) override
+			{
+				CHECK_FAIL(L"FileStream::Write(void*, vint)#Operation not supported.");
+			}
+
+			vint Peek(void* _buffer, vint _size) override
+			{
+				const void* mapped = nullptr;
+				vint available = AcquireRead(mapped, _size);
+				if (available > 0)
+				{
+					memcpy(_buffer, mapped, available);
+				}
+				return available;
+			}
+
+			vint AcquireRead(const void*& _buffer, vint _size) override
+			{
+				CHECK_ERROR(opened, L"FileStream::AcquireRead(const void*&, vint)#Stream is closed, cannot perform this operation.");
+				CHECK_ERROR(_size >= 0, L"FileStream::AcquireRead(const void*&, vint)#Argument size cannot be negative.");
+				if (_size > size - position)
+				{
+					_size = (vint)(size - position);
+				}
+				_buffer = buffer + position;
+				return _size;
+			}
+
+			void CommitRead(vint _size) override
+			{
+				CHECK_ERROR(opened, L"FileStream::CommitRead(vint)#Stream is closed, cannot perform this operation.");
+				CHECK_ERROR(0 <= _size && _size <= size - position, L"FileStream::CommitRead(vint)#Argument size out of range.");
+				position += _size;
+			}
 		};
 
 /***********************************************************************
@@ -227,6 +519,10 @@ CreateOSFileStreamImpl
 
 		Ptr<IFileStreamImpl> CreateOSFileStreamImpl(const WString& fileName, FileStream::AccessRight accessRight)
 		{
+			if (accessRight == FileStream::ReadOnlyMapped)
+			{
+				return Ptr(new OSMappedFileStreamImpl(fileName));
+			}
 			return Ptr(new OSFileStreamImpl(fileName, accessRight));
 		}
 
@@ -251,7 +547,7 @@ FileStream
 
 		bool FileStream::CanRead() const
 		{
-			return impl != nullptr && (accessRight == ReadOnly || accessRight == ReadWrite);
+			return impl != nullptr && (accessRight == ReadOnly || accessRight == ReadWrite || accessRight == ReadOnlyMapped);
 		}
 
 		bool FileStream::CanWrite() const
@@ -266,12 +562,12 @@ FileStream
 
 		bool FileStream::CanPeek() const
 		{
-			return impl != nullptr && (accessRight == ReadOnly || accessRight == ReadWrite);
+			return impl != nullptr && (accessRight == ReadOnly || accessRight == ReadWrite || accessRight == ReadOnlyMapped);
 		}
 
 		bool FileStream::IsLimited() const
 		{
-			return impl != nullptr && accessRight == ReadOnly;
+			return impl != nullptr && (accessRight == ReadOnly || accessRight == ReadOnlyMapped);
 		}
 
 		bool FileStream::IsAvailable() const
@@ -333,5 +629,39 @@ FileStream
 			CHECK_ERROR(impl != nullptr, L"FileStream::Peek(pos_t)#Stream is closed, cannot perform this operation.");
 			return impl->Peek(_buffer, _size);
 		}
+
+		vint FileStream::AcquireRead(const void*& _buffer, vint _size)
+		{
+			CHECK_ERROR(impl != nullptr, L"FileStream::AcquireRead(const void*&, vint)#Stream is closed, cannot perform this operation.");
+			return impl->AcquireRead(_buffer, _size);
+		}
+
+		void FileStream::CommitRead(vint _size)
+		{
+			CHECK_ERROR(impl != nullptr, L"FileStream::CommitRead(vint)#Stream is closed, cannot perform this operation.");
+			impl->CommitRead(_size);
+		}
+
+		vint FileStream::ReadV(const StreamBuffer* _buffers, vint _count)
+		{
+			CHECK_ERROR(impl != nullptr, L"FileStream::ReadV(const StreamBuffer*, vint)#Stream is closed, cannot perform this operation.");
+			for (vint i = 0; i < _count; i++)
+			{
+				CHECK_ERROR(_buffers[i].size >= 0, L"FileStream::ReadV(const StreamBuffer*, vint)#Argument size cannot be negative.");
+			}
+			vint read = impl->ReadV(_buffers, _count);
+			return read == -1 ? IStream::ReadV(_buffers, _count) : read;
+		}
+
+		vint FileStream::WriteV(const StreamBuffer* _buffers, vint _count)
+		{
+			CHECK_ERROR(impl != nullptr, L"FileStream::WriteV(const StreamBuffer*, vint)#Stream is closed, cannot perform this operation.");
+			for (vint i = 0; i < _count; i++)
+			{
+				CHECK_ERROR(_buffers[i].size >= 0, L"FileStream::WriteV(const StreamBuffer*, vint)#Argument size cannot be negative.");
+			}
+			vint written = impl->WriteV(_buffers, _count);
+			return written == -1 ? IStream::WriteV(_buffers, _count) : written;
+		}
 	}
 }
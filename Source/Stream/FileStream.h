@@ -27,6 +27,11 @@ namespace vl
 			virtual vint			Read(void* _buffer, vint _size) = 0;
 			virtual vint			Write(void* _buffer, vint _size) = 0;
 			virtual vint			Peek(void* _buffer, vint _size) = 0;
+			virtual vint			AcquireRead(const void*& _buffer, vint _size) { _buffer = nullptr; return -1; }
+			virtual void			CommitRead(vint _size) { CHECK_FAIL(L"IFileStreamImpl::CommitRead(vint)#Operation not supported."); }
+			// return -1 to let FileStream read or write each buffer
+			virtual vint			ReadV(const StreamBuffer* _buffers, vint _count) { return -1; }
+			virtual vint			WriteV(const StreamBuffer* _buffers, vint _count) { return -1; }
 		};
 
 		/// <summary>A file stream. If the given file name is not working, the stream could be <b>unavailable</b>.</summary>
@@ -41,7 +46,15 @@ namespace vl
 				/// <summary>The file is opened to write, making this stream <b>writable</b>.</summary>
 				WriteOnly,
 				/// <summary>The file is opened to both read and write, making this stream <b>readable</b>, <b>seekable</b> and <b>writable</b>.</summary>
-				ReadWrite
+				ReadWrite,
+				/// <summary>
+				/// The file is mapped to memory to read, making this stream <b>readable</b>, <b>seekable</b> and <b>finite</b>.
+				/// Content could be borrowed by [M:vl.stream.IStream.AcquireRead] without copying.
+				/// Pages are mapped copy-on-write, modifying borrowed content does not change the file.
+				/// The file is expected to be read sequentially, the operating system is hinted to read ahead.
+				/// </summary>
+				/// <remarks>The stream is unavailable if the file cannot be mapped, for example when it is not a regular file or it is too large for the address space.</remarks>
+				ReadOnlyMapped
 			};
 		protected:
 			AccessRight				accessRight;
@@ -68,6 +81,10 @@ namespace vl
 			vint					Read(void* _buffer, vint _size);
 			vint					Write(void* _buffer, vint _size);
 			vint					Peek(void* _buffer, vint _size);
+			vint					AcquireRead(const void*& _buffer, vint _size);
+			void					CommitRead(vint _size);
+			vint					ReadV(const StreamBuffer* _buffers, vint _count);
+			vint					WriteV(const StreamBuffer* _buffers, vint _count);
 		};
 	}
 }
@@ -12,6 +12,15 @@ namespace vl
 {
 	namespace stream
 	{
+		/// <summary>A buffer in a vectored operation, see [M:vl.stream.IStream.ReadV] and [M:vl.stream.IStream.WriteV].</summary>
+		struct StreamBuffer
+		{
+			/// <summary>The buffer.</summary>
+			void*							buffer = nullptr;
+			/// <summary>The size of the buffer.</summary>
+			vint							size = 0;
+		};
+
 		/// <summary>
 		/// <p>
 		/// Interface for streams.
@@ -86,6 +95,63 @@ namespace vl
 			/// <param name="_buffer">A buffer to store the content.</param>
 			/// <param name="_size">The size of the content that is expected to read.</param>
 			virtual vint					Peek(void* _buffer, vint _size)=0;
+			/// <summary>
+			/// Borrow content from the current position without copying and without stepping forward. It will crash if the stream is <b>unreadable</b> or <b>unavailable</b>.
+			/// The borrowed content is valid until <see cref="CommitRead"/> or any other method of the stream is called.
+			/// </summary>
+			/// <returns>
+			/// Returns the size of the borrowed content, which could be smaller than "_size" even if the stream has more data. Returns 0 if a stream has no more data to read.
+			/// Returns -1 if the stream does not support borrowing, [T:vl.stream.StreamSpanReader] works for all <b>readable</b> streams.
+			/// </returns>
+			/// <param name="_buffer">Receives the pointer to the borrowed content.</param>
+			/// <param name="_size">The maximum size of the content to borrow.</param>
+			virtual vint					AcquireRead(const void*& _buffer, vint _size)
+			{
+				_buffer = nullptr;
+				return -1;
+			}
+			/// <summary>Step forward after borrowing content by <see cref="AcquireRead"/>. It will crash if the stream does not support borrowing.</summary>
+			/// <param name="_size">The size of the consumed content, which must not be larger than the size returned from the last <see cref="AcquireRead"/>.</param>
+			virtual void					CommitRead(vint _size)
+			{
+				CHECK_FAIL(L"IStream::CommitRead(vint)#Operation not supported.");
+			}
+			/// <summary>
+			/// Read from the current position to multiple buffers in order and step forward. It will crash if the stream is <b>unreadable</b> or <b>unavailable</b>.
+			/// The default implementation calls <see cref="Read"/> for each buffer, a stream could override it to read all buffers in one operation.
+			/// </summary>
+			/// <returns>Returns the actual size of the content that has read. A buffer is filled only after all previous buffers are full.</returns>
+			/// <param name="_buffers">Buffers to store the content.</param>
+			/// <param name="_count">The number of buffers.</param>
+			virtual vint					ReadV(const StreamBuffer* _buffers, vint _count)
+			{
+				vint total = 0;
+				for (vint i = 0; i < _count; i++)
+				{
+					vint read = Read(_buffers[i].buffer, _buffers[i].size);
+					total += read;
+					if (read < _buffers[i].size) break;
+				}
+				return total;
+			}
+			/// <summary>
+			/// Write multiple buffers in order to the current position and step forward. It will crash if the stream is <b>unwritable</b> or <b>unavailable</b>.
+			/// The default implementation calls <see cref="Write"/> for each buffer, a stream could override it to write all buffers in one operation.
+			/// </summary>
+			/// <returns>Returns the actual size of the content that has written. A buffer is written only after all previous buffers are written.</returns>
+			/// <param name="_buffers">Buffers storing the content to write.</param>
+			/// <param name="_count">The number of buffers.</param>
+			virtual vint					WriteV(const StreamBuffer* _buffers, vint _count)
+			{
+				vint total = 0;
+				for (vint i = 0; i < _count; i++)
+				{
+					vint written = Write(_buffers[i].buffer, _buffers[i].size);
+					total += written;
+					if (written < _buffers[i].size) break;
+				}
+				return total;
+			}
 		};
 	}
 }
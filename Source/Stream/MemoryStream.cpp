@@ -14,24 +14,100 @@ namespace vl
 MemoryStream
 ***********************************************************************/
 
+		using namespace collections;
+
+		class MemoryStreamBuffer : public Array<vuint8_t>
+		{
+		public:
+			// take over a buffer allocated by memory_management::AllocateBuffer, which is how Array allocates
+			MemoryStreamBuffer(char* _buffer, vint _count)
+			{
+				this->buffer=(vuint8_t*)_buffer;
+				this->count=_count;
+			}
+		};
+
 		void MemoryStream::PrepareSpace(vint totalSpace)
 		{
 			if(totalSpace>capacity)
 			{
-				totalSpace=(totalSpace/block+1)*block;
-				char* newBuffer=new char[totalSpace];
-				if(buffer)
+				if(storage==Segmented)
+				{
+					while(capacity<totalSpace)
+					{
+						segments.Add(memory_management::AllocateBuffer<char>(block));
+						capacity+=block;
+					}
+				}
+				else
+				{
+					// grow geometrically to make appending amortized constant time
+					vint newCapacity=capacity*2;
+					if(newCapacity<totalSpace)
+					{
+						newCapacity=totalSpace;
+					}
+					newCapacity=(newCapacity+block-1)/block*block;
+					Reserve(newCapacity);
+				}
+			}
+		}
+
+		void MemoryStream::ReadAt(vint _position, void* _buffer, vint _size)
+		{
+			if(storage==Segmented)
+			{
+				while(_size>0)
 				{
-					memcpy(newBuffer, buffer, size);
-					delete[] buffer;
+					vint offset=_position%block;
+					vint copying=block-offset<_size?block-offset:_size;
+					memcpy(_buffer, segments[_position/block]+offset, copying);
+					_buffer=(char*)_buffer+copying;
+					_position+=copying;
+					_size-=copying;
 				}
-				buffer=newBuffer;
-				capacity=totalSpace;
+			}
+			else
+			{
+				memmove(_buffer, buffer+_position, _size);
 			}
 		}
 
-		MemoryStream::MemoryStream(vint _block)
+		void MemoryStream::WriteAt(vint _position, const void* _buffer, vint _size)
+		{
+			if(storage==Segmented)
+			{
+				while(_size>0)
+				{
+					vint offset=_position%block;
+					vint copying=block-offset<_size?block-offset:_size;
+					memcpy(segments[_position/block]+offset, _buffer, copying);
+					_buffer=(const char*)_buffer+copying;
+					_position+=copying;
+					_size-=copying;
+				}
+			}
+			else
+			{
+				memmove(buffer+_position, _buffer, _size);
+			}
+		}
+
+		void MemoryStream::ReleaseBuffer()
+		{
+			memory_management::DeallocateBuffer(buffer);
+			for(auto segment : segments)
+			{
+				memory_management::DeallocateBuffer(segment);
+			}
+			buffer=0;
+			segments.Clear();
+			capacity=0;
+		}
+
+		MemoryStream::MemoryStream(vint _block, Storage _storage)
 			:block(_block)
+			,storage(_storage)
 			,buffer(0)
 			,size(0)
 			,position(0)
@@ -80,15 +156,10 @@ MemoryStream
 
 		void MemoryStream::Close()
 		{
-			if(buffer)
-			{
-				delete[] buffer;
-			}
+			ReleaseBuffer();
 			block=0;
-			buffer=0;
 			size=-1;
 			position=-1;
-			capacity=0;
 		}
 
 		pos_t MemoryStream::Position()const
@@ -138,7 +209,7 @@ MemoryStream
 			{
 				_size=max;
 			}
-			memmove(_buffer, buffer+position, _size);
+			ReadAt(position, _buffer, _size);
 			position+=_size;
 			return _size;
 		}
@@ -148,7 +219,7 @@ MemoryStream
 			CHECK_ERROR(block!=0, L"MemoryStream::Write(pos_t)#Stream is closed, cannot perform this operation.");
 			CHECK_ERROR(_size>=0, L"MemoryStream::Write(void*, vint)#Argument size cannot be negative.");
 			PrepareSpace(size+_size);
-			memmove(buffer+position, _buffer, _size);
+			WriteAt(position, _buffer, _size);
 			position+=_size;
 			if(size<position)
 			{
@@ -166,13 +237,134 @@ MemoryStream
 			{
 				_size=max;
 			}
-			memmove(_buffer, buffer+position, _size);
+			ReadAt(position, _buffer, _size);
+			return _size;
+		}
+
+		vint MemoryStream::AcquireRead(const void*& _buffer, vint _size)
+		{
+			CHECK_ERROR(block!=0, L"MemoryStream::AcquireRead(const void*&, vint)#Stream is closed, cannot perform this operation.");
+			CHECK_ERROR(_size>=0, L"MemoryStream::AcquireRead(const void*&, vint)#Argument size cannot be negative.");
+			vint max=size-position;
+			if(storage==Segmented)
+			{
+				// lend content until the end of the current segment
+				vint offset=position%block;
+				if(max>block-offset)
+				{
+					max=block-offset;
+				}
+				_buffer=max>0?segments[position/block]+offset:nullptr;
+			}
+			else
+			{
+				_buffer=buffer+position;
+			}
+			if(_size>max)
+			{
+				_size=max;
+			}
 			return _size;
 		}
 
+		void MemoryStream::CommitRead(vint _size)
+		{
+			CHECK_ERROR(block!=0, L"MemoryStream::CommitRead(vint)#Stream is closed, cannot perform this operation.");
+			CHECK_ERROR(0<=_size && _size<=size-position, L"MemoryStream::CommitRead(vint)#Argument size out of range.");
+			position+=_size;
+		}
+
+		vint MemoryStream::ReadV(const StreamBuffer* _buffers, vint _count)
+		{
+			CHECK_ERROR(block!=0, L"MemoryStream::ReadV(const StreamBuffer*, vint)#Stream is closed, cannot perform this operation.");
+			vint total=0;
+			for(vint i=0;i<_count;i++)
+			{
+				CHECK_ERROR(_buffers[i].size>=0, L"MemoryStream::ReadV(const StreamBuffer*, vint)#Argument size cannot be negative.");
+				vint max=size-position;
+				vint read=_buffers[i].size<max?_buffers[i].size:max;
+				ReadAt(position, _buffers[i].buffer, read);
+				position+=read;
+				total+=read;
+				if(read<_buffers[i].size) break;
+			}
+			return total;
+		}
+
+		vint MemoryStream::WriteV(const StreamBuffer* _buffers, vint _count)
+		{
+			CHECK_ERROR(block!=0, L"MemoryStream::WriteV(const StreamBuffer*, vint)#Stream is closed, cannot perform this operation.");
+			vint total=0;
+			for(vint i=0;i<_count;i++)
+			{
+				CHECK_ERROR(_buffers[i].size>=0, L"MemoryStream::WriteV(const StreamBuffer*, vint)#Argument size cannot be negative.");
+				total+=_buffers[i].size;
+			}
+
+			// allocate once for all buffers
+			PrepareSpace(size+total);
+			for(vint i=0;i<_count;i++)
+			{
+				WriteAt(position, _buffers[i].buffer, _buffers[i].size);
+				position+=_buffers[i].size;
+			}
+			if(size<position)
+			{
+				size=position;
+			}
+			return total;
+		}
+
+		void MemoryStream::Reserve(vint _size)
+		{
+			CHECK_ERROR(block!=0, L"MemoryStream::Reserve(vint)#Stream is closed, cannot perform this operation.");
+			if(_size>capacity)
+			{
+				if(storage==Segmented)
+				{
+					PrepareSpace(_size);
+				}
+				else
+				{
+					char* newBuffer=memory_management::AllocateBuffer<char>(_size);
+					if(buffer)
+					{
+						memcpy(newBuffer, buffer, size);
+						memory_management::DeallocateBuffer(buffer);
+					}
+					buffer=newBuffer;
+					capacity=_size;
+				}
+			}
+		}
+
 		void* MemoryStream::GetInternalBuffer()
 		{
+			CHECK_ERROR(storage==Contiguous, L"MemoryStream::GetInternalBuffer()#Operation not supported for a segmented stream.");
 			return buffer;
 		}
+
+		void MemoryStream::TakeBuffer(collections::Array<vuint8_t>& _buffer)
+		{
+			CHECK_ERROR(block!=0, L"MemoryStream::TakeBuffer(Array<vuint8_t>&)#Stream is closed, cannot perform this operation.");
+			if(storage==Segmented || size==0)
+			{
+				_buffer.Resize(size);
+				if(size>0)
+				{
+					ReadAt(0, &_buffer[0], size);
+				}
+				ReleaseBuffer();
+			}
+			else
+			{
+				// the unused capacity stays allocated until the array is destroyed
+				_buffer=MemoryStreamBuffer(buffer, size);
+				buffer=0;
+				capacity=0;
+			}
+			size=0;
+			position=0;
+		}
 	}
 }
\ No newline at end of file
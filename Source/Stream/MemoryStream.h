@@ -15,22 +15,45 @@ namespace vl
 		/// <summary>A <b>readable</b>, <b>peekable</b>, <b>writable</b> and <b>seekable</b> stream that creates on a buffer.</summary>
 		class MemoryStream : public Object, public virtual IStream
 		{
+		public:
+			/// <summary>How the content is stored.</summary>
+			enum Storage
+			{
+				/// <summary>
+				/// The content is stored in one buffer, which is available from <see cref="GetInternalBuffer"/>.
+				/// When the buffer is not big enough for writing, a bigger one is created and the content is copied.
+				/// </summary>
+				Contiguous,
+				/// <summary>
+				/// The content is stored in segments of "_block" bytes, new segments are appended without copying the content.
+				/// [M:vl.stream.IStream.AcquireRead] borrows at most one segment at a time, and <see cref="GetInternalBuffer"/> is not supported.
+				/// </summary>
+				Segmented,
+			};
+
 		protected:
 			vint					block;
+			Storage					storage;
 			char*					buffer;
+			collections::List<char*>	segments;
 			vint					size;
 			vint					position;
 			vint					capacity;
 
 			void					PrepareSpace(vint totalSpace);
+			void					ReadAt(vint _position, void* _buffer, vint _size);
+			void					WriteAt(vint _position, const void* _buffer, vint _size);
+			void					ReleaseBuffer();
 		public:
 			/// <summary>Create a memory stream.</summary>
 			/// <param name="_block">
 			/// Size for each allocation.
 			/// When the allocated buffer is not big enough for writing,
-			/// the buffer will be rebuilt with an extension of "_block" in bytes.
+			/// a <see cref="Contiguous"/> buffer at least doubles its size, and is always a multiple of "_block" in bytes,
+			/// a <see cref="Segmented"/> buffer appends segments of "_block" in bytes.
 			/// </param>
-			MemoryStream(vint _block=65536);
+			/// <param name="_storage">How the content is stored.</param>
+			MemoryStream(vint _block=65536, Storage _storage=Contiguous);
 			~MemoryStream();
 
 			bool					CanRead()const;
@@ -48,7 +71,24 @@ namespace vl
 			vint					Read(void* _buffer, vint _size);
 			vint					Write(void* _buffer, vint _size);
 			vint					Peek(void* _buffer, vint _size);
+			vint					AcquireRead(const void*& _buffer, vint _size);
+			void					CommitRead(vint _size);
+			vint					ReadV(const StreamBuffer* _buffers, vint _count);
+			vint					WriteV(const StreamBuffer* _buffers, vint _count);
+
+			/// <summary>Allocate enough space for the content, so that writing until the given size does not allocate again.</summary>
+			/// <param name="_size">The expected size of the content in bytes.</param>
+			void					Reserve(vint _size);
+			/// <summary>Get the buffer storing the content. It crashes if the stream is <see cref="Segmented"/>.</summary>
+			/// <returns>The buffer, which is only safe to use before the stream is written to.</returns>
 			void*					GetInternalBuffer();
+			/// <summary>
+			/// Move the content out of the stream, the stream becomes empty.
+			/// The content is not copied for a <see cref="Contiguous"/> buffer,
+			/// it could be moved into [F:vl.inter_process.async_tcp_socket.AsyncSocketBuffer.data] to send it.
+			/// </summary>
+			/// <param name="_buffer">The array to receive the content.</param>
+			void					TakeBuffer(collections::Array<vuint8_t>& _buffer);
 		};
 	}
 }
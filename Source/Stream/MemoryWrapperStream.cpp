@@ -145,5 +145,25 @@ MemoryWrapperStream
 			memmove(_buffer, buffer+position, _size);
 			return _size;
 		}
+
+		vint MemoryWrapperStream::AcquireRead(const void*& _buffer, vint _size)
+		{
+			CHECK_ERROR(buffer!=0, L"MemoryWrapperStream::AcquireRead(const void*&, vint)#Stream is closed, cannot perform this operation.");
+			CHECK_ERROR(_size>=0, L"MemoryWrapperStream::AcquireRead(const void*&, vint)#Argument size cannot be negative.");
+			vint max=size-position;
+			if(_size>max)
+			{
+				_size=max;
+			}
+			_buffer=buffer+position;
+			return _size;
+		}
+
+		void MemoryWrapperStream::CommitRead(vint _size)
+		{
+			CHECK_ERROR(buffer!=0, L"MemoryWrapperStream::CommitRead(vint)#Stream is closed, cannot perform this operation.");
+			CHECK_ERROR(0<=_size && _size<=size-position, L"MemoryWrapperStream::CommitRead(vint)#Argument size out of range.");
+			position+=_size;
+		}
 	}
 }
\ No newline at end of file
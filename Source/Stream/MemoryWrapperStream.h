@@ -41,6 +41,8 @@ namespace vl
 			vint					Read(void* _buffer, vint _size);
 			vint					Write(void* _buffer, vint _size);
 			vint					Peek(void* _buffer, vint _size);
+			vint					AcquireRead(const void*& _buffer, vint _size);
+			void					CommitRead(vint _size);
 		};
 	}
 }
@@ -102,5 +102,26 @@ RecorderStream
 		{
 			CHECK_FAIL(L"RecorderStream::Peek(void*, vint)#Operation not supported.");
 		}
+
+		vint RecorderStream::ReadV(const StreamBuffer* _buffers, vint _count)
+		{
+			vint read = in->ReadV(_buffers, _count);
+
+			// copy the filled part of buffers to the output stream in one operation
+			collections::Array<StreamBuffer> filled(_count);
+			vint filledCount = 0;
+			vint remain = read;
+			for (vint i = 0; i < _count && remain > 0; i++)
+			{
+				filled[i].buffer = _buffers[i].buffer;
+				filled[i].size = _buffers[i].size < remain ? _buffers[i].size : remain;
+				remain -= filled[i].size;
+				filledCount++;
+			}
+
+			vint written = filledCount == 0 ? 0 : out->WriteV(&filled[0], filledCount);
+			CHECK_ERROR(written == read, L"RecorderStream::ReadV(const StreamBuffer*, vint)#Failed to copy data to the output stream.");
+			return read;
+		}
 	}
 }
\ No newline at end of file
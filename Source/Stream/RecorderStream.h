@@ -53,6 +53,7 @@ namespace vl
 			vint					Read(void* _buffer, vint _size);
 			vint					Write(void* _buffer, vint _size);
 			vint					Peek(void* _buffer, vint _size);
+			vint					ReadV(const StreamBuffer* _buffers, vint _count);
 		};
 	}
 }
@@ -11,8 +11,15 @@ Licensed under https://github.com/vczh-libraries/License
 #include <semaphore.h>
 #include <errno.h>
 #include <time.h>
+#include <sched.h>
+#include <limits.h>
+#include <sys/resource.h>
 #if defined VCZH_APPLE
-#include <CoreFoundation/CoreFoundation.h>
+extern "C" int __ulock_wait(uint32_t operation, void* addr, uint64_t value, uint32_t timeout);
+extern "C" int __ulock_wake(uint32_t operation, void* addr, uint64_t wakeValue);
+#else
+#include <sys/syscall.h>
+#include <linux/futex.h>
 #endif
 
 #ifndef VCZH_GCC
@@ -25,6 +32,400 @@ namespace vl
 	using namespace collections;
 
 
+/***********************************************************************
+WaitableObject
+***********************************************************************/
+
+	namespace threading_internal
+	{
+		struct WaitableWaiter
+		{
+			CriticalSection				cs;
+			ConditionVariable			cv;
+			vuint64_t					version = 0;
+
+			void Wake()
+			{
+				cs.Enter();
+				version++;
+				cv.WakeOnePending();
+				cs.Leave();
+			}
+		};
+
+		struct WaitableRegistration
+		{
+			WaitableWaiter*				waiter = nullptr;
+			WaitableData*				data = nullptr;
+			WaitableRegistration*		previous = nullptr;
+			WaitableRegistration*		next = nullptr;
+		};
+
+		struct WaitableData
+		{
+			// the futex word of an object, the meaning of lower bits are defined by the object
+			std::atomic<vuint32_t>		state = 0;
+			CriticalSection				csRegistrations;
+			WaitableRegistration*		registrations = nullptr;
+			vint						references = 1;
+			bool						sharedAcrossProcesses = false;
+		};
+
+		static_assert(sizeof(std::atomic<vuint32_t>) == sizeof(vuint32_t), "A futex word must be 32 bits.");
+
+		// some threads are waiting for multiple objects including this object
+		constexpr vuint32_t				WaitableRegistered = 0x80000000;
+		// some threads are sleeping on the futex word
+		constexpr vuint32_t				WaitableSleeping = 0x40000000;
+
+		// the waiter of the current thread is not woken up by objects it gives back in WaitAll
+		thread_local WaitableWaiter*	waitableCurrentWaiter = nullptr;
+
+		// objects that could be signaled by other processes are checked in this interval
+		constexpr vint					WaitableSharedPollingInterval = 10;
+
+		bool GetWaitClock(vuint64_t& nanoseconds)
+		{
+			timespec now;
+#if defined VCZH_APPLE
+			constexpr auto waitClock = CLOCK_REALTIME;
+#else
+			constexpr auto waitClock = CLOCK_MONOTONIC;
+#endif
+			if (clock_gettime(waitClock, &now) != 0) return false;
+			nanoseconds = (vuint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+			return true;
+		}
+
+		// returns false only when the time is out, spurious wake-ups are possible
+		bool FutexWait(std::atomic<vuint32_t>& word, vuint32_t expected, vint ms)
+		{
+#if defined VCZH_APPLE
+			// UL_COMPARE_AND_WAIT, with the time out in microseconds where 0 means infinite
+			uint32_t timeout = ms < 0 ? 0 : ms == 0 ? 1 : (uint32_t)(ms < 4000000 ? ms : 4000000) * 1000;
+			return __ulock_wait(1, &word, expected, timeout) >= 0 || errno != ETIMEDOUT;
+#else
+			timespec timeout;
+			timeout.tv_sec = (time_t)(ms / 1000);
+			timeout.tv_nsec = (long)(ms % 1000) * 1000000;
+			return syscall(SYS_futex, &word, FUTEX_WAIT_PRIVATE, expected, ms < 0 ? nullptr : &timeout, nullptr, 0) == 0 || errno != ETIMEDOUT;
+#endif
+		}
+
+		void FutexWakeAll(std::atomic<vuint32_t>& word)
+		{
+#if defined VCZH_APPLE
+			// UL_COMPARE_AND_WAIT | ULF_WAKE_ALL
+			__ulock_wake(1 | 0x00000100, &word, 0);
+#else
+			syscall(SYS_futex, &word, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+#endif
+		}
+
+		void WaitableWakeRegistrations(WaitableData* data)
+		{
+			for (auto registration = data->registrations; registration; registration = registration->next)
+			{
+				if (registration->waiter != waitableCurrentWaiter)
+				{
+					registration->waiter->Wake();
+				}
+			}
+		}
+
+		// change the futex word to signal an object, and wake up all threads that may be interested in the change
+		// when threads are waiting for multiple objects, they cannot leave and delete the object until this function returns
+		template<typename F>
+		vuint32_t WaitablePublish(WaitableData* data, F&& update)
+		{
+			auto state = data->state.load();
+			while (!(state & WaitableRegistered))
+			{
+				if (data->state.compare_exchange_weak(state, update(state) & ~WaitableSleeping))
+				{
+					if (state & WaitableSleeping)
+					{
+						FutexWakeAll(data->state);
+					}
+					return state;
+				}
+			}
+
+			data->csRegistrations.Enter();
+			state = data->state.load();
+			while (!data->state.compare_exchange_weak(state, update(state) & ~WaitableSleeping));
+			if (state & WaitableSleeping)
+			{
+				FutexWakeAll(data->state);
+			}
+			WaitableWakeRegistrations(data);
+			data->csRegistrations.Leave();
+			return state;
+		}
+
+		// tryAcquire takes the signal according to the state, or returns false with the latest state if the object is not signaled
+		template<typename F>
+		bool WaitableSleep(WaitableData* data, vint ms, F&& tryAcquire)
+		{
+			vuint64_t deadline = 0;
+			auto state = data->state.load();
+			while (!tryAcquire(state))
+			{
+				if (ms == 0) return false;
+				if (!(state & WaitableSleeping))
+				{
+					if (!data->state.compare_exchange_weak(state, state | WaitableSleeping)) continue;
+					state |= WaitableSleeping;
+				}
+
+				vint remaining = -1;
+				if (ms > 0)
+				{
+					vuint64_t now = 0;
+					if (!GetWaitClock(now)) return false;
+					if (deadline == 0)
+					{
+						deadline = now + (vuint64_t)ms * 1000000;
+					}
+					else if (now >= deadline)
+					{
+						return false;
+					}
+					remaining = (vint)((deadline - now + 999999) / 1000000);
+				}
+				FutexWait(data->state, state, remaining);
+				state = data->state.load();
+			}
+			return true;
+		}
+
+		void WaitableRegister(WaitableRegistration& registration)
+		{
+			auto data = registration.data;
+			data->csRegistrations.Enter();
+			registration.next = data->registrations;
+			if (data->registrations)
+			{
+				data->registrations->previous = &registration;
+			}
+			else
+			{
+				data->state.fetch_or(WaitableRegistered);
+			}
+			data->registrations = &registration;
+			data->csRegistrations.Leave();
+		}
+
+		void WaitableUnregister(WaitableRegistration& registration)
+		{
+			auto data = registration.data;
+			data->csRegistrations.Enter();
+			if (registration.previous)
+			{
+				registration.previous->next = registration.next;
+			}
+			else
+			{
+				data->registrations = registration.next;
+			}
+			if (registration.next)
+			{
+				registration.next->previous = registration.previous;
+			}
+			if (!data->registrations)
+			{
+				data->state.fetch_and(~WaitableRegistered);
+			}
+			data->csRegistrations.Leave();
+		}
+	}
+
+	WaitableObject::WaitableObject()
+	{
+		waitableData = new WaitableData;
+	}
+
+	WaitableObject::~WaitableObject()
+	{
+		if (--waitableData->references == 0)
+		{
+			delete waitableData;
+		}
+	}
+
+	void WaitableObject::NotifyWaiters()
+	{
+		// pairs with the fence in WaitForObjects, so either the waiter sees the signal or the signal sees the waiter
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (!(waitableData->state.load(std::memory_order_relaxed) & WaitableRegistered)) return;
+
+		waitableData->csRegistrations.Enter();
+		WaitableWakeRegistrations(waitableData);
+		waitableData->csRegistrations.Leave();
+	}
+
+	void WaitableObject::SetSharedAcrossProcesses()
+	{
+		waitableData->sharedAcrossProcesses = true;
+	}
+
+	void WaitableObject::ShareWaitersWith(WaitableObject& object)
+	{
+		if (--waitableData->references == 0)
+		{
+			delete waitableData;
+		}
+		waitableData = object.waitableData;
+		waitableData->references++;
+	}
+
+	vint WaitableObject::WaitForObjects(WaitableObject** objects, vint count, bool waitAll, vint ms)
+	{
+#define ERROR_MESSAGE_PREFIX L"vl::WaitableObject::WaitForObjects(WaitableObject**, vint, bool, vint)#"
+		CHECK_ERROR(objects && count > 0, ERROR_MESSAGE_PREFIX L"There must be at least one object to wait for.");
+
+		// WaitAll takes signals in the order of addresses, so two WaitAll on overlapping objects do not keep giving back signals to each other
+		Array<WaitableObject*> sorted;
+		if (waitAll)
+		{
+			sorted.Resize(count);
+			for (vint i = 0; i < count; i++)
+			{
+				sorted[i] = objects[i];
+			}
+			Sort(&sorted[0], count, [](WaitableObject* a, WaitableObject* b) { return std::compare_three_way{}(a, b); });
+			for (vint i = 1; i < count; i++)
+			{
+				CHECK_ERROR(sorted[i - 1] != sorted[i], ERROR_MESSAGE_PREFIX L"An object could not be waited twice in WaitAll.");
+			}
+		}
+
+		vuint64_t deadline = 0;
+		if (ms > 0)
+		{
+			if (!GetWaitClock(deadline)) return -1;
+			deadline += (vuint64_t)ms * 1000000;
+		}
+
+		WaitableWaiter waiter;
+		Array<WaitableRegistration> registrations(count);
+		bool polling = false;
+		for (vint i = 0; i < count; i++)
+		{
+			auto& registration = registrations[i];
+			registration.waiter = &waiter;
+			registration.data = objects[i]->waitableData;
+			polling |= registration.data->sharedAcrossProcesses;
+			WaitableRegister(registration);
+		}
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		auto previousWaiter = waitableCurrentWaiter;
+		waitableCurrentWaiter = &waiter;
+		vint result = -1;
+		while (true)
+		{
+			waiter.cs.Enter();
+			auto version = waiter.version;
+			waiter.cs.Leave();
+
+			if (waitAll)
+			{
+				vint acquired = 0;
+				while (acquired < count && sorted[acquired]->TryAcquire())
+				{
+					acquired++;
+				}
+				if (acquired == count)
+				{
+					result = 0;
+					break;
+				}
+				while (acquired > 0)
+				{
+					sorted[--acquired]->UndoAcquire();
+				}
+			}
+			else
+			{
+				for (vint i = 0; i < count; i++)
+				{
+					if (objects[i]->TryAcquire())
+					{
+						result = i;
+						break;
+					}
+				}
+				if (result != -1) break;
+			}
+
+			vint remaining = -1;
+			if (ms == 0) break;
+			if (ms > 0)
+			{
+				vuint64_t now = 0;
+				if (!GetWaitClock(now) || now >= deadline) break;
+				remaining = (vint)((deadline - now + 999999) / 1000000);
+			}
+			if (polling && (remaining < 0 || remaining > WaitableSharedPollingInterval))
+			{
+				remaining = WaitableSharedPollingInterval;
+			}
+
+			waiter.cs.Enter();
+			while (waiter.version == version)
+			{
+				if (remaining < 0)
+				{
+					waiter.cv.SleepWith(waiter.cs);
+				}
+				else if (!waiter.cv.SleepWithForTime(waiter.cs, remaining))
+				{
+					break;
+				}
+			}
+			waiter.cs.Leave();
+		}
+		waitableCurrentWaiter = previousWaiter;
+
+		for (vint i = 0; i < count; i++)
+		{
+			WaitableUnregister(registrations[i]);
+		}
+		return result;
+#undef ERROR_MESSAGE_PREFIX
+	}
+
+	bool WaitableObject::WaitAll(WaitableObject** objects, vint count)
+	{
+		return WaitForObjects(objects, count, true, -1) != -1;
+	}
+
+	bool WaitableObject::WaitAllForTime(WaitableObject** objects, vint count, vint ms)
+	{
+		return WaitForObjects(objects, count, true, ms < 0 ? 0 : ms) != -1;
+	}
+
+	vint WaitableObject::WaitAny(WaitableObject** objects, vint count, bool* abandoned)
+	{
+		auto result = WaitForObjects(objects, count, false, -1);
+		if (result != -1)
+		{
+			*abandoned = false;
+		}
+		return result;
+	}
+
+	vint WaitableObject::WaitAnyForTime(WaitableObject** objects, vint count, vint ms, bool* abandoned)
+	{
+		auto result = WaitForObjects(objects, count, false, ms < 0 ? 0 : ms);
+		if (result != -1)
+		{
+			*abandoned = false;
+		}
+		return result;
+	}
+
 /***********************************************************************
 Thread
 ***********************************************************************/
@@ -36,8 +437,101 @@ Thread
 			pthread_t					id;
 			EventObject					ev;
 			bool						deleteAfterStopped = false;
+			ThreadStartOptions			options;
 		};
 
+		bool ThreadSetAttributes(pthread_attr_t& attr, const ThreadStartOptions& options)
+		{
+			if (options.stackSize > 0)
+			{
+				size_t stackSize = options.stackSize < PTHREAD_STACK_MIN ? PTHREAD_STACK_MIN : (size_t)options.stackSize;
+				if (pthread_attr_setstacksize(&attr, stackSize) != 0) return false;
+			}
+
+#if !defined VCZH_APPLE
+			if (options.affinityMask != 0)
+			{
+				cpu_set_t cpus;
+				CPU_ZERO(&cpus);
+				for (vint i = 0; i < 64; i++)
+				{
+					if (options.affinityMask & ((vuint64_t)1 << i))
+					{
+						CPU_SET(i, &cpus);
+					}
+				}
+				if (pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus) != 0) return false;
+			}
+#endif
+
+			// real-time policies are set here to fail the thread creation without privileges
+			// glibc does not accept other policies in attributes, they are set in ThreadApplyOptions
+			int policy = SCHED_OTHER;
+			sched_param param = {};
+			switch (options.policy)
+			{
+			case ThreadSchedulingPolicy::FIFO:
+				policy = SCHED_FIFO;
+				param.sched_priority = (int)options.priority;
+				break;
+			case ThreadSchedulingPolicy::RoundRobin:
+				policy = SCHED_RR;
+				param.sched_priority = (int)options.priority;
+				break;
+			default:
+				return true;
+			}
+
+			if (pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED) != 0) return false;
+			if (pthread_attr_setschedpolicy(&attr, policy) != 0) return false;
+			if (pthread_attr_setschedparam(&attr, &param) != 0) return false;
+			return true;
+		}
+
+		void ThreadApplyOptions(const ThreadStartOptions& options)
+		{
+			if (options.name.Length() > 0)
+			{
+				// the kernel limits a name to 15 bytes, do not cut a UTF-8 sequence in half
+				auto name = wtou8(options.name);
+				char buffer[16] = {};
+				vint length = name.Length() < 15 ? name.Length() : 15;
+				if (length < name.Length())
+				{
+					while (length > 0 && ((vuint8_t)name[length] & 0xC0) == 0x80)
+					{
+						length--;
+					}
+				}
+				memcpy(buffer, name.Buffer(), length);
+#if defined VCZH_APPLE
+				pthread_setname_np(buffer);
+#else
+				pthread_setname_np(pthread_self(), buffer);
+#endif
+			}
+
+#if !defined VCZH_APPLE
+			sched_param param = {};
+			switch (options.policy)
+			{
+			case ThreadSchedulingPolicy::Normal:
+				if (options.priority != 0)
+				{
+					setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), (int)options.priority);
+				}
+				break;
+			case ThreadSchedulingPolicy::Batch:
+				pthread_setschedparam(pthread_self(), SCHED_BATCH, &param);
+				break;
+			case ThreadSchedulingPolicy::Idle:
+				pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+				break;
+			default:;
+			}
+#endif
+		}
+
 		class ProceduredThread : public Thread
 		{
 		private:
@@ -80,6 +574,7 @@ Thread
 	void InternalThreadProc(Thread* thread)
 	{
 		auto deleteAfterStopped = thread->internalData->deleteAfterStopped;
+		ThreadApplyOptions(thread->internalData->options);
 		ThreadLocalStorage::FixStorages();
 		try
 		{
@@ -109,6 +604,7 @@ Thread
 	{
 		internalData=new ThreadData;
 		internalData->ev.CreateManualUnsignal(false);
+		ShareWaitersWith(internalData->ev);
 		threadState=Thread::NotStarted;
 	}
 
@@ -125,12 +621,12 @@ Thread
 		}
 	}
 
-	Thread* Thread::CreateAndStart(ThreadProcedure procedure, void* argument, bool deleteAfterStopped)
+	Thread* Thread::CreateAndStart(ThreadProcedure procedure, void* argument, bool deleteAfterStopped, const ThreadStartOptions& options)
 	{
 		if(procedure)
 		{
 			Thread* thread=new ProceduredThread(procedure, argument, deleteAfterStopped);
-			if(thread->Start())
+			if(thread->Start(options))
 			{
 				return thread;
 			}
@@ -142,10 +638,10 @@ Thread
 		return 0;
 	}
 
-	Thread* Thread::CreateAndStart(const Func<void()>& procedure, bool deleteAfterStopped)
+	Thread* Thread::CreateAndStart(const Func<void()>& procedure, bool deleteAfterStopped, const ThreadStartOptions& options)
 	{
 		Thread* thread=new LambdaThread(procedure, deleteAfterStopped);
-		if(thread->Start())
+		if(thread->Start(options))
 		{
 			return thread;
 		}
@@ -179,15 +675,33 @@ Thread
 	}
 
 	bool Thread::Start()
+	{
+		return Start(ThreadStartOptions());
+	}
+
+	bool Thread::Start(const ThreadStartOptions& options)
 	{
 		if(threadState==Thread::NotStarted)
 		{
-			threadState=Thread::Running;
-			if(pthread_create(&internalData->id, nullptr, &InternalThreadProcWrapper, this)==0)
+			pthread_attr_t attr;
+			if (pthread_attr_init(&attr) != 0) return false;
+
+			bool started = false;
+			if (ThreadSetAttributes(attr, options))
 			{
-				return true;
+				internalData->options = options;
+				threadState=Thread::Running;
+				if(pthread_create(&internalData->id, &attr, &InternalThreadProcWrapper, this)==0)
+				{
+					started = true;
+				}
+				else
+				{
+					threadState=Thread::NotStarted;
+				}
 			}
-			threadState=Thread::NotStarted;
+			pthread_attr_destroy(&attr);
+			return started;
 		}
 		return false;
 	}
@@ -197,6 +711,15 @@ Thread
 		return internalData->ev.Wait();
 	}
 
+	bool Thread::TryAcquire()
+	{
+		return internalData->ev.WaitForTime(0);
+	}
+
+	void Thread::UndoAcquire()
+	{
+	}
+
 	bool Thread::Stop()
 	{
 		if (threadState==Thread::Running)
@@ -231,6 +754,7 @@ Mutex
 	Mutex::Mutex()
 	{
 		internalData = new MutexData;
+		ShareWaitersWith(internalData->sem);
 	}
 
 	Mutex::~Mutex()
@@ -258,6 +782,16 @@ Mutex
 		return internalData->sem.Wait();
 	}
 
+	bool Mutex::TryAcquire()
+	{
+		return internalData->sem.TryAcquire();
+	}
+
+	void Mutex::UndoAcquire()
+	{
+		internalData->sem.Release();
+	}
+
 /***********************************************************************
 Semaphore
 ***********************************************************************/
@@ -266,16 +800,23 @@ Semaphore
 	{
 		struct SemaphoreData
 		{
-			sem_t			semUnnamed;
+			// an unnamed semaphore keeps its counter in WaitableData::state
 			sem_t*			semNamed = nullptr;
 		};
 
-#if defined VCZH_APPLE
-		void FailOnUnnamedSemaphore()
+		constexpr vuint32_t	SemaphoreCounter = 0x3FFFFFFF;
+
+		bool SemaphoreTryAcquire(WaitableData* data, vuint32_t& state)
 		{
-			CHECK_FAIL(L"vl::Semaphore::~Semaphore()#Unnamed semaphores are not supported on macOS.");
+			while (state & SemaphoreCounter)
+			{
+				if (data->state.compare_exchange_weak(state, state - 1))
+				{
+					return true;
+				}
+			}
+			return false;
 		}
-#endif
 	}
 
 	Semaphore::Semaphore()
@@ -291,14 +832,6 @@ Semaphore
 			{
 				sem_close(internalData->semNamed);
 			}
-			else
-			{
-#if defined VCZH_APPLE
-				threading_internal::FailOnUnnamedSemaphore();
-#else
-				sem_destroy(&internalData->semUnnamed);
-#endif
-			}
 			delete internalData;
 		}
 	}
@@ -307,56 +840,34 @@ Semaphore
 	{
 		if (internalData) return false;
 		if (initialCount > maxCount) return false;
+		if (initialCount < 0 || initialCount > (vint)SemaphoreCounter) return false;
 
 		internalData = new SemaphoreData;
-#if defined VCZH_APPLE
-
-		AString auuid;
-		if(name.Length() == 0)
+		if (name == L"")
 		{
-			CFUUIDRef cfuuid = CFUUIDCreate(kCFAllocatorDefault);
-			CFStringRef cfstr = CFUUIDCreateString(kCFAllocatorDefault, cfuuid);
-			auuid = CFStringGetCStringPtr(cfstr, kCFStringEncodingASCII);
+			waitableData->state.fetch_or((vuint32_t)initialCount);
+			return true;
+		}
 
-			CFRelease(cfstr);
-			CFRelease(cfuuid);
+#if defined VCZH_APPLE
+		// macOS limits the length of a semaphore name to 31 characters
+		AString aname = wtoa(name);
+		if (aname.Length() >= 30)
+		{
+			aname = aname.Sub(0, 30);
 		}
-		auuid = auuid.Insert(0, "/");
-		// OSX SEM_NAME_LENGTH = 31
-		if(auuid.Length() >= 30)
-			auuid = auuid.Sub(0, 30);
-        
-		if ((internalData->semNamed = sem_open(auuid.Buffer(), O_CREAT, O_RDWR, initialCount)) == SEM_FAILED)
+		aname = aname.Insert(0, "/");
+		if ((internalData->semNamed = sem_open(aname.Buffer(), O_CREAT, O_RDWR, initialCount)) == SEM_FAILED)
+#else
+		if ((internalData->semNamed = sem_open(wtoa(name).Buffer(), O_CREAT, 0777, initialCount)) == SEM_FAILED)
+#endif
 		{
 			delete internalData;
 			internalData = 0;
 			return false;
 		}
-        
-#else
-		if (name == L"")
-		{
-			if(sem_init(&internalData->semUnnamed, 0, (int)initialCount) == -1)
-			{
-				delete internalData;
-				internalData = 0;
-				return false;
-			}
-		}
-		else
-		{
-			AString astr = wtoa(name);
-
-			if ((internalData->semNamed = sem_open(astr.Buffer(), O_CREAT, 0777, initialCount)) == SEM_FAILED)
-			{
-				delete internalData;
-				internalData = 0;
-				return false;
-			}
-		}
-#endif
 
-		Release(initialCount);
+		SetSharedAcrossProcesses();
 		return true;
 	}
 
@@ -366,47 +877,85 @@ Semaphore
 		if (inheritable) return false;
 
 		internalData = new SemaphoreData;
-		if (!(internalData->semNamed = sem_open(wtoa(name).Buffer(), 0)))
+		if ((internalData->semNamed = sem_open(wtoa(name).Buffer(), 0)) == SEM_FAILED)
 		{
-            delete internalData;
-            internalData = 0;
+			delete internalData;
+			internalData = 0;
 			return false;
 		}
 
+		SetSharedAcrossProcesses();
 		return true;
 	}
 
 	bool Semaphore::Release()
 	{
-		return Release(1);
+		return Release(1) != -1;
 	}
 
 	vint Semaphore::Release(vint count)
 	{
-		for (vint i = 0; i < count; i++)
+#define ERROR_MESSAGE_PREFIX L"vl::Semaphore::Release(vint)#"
+		if (!internalData || count <= 0) return -1;
+
+		if (internalData->semNamed)
 		{
-			if (internalData->semNamed)
+			int previous = 0;
+			if (sem_getvalue(internalData->semNamed, &previous) != 0)
 			{
-				sem_post(internalData->semNamed);
+				previous = 0;
 			}
-			else
+			for (vint i = 0; i < count; i++)
 			{
-				sem_post(&internalData->semUnnamed);
+				if (sem_post(internalData->semNamed) != 0)
+				{
+					return -1;
+				}
 			}
+			NotifyWaiters();
+			return previous;
 		}
-		return true;
+
+		auto previous = WaitablePublish(waitableData, [=](vuint32_t state)
+		{
+			CHECK_ERROR((vint)(state & SemaphoreCounter) + count <= (vint)SemaphoreCounter, ERROR_MESSAGE_PREFIX L"The counter of the semaphore overflows.");
+			return state + (vuint32_t)count;
+		});
+		return (vint)(previous & SemaphoreCounter);
+#undef ERROR_MESSAGE_PREFIX
 	}
 
 	bool Semaphore::Wait()
 	{
+		if (!internalData) return false;
+
 		if (internalData->semNamed)
 		{
 			return sem_wait(internalData->semNamed) == 0;
 		}
-		else
+
+		return WaitableSleep(waitableData, -1, [this](vuint32_t& state)
 		{
-			return sem_wait(&internalData->semUnnamed) == 0;
+			return SemaphoreTryAcquire(waitableData, state);
+		});
+	}
+
+	bool Semaphore::TryAcquire()
+	{
+		if (!internalData) return false;
+
+		if (internalData->semNamed)
+		{
+			return sem_trywait(internalData->semNamed) == 0;
 		}
+
+		auto state = waitableData->state.load();
+		return SemaphoreTryAcquire(waitableData, state);
+	}
+
+	void Semaphore::UndoAcquire()
+	{
+		Release();
 	}
 
 /***********************************************************************
@@ -417,14 +966,39 @@ EventObject
 	{
 		struct EventData
 		{
+			// the event keeps its signal in WaitableData::state
 			bool				autoReset;
-			volatile bool		signaled;
-			CriticalSection		mutex;
-			ConditionVariable	cond;
-			atomic_vint			counter = 0;
-			vint				releasedWaiters = 0;
-			vuint64_t			signalVersion = 0;
 		};
+
+		constexpr vuint32_t		EventSignaled = 0x00000001;
+		// every Signal changes the generation, so a thread waiting for a manual unsignal event wakes up even when it is unsignaled immediately
+		constexpr vuint32_t		EventGeneration = 0x3FFFFFFE;
+
+		bool EventTryAcquire(WaitableData* data, bool autoReset, vuint32_t& state)
+		{
+			if (!autoReset)
+			{
+				return state & EventSignaled;
+			}
+
+			while (state & EventSignaled)
+			{
+				if (data->state.compare_exchange_weak(state, state & ~EventSignaled))
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+
+		bool EventWait(WaitableData* data, bool autoReset, vint ms)
+		{
+			auto generation = data->state.load() & EventGeneration;
+			return WaitableSleep(data, ms, [=](vuint32_t& state)
+			{
+				return EventTryAcquire(data, autoReset, state) || (!autoReset && (state & EventGeneration) != generation);
+			});
+		}
 	}
 
 	EventObject::EventObject()
@@ -447,7 +1021,10 @@ EventObject
 
 		internalData = new EventData;
 		internalData->autoReset = true;
-		internalData->signaled = signaled;
+		if (signaled)
+		{
+			waitableData->state.fetch_or(EventSignaled);
+		}
 		return true;
 	}
 
@@ -458,7 +1035,10 @@ EventObject
 
 		internalData = new EventData;
 		internalData->autoReset = false;
-		internalData->signaled = signaled;
+		if (signaled)
+		{
+			waitableData->state.fetch_or(EventSignaled);
+		}
 		return true;
 	}
 
@@ -466,29 +1046,10 @@ EventObject
 	{
 		if (!internalData) return false;
 
-		internalData->mutex.Enter();
-		if (internalData->autoReset)
-		{
-			if (internalData->counter > internalData->releasedWaiters)
-			{
-				internalData->releasedWaiters++;
-				internalData->cond.WakeOnePending();
-			}
-			else
-			{
-				internalData->signaled = true;
-			}
-		}
-		else
+		WaitablePublish(waitableData, [](vuint32_t state)
 		{
-			internalData->signaled = true;
-			internalData->signalVersion++;
-			if (internalData->counter)
-			{
-				internalData->cond.WakeAllPendings();
-			}
-		}
-		internalData->mutex.Leave();
+			return (state & ~EventGeneration) | ((state + 2) & EventGeneration) | EventSignaled;
+		});
 		return true;
 	}
 
@@ -496,9 +1057,7 @@ EventObject
 	{
 		if (!internalData) return false;
 
-		internalData->mutex.Enter();
-		internalData->signaled = false;
-		internalData->mutex.Leave();
+		waitableData->state.fetch_and(~EventSignaled);
 		return true;
 	}
 
@@ -506,241 +1065,776 @@ EventObject
 	{
 		if (!internalData) return false;
 
-		bool result = true;
-		internalData->mutex.Enter();
-		if (internalData->signaled)
+		if (!statistics)
 		{
-			if (internalData->autoReset)
+			return EventWait(waitableData, internalData->autoReset, -1);
+		}
+		auto startedTimestamp = GetStatisticsTimestamp();
+		auto result = EventWait(waitableData, internalData->autoReset, -1);
+		statistics->RecordWait(startedTimestamp, result);
+		return result;
+	}
+
+	bool EventObject::WaitForTime(vint ms)
+	{
+		if (!internalData) return false;
+
+		if (!statistics)
+		{
+			return EventWait(waitableData, internalData->autoReset, ms < 0 ? 0 : ms);
+		}
+		auto startedTimestamp = GetStatisticsTimestamp();
+		auto result = EventWait(waitableData, internalData->autoReset, ms < 0 ? 0 : ms);
+		statistics->RecordWait(startedTimestamp, result);
+		return result;
+	}
+
+	void EventObject::SetStatistics(WaitStatistics* _statistics)
+	{
+		statistics = _statistics;
+	}
+
+	bool EventObject::TryAcquire()
+	{
+		if (!internalData) return false;
+
+		auto state = waitableData->state.load();
+		return EventTryAcquire(waitableData, internalData->autoReset, state);
+	}
+
+	void EventObject::UndoAcquire()
+	{
+		if (internalData->autoReset)
+		{
+			Signal();
+		}
+	}
+
+/***********************************************************************
+ThreadPool
+***********************************************************************/
+
+	namespace threading_internal
+	{
+		struct ThreadPoolTask
+		{
+			InlineTask						task;
+			ThreadPoolTask*					next = nullptr;
+			TaskStatistics*					statistics = nullptr;
+			vuint64_t						queuedTimestamp = 0;
+		};
+
+		void ThreadPoolDeleteTasks(ThreadPoolTask* tasks)
+		{
+			while (tasks)
+			{
+				auto next = tasks->next;
+				delete tasks;
+				tasks = next;
+			}
+		}
+
+		/// <summary>
+		/// A fixed-capacity Chase-Lev work-stealing deque.
+		/// Only the owner worker calls Push and Pop, which never take a lock.
+		/// Any thread could call Steal to take the oldest task.
+		/// </summary>
+		class ThreadPoolDeque
+		{
+		public:
+			static constexpr vint			Capacity = 256;
+
+		private:
+			std::atomic<vint>				top = 0;
+			std::atomic<vint>				bottom = 0;
+			std::atomic<ThreadPoolTask*>	slots[Capacity];
+
+		public:
+			bool Push(ThreadPoolTask* task)
+			{
+				auto b = bottom.load(std::memory_order_relaxed);
+				auto t = top.load(std::memory_order_acquire);
+				if (b - t >= Capacity) return false;
+				slots[b % Capacity].store(task, std::memory_order_relaxed);
+				bottom.store(b + 1, std::memory_order_release);
+				return true;
+			}
+
+			ThreadPoolTask* Pop()
+			{
+				auto b = bottom.load(std::memory_order_relaxed) - 1;
+				bottom.store(b, std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_seq_cst);
+				auto t = top.load(std::memory_order_relaxed);
+				if (t > b)
+				{
+					bottom.store(b + 1, std::memory_order_relaxed);
+					return nullptr;
+				}
+
+				auto task = slots[b % Capacity].load(std::memory_order_relaxed);
+				if (t == b)
+				{
+					if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+					{
+						task = nullptr;
+					}
+					bottom.store(b + 1, std::memory_order_relaxed);
+				}
+				return task;
+			}
+
+			ThreadPoolTask* Steal()
+			{
+				while (true)
+				{
+					auto t = top.load(std::memory_order_acquire);
+					std::atomic_thread_fence(std::memory_order_seq_cst);
+					auto b = bottom.load(std::memory_order_acquire);
+					if (t >= b) return nullptr;
+
+					auto task = slots[t % Capacity].load(std::memory_order_relaxed);
+					if (top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+					{
+						return task;
+					}
+				}
+			}
+		};
+
+		/// <summary>
+		/// A worker slot. Slots are created with the pool and reused when a retired worker is spawned again,
+		/// so that tasks left in the inbox of a retired worker are still visible to stealers.
+		/// </summary>
+		struct ThreadPoolWorker
+		{
+			// a retiring slot could be taken back by a submitter before its thread exits
+			static constexpr vint			Free = 0;
+			static constexpr vint			Running = 1;
+			static constexpr vint			Retiring = 2;
+
+			ThreadPoolData*					pool = nullptr;
+			vint							index = -1;
+			atomic_vint						state = Free;
+			Thread*							thread = nullptr;
+			ThreadPoolDeque					deque;
+
+			// covers inboxBegin, inboxEnd
+			SpinLock						lockInbox;
+			std::atomic<ThreadPoolTask*>	inboxBegin = nullptr;
+			ThreadPoolTask*					inboxEnd = nullptr;
+
+			// recycled task nodes, only accessed by the thread occupying this slot
+			ThreadPoolTask*					freeTasks = nullptr;
+			vint							freeTaskCount = 0;
+
+			~ThreadPoolWorker()
+			{
+				ThreadPoolDeleteTasks(freeTasks);
+			}
+
+			void PushInbox(ThreadPoolTask* task)
+			{
+				SPIN_LOCK(lockInbox)
+				{
+					if (inboxEnd)
+					{
+						inboxEnd->next = task;
+					}
+					else
+					{
+						inboxBegin = task;
+					}
+					inboxEnd = task;
+				}
+			}
+
+			ThreadPoolTask* PopInbox()
+			{
+				if (!inboxBegin.load()) return nullptr;
+				ThreadPoolTask* task = nullptr;
+				SPIN_LOCK(lockInbox)
+				{
+					task = inboxBegin;
+					if (task)
+					{
+						inboxBegin = task->next;
+						if (!task->next)
+						{
+							inboxEnd = nullptr;
+						}
+						task->next = nullptr;
+					}
+				}
+				return task;
+			}
+		};
+
+		struct ThreadPoolData
+		{
+			vint							minWorkers = 0;
+			vint							maxWorkers = 0;
+			vint							idleTimeout = -1;
+			ThreadStartOptions				workerOptions;
+			Array<ThreadPoolWorker*>		workers;
+			atomic_vint						workerCount = 0;
+			atomic_vint						idleWorkers = 0;
+			atomic_vint						nextInbox = 0;
+			atomic_vint						submitters = 0;
+			std::atomic<bool>				stopping = false;
+			std::atomic<bool>				exiting = false;
+			std::atomic<TaskStatistics*>	statistics = nullptr;
+
+			// covers wakeTokens, runningThreads
+			CriticalSection					csIdle;
+			ConditionVariable				cvIdle;
+			ConditionVariable				cvExit;
+			vint							wakeTokens = 0;
+			vint							runningThreads = 0;
+
+			// covers freeTasks, freeTaskCount
+			SpinLock						lockFreeTasks;
+			ThreadPoolTask*					freeTasks = nullptr;
+			vint							freeTaskCount = 0;
+
+			~ThreadPoolData()
 			{
-				internalData->signaled = false;
+				for (auto worker : workers)
+				{
+					delete worker;
+				}
+				ThreadPoolDeleteTasks(freeTasks);
+			}
+		};
+
+		thread_local ThreadPoolWorker*		threadPoolCurrentWorker = nullptr;
+
+		// a worker keeps at most WorkerFreeTasks recycled nodes, and gives WorkerFreeTasks/2 back to the pool when it has more
+		// the pool keeps at most PoolFreeTasks recycled nodes for submitters outside of workers
+		constexpr vint						ThreadPoolWorkerFreeTasks = 256;
+		constexpr vint						ThreadPoolPoolFreeTasks = 4096;
+		constexpr vint						ThreadPoolRefillTasks = 32;
+
+		ThreadPoolTask* ThreadPoolAllocateTask(ThreadPoolData* data)
+		{
+			auto worker = threadPoolCurrentWorker;
+			if (worker && worker->pool == data)
+			{
+				if (!worker->freeTasks)
+				{
+					// take a batch from the pool to avoid taking the lock for every task
+					SPIN_LOCK(data->lockFreeTasks)
+					{
+						for (vint i = 0; i < ThreadPoolRefillTasks && data->freeTasks; i++)
+						{
+							auto task = data->freeTasks;
+							data->freeTasks = task->next;
+							data->freeTaskCount--;
+							task->next = worker->freeTasks;
+							worker->freeTasks = task;
+							worker->freeTaskCount++;
+						}
+					}
+				}
+				if (auto task = worker->freeTasks)
+				{
+					worker->freeTasks = task->next;
+					worker->freeTaskCount--;
+					task->next = nullptr;
+					return task;
+				}
+			}
+			else
+			{
+				ThreadPoolTask* task = nullptr;
+				SPIN_LOCK(data->lockFreeTasks)
+				{
+					task = data->freeTasks;
+					if (task)
+					{
+						data->freeTasks = task->next;
+						data->freeTaskCount--;
+					}
+				}
+				if (task)
+				{
+					task->next = nullptr;
+					return task;
+				}
 			}
+			return new ThreadPoolTask;
 		}
-		else
+
+		void ThreadPoolFreeTask(ThreadPoolData* data, ThreadPoolTask* task)
 		{
-			auto signalVersion = internalData->signalVersion;
-			INCRC(&internalData->counter);
-			while (internalData->autoReset
-				? internalData->releasedWaiters == 0
-				: !internalData->signaled && internalData->signalVersion == signalVersion)
+			task->task.Reset();
+			auto worker = threadPoolCurrentWorker;
+			if (worker && worker->pool == data)
 			{
-				if (!internalData->cond.SleepWith(internalData->mutex))
+				task->next = worker->freeTasks;
+				worker->freeTasks = task;
+				if (++worker->freeTaskCount <= ThreadPoolWorkerFreeTasks)
 				{
-					result = false;
-					break;
+					return;
+				}
+
+				// give half of the recycled nodes back to the pool, so that they are visible to submitters outside of workers
+				vint count = ThreadPoolWorkerFreeTasks / 2;
+				auto first = worker->freeTasks;
+				auto last = first;
+				for (vint i = 1; i < count; i++)
+				{
+					last = last->next;
+				}
+				worker->freeTasks = last->next;
+				worker->freeTaskCount -= count;
+
+				SPIN_LOCK(data->lockFreeTasks)
+				{
+					if (data->freeTaskCount < ThreadPoolPoolFreeTasks)
+					{
+						last->next = data->freeTasks;
+						data->freeTasks = first;
+						data->freeTaskCount += count;
+						first = nullptr;
+					}
+				}
+				if (first)
+				{
+					last->next = nullptr;
+					ThreadPoolDeleteTasks(first);
 				}
 			}
-			if (result && internalData->autoReset)
+			else
 			{
-				internalData->releasedWaiters--;
+				task->next = nullptr;
+				SPIN_LOCK(data->lockFreeTasks)
+				{
+					if (data->freeTaskCount < ThreadPoolPoolFreeTasks)
+					{
+						task->next = data->freeTasks;
+						data->freeTasks = task;
+						data->freeTaskCount++;
+						task = nullptr;
+					}
+				}
+				delete task;
 			}
-			DECRC(&internalData->counter);
 		}
-		internalData->mutex.Leave();
-		return result;
-	}
-
-	bool EventObject::WaitForTime(vint ms)
-	{
-		if (!internalData) return false;
 
-		bool result = true;
-		internalData->mutex.Enter();
-		if (internalData->signaled)
+		void ThreadPoolRelease(ThreadPoolData* data, vint count)
 		{
-			if (internalData->autoReset)
+			CS_LOCK(data->csIdle)
 			{
-				internalData->signaled = false;
+				data->wakeTokens += count;
 			}
-		}
-		else
-		{
-			auto signalVersion = internalData->signalVersion;
-			timespec now;
-#if defined VCZH_APPLE
-			constexpr auto waitClock = CLOCK_REALTIME;
-#else
-			constexpr auto waitClock = CLOCK_MONOTONIC;
-#endif
-			if (ms <= 0 || clock_gettime(waitClock, &now) != 0)
+			if (count == 1)
 			{
-				internalData->mutex.Leave();
-				return false;
+				data->cvIdle.WakeOnePending();
 			}
-			auto deadline = (vuint64_t)now.tv_sec * 1000000000 + now.tv_nsec + (vuint64_t)ms * 1000000;
-			auto remaining = ms;
-			INCRC(&internalData->counter);
-			while (internalData->autoReset
-				? internalData->releasedWaiters == 0
-				: !internalData->signaled && internalData->signalVersion == signalVersion)
+			else
 			{
-				if (!internalData->cond.SleepWithForTime(internalData->mutex, remaining))
-				{
-					result = false;
-					break;
-				}
-				if (clock_gettime(waitClock, &now) != 0)
+				data->cvIdle.WakeAllPendings();
+			}
+		}
+
+		bool ThreadPoolPark(ThreadPoolData* data, vint ms)
+		{
+			bool woken = true;
+			CS_LOCK(data->csIdle)
+			{
+				while (data->wakeTokens == 0)
 				{
-					result = false;
-					break;
+					if (ms < 0)
+					{
+						data->cvIdle.SleepWith(data->csIdle);
+					}
+					else if (!data->cvIdle.SleepWithForTime(data->csIdle, ms) && data->wakeTokens == 0)
+					{
+						woken = false;
+						break;
+					}
 				}
-				auto current = (vuint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
-				if (current >= deadline)
+				if (woken)
 				{
-					result = false;
-					break;
+					data->wakeTokens--;
 				}
-				remaining = (vint)((deadline - current + 999999) / 1000000);
 			}
-			if (internalData->autoReset && internalData->releasedWaiters > 0)
+			return woken;
+		}
+
+		bool ThreadPoolWithdrawIdle(ThreadPoolData* data)
+		{
+			// returns false if a submitter has already taken the claim, and a wake up token is on the way
+			auto idle = data->idleWorkers.load();
+			while (idle > 0)
 			{
-				internalData->releasedWaiters--;
-				result = true;
+				if (data->idleWorkers.compare_exchange_weak(idle, idle - 1))
+				{
+					return true;
+				}
 			}
-			else if (!internalData->autoReset && (internalData->signaled || internalData->signalVersion != signalVersion))
+			return false;
+		}
+
+		bool ThreadPoolRetire(ThreadPoolWorker* worker)
+		{
+			auto data = worker->pool;
+			auto count = data->workerCount.load();
+			while (count > data->minWorkers)
 			{
-				result = true;
+				if (data->workerCount.compare_exchange_weak(count, count - 1))
+				{
+					worker->state = ThreadPoolWorker::Retiring;
+					return true;
+				}
 			}
-			DECRC(&internalData->counter);
+			return false;
 		}
-		internalData->mutex.Leave();
-		return result;
-	}
-
-/***********************************************************************
-ThreadPoolLite
-***********************************************************************/
 
-	namespace threading_internal
-	{
-		struct ThreadPoolTask
+		bool ThreadPoolLeave(ThreadPoolWorker* worker)
 		{
-			Func<void()>			task;
-			Ptr<ThreadPoolTask>		next;
-		};
+			// returns false if a submitter has taken the slot back, the worker keeps running without exiting its thread
+			vint expected = ThreadPoolWorker::Retiring;
+			return worker->state.compare_exchange_strong(expected, ThreadPoolWorker::Free);
+		}
 
-		struct ThreadPoolData
+		ThreadPoolTask* ThreadPoolFindTask(ThreadPoolWorker* worker)
 		{
-			Semaphore				semaphore;
-			EventObject				taskFinishEvent;
-			Ptr<ThreadPoolTask>		taskBegin;
-			Ptr<ThreadPoolTask>*	taskEnd = nullptr;
-			volatile bool			stopping = false;
-			List<Thread*>			taskThreads;
-		};
+			if (auto task = worker->deque.Pop()) return task;
+			if (auto task = worker->PopInbox()) return task;
 
-		SpinLock					threadPoolLock;
-		ThreadPoolData*				threadPoolData = nullptr;
+			auto&& workers = worker->pool->workers;
+			for (vint i = 1; i < workers.Count(); i++)
+			{
+				auto victim = workers[(worker->index + i) % workers.Count()];
+				if (auto task = victim->deque.Steal()) return task;
+				if (auto task = victim->PopInbox()) return task;
+			}
+			return nullptr;
+		}
 
 		void ThreadPoolProc(Thread* thread, void* argument)
 		{
+			auto worker = (ThreadPoolWorker*)argument;
+			auto data = worker->pool;
+			threadPoolCurrentWorker = worker;
+
 			while (true)
 			{
-				Ptr<ThreadPoolTask> task;
-
-				threadPoolData->semaphore.Wait();
-				SPIN_LOCK(threadPoolLock)
+				auto task = ThreadPoolFindTask(worker);
+				if (!task)
 				{
-					if (threadPoolData->taskBegin)
+					if (data->exiting)
 					{
-						task = threadPoolData->taskBegin;
-						threadPoolData->taskBegin = task->next;
+						worker->state = ThreadPoolWorker::Free;
+						break;
 					}
 
-					if (!threadPoolData->taskBegin)
+					// claim to be idle and check again, a submitter either sees the claim or the task is visible here
+					INCRC(&data->idleWorkers);
+					task = ThreadPoolFindTask(worker);
+					if (task || data->exiting)
 					{
-						threadPoolData->taskEnd = &threadPoolData->taskBegin;
-						threadPoolData->taskFinishEvent.Signal();
+						if (!ThreadPoolWithdrawIdle(data))
+						{
+							ThreadPoolPark(data, -1);
+						}
+					}
+					else if (!ThreadPoolPark(data, data->idleTimeout))
+					{
+						if (!ThreadPoolWithdrawIdle(data))
+						{
+							ThreadPoolPark(data, -1);
+						}
+						else if (ThreadPoolRetire(worker))
+						{
+							// a submitter that missed the idle claim either takes this slot back or leaves a task visible here
+							task = ThreadPoolFindTask(worker);
+							if (task)
+							{
+								vint expected = ThreadPoolWorker::Retiring;
+								if (worker->state.compare_exchange_strong(expected, ThreadPoolWorker::Running))
+								{
+									INCRC(&data->workerCount);
+								}
+							}
+							else if (ThreadPoolLeave(worker))
+							{
+								break;
+							}
+						}
 					}
 				}
 
 				if (task)
 				{
+					auto statistics = task->statistics;
+					vuint64_t startedTimestamp = 0;
+					if (statistics)
+					{
+						startedTimestamp = statistics->RecordStarted(task->queuedTimestamp);
+					}
+
 					ThreadLocalStorage::FixStorages();
 					try
 					{
 						task->task();
+						task->task.Reset();
 						ThreadLocalStorage::ClearStorages();
 					}
 					catch (...)
 					{
+						task->task.Reset();
 						ThreadLocalStorage::ClearStorages();
 					}
+					if (statistics)
+					{
+						statistics->RecordCompleted(startedTimestamp);
+					}
+					ThreadPoolFreeTask(data, task);
 				}
-				else if (threadPoolData->stopping)
+			}
+
+			// the slot has been released, it could be taken by a new worker immediately
+			threadPoolCurrentWorker = nullptr;
+			CS_LOCK(data->csIdle)
+			{
+				if (--data->runningThreads == 0)
 				{
-					return;
+					data->cvExit.WakeAllPendings();
 				}
 			}
 		}
 
-		bool ThreadPoolQueue(const Func<void()>& proc)
+		bool ThreadPoolSpawn(ThreadPoolData* data)
 		{
-			SPIN_LOCK(threadPoolLock)
+			// when every slot is running, the pool is full and all workers will see the task before parking or retiring
+			for (auto worker : data->workers)
 			{
-				if (!threadPoolData)
+				vint expected = ThreadPoolWorker::Retiring;
+				if (worker->state.compare_exchange_strong(expected, ThreadPoolWorker::Running))
 				{
-					threadPoolData = new ThreadPoolData;
-					threadPoolData->semaphore.Create(0, 65536);
-					threadPoolData->taskFinishEvent.CreateManualUnsignal(false);
-					threadPoolData->taskEnd = &threadPoolData->taskBegin;
-
-					for (vint i = 0; i < Thread::GetCPUCount() * 4; i++)
-					{
-						threadPoolData->taskThreads.Add(Thread::CreateAndStart(&ThreadPoolProc, nullptr, false));
-					}
+					// the retiring thread has not exited, it keeps running in this slot
+					INCRC(&data->workerCount);
+					return true;
 				}
+			}
 
-				if (threadPoolData)
+			for (auto worker : data->workers)
+			{
+				vint expected = ThreadPoolWorker::Free;
+				if (worker->state.compare_exchange_strong(expected, ThreadPoolWorker::Running))
 				{
-					if (threadPoolData->stopping)
+					INCRC(&data->workerCount);
+					if (worker->thread)
 					{
-						return false;
+						// the previous thread has released the slot, it is only returning from ThreadPoolProc
+						worker->thread->Wait();
+						delete worker->thread;
+					}
+					CS_LOCK(data->csIdle)
+					{
+						data->runningThreads++;
 					}
+					worker->thread = Thread::CreateAndStart(&ThreadPoolProc, worker, false, data->workerOptions);
+					CHECK_ERROR(worker->thread, L"vl::ThreadPool::Queue(const Func<void()>&)#Failed to create a worker thread.");
+					return true;
+				}
+			}
+			return false;
+		}
 
-					auto task = Ptr(new ThreadPoolTask);
-					task->task = proc;
-					*threadPoolData->taskEnd = task;
-					threadPoolData->taskEnd = &task->next;
-					threadPoolData->semaphore.Release();
-					threadPoolData->taskFinishEvent.Unsignal();
+		void ThreadPoolWakeOne(ThreadPoolData* data)
+		{
+			// only release a wake up token when there is a worker that has claimed to be idle
+			auto idle = data->idleWorkers.load();
+			while (idle > 0)
+			{
+				if (data->idleWorkers.compare_exchange_weak(idle, idle - 1))
+				{
+					ThreadPoolRelease(data, 1);
+					return;
 				}
 			}
-			return true;
+			ThreadPoolSpawn(data);
+		}
+
+		void ThreadPoolWaitForSubmitters(atomic_vint& submitters)
+		{
+			// submitters only touch the pool for a few instructions, this only happens during stopping
+			while (submitters.load() != 0)
+			{
+				sched_yield();
+			}
+		}
+	}
+
+	ThreadPool::ThreadPool(const ThreadPoolConfig& config)
+	{
+#define ERROR_MESSAGE_PREFIX L"vl::ThreadPool::ThreadPool(const ThreadPoolConfig&)#"
+		auto maxWorkers = config.maxWorkers == -1 ? Thread::GetCPUCount() * 4 : config.maxWorkers;
+		CHECK_ERROR(maxWorkers > 0, ERROR_MESSAGE_PREFIX L"maxWorkers must be positive or -1.");
+		CHECK_ERROR(0 <= config.minWorkers && config.minWorkers <= maxWorkers, ERROR_MESSAGE_PREFIX L"minWorkers must be in [0, maxWorkers].");
+		CHECK_ERROR(config.idleTimeout == -1 || config.idleTimeout > 0, ERROR_MESSAGE_PREFIX L"idleTimeout must be positive or -1.");
+#undef ERROR_MESSAGE_PREFIX
+
+		internalData = new ThreadPoolData;
+		internalData->minWorkers = config.minWorkers;
+		internalData->maxWorkers = maxWorkers;
+		internalData->idleTimeout = config.idleTimeout;
+		internalData->workerOptions = config.workerOptions;
+		internalData->workers.Resize(maxWorkers);
+		for (vint i = 0; i < maxWorkers; i++)
+		{
+			auto worker = new ThreadPoolWorker;
+			worker->pool = internalData;
+			worker->index = i;
+			internalData->workers[i] = worker;
 		}
 
-		bool ThreadPoolStop(bool discardPendingTasks)
+		if (config.warmUp)
+		{
+			for (vint i = 0; i < config.minWorkers; i++)
+			{
+				ThreadPoolSpawn(internalData);
+			}
+		}
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		Stop(false);
+		delete internalData;
+	}
+
+	bool ThreadPool::Queue(void(*proc)(void*), void* argument)
+	{
+		return Queue(InlineTask(proc, argument));
+	}
+
+	bool ThreadPool::Queue(const Func<void()>& proc)
+	{
+		return Queue(InlineTask(proc));
+	}
+
+	bool ThreadPool::Queue(InlineTask&& task)
+	{
+		INCRC(&internalData->submitters);
+		bool queued = false;
+		if (!internalData->stopping)
 		{
-			SPIN_LOCK(threadPoolLock)
+			auto node = ThreadPoolAllocateTask(internalData);
+			node->task = std::move(task);
+			node->statistics = internalData->statistics.load(std::memory_order_relaxed);
+			if (node->statistics)
+			{
+				node->queuedTimestamp = node->statistics->RecordQueued();
+			}
+
+			auto worker = threadPoolCurrentWorker;
+			if (!worker || worker->pool != internalData || !worker->deque.Push(node))
 			{
-				if (!threadPoolData) return false;
-				if (threadPoolData->stopping) return false;
+				auto index = (vuint)INCRC(&internalData->nextInbox) % (vuint)internalData->workers.Count();
+				internalData->workers[(vint)index]->PushInbox(node);
+			}
+			ThreadPoolWakeOne(internalData);
+			queued = true;
+		}
+		DECRC(&internalData->submitters);
+		return queued;
+	}
+
+	void ThreadPool::SetStatistics(TaskStatistics* statistics)
+	{
+		internalData->statistics = statistics;
+	}
+
+	vint ThreadPool::GetWorkerCount()
+	{
+		return internalData->workerCount;
+	}
+
+	bool ThreadPool::Stop(bool discardPendingTasks)
+	{
+		bool expected = false;
+		if (!internalData->stopping.compare_exchange_strong(expected, true))
+		{
+			return false;
+		}
 
-				threadPoolData->stopping = true;
-				if (discardPendingTasks)
+		// after all current submitters leave, no more task could be queued to this pool
+		ThreadPoolWaitForSubmitters(internalData->submitters);
+		if (discardPendingTasks)
+		{
+			for (auto worker : internalData->workers)
+			{
+				while (auto task = worker->deque.Steal())
 				{
-					threadPoolData->taskEnd = &threadPoolData->taskBegin;
-					threadPoolData->taskBegin = nullptr;
+					ThreadPoolFreeTask(internalData, task);
+				}
+				while (auto task = worker->PopInbox())
+				{
+					ThreadPoolFreeTask(internalData, task);
 				}
-
-				threadPoolData->semaphore.Release(threadPoolData->taskThreads.Count());
 			}
+		}
 
-			threadPoolData->taskFinishEvent.Wait();
-			// TODO: (enumerable) foreach
-			for (vint i = 0; i < threadPoolData->taskThreads.Count(); i++)
+		internalData->exiting = true;
+		ThreadPoolRelease(internalData, internalData->maxWorkers);
+		CS_LOCK(internalData->csIdle)
+		{
+			while (internalData->runningThreads > 0)
 			{
-				auto thread = threadPoolData->taskThreads[i];
-				thread->Wait();
-				delete thread;
+				internalData->cvExit.SleepWith(internalData->csIdle);
+			}
+		}
+		for (auto worker : internalData->workers)
+		{
+			if (worker->thread)
+			{
+				worker->thread->Wait();
+				delete worker->thread;
+				worker->thread = nullptr;
 			}
-			threadPoolData->taskThreads.Clear();
+		}
+		return true;
+	}
+
+/***********************************************************************
+ThreadPoolLite
+***********************************************************************/
+
+	namespace threading_internal
+	{
+		// covers threadPoolConfig, threadPoolStatistics, threadPoolStopping and the creation of threadPoolDefault
+		SpinLock							threadPoolLock;
+		ThreadPoolConfig*					threadPoolConfig = nullptr;
+		TaskStatistics*						threadPoolStatistics = nullptr;
+		bool								threadPoolStopping = false;
+		std::atomic<ThreadPool*>			threadPoolDefault = nullptr;
+		atomic_vint							threadPoolSubmitters = 0;
 
-			SPIN_LOCK(threadPoolLock)
+		bool ThreadPoolQueue(InlineTask&& task)
+		{
+			INCRC(&threadPoolSubmitters);
+			auto pool = threadPoolDefault.load();
+			if (!pool)
 			{
-				delete threadPoolData;
-				threadPoolData = nullptr;
+				SPIN_LOCK(threadPoolLock)
+				{
+					pool = threadPoolDefault.load();
+					if (!pool)
+					{
+						pool = threadPoolConfig ? new ThreadPool(*threadPoolConfig) : new ThreadPool;
+						pool->SetStatistics(threadPoolStatistics);
+						threadPoolDefault = pool;
+					}
+				}
 			}
-			return true;
+			auto queued = pool->Queue(std::move(task));
+			DECRC(&threadPoolSubmitters);
+			return queued;
 		}
 	}
 
@@ -754,17 +1848,103 @@ ThreadPoolLite
 
 	bool ThreadPoolLite::Queue(void(*proc)(void*), void* argument)
 	{
-		return ThreadPoolQueue([proc, argument](){proc(argument);});
+		return ThreadPoolQueue(InlineTask(proc, argument));
 	}
 
 	bool ThreadPoolLite::Queue(const Func<void()>& proc)
 	{
-		return ThreadPoolQueue(proc);
+		return ThreadPoolQueue(InlineTask(proc));
+	}
+
+	bool ThreadPoolLite::Queue(InlineTask&& task)
+	{
+		return ThreadPoolQueue(std::move(task));
+	}
+
+	bool ThreadPoolLite::Configure(const ThreadPoolConfig& config)
+	{
+		SPIN_LOCK(threadPoolLock)
+		{
+			if (threadPoolDefault.load()) return false;
+			if (!threadPoolConfig)
+			{
+				threadPoolConfig = new ThreadPoolConfig;
+			}
+			*threadPoolConfig = config;
+			if (config.warmUp)
+			{
+				auto pool = new ThreadPool(config);
+				pool->SetStatistics(threadPoolStatistics);
+				threadPoolDefault = pool;
+			}
+		}
+		return true;
+	}
+
+	void ThreadPoolLite::SetStatistics(TaskStatistics* statistics)
+	{
+		SPIN_LOCK(threadPoolLock)
+		{
+			threadPoolStatistics = statistics;
+			if (auto pool = threadPoolDefault.load())
+			{
+				pool->SetStatistics(statistics);
+			}
+		}
 	}
 
 	bool ThreadPoolLite::Stop(bool discardPendingTasks)
 	{
-		return ThreadPoolStop(discardPendingTasks);
+		ThreadPool* pool = nullptr;
+		SPIN_LOCK(threadPoolLock)
+		{
+			pool = threadPoolDefault.load();
+			if (!pool || threadPoolStopping) return false;
+			threadPoolStopping = true;
+		}
+		pool->Stop(discardPendingTasks);
+
+		// the next call to Queue creates a new default thread pool
+		SPIN_LOCK(threadPoolLock)
+		{
+			threadPoolDefault = nullptr;
+			threadPoolStopping = false;
+		}
+		ThreadPoolWaitForSubmitters(threadPoolSubmitters);
+		delete pool;
+		return true;
+	}
+
+/***********************************************************************
+SpinLock
+***********************************************************************/
+
+	namespace threading_internal
+	{
+		void SpinLockPark(std::atomic<vuint32_t>& token, vuint32_t expected)
+		{
+			FutexWait(token, expected, -1);
+		}
+
+		void SpinLockUnpark(std::atomic<vuint32_t>& token)
+		{
+#if defined VCZH_APPLE
+			// UL_COMPARE_AND_WAIT
+			__ulock_wake(1, &token, 0);
+#else
+			syscall(SYS_futex, &token, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+#endif
+		}
+
+		void SpinLockUnparkAll(std::atomic<vuint32_t>& token)
+		{
+			FutexWakeAll(token);
+		}
+
+		void ChannelPark(std::atomic<vuint32_t>& version, vuint32_t expected, vint ms)
+		{
+			FutexWait(version, expected, ms);
+		}
 	}
 
 /***********************************************************************
@@ -941,7 +2121,14 @@ ConditionVariable
 
 	bool ConditionVariable::SleepWith(CriticalSection& cs)
 	{
-		return pthread_cond_wait(&internalData->cond, &cs.internalData->mutex) == 0;
+		if (!statistics)
+		{
+			return pthread_cond_wait(&internalData->cond, &cs.internalData->mutex) == 0;
+		}
+		auto startedTimestamp = GetStatisticsTimestamp();
+		auto result = pthread_cond_wait(&internalData->cond, &cs.internalData->mutex) == 0;
+		statistics->RecordWait(startedTimestamp, result);
+		return result;
 	}
 
 	bool ConditionVariable::SleepWithForTime(CriticalSection& cs, vint ms)
@@ -972,7 +2159,19 @@ ConditionVariable
 			timeout.tv_nsec += 1000000000;
 		}
 
-		return pthread_cond_timedwait(&internalData->cond, &cs.internalData->mutex, &timeout) == 0;
+		if (!statistics)
+		{
+			return pthread_cond_timedwait(&internalData->cond, &cs.internalData->mutex, &timeout) == 0;
+		}
+		auto startedTimestamp = GetStatisticsTimestamp();
+		auto result = pthread_cond_timedwait(&internalData->cond, &cs.internalData->mutex, &timeout) == 0;
+		statistics->RecordWait(startedTimestamp, result);
+		return result;
+	}
+
+	void ConditionVariable::SetStatistics(WaitStatistics* _statistics)
+	{
+		statistics = _statistics;
 	}
 
 	void ConditionVariable::WakeOnePending()
@@ -984,38 +2183,4 @@ ConditionVariable
 	{
 		pthread_cond_broadcast(&internalData->cond);
 	}
-
-/***********************************************************************
-ThreadLocalStorage
-***********************************************************************/
-
-#define KEY ((pthread_key_t&)key)
-
-	ThreadLocalStorage::ThreadLocalStorage(Destructor _destructor)
-		:destructor(_destructor)
-	{
-		static_assert(sizeof(key) >= sizeof(pthread_key_t), "ThreadLocalStorage's key storage is not large enouth.");
-		PushStorage(this);
-		auto error = pthread_key_create(&KEY, destructor);
-		CHECK_ERROR(error != EAGAIN && error != ENOMEM, L"vl::ThreadLocalStorage::ThreadLocalStorage()#Failed to create a thread local storage index.");
-	}
-
-	ThreadLocalStorage::~ThreadLocalStorage()
-	{
-		pthread_key_delete(KEY);
-	}
-
-	void* ThreadLocalStorage::Get()
-	{
-		CHECK_ERROR(!disposed, L"vl::ThreadLocalStorage::Get()#Cannot access a disposed ThreadLocalStorage.");
-		return pthread_getspecific(KEY);
-	}
-
-	void ThreadLocalStorage::Set(void* data)
-	{
-		CHECK_ERROR(!disposed, L"vl::ThreadLocalStorage::Set()#Cannot access a disposed ThreadLocalStorage.");
-		pthread_setspecific(KEY, data);
-	}
-
-#undef KEY
 }
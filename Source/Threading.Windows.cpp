@@ -6,6 +6,7 @@ Licensed under https://github.com/vczh-libraries/License
 #include "Threading.h"
 #define _WINSOCKAPI_
 #include <Windows.h>
+#pragma comment(lib, "Synchronization.lib")
 
 #ifndef VCZH_MSVC
 static_assert(false, "Do not build this file for non-Windows applications.");
@@ -255,12 +256,12 @@ Thread
 		}
 	}
 
-	Thread* Thread::CreateAndStart(ThreadProcedure procedure, void* argument, bool deleteAfterStopped)
+	Thread* Thread::CreateAndStart(ThreadProcedure procedure, void* argument, bool deleteAfterStopped, const ThreadStartOptions& options)
 	{
 		if(procedure)
 		{
 			Thread* thread=new ProceduredThread(procedure, argument, deleteAfterStopped);
-			if(thread->Start())
+			if(thread->Start(options))
 			{
 				return thread;
 			}
@@ -272,10 +273,10 @@ Thread
 		return 0;
 	}
 
-	Thread* Thread::CreateAndStart(const Func<void()>& procedure, bool deleteAfterStopped)
+	Thread* Thread::CreateAndStart(const Func<void()>& procedure, bool deleteAfterStopped, const ThreadStartOptions& options)
 	{
 		Thread* thread=new LambdaThread(procedure, deleteAfterStopped);
-		if(thread->Start())
+		if(thread->Start(options))
 		{
 			return thread;
 		}
@@ -305,9 +306,55 @@ Thread
 	}
 
 	bool Thread::Start()
+	{
+		return Start(ThreadStartOptions());
+	}
+
+	bool Thread::Start(const ThreadStartOptions& options)
 	{
 		if(threadState==Thread::NotStarted && internalData->handle!=NULL)
 		{
+			if (options.stackSize > 0)
+			{
+				// the stack size can only be specified when creating the thread, replace the suspended thread
+				HANDLE handle = CreateThread(NULL, (SIZE_T)options.stackSize, InternalThreadProcWrapper, this, CREATE_SUSPENDED | STACK_SIZE_PARAM_IS_A_RESERVATION, &internalData->id);
+				if (handle == NULL) return false;
+				TerminateThread(internalData->handle, 0);
+				CloseHandle(internalData->handle);
+				internalData->handle = handle;
+			}
+
+			if (options.affinityMask != 0)
+			{
+				if (SetThreadAffinityMask(internalData->handle, (DWORD_PTR)options.affinityMask) == 0) return false;
+			}
+
+			int priority = THREAD_PRIORITY_NORMAL;
+			switch (options.policy)
+			{
+			case ThreadSchedulingPolicy::Batch:
+				priority = THREAD_PRIORITY_BELOW_NORMAL;
+				break;
+			case ThreadSchedulingPolicy::Idle:
+				priority = THREAD_PRIORITY_IDLE;
+				break;
+			case ThreadSchedulingPolicy::FIFO:
+			case ThreadSchedulingPolicy::RoundRobin:
+				priority = THREAD_PRIORITY_TIME_CRITICAL;
+				break;
+			default:
+				priority = (int)(options.priority < -2 ? -2 : options.priority > 2 ? 2 : options.priority);
+			}
+			if (priority != THREAD_PRIORITY_NORMAL)
+			{
+				if (!SetThreadPriority(internalData->handle, priority)) return false;
+			}
+
+			if (options.name.Length() > 0)
+			{
+				SetThreadDescription(internalData->handle, options.name.Buffer());
+			}
+
 			if(ResumeThread(internalData->handle)!=-1)
 			{
 				threadState=Thread::Running;
@@ -572,23 +619,78 @@ EventObject
 		return false;
 	}
 
+	bool EventObject::Wait()
+	{
+		return WaitForTime(INFINITE);
+	}
+
+	bool EventObject::WaitForTime(vint ms)
+	{
+		if (!statistics)
+		{
+			return WaitableObject::WaitForTime(ms);
+		}
+		auto startedTimestamp = GetStatisticsTimestamp();
+		auto result = WaitableObject::WaitForTime(ms);
+		statistics->RecordWait(startedTimestamp, result);
+		return result;
+	}
+
+	void EventObject::SetStatistics(WaitStatistics* _statistics)
+	{
+		statistics = _statistics;
+	}
+
 /***********************************************************************
 ThreadPoolLite
 ***********************************************************************/
 
+	namespace threading_internal
+	{
+		struct ThreadPoolItem
+		{
+			InlineTask						task;
+			TaskStatistics*					statistics = nullptr;
+			vuint64_t						queuedTimestamp = 0;
+
+			ThreadPoolItem(InlineTask&& _task, TaskStatistics* _statistics)
+				:task(std::move(_task))
+				, statistics(_statistics)
+			{
+				if (statistics)
+				{
+					queuedTimestamp = statistics->RecordQueued();
+				}
+			}
+		};
+
+		std::atomic<TaskStatistics*>		threadPoolStatistics = nullptr;
+	}
+
 		DWORD WINAPI ThreadPoolQueueFunc(void* argument)
 		{
-			auto proc=Ptr((Func<void()>*)argument);
+			auto item=Ptr((ThreadPoolItem*)argument);
+			vuint64_t startedTimestamp = 0;
+			if (item->statistics)
+			{
+				startedTimestamp = item->statistics->RecordStarted(item->queuedTimestamp);
+			}
+
 			ThreadLocalStorage::FixStorages();
 			try
 			{
-				(*proc.Obj())();
+				item->task();
 				ThreadLocalStorage::ClearStorages();
 			}
 			catch (...)
 			{
 				ThreadLocalStorage::ClearStorages();
 			}
+
+			if (item->statistics)
+			{
+				item->statistics->RecordCompleted(startedTimestamp);
+			}
 			return 0;
 		}
 
@@ -602,12 +704,18 @@ ThreadPoolLite
 
 		bool ThreadPoolLite::Queue(void(*proc)(void*), void* argument)
 		{
-			return Queue([=]() {proc(argument); });
+			return Queue(InlineTask(proc, argument));
 		}
 
 		bool ThreadPoolLite::Queue(const Func<void()>& proc)
 		{
-			Func<void()>* p=new Func<void()>(proc);
+			return Queue(InlineTask(proc));
+		}
+
+		bool ThreadPoolLite::Queue(InlineTask&& task)
+		{
+			// the system thread pool takes a pointer as the context, so the task is moved to the heap
+			auto p=new ThreadPoolItem(std::move(task), threadPoolStatistics.load(std::memory_order_relaxed));
 			if(QueueUserWorkItem(&ThreadPoolQueueFunc, p, WT_EXECUTEDEFAULT))
 			{
 				return true;
@@ -619,6 +727,141 @@ ThreadPoolLite
 			}
 		}
 
+		void ThreadPoolLite::SetStatistics(TaskStatistics* statistics)
+		{
+			threadPoolStatistics = statistics;
+		}
+
+/***********************************************************************
+ThreadPool
+***********************************************************************/
+
+	namespace threading_internal
+	{
+		struct ThreadPoolData
+		{
+			PTP_POOL						pool = NULL;
+			PTP_CLEANUP_GROUP				cleanupGroup = NULL;
+			TP_CALLBACK_ENVIRON				environment;
+			SRWLOCK							lock;
+			bool							stopping = false;
+			std::atomic<TaskStatistics*>	statistics = nullptr;
+		};
+
+		void CALLBACK ThreadPoolCallback(PTP_CALLBACK_INSTANCE instance, void* context)
+		{
+			ThreadPoolQueueFunc(context);
+		}
+
+		void CALLBACK ThreadPoolCancelCallback(void* objectContext, void* cleanupContext)
+		{
+			delete (ThreadPoolItem*)objectContext;
+		}
+	}
+
+	ThreadPool::ThreadPool(const ThreadPoolConfig& config)
+	{
+#define ERROR_MESSAGE_PREFIX L"vl::ThreadPool::ThreadPool(const ThreadPoolConfig&)#"
+		auto maxWorkers = config.maxWorkers == -1 ? Thread::GetCPUCount() * 4 : config.maxWorkers;
+		CHECK_ERROR(maxWorkers > 0, ERROR_MESSAGE_PREFIX L"maxWorkers must be positive or -1.");
+		CHECK_ERROR(0 <= config.minWorkers && config.minWorkers <= maxWorkers, ERROR_MESSAGE_PREFIX L"minWorkers must be in [0, maxWorkers].");
+		CHECK_ERROR(config.idleTimeout == -1 || config.idleTimeout > 0, ERROR_MESSAGE_PREFIX L"idleTimeout must be positive or -1.");
+
+		internalData = new ThreadPoolData;
+		InitializeSRWLock(&internalData->lock);
+		internalData->pool = CreateThreadpool(NULL);
+		internalData->cleanupGroup = CreateThreadpoolCleanupGroup();
+		CHECK_ERROR(internalData->pool && internalData->cleanupGroup, ERROR_MESSAGE_PREFIX L"Failed to create the thread pool.");
+
+		// the system thread pool always starts minimum threads immediately, warmUp is ignored
+		SetThreadpoolThreadMaximum(internalData->pool, (DWORD)maxWorkers);
+		CHECK_ERROR(SetThreadpoolThreadMinimum(internalData->pool, (DWORD)config.minWorkers) != 0, ERROR_MESSAGE_PREFIX L"Failed to start minimum workers.");
+		InitializeThreadpoolEnvironment(&internalData->environment);
+		SetThreadpoolCallbackPool(&internalData->environment, internalData->pool);
+		SetThreadpoolCallbackCleanupGroup(&internalData->environment, internalData->cleanupGroup, &ThreadPoolCancelCallback);
+#undef ERROR_MESSAGE_PREFIX
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		Stop(false);
+		CloseThreadpoolCleanupGroup(internalData->cleanupGroup);
+		DestroyThreadpoolEnvironment(&internalData->environment);
+		CloseThreadpool(internalData->pool);
+		delete internalData;
+	}
+
+	bool ThreadPool::Queue(void(*proc)(void*), void* argument)
+	{
+		return Queue(InlineTask(proc, argument));
+	}
+
+	bool ThreadPool::Queue(const Func<void()>& proc)
+	{
+		return Queue(InlineTask(proc));
+	}
+
+	bool ThreadPool::Queue(InlineTask&& task)
+	{
+		bool queued = false;
+		AcquireSRWLockShared(&internalData->lock);
+		if (!internalData->stopping)
+		{
+			auto p = new ThreadPoolItem(std::move(task), internalData->statistics.load(std::memory_order_relaxed));
+			queued = TrySubmitThreadpoolCallback(&ThreadPoolCallback, p, &internalData->environment) != 0;
+			if (!queued)
+			{
+				delete p;
+			}
+		}
+		ReleaseSRWLockShared(&internalData->lock);
+		return queued;
+	}
+
+	void ThreadPool::SetStatistics(TaskStatistics* statistics)
+	{
+		internalData->statistics = statistics;
+	}
+
+	bool ThreadPool::Stop(bool discardPendingTasks)
+	{
+		AcquireSRWLockExclusive(&internalData->lock);
+		bool stopping = internalData->stopping;
+		internalData->stopping = true;
+		ReleaseSRWLockExclusive(&internalData->lock);
+		if (stopping) return false;
+
+		CloseThreadpoolCleanupGroupMembers(internalData->cleanupGroup, discardPendingTasks ? TRUE : FALSE, nullptr);
+		return true;
+	}
+
+/***********************************************************************
+SpinLock
+***********************************************************************/
+
+	namespace threading_internal
+	{
+		void SpinLockPark(std::atomic<vuint32_t>& token, vuint32_t expected)
+		{
+			WaitOnAddress(&token, &expected, sizeof(expected), INFINITE);
+		}
+
+		void SpinLockUnpark(std::atomic<vuint32_t>& token)
+		{
+			WakeByAddressSingle(&token);
+		}
+
+		void SpinLockUnparkAll(std::atomic<vuint32_t>& token)
+		{
+			WakeByAddressAll(&token);
+		}
+
+		void ChannelPark(std::atomic<vuint32_t>& version, vuint32_t expected, vint ms)
+		{
+			WaitOnAddress(&version, &expected, sizeof(expected), ms < 0 ? INFINITE : (DWORD)ms);
+		}
+	}
+
 /***********************************************************************
 CriticalSection
 ***********************************************************************/
@@ -769,32 +1012,79 @@ ConditionVariable
 
 	bool ConditionVariable::SleepWith(CriticalSection& cs)
 	{
-		return SleepConditionVariableCS(&internalData->variable, &cs.internalData->criticalSection, INFINITE)!=0;
+		if (!statistics)
+		{
+			return SleepConditionVariableCS(&internalData->variable, &cs.internalData->criticalSection, INFINITE)!=0;
+		}
+		auto startedTimestamp = GetStatisticsTimestamp();
+		auto result = SleepConditionVariableCS(&internalData->variable, &cs.internalData->criticalSection, INFINITE)!=0;
+		statistics->RecordWait(startedTimestamp, result);
+		return result;
 	}
 
 	bool ConditionVariable::SleepWithForTime(CriticalSection& cs, vint ms)
 	{
-		return SleepConditionVariableCS(&internalData->variable, &cs.internalData->criticalSection, (DWORD)ms)!=0;
+		if (!statistics)
+		{
+			return SleepConditionVariableCS(&internalData->variable, &cs.internalData->criticalSection, (DWORD)ms)!=0;
+		}
+		auto startedTimestamp = GetStatisticsTimestamp();
+		auto result = SleepConditionVariableCS(&internalData->variable, &cs.internalData->criticalSection, (DWORD)ms)!=0;
+		statistics->RecordWait(startedTimestamp, result);
+		return result;
 	}
 
 	bool ConditionVariable::SleepWithReader(ReaderWriterLock& lock)
 	{
-		return SleepConditionVariableSRW(&internalData->variable, &lock.internalData->lock, INFINITE, CONDITION_VARIABLE_LOCKMODE_SHARED)!=0;
+		if (!statistics)
+		{
+			return SleepConditionVariableSRW(&internalData->variable, &lock.internalData->lock, INFINITE, CONDITION_VARIABLE_LOCKMODE_SHARED)!=0;
+		}
+		auto startedTimestamp = GetStatisticsTimestamp();
+		auto result = SleepConditionVariableSRW(&internalData->variable, &lock.internalData->lock, INFINITE, CONDITION_VARIABLE_LOCKMODE_SHARED)!=0;
+		statistics->RecordWait(startedTimestamp, result);
+		return result;
 	}
 
 	bool ConditionVariable::SleepWithReaderForTime(ReaderWriterLock& lock, vint ms)
 	{
-		return SleepConditionVariableSRW(&internalData->variable, &lock.internalData->lock, (DWORD)ms, CONDITION_VARIABLE_LOCKMODE_SHARED)!=0;
+		if (!statistics)
+		{
+			return SleepConditionVariableSRW(&internalData->variable, &lock.internalData->lock, (DWORD)ms, CONDITION_VARIABLE_LOCKMODE_SHARED)!=0;
+		}
+		auto startedTimestamp = GetStatisticsTimestamp();
+		auto result = SleepConditionVariableSRW(&internalData->variable, &lock.internalData->lock, (DWORD)ms, CONDITION_VARIABLE_LOCKMODE_SHARED)!=0;
+		statistics->RecordWait(startedTimestamp, result);
+		return result;
 	}
 
 	bool ConditionVariable::SleepWithWriter(ReaderWriterLock& lock)
 	{
-		return SleepConditionVariableSRW(&internalData->variable, &lock.internalData->lock, INFINITE, 0)!=0;
+		if (!statistics)
+		{
+			return SleepConditionVariableSRW(&internalData->variable, &lock.internalData->lock, INFINITE, 0)!=0;
+		}
+		auto startedTimestamp = GetStatisticsTimestamp();
+		auto result = SleepConditionVariableSRW(&internalData->variable, &lock.internalData->lock, INFINITE, 0)!=0;
+		statistics->RecordWait(startedTimestamp, result);
+		return result;
 	}
 
 	bool ConditionVariable::SleepWithWriterForTime(ReaderWriterLock& lock, vint ms)
 	{
-		return SleepConditionVariableSRW(&internalData->variable, &lock.internalData->lock, (DWORD)ms, 0)!=0;
+		if (!statistics)
+		{
+			return SleepConditionVariableSRW(&internalData->variable, &lock.internalData->lock, (DWORD)ms, 0)!=0;
+		}
+		auto startedTimestamp = GetStatisticsTimestamp();
+		auto result = SleepConditionVariableSRW(&internalData->variable, &lock.internalData->lock, (DWORD)ms, 0)!=0;
+		statistics->RecordWait(startedTimestamp, result);
+		return result;
+	}
+
+	void ConditionVariable::SetStatistics(WaitStatistics* _statistics)
+	{
+		statistics = _statistics;
 	}
 
 	void ConditionVariable::WakeOnePending()
@@ -806,38 +1096,4 @@ ConditionVariable
 	{
 		WakeAllConditionVariable(&internalData->variable);
 	}
-
-/***********************************************************************
-ThreadLocalStorage
-***********************************************************************/
-
-#define KEY ((DWORD&)key)
-
-	ThreadLocalStorage::ThreadLocalStorage(Destructor _destructor)
-		:destructor(_destructor)
-	{
-		static_assert(sizeof(key) >= sizeof(DWORD), "ThreadLocalStorage's key storage is not large enouth.");
-		PushStorage(this);
-		KEY = TlsAlloc();
-		CHECK_ERROR(KEY != TLS_OUT_OF_INDEXES, L"vl::ThreadLocalStorage::ThreadLocalStorage()#Failed to alloc new thread local storage index.");
-	}
-
-	ThreadLocalStorage::~ThreadLocalStorage()
-	{
-		TlsFree(KEY);
-	}
-
-	void* ThreadLocalStorage::Get()
-	{
-		CHECK_ERROR(!disposed, L"vl::ThreadLocalStorage::Get()#Cannot access a disposed ThreadLocalStorage.");
-		return TlsGetValue(KEY);
-	}
-
-	void ThreadLocalStorage::Set(void* data)
-	{
-		CHECK_ERROR(!disposed, L"vl::ThreadLocalStorage::Set()#Cannot access a disposed ThreadLocalStorage.");
-		TlsSetValue(KEY, data);
-	}
-
-#undef KEY
 }
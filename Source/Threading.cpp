@@ -4,6 +4,11 @@ Licensed under https://github.com/vczh-libraries/License
 ***********************************************************************/
 
 #include "Threading.h"
+#include <thread>
+#include <chrono>
+#include <exception>
+#include <bit>
+#include <cmath>
 
 #if defined VCZH_ARM
 #include <arm_acle.h>
@@ -13,189 +18,2242 @@ Licensed under https://github.com/vczh-libraries/License
 
 namespace vl
 {
+	using namespace threading_internal;
 
 /***********************************************************************
-SpinLock
+SpinLockStatistics
 ***********************************************************************/
 
-	SpinLock::Scope::Scope(SpinLock& _spinLock)
-		:spinLock(&_spinLock)
+	namespace threading_internal
 	{
-		spinLock->Enter();
+		std::atomic<bool>			spinLockStatisticsLock = false;
+		SpinLockStatistics*			spinLockStatisticsHead = nullptr;
+
+		void EnterSpinLockStatistics()
+		{
+			while (spinLockStatisticsLock.exchange(true, std::memory_order_acquire))
+			{
+				std::this_thread::yield();
+			}
+		}
+
+		void LeaveSpinLockStatistics()
+		{
+			spinLockStatisticsLock.store(false, std::memory_order_release);
+		}
+
+		// implemented in Threading.Windows.cpp or Threading.Linux.cpp
+		extern void SpinLockPark(std::atomic<vuint32_t>& token, vuint32_t expected);
+		extern void SpinLockUnpark(std::atomic<vuint32_t>& token);
+
+		// the number of backoff rounds before yielding, the backoff doubles every round
+		constexpr vint				SpinLockBackoffRounds = 10;
+		constexpr vint				SpinLockMaxBackoff = 64;
+		// the number of yields before sleeping
+		constexpr vint				SpinLockYieldRounds = 4;
 	}
 
-	SpinLock::Scope::~Scope()
+	SpinLockStatistics::SpinLockStatistics(const wchar_t* _name)
+		:name(_name)
 	{
-		spinLock->Leave();
+		EnterSpinLockStatistics();
+		next = spinLockStatisticsHead;
+		if (next)
+		{
+			next->previous = this;
+		}
+		spinLockStatisticsHead = this;
+		LeaveSpinLockStatistics();
 	}
 
-	bool SpinLock::TryEnter()
+	SpinLockStatistics::~SpinLockStatistics()
+	{
+		EnterSpinLockStatistics();
+		if (previous)
+		{
+			previous->next = next;
+		}
+		else
+		{
+			spinLockStatisticsHead = next;
+		}
+		if (next)
+		{
+			next->previous = previous;
+		}
+		LeaveSpinLockStatistics();
+	}
+
+	const wchar_t* SpinLockStatistics::GetName()
 	{
-		return token.exchange(1) == 0;
+		return name;
 	}
 
-	void SpinLock::Enter()
+	void SpinLockStatistics::Reset()
 	{
-		while (true)
+		acquisitions = 0;
+		contendedAcquisitions = 0;
+		spinIterations = 0;
+		parks = 0;
+	}
+
+	void SpinLockStatistics::Enumerate(const Func<void(SpinLockStatistics*)>& callback)
+	{
+		EnterSpinLockStatistics();
+		try
 		{
-			vint expected = 0;
-			if (token.compare_exchange_strong(expected, 1))
-			{
-				return;
-			}
-			while (token != 0)
+			for (auto statistics = spinLockStatisticsHead; statistics; statistics = statistics->next)
 			{
-#ifdef VCZH_ARM
-				__yield();
-#else
-				_mm_pause();
-#endif
+				callback(statistics);
 			}
 		}
+		catch (...)
+		{
+			LeaveSpinLockStatistics();
+			throw;
+		}
+		LeaveSpinLockStatistics();
 	}
 
-	void SpinLock::Leave()
+/***********************************************************************
+Statistics
+***********************************************************************/
+
+	namespace threading_internal
 	{
-		token.exchange(0);
+		TaskStatistics*				taskStatisticsHead = nullptr;
+		WaitStatistics*				waitStatisticsHead = nullptr;
+
+		vuint64_t GetStatisticsTimestamp()
+		{
+			return (vuint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+
+		vuint64_t GetStatisticsElapsed(vuint64_t startedTimestamp, vuint64_t finishedTimestamp)
+		{
+			return finishedTimestamp > startedTimestamp ? finishedTimestamp - startedTimestamp : 0;
+		}
 	}
 
-/***********************************************************************
-ThreadLocalStorage
-***********************************************************************/
+	vuint64_t LatencyHistogramSnapshot::GetMean() const
+	{
+		return count == 0 ? 0 : sum / count;
+	}
 
-	void ThreadLocalStorage::Clear()
+	vuint64_t LatencyHistogramSnapshot::GetPercentile(double percentile) const
 	{
-		CHECK_ERROR(!disposed, L"vl::ThreadLocalStorage::Clear()#Cannot access a disposed ThreadLocalStorage.");
-		if(destructor)
+		if (count == 0) return 0;
+		if (percentile < 0) percentile = 0;
+		if (percentile > 100) percentile = 100;
+
+		// buckets are copied one by one while recording, so the sum of buckets could be different from count
+		vuint64_t total = 0;
+		for (vint i = 0; i < BucketCount; i++)
 		{
-			if (auto data = Get())
+			total += buckets[i];
+		}
+		auto rank = (vuint64_t)std::ceil(total * percentile / 100);
+		if (rank == 0) rank = 1;
+
+		vuint64_t accumulated = 0;
+		for (vint i = 0; i < BucketCount; i++)
+		{
+			accumulated += buckets[i];
+			if (accumulated >= rank)
 			{
-				destructor(data);
+				auto upperBound = GetBucketUpperBound(i);
+				return upperBound < max ? upperBound : max;
 			}
 		}
-		Set(nullptr);
+		return max;
 	}
 
-	void ThreadLocalStorage::Dispose()
+	vint LatencyHistogramSnapshot::GetBucketIndex(vuint64_t value)
 	{
-		CHECK_ERROR(!disposed, L"vl::ThreadLocalStorage::Dispose()#Cannot access a disposed ThreadLocalStorage.");
-		Clear();
-		disposed = true;
+		// values under 16 have their own buckets, each larger power of 2 is split into 8 buckets by the next 3 bits
+		if (value < 16) return (vint)value;
+		vint exponent = (vint)std::bit_width(value) - 1;
+		return (exponent - 2) * 8 + (vint)((value >> (exponent - 3)) & 7);
 	}
 
-	struct TlsStorageLink
+	vuint64_t LatencyHistogramSnapshot::GetBucketLowerBound(vint index)
 	{
-		ThreadLocalStorage*		storage = nullptr;
-		TlsStorageLink*			next = nullptr;
-	};
+		if (index < 16) return (vuint64_t)index;
+		vint exponent = index / 8 + 2;
+		return (vuint64_t)(8 + index % 8) << (exponent - 3);
+	}
 
-	volatile bool				tlsFixed = false;
-	TlsStorageLink*				tlsHead = nullptr;
-	TlsStorageLink**			tlsTail = &tlsHead;
+	vuint64_t LatencyHistogramSnapshot::GetBucketUpperBound(vint index)
+	{
+		if (index < 16) return (vuint64_t)index;
+		vint exponent = index / 8 + 2;
+		return GetBucketLowerBound(index) + (((vuint64_t)1 << (exponent - 3)) - 1);
+	}
 
-	void ThreadLocalStorage::PushStorage(ThreadLocalStorage* storage)
+	LatencyHistogram::LatencyHistogram()
 	{
-		CHECK_ERROR(!tlsFixed, L"vl::ThreadLocalStorage::PushStorage(ThreadLocalStorage*)#Cannot create new ThreadLocalStorage instance after calling ThreadLocalStorage::FixStorages().");
-		auto link = new TlsStorageLink;
-		link->storage = storage;
-		*tlsTail = link;
-		tlsTail = &link->next;
+		for (auto&& bucket : buckets)
+		{
+			bucket.store(0, std::memory_order_relaxed);
+		}
 	}
 
-	void ThreadLocalStorage::FixStorages()
+	void LatencyHistogram::Record(vuint64_t value)
 	{
-		tlsFixed = true;
+		count.fetch_add(1, std::memory_order_relaxed);
+		sum.fetch_add(value, std::memory_order_relaxed);
+		buckets[LatencyHistogramSnapshot::GetBucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+
+		auto current = max.load(std::memory_order_relaxed);
+		while (current < value && !max.compare_exchange_weak(current, value, std::memory_order_relaxed));
 	}
 
-	void ThreadLocalStorage::ClearStorages()
+	void LatencyHistogram::GetSnapshot(LatencyHistogramSnapshot& snapshot)
 	{
-		FixStorages();
-		auto current = tlsHead;
-		while (current)
+		snapshot.count = count.load(std::memory_order_relaxed);
+		snapshot.sum = sum.load(std::memory_order_relaxed);
+		snapshot.max = max.load(std::memory_order_relaxed);
+		for (vint i = 0; i < LatencyHistogramSnapshot::BucketCount; i++)
 		{
-			current->storage->Clear();
-			current = current->next;
+			snapshot.buckets[i] = buckets[i].load(std::memory_order_relaxed);
 		}
 	}
 
-	void ThreadLocalStorage::DisposeStorages()
+	void LatencyHistogram::Reset()
 	{
-		FixStorages();
-		auto current = tlsHead;
-		tlsHead = nullptr;
-		tlsTail = nullptr;
-		while (current)
+		count = 0;
+		sum = 0;
+		max = 0;
+		for (auto&& bucket : buckets)
 		{
-			current->storage->Dispose();
+			bucket = 0;
+		}
+	}
 
-			auto temp = current;
-			current = current->next;
-			delete temp;
+	TaskStatistics::TaskStatistics(const wchar_t* _name)
+		:name(_name)
+	{
+		EnterSpinLockStatistics();
+		next = taskStatisticsHead;
+		if (next)
+		{
+			next->previous = this;
 		}
+		taskStatisticsHead = this;
+		LeaveSpinLockStatistics();
 	}
 
-/***********************************************************************
-TaskQueue
-***********************************************************************/
+	TaskStatistics::~TaskStatistics()
+	{
+		EnterSpinLockStatistics();
+		if (previous)
+		{
+			previous->next = next;
+		}
+		else
+		{
+			taskStatisticsHead = next;
+		}
+		if (next)
+		{
+			next->previous = previous;
+		}
+		LeaveSpinLockStatistics();
+	}
 
-	TaskQueue::TaskQueue()
+	vuint64_t TaskStatistics::RecordQueued()
 	{
-		CHECK_ERROR(semaphoreTasks.Create(0, 65536), L"vl::TaskQueue::TaskQueue()#Failed to create the task semaphore.");
+		queued.fetch_add(1, std::memory_order_relaxed);
+		return GetStatisticsTimestamp();
 	}
 
-	TaskQueue::~TaskQueue()
+	vuint64_t TaskStatistics::RecordStarted(vuint64_t queuedTimestamp)
 	{
+		auto timestamp = GetStatisticsTimestamp();
+		started.fetch_add(1, std::memory_order_relaxed);
+		waitTime.Record(GetStatisticsElapsed(queuedTimestamp, timestamp));
+		return timestamp;
 	}
 
-	void TaskQueue::QueueTask(Func<void()> task)
+	void TaskStatistics::RecordCompleted(vuint64_t startedTimestamp)
+	{
+		completed.fetch_add(1, std::memory_order_relaxed);
+		runTime.Record(GetStatisticsElapsed(startedTimestamp, GetStatisticsTimestamp()));
+	}
+
+	const wchar_t* TaskStatistics::GetName()
+	{
+		return name;
+	}
+
+	void TaskStatistics::GetSnapshot(TaskStatisticsSnapshot& snapshot)
+	{
+		snapshot.name = name;
+		snapshot.completed = completed.load(std::memory_order_relaxed);
+		snapshot.started = started.load(std::memory_order_relaxed);
+		snapshot.queued = queued.load(std::memory_order_relaxed);
+		waitTime.GetSnapshot(snapshot.waitTime);
+		runTime.GetSnapshot(snapshot.runTime);
+	}
+
+	void TaskStatistics::Reset()
 	{
-		SPIN_LOCK(lockTasks)
+		queued = 0;
+		started = 0;
+		completed = 0;
+		waitTime.Reset();
+		runTime.Reset();
+	}
+
+	void TaskStatistics::Enumerate(const Func<void(TaskStatistics*)>& callback)
+	{
+		EnterSpinLockStatistics();
+		try
+		{
+			for (auto statistics = taskStatisticsHead; statistics; statistics = statistics->next)
+			{
+				callback(statistics);
+			}
+		}
+		catch (...)
 		{
-			tasks.Add(task);
+			LeaveSpinLockStatistics();
+			throw;
 		}
-		semaphoreTasks.Release();
+		LeaveSpinLockStatistics();
 	}
 
-	void TaskQueue::QueueExitTask()
+	WaitStatistics::WaitStatistics(const wchar_t* _name)
+		:name(_name)
 	{
-		SPIN_LOCK(lockTasks)
+		EnterSpinLockStatistics();
+		next = waitStatisticsHead;
+		if (next)
 		{
-			exitTaskQueued = true;
+			next->previous = this;
 		}
-		semaphoreTasks.Release();
+		waitStatisticsHead = this;
+		LeaveSpinLockStatistics();
 	}
 
-	void TaskQueue::RunTaskQueue()
+	WaitStatistics::~WaitStatistics()
 	{
-		while (true)
+		EnterSpinLockStatistics();
+		if (previous)
+		{
+			previous->next = next;
+		}
+		else
+		{
+			waitStatisticsHead = next;
+		}
+		if (next)
+		{
+			next->previous = previous;
+		}
+		LeaveSpinLockStatistics();
+	}
+
+	void WaitStatistics::RecordWait(vuint64_t startedTimestamp, bool succeeded)
+	{
+		waits.fetch_add(1, std::memory_order_relaxed);
+		if (!succeeded)
+		{
+			failures.fetch_add(1, std::memory_order_relaxed);
+		}
+		waitTime.Record(GetStatisticsElapsed(startedTimestamp, GetStatisticsTimestamp()));
+	}
+
+	const wchar_t* WaitStatistics::GetName()
+	{
+		return name;
+	}
+
+	void WaitStatistics::GetSnapshot(WaitStatisticsSnapshot& snapshot)
+	{
+		snapshot.name = name;
+		snapshot.waits = waits.load(std::memory_order_relaxed);
+		snapshot.failures = failures.load(std::memory_order_relaxed);
+		waitTime.GetSnapshot(snapshot.waitTime);
+	}
+
+	void WaitStatistics::Reset()
+	{
+		waits = 0;
+		failures = 0;
+		waitTime.Reset();
+	}
+
+	void WaitStatistics::Enumerate(const Func<void(WaitStatistics*)>& callback)
+	{
+		EnterSpinLockStatistics();
+		try
+		{
+			for (auto statistics = waitStatisticsHead; statistics; statistics = statistics->next)
+			{
+				callback(statistics);
+			}
+		}
+		catch (...)
+		{
+			LeaveSpinLockStatistics();
+			throw;
+		}
+		LeaveSpinLockStatistics();
+	}
+
+/***********************************************************************
+SpinLock
+***********************************************************************/
+
+	SpinLock::Scope::Scope(SpinLock& _spinLock)
+		:spinLock(&_spinLock)
+	{
+		spinLock->Enter();
+	}
+
+	SpinLock::Scope::~Scope()
+	{
+		spinLock->Leave();
+	}
+
+	void SpinLock::EnterContended()
+	{
+		vuint64_t spins = 0;
+		vint backoff = 1;
+		for (vint round = 0; round < SpinLockBackoffRounds + SpinLockYieldRounds; round++)
 		{
-			Func<void()> task;
-			bool hasTask = false;
-			bool shouldExit = false;
-			SPIN_LOCK(lockTasks)
+			if (round < SpinLockBackoffRounds)
 			{
-				if (tasks.Count() > 0)
+				for (vint i = 0; i < backoff; i++)
+				{
+#ifdef VCZH_ARM
+					__yield();
+#else
+					_mm_pause();
+#endif
+				}
+				spins += backoff;
+				if (backoff < SpinLockMaxBackoff)
 				{
-					task = tasks[0];
-					tasks.RemoveAt(0);
-					hasTask = true;
+					backoff *= 2;
 				}
-				else
+			}
+			else
+			{
+				std::this_thread::yield();
+			}
+
+			vuint32_t expected = 0;
+			if (token.load(std::memory_order_relaxed) == 0 && token.compare_exchange_strong(expected, 1, std::memory_order_acquire))
+			{
+				if (statistics)
 				{
-					shouldExit = exitTaskQueued;
+					statistics->spinIterations.fetch_add(spins, std::memory_order_relaxed);
 				}
+				return;
+			}
+		}
+
+		// mark the lock as having sleeping threads, so that Leave wakes one of them up
+		vuint64_t parks = 0;
+		while (token.exchange(2, std::memory_order_acquire) != 0)
+		{
+			SpinLockPark(token, 2);
+			parks++;
+		}
+		if (statistics)
+		{
+			statistics->spinIterations.fetch_add(spins, std::memory_order_relaxed);
+			statistics->parks.fetch_add(parks, std::memory_order_relaxed);
+		}
+	}
+
+	bool SpinLock::TryEnter()
+	{
+		vuint32_t expected = 0;
+		if (!token.compare_exchange_strong(expected, 1, std::memory_order_acquire))
+		{
+			return false;
+		}
+		if (statistics)
+		{
+			statistics->acquisitions.fetch_add(1, std::memory_order_relaxed);
+		}
+		return true;
+	}
+
+	void SpinLock::Enter()
+	{
+		vuint32_t expected = 0;
+		if (!token.compare_exchange_strong(expected, 1, std::memory_order_acquire))
+		{
+			if (statistics)
+			{
+				statistics->contendedAcquisitions.fetch_add(1, std::memory_order_relaxed);
 			}
+			EnterContended();
+		}
+		if (statistics)
+		{
+			statistics->acquisitions.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	void SpinLock::Leave()
+	{
+		if (token.exchange(0, std::memory_order_release) == 2)
+		{
+			SpinLockUnpark(token);
+		}
+	}
+
+	void SpinLock::SetStatistics(SpinLockStatistics* _statistics)
+	{
+		statistics = _statistics;
+	}
+
+/***********************************************************************
+StripedReaderWriterLock
+***********************************************************************/
+
+	namespace threading_internal
+	{
+		// implemented in Threading.Windows.cpp or Threading.Linux.cpp
+		extern void SpinLockUnparkAll(std::atomic<vuint32_t>& token);
 
-			if (shouldExit)
+		atomic_vint					readerStripeCounter = 0;
+		thread_local vint			readerStripeIndex = -1;
+
+		vint GetReaderStripeIndex()
+		{
+			if (readerStripeIndex == -1)
 			{
-				break;
+				readerStripeIndex = readerStripeCounter.fetch_add(1, std::memory_order_relaxed) % ReaderStripeCount;
 			}
-			if (!hasTask)
+			return readerStripeIndex;
+		}
+
+		void ReaderStripePause(vint count)
+		{
+			for (vint i = 0; i < count; i++)
 			{
-				semaphoreTasks.Wait();
-				continue;
+#ifdef VCZH_ARM
+				__yield();
+#else
+				_mm_pause();
+#endif
 			}
-			task();
+		}
+
+		// wait until a reader counter becomes 0, the last leaving reader wakes up the waiting thread
+		void DrainReaderStripe(std::atomic<vuint32_t>& readers)
+		{
+			vint backoff = 1;
+			for (vint round = 0;; round++)
+			{
+				auto count = readers.load(std::memory_order_seq_cst);
+				if (count == 0) return;
+
+				if (round < SpinLockBackoffRounds)
+				{
+					ReaderStripePause(backoff);
+					if (backoff < SpinLockMaxBackoff)
+					{
+						backoff *= 2;
+					}
+				}
+				else
+				{
+					SpinLockPark(readers, count);
+				}
+			}
+		}
+	}
+
+	StripedReaderWriterLock::ReaderScope::ReaderScope(StripedReaderWriterLock& _lock)
+		:lock(&_lock)
+	{
+		lock->EnterReader();
+	}
+
+	StripedReaderWriterLock::ReaderScope::~ReaderScope()
+	{
+		lock->LeaveReader();
+	}
+
+	StripedReaderWriterLock::WriterScope::WriterScope(StripedReaderWriterLock& _lock)
+		:lock(&_lock)
+	{
+		lock->EnterWriter();
+	}
+
+	StripedReaderWriterLock::WriterScope::~WriterScope()
+	{
+		lock->LeaveWriter();
+	}
+
+	void StripedReaderWriterLock::ReleaseReader(ReaderStripe& stripe)
+	{
+		// writerState is set before a writer checks counters, so a writer waiting for this counter is always seen
+		if (stripe.readers[0].fetch_sub(1, std::memory_order_seq_cst) == 1 && writerState.load(std::memory_order_seq_cst) != 0)
+		{
+			SpinLockUnpark(stripe.readers[0]);
+		}
+	}
+
+	void StripedReaderWriterLock::WaitForWriter()
+	{
+		vint backoff = 1;
+		for (vint round = 0; round < SpinLockBackoffRounds; round++)
+		{
+			if (writerState.load(std::memory_order_relaxed) == 0) return;
+			ReaderStripePause(backoff);
+			if (backoff < SpinLockMaxBackoff)
+			{
+				backoff *= 2;
+			}
+		}
+
+		while (true)
+		{
+			vuint32_t state = writerState.load(std::memory_order_relaxed);
+			if (state == 0) return;
+			if (state == 1 && !writerState.compare_exchange_strong(state, 2, std::memory_order_relaxed)) continue;
+			SpinLockPark(writerState, 2);
+		}
+	}
+
+	void StripedReaderWriterLock::ReleaseWriterState()
+	{
+		if (writerState.exchange(0, std::memory_order_seq_cst) == 2)
+		{
+			SpinLockUnparkAll(writerState);
+		}
+	}
+
+	bool StripedReaderWriterLock::TryEnterReader()
+	{
+		auto& stripe = stripes[GetReaderStripeIndex()];
+		stripe.readers[0].fetch_add(1, std::memory_order_seq_cst);
+		if (writerState.load(std::memory_order_seq_cst) == 0)
+		{
+			return true;
+		}
+		ReleaseReader(stripe);
+		return false;
+	}
+
+	void StripedReaderWriterLock::EnterReader()
+	{
+		auto& stripe = stripes[GetReaderStripeIndex()];
+		while (true)
+		{
+			stripe.readers[0].fetch_add(1, std::memory_order_seq_cst);
+			if (writerState.load(std::memory_order_seq_cst) == 0)
+			{
+				return;
+			}
+
+			// back off so that the writer is not blocked by readers arriving after it
+			ReleaseReader(stripe);
+			WaitForWriter();
+		}
+	}
+
+	void StripedReaderWriterLock::LeaveReader()
+	{
+		ReleaseReader(stripes[GetReaderStripeIndex()]);
+	}
+
+	bool StripedReaderWriterLock::TryEnterWriter()
+	{
+		if (!lockWriters.TryEnter())
+		{
+			return false;
+		}
+
+		writerState.store(1, std::memory_order_seq_cst);
+		for (auto& stripe : stripes)
+		{
+			if (stripe.readers[0].load(std::memory_order_seq_cst) != 0)
+			{
+				ReleaseWriterState();
+				lockWriters.Leave();
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void StripedReaderWriterLock::EnterWriter()
+	{
+		lockWriters.Enter();
+		writerState.store(1, std::memory_order_seq_cst);
+		for (auto& stripe : stripes)
+		{
+			DrainReaderStripe(stripe.readers[0]);
+		}
+	}
+
+	void StripedReaderWriterLock::LeaveWriter()
+	{
+		ReleaseWriterState();
+		lockWriters.Leave();
+	}
+
+/***********************************************************************
+ReadMostly
+***********************************************************************/
+
+	namespace threading_internal
+	{
+		vint ReadMostlyBase::EnterRead()
+		{
+			auto& stripe = stripes[GetReaderStripeIndex()];
+			while (true)
+			{
+				vint group = (vint)(epoch.load(std::memory_order_seq_cst) & 1);
+				stripe.readers[group].fetch_add(1, std::memory_order_seq_cst);
+
+				// if the epoch is not flipped after counting, a writer publishing a new version later will wait for this group
+				if ((vint)(epoch.load(std::memory_order_seq_cst) & 1) == group)
+				{
+					return group;
+				}
+				LeaveRead(group);
+			}
+		}
+
+		void ReadMostlyBase::LeaveRead(vint group)
+		{
+			auto& readers = stripes[GetReaderStripeIndex()].readers[group];
+			if (readers.fetch_sub(1, std::memory_order_seq_cst) == 1 && synchronizing.load(std::memory_order_seq_cst) != 0)
+			{
+				SpinLockUnpark(readers);
+			}
+		}
+
+		void ReadMostlyBase::Synchronize()
+		{
+			synchronizing.store(1, std::memory_order_seq_cst);
+			vint group = (vint)(epoch.fetch_add(1, std::memory_order_seq_cst) & 1);
+			for (auto& stripe : stripes)
+			{
+				DrainReaderStripe(stripe.readers[group]);
+			}
+			synchronizing.store(0, std::memory_order_relaxed);
+		}
+	}
+
+/***********************************************************************
+ThreadLocalStorage
+***********************************************************************/
+
+	namespace threading_internal
+	{
+		struct TlsSlots
+		{
+			void**						values = nullptr;
+			vint						count = 0;
+			bool						dirty = false;
+
+			~TlsSlots()
+			{
+				// threads that are not created using vl::Thread rely on this to release their values
+				for (vint i = 0; i < 4 && dirty; i++)
+				{
+					ThreadLocalStorage::ClearStorages();
+				}
+				delete[] values;
+			}
+		};
+
+		thread_local TlsSlots			tlsSlots;
+	}
+
+	struct TlsStorageLink
+	{
+		ThreadLocalStorage*		storage = nullptr;
+		TlsStorageLink*			next = nullptr;
+	};
+
+	atomic_vint					tlsFixed = 0;
+	vint						tlsCount = 0;
+	TlsStorageLink*				tlsHead = nullptr;
+	TlsStorageLink**			tlsTail = &tlsHead;
+
+	ThreadLocalStorage::ThreadLocalStorage(Destructor _destructor)
+		:destructor(_destructor)
+	{
+		PushStorage(this);
+	}
+
+	ThreadLocalStorage::~ThreadLocalStorage()
+	{
+	}
+
+	void* ThreadLocalStorage::Get()
+	{
+		CHECK_ERROR(!disposed, L"vl::ThreadLocalStorage::Get()#Cannot access a disposed ThreadLocalStorage.");
+		auto& slots = tlsSlots;
+		return index < slots.count ? slots.values[index] : nullptr;
+	}
+
+	void ThreadLocalStorage::Set(void* data)
+	{
+		CHECK_ERROR(!disposed, L"vl::ThreadLocalStorage::Set()#Cannot access a disposed ThreadLocalStorage.");
+		auto& slots = tlsSlots;
+		if (index >= slots.count)
+		{
+			if (!data) return;
+
+			// all storages are usually created before any thread starts, so the slot array grows only once per thread
+			vint count = tlsCount > index ? tlsCount : index + 1;
+			auto values = new void*[count];
+			for (vint i = 0; i < count; i++)
+			{
+				values[i] = i < slots.count ? slots.values[i] : nullptr;
+			}
+			delete[] slots.values;
+			slots.values = values;
+			slots.count = count;
+		}
+		slots.values[index] = data;
+		if (data) slots.dirty = true;
+	}
+
+	void ThreadLocalStorage::Clear()
+	{
+		CHECK_ERROR(!disposed, L"vl::ThreadLocalStorage::Clear()#Cannot access a disposed ThreadLocalStorage.");
+		if(destructor)
+		{
+			if (auto data = Get())
+			{
+				destructor(data);
+			}
+		}
+		Set(nullptr);
+	}
+
+	void ThreadLocalStorage::Dispose()
+	{
+		CHECK_ERROR(!disposed, L"vl::ThreadLocalStorage::Dispose()#Cannot access a disposed ThreadLocalStorage.");
+		Clear();
+		disposed = true;
+	}
+
+	void ThreadLocalStorage::PushStorage(ThreadLocalStorage* storage)
+	{
+		CHECK_ERROR(!tlsFixed, L"vl::ThreadLocalStorage::PushStorage(ThreadLocalStorage*)#Cannot create new ThreadLocalStorage instance after calling ThreadLocalStorage::FixStorages().");
+		auto link = new TlsStorageLink;
+		link->storage = storage;
+		storage->index = tlsCount++;
+		*tlsTail = link;
+		tlsTail = &link->next;
+	}
+
+	void ThreadLocalStorage::FixStorages()
+	{
+		// thread pool workers call this after every task, avoid writing to the shared flag again
+		if (!tlsFixed.load(std::memory_order_relaxed))
+		{
+			tlsFixed = 1;
+		}
+	}
+
+	void ThreadLocalStorage::ClearStorages()
+	{
+		FixStorages();
+		auto& slots = tlsSlots;
+		if (!slots.dirty) return;
+
+		// destructors could assign values again, which will be cleared in the next call
+		slots.dirty = false;
+		auto current = tlsHead;
+		while (current)
+		{
+			if (!current->storage->disposed)
+			{
+				current->storage->Clear();
+			}
+			current = current->next;
+		}
+	}
+
+	void ThreadLocalStorage::DisposeStorages()
+	{
+		FixStorages();
+		auto current = tlsHead;
+		tlsHead = nullptr;
+		tlsTail = nullptr;
+		while (current)
+		{
+			if (!current->storage->disposed)
+			{
+				current->storage->Dispose();
+			}
+
+			auto temp = current;
+			current = current->next;
+			delete temp;
+		}
+
+		auto& slots = tlsSlots;
+		delete[] slots.values;
+		slots.values = nullptr;
+		slots.count = 0;
+		slots.dirty = false;
+	}
+
+/***********************************************************************
+TaskQueue
+***********************************************************************/
+
+	namespace threading_internal
+	{
+		struct TaskQueueNode
+		{
+			Func<void()>				task;
+			TaskQueueNode*				next = nullptr;
+			TaskStatistics*				statistics = nullptr;
+			vuint64_t					queuedTimestamp = 0;
+		};
+
+		void DeleteTaskQueueNodes(TaskQueueNode* node)
+		{
+			while (node)
+			{
+				auto next = node->next;
+				delete node;
+				node = next;
+			}
+		}
+	}
+
+	void TaskQueue::PushTasks(TaskQueueNode* latest, TaskQueueNode* earliest)
+	{
+		auto head = queuedTasks.load(std::memory_order_relaxed);
+		do
+		{
+			earliest->next = head;
+		} while (!queuedTasks.compare_exchange_weak(head, latest, std::memory_order_release, std::memory_order_relaxed));
+
+		// the running thread only sleeps after it takes all tasks, so only the first task after that needs to wake it up
+		if (!head)
+		{
+			eventTasks.Signal();
+		}
+	}
+
+	bool TaskQueue::RunTasks(vint ms)
+	{
+		auto start = std::chrono::steady_clock::now();
+		auto elapsed = [=]()
+		{
+			return (vint)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+		};
+
+		while (true)
+		{
+			if (!pendingTasks)
+			{
+				// take all queued tasks in one swap and reverse them to the queued order
+				auto node = queuedTasks.exchange(nullptr, std::memory_order_acquire);
+				while (node)
+				{
+					auto next = node->next;
+					node->next = pendingTasks;
+					pendingTasks = node;
+					node = next;
+				}
+			}
+
+			if (pendingTasks)
+			{
+				auto node = pendingTasks;
+				pendingTasks = node->next;
+				auto task = node->task;
+				auto statistics = node->statistics;
+				vuint64_t startedTimestamp = 0;
+				if (statistics)
+				{
+					startedTimestamp = statistics->RecordStarted(node->queuedTimestamp);
+				}
+				delete node;
+				task();
+				if (statistics)
+				{
+					statistics->RecordCompleted(startedTimestamp);
+				}
+				if (ms >= 0 && elapsed() > ms)
+				{
+					return true;
+				}
+			}
+			else if (exitTaskQueued)
+			{
+				// tasks queued before QueueExitTask but after the last swap must be executed
+				if (!queuedTasks.load(std::memory_order_acquire))
+				{
+					return false;
+				}
+			}
+			else if (ms < 0)
+			{
+				eventTasks.Wait();
+			}
+			else
+			{
+				auto remaining = ms - elapsed();
+				if (remaining <= 0 || !eventTasks.WaitForTime(remaining))
+				{
+					return true;
+				}
+			}
+		}
+	}
+
+	TaskQueue::TaskQueue()
+	{
+		CHECK_ERROR(eventTasks.CreateAutoUnsignal(false), L"vl::TaskQueue::TaskQueue()#Failed to create the task event.");
+	}
+
+	TaskQueue::~TaskQueue()
+	{
+		DeleteTaskQueueNodes(pendingTasks);
+		DeleteTaskQueueNodes(queuedTasks.exchange(nullptr));
+	}
+
+	void TaskQueue::QueueTask(Func<void()> task)
+	{
+		auto node = new TaskQueueNode;
+		node->task = task;
+		node->statistics = statistics.load(std::memory_order_relaxed);
+		if (node->statistics)
+		{
+			node->queuedTimestamp = node->statistics->RecordQueued();
+		}
+		PushTasks(node, node);
+	}
+
+	void TaskQueue::QueueTasks(const collections::IEnumerable<Func<void()>>& tasks)
+	{
+		TaskQueueNode* latest = nullptr;
+		TaskQueueNode* earliest = nullptr;
+		auto taskStatistics = statistics.load(std::memory_order_relaxed);
+		for (auto&& task : tasks)
+		{
+			auto node = new TaskQueueNode;
+			node->task = task;
+			node->statistics = taskStatistics;
+			if (taskStatistics)
+			{
+				node->queuedTimestamp = taskStatistics->RecordQueued();
+			}
+			node->next = latest;
+			latest = node;
+			if (!earliest)
+			{
+				earliest = node;
+			}
+		}
+		if (latest)
+		{
+			PushTasks(latest, earliest);
+		}
+	}
+
+	void TaskQueue::QueueExitTask()
+	{
+		exitTaskQueued = true;
+		eventTasks.Signal();
+	}
+
+	void TaskQueue::RunTaskQueue()
+	{
+		RunTasks(-1);
+	}
+
+	bool TaskQueue::RunTaskQueueFor(vint ms)
+	{
+		return RunTasks(ms);
+	}
+
+	void TaskQueue::SetStatistics(TaskStatistics* _statistics)
+	{
+		statistics = _statistics;
+	}
+
+/***********************************************************************
+Timer
+***********************************************************************/
+
+	namespace threading_internal
+	{
+		// the wheel has 4 levels of 64 slots, a slot in level N covers 64^N milliseconds
+		constexpr vint					TimerWheelBits = 6;
+		constexpr vint					TimerWheelSlots = 1 << TimerWheelBits;
+		constexpr vint					TimerWheelLevels = 4;
+		constexpr vuint64_t				TimerWheelRange = (vuint64_t)1 << (TimerWheelBits * TimerWheelLevels);
+
+		struct TimerServiceData;
+
+		struct TimerData
+		{
+			TimerServiceData*			service = nullptr;
+
+			// all fields below are covered by service->csTimers
+			vint						references = 1;
+			Func<void()>				callback;
+			vint						duration = 0;
+			vuint64_t					deadline = 0;
+			bool						scheduled = false;
+			bool						pending = false;
+			vint						activeCallbacks = 0;
+			TimerData**					slot = nullptr;
+			TimerData*					previous = nullptr;
+			TimerData*					next = nullptr;
+		};
+
+		struct TimerServiceData
+		{
+			atomic_vint					references = 1;
+			Thread*						thread = nullptr;
+
+			// covers everything below and all timers of this service
+			CriticalSection				csTimers;
+			ConditionVariable			cvTimers;
+			ConditionVariable			cvCallbacks;
+			bool						stopping = false;
+			vuint64_t					nextTick = 0;
+			vuint64_t					wakeTick = 0;
+			vint						scheduledCount = 0;
+			TimerData*					wheel[TimerWheelLevels][TimerWheelSlots] = {};
+		};
+
+		// covers timerService
+		SpinLock						timerServiceLock;
+		TimerServiceData*				timerService = nullptr;
+		thread_local TimerData*			timerCurrentCallback = nullptr;
+
+		vuint64_t TimerGetTick()
+		{
+			return (vuint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+
+		void TimerReleaseService(TimerServiceData* service)
+		{
+			if (DECRC(&service->references) == 0)
+			{
+				delete service;
+			}
+		}
+
+		void TimerLink(TimerServiceData* service, TimerData* timer)
+		{
+			// the expiration is relative to the next tick to process, it decides the level and the slot
+			auto expiration = timer->deadline < service->nextTick ? service->nextTick : timer->deadline;
+			auto delta = expiration - service->nextTick;
+			if (delta >= TimerWheelRange)
+			{
+				// the timer is linked again when its slot is cascaded, until the deadline is close enough
+				delta = TimerWheelRange - 1;
+				expiration = service->nextTick + delta;
+			}
+
+			vint level = 0;
+			while (delta >= ((vuint64_t)1 << (TimerWheelBits * (level + 1))))
+			{
+				level++;
+			}
+			auto slot = &service->wheel[level][(expiration >> (TimerWheelBits * level)) & (TimerWheelSlots - 1)];
+
+			timer->slot = slot;
+			timer->previous = nullptr;
+			timer->next = *slot;
+			if (*slot)
+			{
+				(*slot)->previous = timer;
+			}
+			*slot = timer;
+		}
+
+		void TimerUnlink(TimerData* timer)
+		{
+			if (timer->previous)
+			{
+				timer->previous->next = timer->next;
+			}
+			else
+			{
+				*timer->slot = timer->next;
+			}
+			if (timer->next)
+			{
+				timer->next->previous = timer->previous;
+			}
+			timer->slot = nullptr;
+			timer->previous = nullptr;
+			timer->next = nullptr;
+		}
+
+		TimerData* TimerTakeSlot(TimerData*& slot)
+		{
+			auto timers = slot;
+			slot = nullptr;
+			return timers;
+		}
+
+		void TimerCascade(TimerServiceData* service, vint level, vuint64_t tick)
+		{
+			auto timer = TimerTakeSlot(service->wheel[level][(tick >> (TimerWheelBits * level)) & (TimerWheelSlots - 1)]);
+			while (timer)
+			{
+				auto next = timer->next;
+				TimerLink(service, timer);
+				timer = next;
+			}
+		}
+
+		void TimerProcessTick(TimerServiceData* service, TimerData*& expired)
+		{
+			auto tick = service->nextTick;
+			for (vint level = 1; level < TimerWheelLevels; level++)
+			{
+				// move timers in the next slot of the upper level down, when the lower level wraps around
+				if ((tick >> (TimerWheelBits * (level - 1))) & (TimerWheelSlots - 1)) break;
+				TimerCascade(service, level, tick);
+			}
+
+			auto timer = TimerTakeSlot(service->wheel[0][tick & (TimerWheelSlots - 1)]);
+			while (timer)
+			{
+				auto next = timer->next;
+				if (timer->deadline > tick)
+				{
+					// Refresh only updates the deadline, the timer is moved when its old deadline is reached
+					TimerLink(service, timer);
+				}
+				else
+				{
+					timer->scheduled = false;
+					timer->pending = true;
+					timer->references++;
+					timer->slot = nullptr;
+					timer->previous = nullptr;
+					timer->next = expired;
+					expired = timer;
+					service->scheduledCount--;
+				}
+				timer = next;
+			}
+			service->nextTick = tick + 1;
+		}
+
+		void TimerRelease(TimerData* timer)
+		{
+			auto service = timer->service;
+			delete timer;
+			TimerReleaseService(service);
+		}
+
+		void TimerRun(void* argument)
+		{
+			auto timer = (TimerData*)argument;
+			auto service = timer->service;
+			Func<void()> callback;
+			CS_LOCK(service->csTimers)
+			{
+				// the timer could be cancelled, or even scheduled again, after it is dispatched
+				if (timer->pending)
+				{
+					timer->pending = false;
+					timer->activeCallbacks++;
+					callback = std::move(timer->callback);
+				}
+			}
+
+			if (callback)
+			{
+				auto previous = timerCurrentCallback;
+				timerCurrentCallback = timer;
+				try
+				{
+					callback();
+				}
+				catch (...)
+				{
+				}
+				timerCurrentCallback = previous;
+			}
+
+			bool release = false;
+			CS_LOCK(service->csTimers)
+			{
+				if (callback)
+				{
+					timer->activeCallbacks--;
+					service->cvCallbacks.WakeAllPendings();
+				}
+				release = --timer->references == 0;
+			}
+			if (release)
+			{
+				TimerRelease(timer);
+			}
+		}
+
+		void TimerServiceProc(Thread* thread, void* argument)
+		{
+			auto service = (TimerServiceData*)argument;
+			service->csTimers.Enter();
+			while (!service->stopping)
+			{
+				auto now = TimerGetTick();
+				TimerData* expired = nullptr;
+				if (service->scheduledCount == 0)
+				{
+					service->nextTick = now + 1;
+				}
+				else
+				{
+					while (service->nextTick <= now)
+					{
+						TimerProcessTick(service, expired);
+					}
+				}
+
+				if (expired)
+				{
+					service->csTimers.Leave();
+					while (expired)
+					{
+						auto timer = expired;
+						expired = timer->next;
+						timer->next = nullptr;
+						if (!ThreadPoolLite::Queue(&TimerRun, timer))
+						{
+							TimerRun(timer);
+						}
+					}
+					service->csTimers.Enter();
+					continue;
+				}
+
+				if (service->scheduledCount == 0)
+				{
+					service->wakeTick = (vuint64_t)-1;
+					service->cvTimers.SleepWith(service->csTimers);
+				}
+				else
+				{
+					// sleep until the next non-empty slot in level 0, or until the next cascading
+					auto tick = service->nextTick;
+					do
+					{
+						if (service->wheel[0][tick & (TimerWheelSlots - 1)]) break;
+						tick++;
+					} while (tick & (TimerWheelSlots - 1));
+					service->wakeTick = tick;
+					service->cvTimers.SleepWithForTime(service->csTimers, (vint)(tick - now));
+				}
+			}
+			service->csTimers.Leave();
+		}
+
+		BEGIN_GLOBAL_STORAGE_CLASS(TimerServiceStorage)
+		INITIALIZE_GLOBAL_STORAGE_CLASS
+		FINALIZE_GLOBAL_STORAGE_CLASS
+			TimerServiceData* service = nullptr;
+			SPIN_LOCK(timerServiceLock)
+			{
+				service = timerService;
+				timerService = nullptr;
+			}
+
+			if (service)
+			{
+				CS_LOCK(service->csTimers)
+				{
+					service->stopping = true;
+					for (auto&& slots : service->wheel)
+					{
+						for (auto&& slot : slots)
+						{
+							auto timer = TimerTakeSlot(slot);
+							while (timer)
+							{
+								auto next = timer->next;
+								timer->scheduled = false;
+								timer->callback = {};
+								timer->slot = nullptr;
+								timer->previous = nullptr;
+								timer->next = nullptr;
+								timer = next;
+							}
+						}
+					}
+					service->scheduledCount = 0;
+					service->cvTimers.WakeAllPendings();
+				}
+				service->thread->Wait();
+				delete service->thread;
+				service->thread = nullptr;
+				TimerReleaseService(service);
+			}
+		END_GLOBAL_STORAGE_CLASS(TimerServiceStorage)
+
+		TimerServiceData* TimerAcquireService()
+		{
+			TimerServiceData* service = nullptr;
+			SPIN_LOCK(timerServiceLock)
+			{
+				if (!timerService)
+				{
+					GetTimerServiceStorage();
+					timerService = new TimerServiceData;
+					timerService->nextTick = TimerGetTick();
+					timerService->thread = Thread::CreateAndStart(&TimerServiceProc, timerService, false);
+					CHECK_ERROR(timerService->thread, L"vl::Timer::Timer()#Failed to create the timer service thread.");
+				}
+				service = timerService;
+				INCRC(&service->references);
+			}
+			return service;
+		}
+	}
+
+	Timer::Timer()
+	{
+		internalData = new TimerData;
+		internalData->service = TimerAcquireService();
+	}
+
+	Timer::~Timer()
+	{
+		CancelAndWait();
+		bool release = false;
+		CS_LOCK(internalData->service->csTimers)
+		{
+			release = --internalData->references == 0;
+		}
+		if (release)
+		{
+			TimerRelease(internalData);
+		}
+	}
+
+	bool Timer::Schedule(vint ms, const Func<void()>& callback)
+	{
+		CHECK_ERROR(ms >= 0, L"vl::Timer::Schedule(vint, const Func<void()>&)#ms must not be negative.");
+		auto service = internalData->service;
+		CS_LOCK(service->csTimers)
+		{
+			if (service->stopping || internalData->scheduled || internalData->pending)
+			{
+				return false;
+			}
+
+			if (service->scheduledCount == 0)
+			{
+				// the service thread does not advance the wheel when it is empty
+				service->nextTick = TimerGetTick();
+			}
+			internalData->callback = callback;
+			internalData->duration = ms;
+			internalData->deadline = TimerGetTick() + (vuint64_t)ms;
+			internalData->scheduled = true;
+			TimerLink(service, internalData);
+			if (service->scheduledCount++ == 0 || internalData->deadline < service->wakeTick)
+			{
+				service->cvTimers.WakeOnePending();
+			}
+		}
+		return true;
+	}
+
+	bool Timer::Refresh()
+	{
+		CS_LOCK(internalData->service->csTimers)
+		{
+			if (!internalData->scheduled) return false;
+			internalData->deadline = TimerGetTick() + (vuint64_t)internalData->duration;
+		}
+		return true;
+	}
+
+	bool Timer::Cancel()
+	{
+		auto service = internalData->service;
+		bool cancelled = false;
+		Func<void()> callback;
+		CS_LOCK(service->csTimers)
+		{
+			if (internalData->scheduled)
+			{
+				TimerUnlink(internalData);
+				service->scheduledCount--;
+				cancelled = true;
+			}
+			cancelled |= internalData->pending;
+			internalData->scheduled = false;
+			internalData->pending = false;
+			callback = std::move(internalData->callback);
+		}
+		return cancelled;
+	}
+
+	void Timer::CancelAndWait()
+	{
+		Cancel();
+		if (timerCurrentCallback == internalData) return;
+		auto service = internalData->service;
+		CS_LOCK(service->csTimers)
+		{
+			while (internalData->activeCallbacks > 0)
+			{
+				service->cvCallbacks.SleepWith(service->csTimers);
+			}
+		}
+	}
+
+	bool Timer::IsScheduled()
+	{
+		bool scheduled = false;
+		CS_LOCK(internalData->service->csTimers)
+		{
+			scheduled = internalData->scheduled || internalData->pending;
+		}
+		return scheduled;
+	}
+
+/***********************************************************************
+BoundedChannel
+***********************************************************************/
+
+	namespace threading_internal
+	{
+		// implemented in Threading.Windows.cpp or Threading.Linux.cpp
+		extern void ChannelPark(std::atomic<vuint32_t>& version, vuint32_t expected, vint ms);
+
+		void BoundedChannelBase::Notify(WaitList& waitList)
+		{
+			// pairs with the fence in BeginWait, either the waiting thread sees the change, or this thread sees the waiting thread
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (waitList.waiters.load(std::memory_order_relaxed) != 0)
+			{
+				waitList.version.fetch_add(1, std::memory_order_release);
+				SpinLockUnparkAll(waitList.version);
+			}
+		}
+
+		vuint32_t BoundedChannelBase::BeginWait(WaitList& waitList)
+		{
+			auto version = waitList.version.load(std::memory_order_acquire);
+			waitList.waiters.fetch_add(1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			return version;
+		}
+
+		bool BoundedChannelBase::EndWait(WaitList& waitList, vuint32_t version, vuint64_t deadline)
+		{
+			vint ms = -1;
+			if (deadline != 0)
+			{
+				auto now = TimerGetTick();
+				if (now >= deadline)
+				{
+					CancelWait(waitList);
+					return false;
+				}
+				ms = (vint)(deadline - now);
+			}
+
+			// returns immediately if the version has been changed after BeginWait
+			ChannelPark(waitList.version, version, ms);
+			CancelWait(waitList);
+			return true;
+		}
+
+		void BoundedChannelBase::CancelWait(WaitList& waitList)
+		{
+			waitList.waiters.fetch_sub(1, std::memory_order_relaxed);
+		}
+
+		vuint64_t BoundedChannelBase::GetDeadline(vint ms)
+		{
+			return ms < 0 ? 0 : TimerGetTick() + (vuint64_t)ms;
+		}
+
+		void BoundedChannelBase::Close()
+		{
+			closed.store(true, std::memory_order_seq_cst);
+			for (auto waitList : { &sendWaitList,&receiveWaitList })
+			{
+				waitList->version.fetch_add(1, std::memory_order_release);
+				SpinLockUnparkAll(waitList->version);
+			}
+		}
+
+		bool BoundedChannelBase::IsClosed()
+		{
+			return closed.load(std::memory_order_acquire);
+		}
+	}
+
+/***********************************************************************
+Task
+***********************************************************************/
+
+	namespace threading_internal
+	{
+		struct CancellationData
+		{
+			atomic_vint					references = 1;
+			std::atomic<bool>			cancelled = false;
+		};
+
+		void CancellationRelease(CancellationData* data)
+		{
+			if (data && DECRC(&data->references) == 0)
+			{
+				delete data;
+			}
+		}
+
+		TaskContinuation* TaskContinuationsCompleted()
+		{
+			// marks the continuation list of a completed task, it is never a valid address of a continuation
+			return reinterpret_cast<TaskContinuation*>(static_cast<vuint>(1));
+		}
+
+		void TaskExecuteQueued(void* argument)
+		{
+			auto continuation = (TaskContinuation*)argument;
+			auto antecedent = continuation->antecedent;
+			continuation->Execute(antecedent);
+			delete continuation;
+			if (antecedent)
+			{
+				antecedent->Release();
+			}
+		}
+
+		void TaskDispatch(TaskStateBase* antecedent, TaskContinuation* continuation)
+		{
+			if (continuation->runInline)
+			{
+				// an awaiter owning the continuation could be destroyed in Execute
+				bool deleteAfterExecute = continuation->deleteAfterExecute;
+				continuation->Execute(antecedent);
+				if (deleteAfterExecute)
+				{
+					delete continuation;
+				}
+				return;
+			}
+
+			if (antecedent)
+			{
+				antecedent->AddRef();
+			}
+			continuation->antecedent = antecedent;
+			if (!ThreadPoolLite::Queue(&TaskExecuteQueued, continuation))
+			{
+				TaskExecuteQueued(continuation);
+			}
+		}
+
+/***********************************************************************
+TaskStateBase
+***********************************************************************/
+
+		TaskStateBase::~TaskStateBase()
+		{
+			// a task destroyed before completing never runs its continuations
+			auto current = continuations.load();
+			if (current == TaskContinuationsCompleted()) return;
+			while (current)
+			{
+				auto next = current->next;
+				if (current->deleteAfterExecute)
+				{
+					delete current;
+				}
+				current = next;
+			}
+		}
+
+		bool TaskStateBase::BeginComplete()
+		{
+			bool expected = false;
+			return completing.compare_exchange_strong(expected, true);
+		}
+
+		void TaskStateBase::EndComplete(TaskStatus finalStatus)
+		{
+			status = (vint)finalStatus;
+
+			// continuations are pushed as a stack, reverse it to run them in registration order
+			auto current = continuations.exchange(TaskContinuationsCompleted());
+			TaskContinuation* reversed = nullptr;
+			while (current)
+			{
+				auto next = current->next;
+				current->next = reversed;
+				reversed = current;
+				current = next;
+			}
+
+			while (reversed)
+			{
+				auto next = reversed->next;
+				TaskDispatch(this, reversed);
+				reversed = next;
+			}
+		}
+
+		void TaskStateBase::EndCompleteWithException(std::exception_ptr _exception)
+		{
+			exception = _exception;
+			EndComplete(TaskStatus::Failed);
+		}
+
+		void TaskStateBase::AddRef()
+		{
+			INCRC(&references);
+		}
+
+		void TaskStateBase::Release()
+		{
+			if (DECRC(&references) == 0)
+			{
+				delete this;
+			}
+		}
+
+		TaskStatus TaskStateBase::GetStatus()
+		{
+			return (TaskStatus)status.load();
+		}
+
+		std::exception_ptr TaskStateBase::GetException()
+		{
+			return exception;
+		}
+
+		bool TaskStateBase::TrySetException(std::exception_ptr _exception)
+		{
+			if (!BeginComplete()) return false;
+			EndCompleteWithException(_exception);
+			return true;
+		}
+
+		bool TaskStateBase::TrySetCancelled()
+		{
+			if (!BeginComplete()) return false;
+			EndComplete(TaskStatus::Cancelled);
+			return true;
+		}
+
+		bool TaskStateBase::TrySetFailure(TaskStateBase* source)
+		{
+			switch (source->GetStatus())
+			{
+			case TaskStatus::Failed:
+				TrySetException(source->GetException());
+				return true;
+			case TaskStatus::Cancelled:
+				TrySetCancelled();
+				return true;
+			default:
+				return false;
+			}
+		}
+
+		bool TaskStateBase::TryAddContinuation(TaskContinuation* continuation)
+		{
+			// returns false without executing the continuation if the task has completed
+			auto head = continuations.load();
+			while (true)
+			{
+				if (head == TaskContinuationsCompleted())
+				{
+					return false;
+				}
+				continuation->next = head;
+				if (continuations.compare_exchange_weak(head, continuation))
+				{
+					return true;
+				}
+			}
+		}
+
+		void TaskStateBase::AddContinuation(TaskContinuation* continuation)
+		{
+			if (!TryAddContinuation(continuation))
+			{
+				TaskDispatch(this, continuation);
+			}
+		}
+
+		struct TaskWaiter
+		{
+			atomic_vint					references = 2;
+			EventObject					eventCompleted;
+		};
+
+		void TaskWaiterRelease(TaskWaiter* waiter)
+		{
+			if (DECRC(&waiter->references) == 0)
+			{
+				delete waiter;
+			}
+		}
+
+		class TaskWaitContinuation : public TaskContinuation
+		{
+		private:
+			TaskWaiter*					waiter;
+
+		public:
+			TaskWaitContinuation(TaskWaiter* _waiter)
+				:waiter(_waiter)
+			{
+				runInline = true;
+			}
+
+			~TaskWaitContinuation()
+			{
+				TaskWaiterRelease(waiter);
+			}
+
+			void Execute(TaskStateBase*) override
+			{
+				waiter->eventCompleted.Signal();
+			}
+		};
+
+		bool TaskStateBase::Wait(vint ms)
+		{
+			if (GetStatus() != TaskStatus::Pending) return true;
+			if (ms == 0) return false;
+
+			auto waiter = new TaskWaiter;
+			waiter->eventCompleted.CreateManualUnsignal(false);
+			AddContinuation(new TaskWaitContinuation(waiter));
+			bool completed = ms < 0 ? waiter->eventCompleted.Wait() : waiter->eventCompleted.WaitForTime(ms);
+			TaskWaiterRelease(waiter);
+			return completed || GetStatus() != TaskStatus::Pending;
+		}
+
+		void TaskStateBase::RethrowIfNotSucceeded()
+		{
+			switch (GetStatus())
+			{
+			case TaskStatus::Failed:
+				std::rethrow_exception(exception);
+			case TaskStatus::Cancelled:
+				throw TaskCancelledException();
+			case TaskStatus::Pending:
+				CHECK_FAIL(L"vl::threading_internal::TaskStateBase::RethrowIfNotSucceeded()#The task has not completed.");
+			default:;
+			}
+		}
+
+/***********************************************************************
+WhenAll / WhenAny
+***********************************************************************/
+
+		struct TaskWhenAllData
+		{
+			atomic_vint					references = 1;
+			atomic_vint					remaining = 0;
+			TaskState<void>*			target = nullptr;
+			std::atomic<bool>			cancelled = false;
+
+			// covers exception
+			SpinLock					lockException;
+			std::exception_ptr			exception;
+		};
+
+		class TaskWhenAllContinuation : public TaskContinuation
+		{
+		private:
+			TaskWhenAllData*			data;
+
+		public:
+			TaskWhenAllContinuation(TaskWhenAllData* _data)
+				:data(_data)
+			{
+				runInline = true;
+				INCRC(&data->references);
+			}
+
+			~TaskWhenAllContinuation()
+			{
+				if (DECRC(&data->references) == 0)
+				{
+					data->target->Release();
+					delete data;
+				}
+			}
+
+			void Execute(TaskStateBase* completed) override
+			{
+				switch (completed->GetStatus())
+				{
+				case TaskStatus::Failed:
+					SPIN_LOCK(data->lockException)
+					{
+						if (!data->exception)
+						{
+							data->exception = completed->GetException();
+						}
+					}
+					break;
+				case TaskStatus::Cancelled:
+					data->cancelled = true;
+					break;
+				default:;
+				}
+
+				if (DECRC(&data->remaining) == 0)
+				{
+					if (data->exception)
+					{
+						data->target->TrySetException(data->exception);
+					}
+					else if (data->cancelled)
+					{
+						data->target->TrySetCancelled();
+					}
+					else
+					{
+						data->target->TrySetResult();
+					}
+				}
+			}
+		};
+
+		Task<void> TaskWhenAll(TaskStateBase* const* states, vint count)
+		{
+			auto target = new TaskState<void>;
+			auto task = TaskAccessor::CreateTask(target);
+			if (count == 0)
+			{
+				target->TrySetResult();
+				target->Release();
+				return task;
+			}
+
+			auto data = new TaskWhenAllData;
+			data->target = target;
+			data->remaining = count;
+			for (vint i = 0; i < count; i++)
+			{
+				CHECK_ERROR(states[i], L"vl::WhenAll(...)#All tasks should be valid.");
+				states[i]->AddContinuation(new TaskWhenAllContinuation(data));
+			}
+
+			if (DECRC(&data->references) == 0)
+			{
+				data->target->Release();
+				delete data;
+			}
+			return task;
+		}
+
+		class TaskWhenAnyContinuation : public TaskContinuation
+		{
+		private:
+			TaskState<vint>*			target;
+			vint						index;
+
+		public:
+			TaskWhenAnyContinuation(TaskState<vint>* _target, vint _index)
+				:target(_target)
+				, index(_index)
+			{
+				runInline = true;
+				target->AddRef();
+			}
+
+			~TaskWhenAnyContinuation()
+			{
+				target->Release();
+			}
+
+			void Execute(TaskStateBase*) override
+			{
+				target->TrySetResult(index);
+			}
+		};
+
+		Task<vint> TaskWhenAny(TaskStateBase* const* states, vint count)
+		{
+			CHECK_ERROR(count > 0, L"vl::WhenAny(...)#There should be at least one task.");
+			auto target = new TaskState<vint>;
+			auto task = TaskAccessor::CreateTask(target);
+			target->Release();
+			for (vint i = 0; i < count; i++)
+			{
+				CHECK_ERROR(states[i], L"vl::WhenAny(...)#All tasks should be valid.");
+				if (target->GetStatus() != TaskStatus::Pending) break;
+				states[i]->AddContinuation(new TaskWhenAnyContinuation(target, i));
+			}
+			return task;
+		}
+	}
+
+/***********************************************************************
+CancellationToken
+***********************************************************************/
+
+	CancellationToken::CancellationToken(threading_internal::CancellationData* _internalData)
+		:internalData(_internalData)
+	{
+		INCRC(&internalData->references);
+	}
+
+	CancellationToken::CancellationToken(const CancellationToken& token)
+		:internalData(token.internalData)
+	{
+		if (internalData) INCRC(&internalData->references);
+	}
+
+	CancellationToken::CancellationToken(CancellationToken&& token)
+		:internalData(token.internalData)
+	{
+		token.internalData = nullptr;
+	}
+
+	CancellationToken::~CancellationToken()
+	{
+		CancellationRelease(internalData);
+	}
+
+	CancellationToken& CancellationToken::operator=(const CancellationToken& token)
+	{
+		if (token.internalData) INCRC(&token.internalData->references);
+		CancellationRelease(internalData);
+		internalData = token.internalData;
+		return *this;
+	}
+
+	CancellationToken& CancellationToken::operator=(CancellationToken&& token)
+	{
+		if (this != &token)
+		{
+			CancellationRelease(internalData);
+			internalData = token.internalData;
+			token.internalData = nullptr;
+		}
+		return *this;
+	}
+
+	bool CancellationToken::IsCancellationRequested() const
+	{
+		return internalData && internalData->cancelled;
+	}
+
+/***********************************************************************
+CancellationTokenSource
+***********************************************************************/
+
+	CancellationTokenSource::CancellationTokenSource()
+		:internalData(new CancellationData)
+	{
+	}
+
+	CancellationTokenSource::~CancellationTokenSource()
+	{
+		CancellationRelease(internalData);
+	}
+
+	CancellationToken CancellationTokenSource::GetToken() const
+	{
+		return CancellationToken(internalData);
+	}
+
+	void CancellationTokenSource::Cancel()
+	{
+		internalData->cancelled = true;
+	}
+
+	bool CancellationTokenSource::IsCancellationRequested() const
+	{
+		return internalData->cancelled;
+	}
+
+/***********************************************************************
+Parallel Algorithms
+***********************************************************************/
+
+	namespace threading_internal
+	{
+		struct ParallelRange
+		{
+			vint						begin = 0;
+			vint						end = 0;
+		};
+
+		struct ParallelGroup
+		{
+			const Func<void(vint, vint)>*	body = nullptr;
+			vint						grain = 1;
+			atomic_vint					references = 1;
+			atomic_vint					unfinished = 1;
+			std::atomic<bool>			failed = false;
+			std::atomic<bool>			waiting = false;
+			EventObject					eventWake;
+
+			// covers ranges, exception
+			SpinLock					lockRanges;
+			collections::List<ParallelRange>	ranges;
+			std::exception_ptr			exception;
+		};
+
+		void ParallelRelease(ParallelGroup* group)
+		{
+			if (DECRC(&group->references) == 0)
+			{
+				delete group;
+			}
+		}
+
+		bool ParallelPop(ParallelGroup* group, ParallelRange& range)
+		{
+			SPIN_LOCK(group->lockRanges)
+			{
+				if (group->ranges.Count() > 0)
+				{
+					range = group->ranges[group->ranges.Count() - 1];
+					group->ranges.RemoveAt(group->ranges.Count() - 1);
+					return true;
+				}
+			}
+			return false;
+		}
+
+		bool ParallelHasRanges(ParallelGroup* group)
+		{
+			SPIN_LOCK(group->lockRanges)
+			{
+				return group->ranges.Count() > 0;
+			}
+			return false;
+		}
+
+		void ParallelTicket(void* argument);
+
+		void ParallelProcess(ParallelGroup* group, vint begin, vint end)
+		{
+			while (end - begin > group->grain && !group->failed)
+			{
+				// keep the first half and offer the second half, a ticket executes any offered range, or nothing if the caller has taken them all
+				auto middle = begin + (end - begin) / 2;
+				INCRC(&group->unfinished);
+				SPIN_LOCK(group->lockRanges)
+				{
+					group->ranges.Add({ middle,end });
+				}
+				INCRC(&group->references);
+				if (!ThreadPoolLite::Queue(&ParallelTicket, group))
+				{
+					ParallelRelease(group);
+				}
+				if (group->waiting.exchange(false))
+				{
+					group->eventWake.Signal();
+				}
+				end = middle;
+			}
+
+			if (!group->failed)
+			{
+				try
+				{
+					(*group->body)(begin, end);
+				}
+				catch (...)
+				{
+					SPIN_LOCK(group->lockRanges)
+					{
+						if (!group->exception)
+						{
+							group->exception = std::current_exception();
+						}
+					}
+					group->failed = true;
+				}
+			}
+
+			if (DECRC(&group->unfinished) == 0)
+			{
+				group->eventWake.Signal();
+			}
+		}
+
+		void ParallelTicket(void* argument)
+		{
+			auto group = (ParallelGroup*)argument;
+			ParallelRange range;
+			if (ParallelPop(group, range))
+			{
+				ParallelProcess(group, range.begin, range.end);
+			}
+			ParallelRelease(group);
+		}
+	}
+
+	void ParallelForRange(vint begin, vint end, vint grain, const Func<void(vint, vint)>& body)
+	{
+		CHECK_ERROR(grain >= 0, L"vl::ParallelForRange(vint, vint, vint, const Func<void(vint, vint)>&)#grain must not be negative.");
+		if (begin >= end) return;
+		if (grain == 0)
+		{
+			grain = (end - begin) / (Thread::GetCPUCount() * 4);
+			if (grain < 1) grain = 1;
+		}
+		if (end - begin <= grain)
+		{
+			body(begin, end);
+			return;
+		}
+
+		auto group = new ParallelGroup;
+		group->body = &body;
+		group->grain = grain;
+		group->eventWake.CreateAutoUnsignal(false);
+		ParallelProcess(group, begin, end);
+
+		while (true)
+		{
+			ParallelRange range;
+			if (ParallelPop(group, range))
+			{
+				ParallelProcess(group, range.begin, range.end);
+				continue;
+			}
+			if (group->unfinished == 0) break;
+
+			// sleep until a range is offered or all ranges finish, check again after claiming to wait to avoid missing a signal
+			group->waiting = true;
+			if (ParallelHasRanges(group) || group->unfinished == 0)
+			{
+				group->waiting = false;
+				continue;
+			}
+			group->eventWake.Wait();
+		}
+
+		auto exception = group->exception;
+		ParallelRelease(group);
+		if (exception)
+		{
+			std::rethrow_exception(exception);
 		}
 	}
 }
@@ -7,6 +7,9 @@ Licensed under https://github.com/vczh-libraries/License
 #define VCZH_THREADING
 
 #include <Vlpp.h>
+#include <cstddef>
+#include <exception>
+#include <coroutine>
 
 namespace vl
 {
@@ -25,7 +28,14 @@ Kernel Mode Objects
 		struct CriticalSectionData;
 		struct ReaderWriterLockData;
 		struct ConditionVariableData;
+		struct ThreadPoolData;
+		struct TaskQueueNode;
+		struct TimerData;
+		struct CancellationData;
 	}
+
+	class WaitStatistics;
+	class TaskStatistics;
 	
 	/// <summary>Base type of all synchronization objects.</summary>
 	class WaitableObject : public Object
@@ -52,37 +62,87 @@ Kernel Mode Objects
 		/// <remarks>This function is only available in Windows.</remarks>
 		bool										WaitForTime(vint ms);
 		
+#elif defined VCZH_GCC
+	private:
+		static vint									WaitForObjects(WaitableObject** objects, vint count, bool waitAll, vint ms);
+	protected:
+		threading_internal::WaitableData*			waitableData;
+
+		WaitableObject();
+		~WaitableObject();
+
+		/// <summary>Wake up threads that are waiting for multiple objects including this object. It must be called after this object becomes signaled.</summary>
+		void										NotifyWaiters();
+		/// <summary>Tell threads waiting for multiple objects including this object that it could be signaled by another process, which does not call <see cref="NotifyWaiters"/>.</summary>
+		void										SetSharedAcrossProcesses();
+		/// <summary>Let threads waiting for this object be woken up by another object, which is signaled when this object is signaled.</summary>
+		/// <param name="object">The other object.</param>
+		void										ShareWaitersWith(WaitableObject& object);
+		/// <summary>Take the signal of this object without blocking, like a successful <see cref="Wait"/>.</summary>
+		/// <returns>Returns true if the signal is taken.</returns>
+		virtual bool								TryAcquire() = 0;
+		/// <summary>Give back the signal taken by <see cref="TryAcquire"/>.</summary>
+		virtual void								UndoAcquire() = 0;
+	public:
+		NOT_COPYABLE(WaitableObject);
+
+		virtual bool								Wait() = 0;
+#endif
+
 		/// <summary>Wait for multiple objects.</summary>
 		/// <returns>Returns true if all objects are signaled. Returns false if this operation failed.</returns>
 		/// <param name="objects">A pointer to an array to <see cref="WaitableObject"/> pointers.</param>
 		/// <param name="count">The number of <see cref="WaitableObject"/> objects in the array.</param>
-		/// <remarks>This function is only available in Windows.</remarks>
 		static bool									WaitAll(WaitableObject** objects, vint count);
 		/// <summary>Wait for multiple objects for a period of time.</summary>
 		/// <returns>Returns true if all objects are signaled. Returns false if this operation failed, including time out.</returns>
 		/// <param name="objects">A pointer to an array to <see cref="WaitableObject"/> pointers.</param>
 		/// <param name="count">The number of <see cref="WaitableObject"/> objects in the array.</param>
 		/// <param name="ms">Time in milliseconds.</param>
-		/// <remarks>This function is only available in Windows.</remarks>
 		static bool									WaitAllForTime(WaitableObject** objects, vint count, vint ms);
 		/// <summary>Wait for one of the objects.</summary>
 		/// <returns>Returns the index of the first signaled or abandoned object, according to the "abandoned" parameter. Returns -1 if this operation failed.</returns>
 		/// <param name="objects">A pointer to an array to <see cref="WaitableObject"/> pointers.</param>
 		/// <param name="count">The number of <see cref="WaitableObject"/> objects in the array.</param>
-		/// <param name="abandoned">Returns true if the waiting is canceled by an abandoned object. An abandoned object is caused by it's owner thread existing without releasing it.</param>
-		/// <remarks>This function is only available in Windows.</remarks>
+		/// <param name="abandoned">Returns true if the waiting is canceled by an abandoned object. An abandoned object is caused by it's owner thread existing without releasing it. It is always false in Linux.</param>
 		static vint									WaitAny(WaitableObject** objects, vint count, bool* abandoned);
 		/// <summary>Wait for one of the objects for a period of time.</summary>
 		/// <returns>Returns the index of the first signaled or abandoned object, according to the "abandoned" parameter. Returns -1 if this operation failed, including time out.</returns>
 		/// <param name="objects">A pointer to an array to <see cref="WaitableObject"/> pointers.</param>
 		/// <param name="count">The number of <see cref="WaitableObject"/> objects in the array.</param>
 		/// <param name="ms">Time in milliseconds.</param>
-		/// <param name="abandoned">Returns true if the waiting is canceled by an abandoned object. An abandoned object is caused by it's owner thread existing without releasing it.</param>
-		/// <remarks>This function is only available in Windows.</remarks>
+		/// <param name="abandoned">Returns true if the waiting is canceled by an abandoned object. An abandoned object is caused by it's owner thread existing without releasing it. It is always false in Linux.</param>
 		static vint									WaitAnyForTime(WaitableObject** objects, vint count, vint ms, bool* abandoned);
-#elif defined VCZH_GCC
-		virtual bool								Wait() = 0;
-#endif
+	};
+
+	/// <summary>Scheduling policy of a thread.</summary>
+	enum class ThreadSchedulingPolicy
+	{
+		/// <summary>The default time-sharing policy. <see cref="ThreadStartOptions::priority"/> is the nice value in Linux, which is applied when the thread starts and ignored if it is not permitted. It is the relative priority from -2 to 2 in Windows.</summary>
+		Normal,
+		/// <summary>A time-sharing policy for CPU-intensive threads that tolerate a longer latency. It maps to SCHED_BATCH in Linux, and to a below normal priority in Windows.</summary>
+		Batch,
+		/// <summary>Only runs when the processor is otherwise idle. It maps to SCHED_IDLE in Linux, and to the idle priority in Windows.</summary>
+		Idle,
+		/// <summary>A real-time first-in-first-out policy. <see cref="ThreadStartOptions::priority"/> is the real-time priority in Linux. It maps to the time critical priority in Windows. It usually requires privileges.</summary>
+		FIFO,
+		/// <summary>A real-time round-robin policy. <see cref="ThreadStartOptions::priority"/> is the real-time priority in Linux. It maps to the time critical priority in Windows. It usually requires privileges.</summary>
+		RoundRobin,
+	};
+
+	/// <summary>Options to start a thread. Default values keep the behavior of the operating system.</summary>
+	struct ThreadStartOptions
+	{
+		/// <summary>The name of the thread visible in debuggers and tools like top and perf. Linux truncates it to 15 bytes in UTF-8. An empty name keeps the default name.</summary>
+		WString										name;
+		/// <summary>The stack size in bytes, 0 to use the default size.</summary>
+		vint										stackSize = 0;
+		/// <summary>Bit i allows the thread to run on logical processor i, 0 to run on any processor. It is ignored in macOS.</summary>
+		vuint64_t									affinityMask = 0;
+		/// <summary>The scheduling policy.</summary>
+		ThreadSchedulingPolicy						policy = ThreadSchedulingPolicy::Normal;
+		/// <summary>The priority, its meaning depends on <see cref="policy"/>.</summary>
+		vint										priority = 0;
 	};
 
 	/// <summary>Thread. [M:vl.Thread.CreateAndStart] is the suggested way to create threads.</summary>
@@ -107,6 +167,10 @@ Kernel Mode Objects
 		volatile ThreadState						threadState;
 
 		virtual void								Run()=0;
+#if defined VCZH_GCC
+		bool										TryAcquire() override;
+		void										UndoAcquire() override;
+#endif
 
 		Thread();
 	public:
@@ -117,12 +181,14 @@ Kernel Mode Objects
 		/// <param name="procedure">The function pointer.</param>
 		/// <param name="argument">The argument to call the function pointer.</param>
 		/// <param name="deleteAfterStopped">Set to true (by default) to make the thread delete itself after the job is done. If you set this argument to true, you are not recommended to touch the returned thread pointer in any way.</param>
-		static Thread*								CreateAndStart(ThreadProcedure procedure, void* argument=0, bool deleteAfterStopped=true);
+		/// <param name="options">Options to start the thread.</param>
+		static Thread*								CreateAndStart(ThreadProcedure procedure, void* argument=0, bool deleteAfterStopped=true, const ThreadStartOptions& options={});
 		/// <summary>Create a thread using a function object or a lambda expression.</summary>
 		/// <returns>Returns the created thread.</returns>
 		/// <param name="procedure">The function object or the lambda expression.</param>
 		/// <param name="deleteAfterStopped">Set to true (by default) to make the thread delete itself after the job is done. If you set this argument to true, you are not recommended to touch the returned thread pointer in any way.</param>
-		static Thread*								CreateAndStart(const Func<void()>& procedure, bool deleteAfterStopped=true);
+		/// <param name="options">Options to start the thread.</param>
+		static Thread*								CreateAndStart(const Func<void()>& procedure, bool deleteAfterStopped=true, const ThreadStartOptions& options={});
 		/// <summary>Pause the caller thread for a period of time.</summary>
 		/// <param name="ms">Time in milliseconds.</param>
 		static void									Sleep(vint ms);
@@ -136,6 +202,10 @@ Kernel Mode Objects
 		/// <summary>Start the thread.</summary>
 		/// <returns>Returns true if this operation succeeded.</returns>
 		bool										Start();
+		/// <summary>Start the thread with options.</summary>
+		/// <returns>Returns true if this operation succeeded. Returns false if any option could not be applied, for example, a real-time policy without privileges.</returns>
+		/// <param name="options">Options to start the thread.</param>
+		bool										Start(const ThreadStartOptions& options);
 #if defined VCZH_GCC
 		bool										Wait();
 #endif
@@ -155,6 +225,11 @@ Kernel Mode Objects
 	{
 	private:
 		threading_internal::MutexData*				internalData;
+#ifdef VCZH_GCC
+	protected:
+		bool										TryAcquire() override;
+		void										UndoAcquire() override;
+#endif
 	public:
 		Mutex();
 		~Mutex();
@@ -186,6 +261,12 @@ Kernel Mode Objects
 	{
 	private:
 		threading_internal::SemaphoreData*			internalData;
+#ifdef VCZH_GCC
+		friend class Mutex;
+	protected:
+		bool										TryAcquire() override;
+		void										UndoAcquire() override;
+#endif
 	public:
 		Semaphore();
 		~Semaphore();
@@ -206,7 +287,7 @@ Kernel Mode Objects
 		/// <returns>Returns true if this operation succeeded.</returns>
 		bool										Release();
 		/// <summary> Release the semaphore multiple times. </summary>
-		/// <returns>Returns true if this operation succeeded.</returns>
+		/// <returns>Returns the counter before releasing. Returns -1 if this operation failed.</returns>
 		/// <param name="count">The amout to release.</param>
 		vint										Release(vint count);
 #ifdef VCZH_GCC
@@ -219,6 +300,12 @@ Kernel Mode Objects
 	{
 	private:
 		threading_internal::EventData*				internalData;
+		WaitStatistics*								statistics = nullptr;
+#ifdef VCZH_GCC
+	protected:
+		bool										TryAcquire() override;
+		void										UndoAcquire() override;
+#endif
 	public:
 		EventObject();
 		~EventObject();
@@ -245,20 +332,234 @@ Kernel Mode Objects
 		/// <summary>Unsignal the event.</summary>
 		/// <returns>Returns true if this operation succeeded.</returns>
 		bool										Unsignal();
-#ifdef VCZH_GCC
+		/// <summary>Wait for this event to signal.</summary>
+		/// <returns>Returns true if the event is signaled. Returns false if this operation failed.</returns>
 		bool										Wait();
 		/// <summary>Wait for this event to signal for a period of time.</summary>
 		/// <returns>Returns true if the event is signaled. Returns false if this operation failed, including time out.</returns>
 		/// <param name="ms">Time in milliseconds.</param>
 		bool										WaitForTime(vint ms);
-#endif
+		/// <summary>Attach a statistics object to record waits on this event by <see cref="Wait"/> and <see cref="WaitForTime"/>. It should be called before the event is used by multiple threads.</summary>
+		/// <param name="_statistics">The statistics object, which must outlive this event. Set to null to stop recording.</param>
+		void										SetStatistics(WaitStatistics* _statistics);
 	};
 
 /***********************************************************************
 Thread Pool
 ***********************************************************************/
 
-	/// <summary>A light-weight thread pool.</summary>
+	/// <summary>
+	/// A move-only task for thread pools.
+	/// A function pointer with its argument, or a callable object no larger than <see cref="InlineSize"/>, is stored inline without allocating memory.
+	/// Larger callable objects are stored on the heap.
+	/// </summary>
+	class InlineTask
+	{
+	public:
+		/// <summary>The maximum size of a callable object that is stored inline.</summary>
+		static constexpr vint						InlineSize = sizeof(void*) * 6;
+
+	private:
+		struct Operations
+		{
+			void(*invoke)(void* storage);
+			void(*move)(void* from, void* to);
+			void(*destroy)(void* storage);
+		};
+
+		template<typename T>
+		struct InlineOperations
+		{
+			static void Invoke(void* storage) { (*reinterpret_cast<T*>(storage))(); }
+			static void Move(void* from, void* to) { new(to) T(std::move(*reinterpret_cast<T*>(from))); reinterpret_cast<T*>(from)->~T(); }
+			static void Destroy(void* storage) { reinterpret_cast<T*>(storage)->~T(); }
+			static constexpr Operations Table = { &Invoke, &Move, &Destroy };
+		};
+
+		template<typename T>
+		struct HeapOperations
+		{
+			static void Invoke(void* storage) { (**reinterpret_cast<T**>(storage))(); }
+			static void Move(void* from, void* to) { *reinterpret_cast<T**>(to) = *reinterpret_cast<T**>(from); }
+			static void Destroy(void* storage) { delete *reinterpret_cast<T**>(storage); }
+			static constexpr Operations Table = { &Invoke, &Move, &Destroy };
+		};
+
+		struct FunctionPointer
+		{
+			void(*proc)(void*);
+			void*									argument;
+
+			void operator()() const { proc(argument); }
+		};
+
+		const Operations*							operations = nullptr;
+		alignas(std::max_align_t) char				storage[InlineSize];
+
+		template<typename T, typename F>
+		void Construct(F&& callable)
+		{
+			if constexpr (sizeof(T) <= InlineSize && alignof(T) <= alignof(std::max_align_t))
+			{
+				new(storage) T(std::forward<F>(callable));
+				operations = &InlineOperations<T>::Table;
+			}
+			else
+			{
+				*reinterpret_cast<T**>(storage) = new T(std::forward<F>(callable));
+				operations = &HeapOperations<T>::Table;
+			}
+		}
+
+	public:
+		/// <summary>Create an empty task.</summary>
+		InlineTask() = default;
+
+		/// <summary>Create a task calling a function pointer.</summary>
+		/// <param name="proc">The function pointer.</param>
+		/// <param name="argument">The argument to call the function pointer.</param>
+		InlineTask(void(*proc)(void*), void* argument)
+		{
+			Construct<FunctionPointer>(FunctionPointer{ proc, argument });
+		}
+
+		/// <summary>Create a task from a callable object, including a <see cref="Func`1"/>.</summary>
+		/// <typeparam name="F">The type of the callable object.</typeparam>
+		/// <param name="callable">The callable object.</param>
+		template<typename F>
+			requires(!std::is_same_v<std::remove_cvref_t<F>, InlineTask> && std::is_invocable_v<std::remove_cvref_t<F>&>)
+		explicit InlineTask(F&& callable)
+		{
+			Construct<std::remove_cvref_t<F>>(std::forward<F>(callable));
+		}
+
+		InlineTask(InlineTask&& task)
+		{
+			if (task.operations)
+			{
+				task.operations->move(task.storage, storage);
+				operations = task.operations;
+				task.operations = nullptr;
+			}
+		}
+
+		~InlineTask()
+		{
+			Reset();
+		}
+
+		InlineTask(const InlineTask&) = delete;
+		InlineTask& operator=(const InlineTask&) = delete;
+
+		InlineTask& operator=(InlineTask&& task)
+		{
+			if (this != &task)
+			{
+				Reset();
+				if (task.operations)
+				{
+					task.operations->move(task.storage, storage);
+					operations = task.operations;
+					task.operations = nullptr;
+				}
+			}
+			return *this;
+		}
+
+		/// <summary>Test if the task is empty.</summary>
+		/// <returns>Returns true if the task is empty.</returns>
+		bool IsEmpty() const
+		{
+			return operations == nullptr;
+		}
+
+		/// <summary>Destroy the callable object and make the task empty.</summary>
+		void Reset()
+		{
+			if (operations)
+			{
+				auto destroy = operations->destroy;
+				operations = nullptr;
+				destroy(storage);
+			}
+		}
+
+		/// <summary>Run the task. The task must not be empty.</summary>
+		void operator()()
+		{
+			operations->invoke(storage);
+		}
+	};
+
+	/// <summary>Configuration of a <see cref="ThreadPool"/>.</summary>
+	struct ThreadPoolConfig
+	{
+		/// <summary>The number of workers that are kept alive even when they are idle. The default value is 0.</summary>
+		vint										minWorkers = 0;
+		/// <summary>The maximum number of workers. A new worker is only spawned when a task is queued while no worker is idle. The default value -1 means 4 workers per logical processor.</summary>
+		vint										maxWorkers = -1;
+		/// <summary>Time in milliseconds for an idle worker to exit when there are more than <see cref="minWorkers"/> workers. Set to -1 to keep all spawned workers. The default value is 30 seconds. This field is ignored in Windows.</summary>
+		vint										idleTimeout = 30000;
+		/// <summary>Set to true to start <see cref="minWorkers"/> workers when the pool is created, instead of spawning them on demand.</summary>
+		bool										warmUp = false;
+		/// <summary>Options to start workers, for example, to pin compute workers to processors not used by network threads. This field is ignored in Windows.</summary>
+		ThreadStartOptions							workerOptions;
+	};
+
+	/// <summary>A thread pool owning its workers. Tasks in different thread pools do not starve each other.</summary>
+	class ThreadPool : public Object
+	{
+	private:
+		threading_internal::ThreadPoolData*			internalData;
+	public:
+		NOT_COPYABLE(ThreadPool);
+		/// <summary>Create a thread pool.</summary>
+		/// <param name="config">The configuration of the thread pool.</param>
+		ThreadPool(const ThreadPoolConfig& config = {});
+		/// <summary>Stop the thread pool without discarding pending tasks if <see cref="Stop"/> has not been called.</summary>
+		~ThreadPool();
+
+		/// <summary>Queue a function pointer.</summary>
+		/// <returns>Returns true if this operation succeeded. Returns false if the thread pool is stopped.</returns>
+		/// <param name="proc">The function pointer.</param>
+		/// <param name="argument">The argument to call the function pointer.</param>
+		bool										Queue(void(*proc)(void*), void* argument);
+		/// <summary>Queue a function object.</summary>
+		/// <returns>Returns true if this operation succeeded. Returns false if the thread pool is stopped.</returns>
+		/// <param name="proc">The function object.</param>
+		bool										Queue(const Func<void()>& proc);
+		/// <summary>Queue a task. Submitting a task that is stored inline does not allocate memory after the thread pool is warmed up in Linux and macOS.</summary>
+		/// <returns>Returns true if this operation succeeded. Returns false if the thread pool is stopped.</returns>
+		/// <param name="task">The task.</param>
+		bool										Queue(InlineTask&& task);
+
+		/// <summary>Queue a lambda expression.</summary>
+		/// <typeparam name="T">The type of the lambda expression.</typeparam>
+		/// <param name="proc">The lambda expression.</param>
+		template<typename T>
+		void QueueLambda(const T& proc)
+		{
+			Queue(InlineTask(proc));
+		}
+
+		/// <summary>Attach a statistics object to record tasks queued to this thread pool.</summary>
+		/// <param name="statistics">The statistics object, which must outlive this thread pool. Set to null to stop recording.</param>
+		void										SetStatistics(TaskStatistics* statistics);
+
+#ifdef VCZH_GCC
+		/// <summary>Get the number of workers that have not retired.</summary>
+		/// <returns>The number of workers, which is between <see cref="ThreadPoolConfig::minWorkers"/> and <see cref="ThreadPoolConfig::maxWorkers"/> after workers are started.</returns>
+		/// <remarks>This function is only available in Linux and macOS. In Windows, the system thread pool is used.</remarks>
+		vint										GetWorkerCount();
+#endif
+
+		/// <summary>Stop accepting new tasks and wait until all workers exit. It should not be called in a worker of this thread pool.</summary>
+		/// <returns>Returns true if this operation succeeded. Returns false if the thread pool has already been stopped.</returns>
+		/// <param name="discardPendingTasks">Set to true to discard all tasks that have not started.</param>
+		bool										Stop(bool discardPendingTasks);
+	};
+
+	/// <summary>A light-weight thread pool. It queues tasks to a process-wide default thread pool.</summary>
 	class ThreadPoolLite : public Object
 	{
 	private:
@@ -274,6 +575,10 @@ Thread Pool
 		/// <returns>Returns true if this operation succeeded.</returns>
 		/// <param name="proc">The function object.</param>
 		static bool									Queue(const Func<void()>& proc);
+		/// <summary>Queue a task. Submitting a task that is stored inline does not allocate memory after the thread pool is warmed up in Linux and macOS.</summary>
+		/// <returns>Returns true if this operation succeeded.</returns>
+		/// <param name="task">The task.</param>
+		static bool									Queue(InlineTask&& task);
 		
 		/// <summary>Queue a lambda expression.</summary>
 		/// <typeparam name="T">The type of the lambda expression.</typeparam>
@@ -281,10 +586,19 @@ Thread Pool
 		template<typename T>
 		static void QueueLambda(const T& proc)
 		{
-			Queue(Func<void()>(proc));
+			Queue(InlineTask(proc));
 		}
 
+		/// <summary>Attach a statistics object to record tasks queued to the default thread pool.</summary>
+		/// <param name="statistics">The statistics object, which must outlive all tasks queued to the default thread pool. Set to null to stop recording.</param>
+		static void									SetStatistics(TaskStatistics* statistics);
+
 #ifdef VCZH_GCC
+		/// <summary>Configure the default thread pool. If <see cref="ThreadPoolConfig::warmUp"/> is true, the default thread pool is created immediately.</summary>
+		/// <returns>Returns false if the default thread pool is running, the configuration takes effect after <see cref="Stop"/>.</returns>
+		/// <param name="config">The configuration of the default thread pool.</param>
+		/// <remarks>This function is only available in Linux and macOS. In Windows, the system thread pool is used.</remarks>
+		static bool									Configure(const ThreadPoolConfig& config);
 		static bool									Stop(bool discardPendingTasks);
 #endif
 	};
@@ -407,6 +721,7 @@ Kernel Mode Objects in Process
 	{
 	private:
 		threading_internal::ConditionVariableData*	internalData;
+		WaitStatistics*								statistics = nullptr;
 	public:
 		NOT_COPYABLE(ConditionVariable);
 		/// <summary>Create a conditional variable.</summary>
@@ -446,6 +761,9 @@ Kernel Mode Objects in Process
 		/// <remarks>This function is only available in Windows.</remarks>
 		bool										SleepWithWriterForTime(ReaderWriterLock& lock, vint ms);
 #endif
+		/// <summary>Attach a statistics object to record waits on this condition variable by all Sleep functions. It should be called before the condition variable is used by multiple threads.</summary>
+		/// <param name="_statistics">The statistics object, which must outlive this condition variable. Set to null to stop recording.</param>
+		void										SetStatistics(WaitStatistics* _statistics);
 		/// <summary>Wake one thread that pending on this condition variable.</summary>
 		void										WakeOnePending();
 		/// <summary>Wake all thread that pending on this condition variable.</summary>
@@ -456,8 +774,48 @@ Kernel Mode Objects in Process
 User Mode Objects
 ***********************************************************************/
 	
+	/// <summary>
+	/// Contention counters of <see cref="SpinLock"/> objects.
+	/// Counters are only updated for locks that are attached to a <see cref="SpinLockStatistics"/> by [M:vl.SpinLock.SetStatistics].
+	/// Multiple locks could share the same <see cref="SpinLockStatistics"/>.
+	/// All living <see cref="SpinLockStatistics"/> objects could be listed by <see cref="Enumerate"/> to find hot locks.
+	/// </summary>
+	class SpinLockStatistics : public Object
+	{
+	private:
+		const wchar_t*								name;
+		SpinLockStatistics*							previous = nullptr;
+		SpinLockStatistics*							next = nullptr;
+	public:
+		NOT_COPYABLE(SpinLockStatistics);
+		/// <summary>Create and register a statistics object.</summary>
+		/// <param name="_name">The name of the statistics object, it should be a string literal.</param>
+		SpinLockStatistics(const wchar_t* _name);
+		~SpinLockStatistics();
+
+		/// <summary>The number of acquisitions.</summary>
+		std::atomic<vuint64_t>						acquisitions = 0;
+		/// <summary>The number of acquisitions that could not succeed immediately.</summary>
+		std::atomic<vuint64_t>						contendedAcquisitions = 0;
+		/// <summary>The number of pause instructions executed while spinning.</summary>
+		std::atomic<vuint64_t>						spinIterations = 0;
+		/// <summary>The number of times waiting threads fall asleep.</summary>
+		std::atomic<vuint64_t>						parks = 0;
+
+		/// <summary>Get the name of the statistics object.</summary>
+		/// <returns>The name.</returns>
+		const wchar_t*								GetName();
+		/// <summary>Set all counters to 0.</summary>
+		void										Reset();
+
+		/// <summary>Call a callback for all living statistics objects. The callback must not create or destroy any statistics object.</summary>
+		/// <param name="callback">The callback.</param>
+		static void									Enumerate(const Func<void(SpinLockStatistics*)>& callback);
+	};
+
 	/// <summary>
 	/// Spin lock. It is similar to mutex, but it does not occupy resource in the system.
+	/// A thread spins with exponential backoff for a short period when the lock is owned by another thread, and then yields, and then sleeps until the lock is released.
 	/// The macro "SPIN_LOCK" is recommended instead of calling [M:vl.SpinLock.Enter] and [M:vl.SpinLock.Leave] like this:
 	/// <program><code><![CDATA[
 	/// SPIN_LOCK(yourLock)
@@ -469,7 +827,11 @@ User Mode Objects
 	class SpinLock : public Object
 	{
 	protected:
-		atomic_vint									token = 0;
+		// 0: free, 1: owned, 2: owned and some threads may be sleeping
+		std::atomic<vuint32_t>						token = 0;
+		SpinLockStatistics*							statistics = nullptr;
+
+		void										EnterContended();
 	public:
 		NOT_COPYABLE(SpinLock);
 		/// <summary>Create a spin lock.</summary>
@@ -483,6 +845,9 @@ User Mode Objects
 		void										Enter();
 		/// <summary>Leave a spin lock.</summary>
 		void										Leave();
+		/// <summary>Attach a statistics object to record contention of this lock. It should be called before the lock is used by multiple threads.</summary>
+		/// <param name="_statistics">The statistics object, which must outlive this lock. Set to null to stop recording.</param>
+		void										SetStatistics(SpinLockStatistics* _statistics);
 
 	public:
 		class Scope : public Object
@@ -498,98 +863,500 @@ User Mode Objects
 
 #define SPIN_LOCK(LOCK) SCOPE_VARIABLE(const SpinLock::Scope&, scope, LOCK)
 #define CS_LOCK(LOCK) SCOPE_VARIABLE(const CriticalSection::Scope&, scope, LOCK)
-#define READER_LOCK(LOCK) SCOPE_VARIABLE(const ReaderWriterLock::ReaderScope&, scope, LOCK)
-#define WRITER_LOCK(LOCK) SCOPE_VARIABLE(const ReaderWriterLock::WriterScope&, scope, LOCK)
+#define READER_LOCK(LOCK) SCOPE_VARIABLE(const typename std::remove_reference_t<decltype(LOCK)>::ReaderScope&, scope, LOCK)
+#define WRITER_LOCK(LOCK) SCOPE_VARIABLE(const typename std::remove_reference_t<decltype(LOCK)>::WriterScope&, scope, LOCK)
 
-/***********************************************************************
-Thread Local Storage
-***********************************************************************/
+	namespace threading_internal
+	{
+		/// <summary>The number of reader counters in <see cref="StripedReaderWriterLock"/> and <see cref="ReadMostly`1"/>.</summary>
+		constexpr vint								ReaderStripeCount = 32;
 
-	/// <summary>Thread local storage operations.</summary>
+		/// <summary>Get the reader counter assigned to the current thread. Threads are assigned to counters in turn when they first call this function.</summary>
+		/// <returns>The index of the reader counter, between 0 and <see cref="ReaderStripeCount"/> - 1.</returns>
+		extern vint									GetReaderStripeIndex();
+
+		/// <summary>A group of reader counters occupying its own cache line.</summary>
+		struct alignas(64) ReaderStripe
+		{
+			std::atomic<vuint32_t>					readers[2] = { 0,0 };
+		};
+	}
+
+	/// <summary>
+	/// Reader writer lock for data that is rarely modified.
+	/// A reader only updates a counter assigned to its thread, these counters are in different cache lines, so that readers on different cores do not slow down each other.
+	/// A writer blocks new readers, and waits for all counters to become 0, so acquiring a writer lock is much more expensive than <see cref="ReaderWriterLock"/>.
+	/// The macro "READER_LOCK" and "WRITER_LOCK" are recommended instead of calling [M:vl.StripedReaderWriterLock.EnterReader], [M:vl.StripedReaderWriterLock.LeaveReader], [M:vl.StripedReaderWriterLock.EnterWriter] and [M:vl.StripedReaderWriterLock.LeaveWriter].
+	/// </summary>
 	/// <remarks>
-	/// This class is designed to define global variables.
-	/// Dynamically allocation will result in undefined behavior.
+	/// The lock is not reentrant, a thread must not acquire a reader lock again while it owns one, because a waiting writer blocks the second acquisition.
+	/// A reader lock must be released in the thread that acquires it.
 	/// </remarks>
-	class ThreadLocalStorage : public Object
+	class StripedReaderWriterLock : public Object
 	{
-		typedef void(*Destructor)(void*);
 	protected:
-		vuint64_t								key;
-		Destructor								destructor;
-		volatile bool							disposed = false;
-		
-		static void								PushStorage(ThreadLocalStorage* storage);
+		threading_internal::ReaderStripe			stripes[threading_internal::ReaderStripeCount];
+		// 0: no writer, 1: owned by a writer, 2: owned by a writer and some readers may be sleeping
+		std::atomic<vuint32_t>						writerState = 0;
+		SpinLock									lockWriters;
+
+		void										ReleaseReader(threading_internal::ReaderStripe& stripe);
+		void										WaitForWriter();
+		void										ReleaseWriterState();
 	public:
-		NOT_COPYABLE(ThreadLocalStorage);
-		ThreadLocalStorage(Destructor _destructor);
-		~ThreadLocalStorage();
+		NOT_COPYABLE(StripedReaderWriterLock);
+		/// <summary>Create a reader writer lock.</summary>
+		StripedReaderWriterLock() = default;
+		~StripedReaderWriterLock() = default;
 
-		void*									Get();
-		void									Set(void* data);
-		void									Clear();
-		void									Dispose();
+		/// <summary>Try acquire a reader lock. This function will return immediately.</summary>
+		/// <returns>Returns true if the current thread acquired the reader lock.</returns>
+		bool										TryEnterReader();
+		/// <summary>Acquire a reader lock.</summary>
+		void										EnterReader();
+		/// <summary>Release a reader lock.</summary>
+		void										LeaveReader();
+		/// <summary>Try acquire a writer lock. This function will return immediately if another writer owns the lock, or any reader owns the lock.</summary>
+		/// <returns>Returns true if the current thread acquired the writer lock.</returns>
+		bool										TryEnterWriter();
+		/// <summary>Acquire a writer lock.</summary>
+		void										EnterWriter();
+		/// <summary>Release a writer lock.</summary>
+		void										LeaveWriter();
+	public:
+		class ReaderScope : public Object
+		{
+		private:
+			StripedReaderWriterLock*				lock;
+		public:
+			NOT_COPYABLE(ReaderScope);
+			ReaderScope(StripedReaderWriterLock& _lock);
+			~ReaderScope();
+		};
 
-		/// <summary>Fix all storage creation.</summary>
-		static void								FixStorages();
-		/// <summary>Clear all storages for the current thread. For threads that are created using [T:vl.Thread], this function will be automatically called when before the thread exit.</summary>
-		static void								ClearStorages();
-		/// <summary>Clear all storages for the current thread (should be the main thread) and clear all records. This function can only be called by the main thread when all other threads are exited. It will reduce noices for detecting memory leaks.</summary>
-		static void								DisposeStorages();
+		class WriterScope : public Object
+		{
+		private:
+			StripedReaderWriterLock*				lock;
+		public:
+			NOT_COPYABLE(WriterScope);
+			WriterScope(StripedReaderWriterLock& _lock);
+			~WriterScope();
+		};
 	};
 
-	/// <summary>Thread local variable. Different threads can store different values to and obtain differnt values from a thread local variable.</summary>
-	/// <typeparam name="T">Type of the storage.</typeparam>
-	/// <remarks>
-	/// This class is designed to define global variables.
-	/// Dynamically allocation will result in undefined behavior.
-	/// </remarks>
+	namespace threading_internal
+	{
+		/// <summary>Reader tracking of <see cref="ReadMostly`1"/>. Readers are counted in one of two counter groups selected by the epoch, a writer flips the epoch and waits for the previous group to be drained, so that continuous readers could not starve writers.</summary>
+		class ReadMostlyBase : public Object
+		{
+		protected:
+			ReaderStripe							stripes[ReaderStripeCount];
+			std::atomic<vuint32_t>					epoch = 0;
+			std::atomic<vuint32_t>					synchronizing = 0;
+			SpinLock								lockWriters;
+
+			vint									EnterRead();
+			void									LeaveRead(vint group);
+			void									Synchronize();
+
+			class ReadScope
+			{
+			private:
+				ReadMostlyBase*						owner;
+				vint								group;
+			public:
+				ReadScope(ReadMostlyBase* _owner) :owner(_owner), group(_owner->EnterRead()) {}
+				~ReadScope() { owner->LeaveRead(group); }
+			};
+		public:
+			NOT_COPYABLE(ReadMostlyBase);
+			ReadMostlyBase() = default;
+			~ReadMostlyBase() = default;
+		};
+	}
+
+	/// <summary>
+	/// A value that is rarely modified.
+	/// Readers access the current version without taking any lock, and only update a counter assigned to its thread.
+	/// A writer creates a new version, publishes it, and deletes the previous version after all readers that could see it are finished.
+	/// </summary>
+	/// <typeparam name="T">Type of the value.</typeparam>
 	template<typename T>
-	class ThreadVariable : public Object
+	class ReadMostly : public threading_internal::ReadMostlyBase
 	{
 	protected:
-		ThreadLocalStorage						storage;
+		std::atomic<T*>								current;
 
-		static void Destructor(void* data)
-		{
-			if (data)
-			{
-				delete (T*)data;
-			}
-		}
 	public:
-		NOT_COPYABLE(ThreadVariable);
+		NOT_COPYABLE(ReadMostly);
 
-		/// <summary>Create a thread local variable.</summary>
-		ThreadVariable()
-			:storage(&Destructor)
+		/// <summary>Create the value by the default constructor.</summary>
+		ReadMostly()
+			:current(new T)
 		{
 		}
 
-		~ThreadVariable()
+		/// <summary>Create the value by copying.</summary>
+		/// <param name="value">The initial value.</param>
+		ReadMostly(const T& value)
+			:current(new T(value))
 		{
 		}
 
-		/// <summary>Test if the storage has data.</summary>
-		/// <returns>Returns true if the storage has data.</returns>
-		bool HasData()
+		~ReadMostly()
 		{
-			return storage.Get() != nullptr;
+			delete current.load(std::memory_order_relaxed);
 		}
 
-		/// <summary>Remove the data from this storage.</summary>
-		void Clear()
+		/// <summary>Read the current version. The version will not be deleted until the callback returns.</summary>
+		/// <returns>The return value from the callback.</returns>
+		/// <typeparam name="F">Type of the callback.</typeparam>
+		/// <param name="callback">The callback receiving a constant reference to the current version. The reference must not be used after the callback returns.</param>
+		template<typename F>
+		decltype(auto) Read(F&& callback)
 		{
-			storage.Clear();
+			ReadScope scope(this);
+			return callback((const T&)*current.load(std::memory_order_seq_cst));
 		}
 
-		/// <summary>Get the stored data.</summary>
-		/// <returns>The stored ata.</returns>
-		T& Get()
+		/// <summary>Replace the value. It blocks until all readers of the previous version are finished.</summary>
+		/// <param name="value">The new value.</param>
+		void Update(T value)
 		{
-			return *(T*)storage.Get();
+			auto created = new T(std::move(value));
+			SPIN_LOCK(lockWriters)
+			{
+				auto previous = current.exchange(created, std::memory_order_seq_cst);
+				Synchronize();
+				delete previous;
+			}
 		}
 
-		/// <summary>Set data to this storage.</summary>
+		/// <summary>Modify a copy of the current version and publish it. It blocks until all readers of the previous version are finished. Writers are serialized, so no modification is lost.</summary>
+		/// <typeparam name="F">Type of the callback.</typeparam>
+		/// <param name="callback">The callback receiving a copy of the current version. If it throws, the value is not changed.</param>
+		template<typename F>
+		void Modify(F&& callback)
+		{
+			SPIN_LOCK(lockWriters)
+			{
+				auto created = new T(*current.load(std::memory_order_relaxed));
+				try
+				{
+					callback(*created);
+				}
+				catch (...)
+				{
+					delete created;
+					throw;
+				}
+				auto previous = current.exchange(created, std::memory_order_seq_cst);
+				Synchronize();
+				delete previous;
+			}
+		}
+	};
+
+
+/***********************************************************************
+Statistics
+***********************************************************************/
+
+	namespace threading_internal
+	{
+		/// <summary>Get the current time in nanoseconds from a monotonic clock, for recording statistics.</summary>
+		/// <returns>The current time.</returns>
+		extern vuint64_t							GetStatisticsTimestamp();
+	}
+
+	/// <summary>
+	/// A copy of all counters in a <see cref="LatencyHistogram"/>.
+	/// Values are grouped in buckets, each power of 2 is split into 8 buckets, so the relative error of a percentile is not larger than 12.5%.
+	/// </summary>
+	struct LatencyHistogramSnapshot
+	{
+		/// <summary>The number of buckets.</summary>
+		static constexpr vint						BucketCount = 496;
+
+		/// <summary>The number of recorded values.</summary>
+		vuint64_t									count = 0;
+		/// <summary>The sum of recorded values.</summary>
+		vuint64_t									sum = 0;
+		/// <summary>The maximum recorded value.</summary>
+		vuint64_t									max = 0;
+		/// <summary>The number of recorded values in each bucket.</summary>
+		vuint64_t									buckets[BucketCount] = {};
+
+		/// <summary>Get the average of recorded values.</summary>
+		/// <returns>The average, or 0 if there is no value.</returns>
+		vuint64_t									GetMean() const;
+		/// <summary>Estimate a percentile.</summary>
+		/// <returns>The largest value in the bucket that contains the percentile, not larger than <see cref="max"/>. Returns 0 if there is no value.</returns>
+		/// <param name="percentile">The percentile between 0 and 100.</param>
+		vuint64_t									GetPercentile(double percentile) const;
+
+		/// <summary>Get the index of the bucket that contains a value.</summary>
+		/// <returns>The index of the bucket.</returns>
+		/// <param name="value">The value.</param>
+		static vint									GetBucketIndex(vuint64_t value);
+		/// <summary>Get the smallest value in a bucket.</summary>
+		/// <returns>The smallest value.</returns>
+		/// <param name="index">The index of the bucket.</param>
+		static vuint64_t							GetBucketLowerBound(vint index);
+		/// <summary>Get the largest value in a bucket.</summary>
+		/// <returns>The largest value.</returns>
+		/// <param name="index">The index of the bucket.</param>
+		static vuint64_t							GetBucketUpperBound(vint index);
+	};
+
+	/// <summary>A histogram of durations in nanoseconds. Any thread could record values at the same time without taking a lock.</summary>
+	class LatencyHistogram : public Object
+	{
+	protected:
+		std::atomic<vuint64_t>						count = 0;
+		std::atomic<vuint64_t>						sum = 0;
+		std::atomic<vuint64_t>						max = 0;
+		std::atomic<vuint64_t>						buckets[LatencyHistogramSnapshot::BucketCount];
+
+	public:
+		NOT_COPYABLE(LatencyHistogram);
+		/// <summary>Create an empty histogram.</summary>
+		LatencyHistogram();
+		~LatencyHistogram() = default;
+
+		/// <summary>Record a value.</summary>
+		/// <param name="value">The value.</param>
+		void										Record(vuint64_t value);
+		/// <summary>Copy all counters. Values recorded during copying could be partially included.</summary>
+		/// <param name="snapshot">The snapshot to receive counters.</param>
+		void										GetSnapshot(LatencyHistogramSnapshot& snapshot);
+		/// <summary>Set all counters to 0.</summary>
+		void										Reset();
+	};
+
+	/// <summary>A copy of all counters in a <see cref="TaskStatistics"/>.</summary>
+	struct TaskStatisticsSnapshot
+	{
+		/// <summary>The name of the statistics object.</summary>
+		const wchar_t*								name = nullptr;
+		/// <summary>The number of queued tasks.</summary>
+		vuint64_t									queued = 0;
+		/// <summary>The number of started tasks.</summary>
+		vuint64_t									started = 0;
+		/// <summary>The number of finished tasks.</summary>
+		vuint64_t									completed = 0;
+		/// <summary>Time in nanoseconds between queuing and starting a task.</summary>
+		LatencyHistogramSnapshot					waitTime;
+		/// <summary>Time in nanoseconds for running a task.</summary>
+		LatencyHistogramSnapshot					runTime;
+
+		/// <summary>Get the number of tasks that have not started.</summary>
+		/// <returns>The number of tasks. Discarded tasks are included.</returns>
+		vuint64_t									GetPending() const { return queued > started ? queued - started : 0; }
+	};
+
+	/// <summary>
+	/// Counters and latency histograms of a thread pool or a task queue.
+	/// It is attached by [M:vl.ThreadPool.SetStatistics], [M:vl.ThreadPoolLite.SetStatistics] or [M:vl.TaskQueue.SetStatistics].
+	/// When no statistics object is attached, nothing is recorded and the cost is one pointer test for each task.
+	/// All living <see cref="TaskStatistics"/> objects could be listed by <see cref="Enumerate"/> to export them.
+	/// </summary>
+	class TaskStatistics : public Object
+	{
+	private:
+		const wchar_t*								name;
+		TaskStatistics*								previous = nullptr;
+		TaskStatistics*								next = nullptr;
+	public:
+		NOT_COPYABLE(TaskStatistics);
+		/// <summary>Create and register a statistics object.</summary>
+		/// <param name="_name">The name of the statistics object, it should be a string literal.</param>
+		TaskStatistics(const wchar_t* _name);
+		~TaskStatistics();
+
+		/// <summary>The number of queued tasks.</summary>
+		std::atomic<vuint64_t>						queued = 0;
+		/// <summary>The number of started tasks.</summary>
+		std::atomic<vuint64_t>						started = 0;
+		/// <summary>The number of finished tasks.</summary>
+		std::atomic<vuint64_t>						completed = 0;
+		/// <summary>Time in nanoseconds between queuing and starting a task.</summary>
+		LatencyHistogram							waitTime;
+		/// <summary>Time in nanoseconds for running a task.</summary>
+		LatencyHistogram							runTime;
+
+		/// <summary>Record a queued task.</summary>
+		/// <returns>The timestamp to pass to <see cref="RecordStarted"/>.</returns>
+		vuint64_t									RecordQueued();
+		/// <summary>Record a started task.</summary>
+		/// <returns>The timestamp to pass to <see cref="RecordCompleted"/>.</returns>
+		/// <param name="queuedTimestamp">The timestamp returned from <see cref="RecordQueued"/>.</param>
+		vuint64_t									RecordStarted(vuint64_t queuedTimestamp);
+		/// <summary>Record a finished task.</summary>
+		/// <param name="startedTimestamp">The timestamp returned from <see cref="RecordStarted"/>.</param>
+		void										RecordCompleted(vuint64_t startedTimestamp);
+
+		/// <summary>Get the name of the statistics object.</summary>
+		/// <returns>The name.</returns>
+		const wchar_t*								GetName();
+		/// <summary>Copy all counters.</summary>
+		/// <param name="snapshot">The snapshot to receive counters.</param>
+		void										GetSnapshot(TaskStatisticsSnapshot& snapshot);
+		/// <summary>Set all counters to 0. Tasks that are running or pending are not counted as started or completed after resetting.</summary>
+		void										Reset();
+
+		/// <summary>Call a callback for all living statistics objects. The callback must not create or destroy any statistics object.</summary>
+		/// <param name="callback">The callback.</param>
+		static void									Enumerate(const Func<void(TaskStatistics*)>& callback);
+	};
+
+	/// <summary>A copy of all counters in a <see cref="WaitStatistics"/>.</summary>
+	struct WaitStatisticsSnapshot
+	{
+		/// <summary>The name of the statistics object.</summary>
+		const wchar_t*								name = nullptr;
+		/// <summary>The number of waits.</summary>
+		vuint64_t									waits = 0;
+		/// <summary>The number of waits that failed, including time out.</summary>
+		vuint64_t									failures = 0;
+		/// <summary>Time in nanoseconds for waiting.</summary>
+		LatencyHistogramSnapshot					waitTime;
+	};
+
+	/// <summary>
+	/// Counters and a latency histogram of waits on <see cref="EventObject"/> or <see cref="ConditionVariable"/>.
+	/// It is attached by [M:vl.EventObject.SetStatistics] or [M:vl.ConditionVariable.SetStatistics].
+	/// All living <see cref="WaitStatistics"/> objects could be listed by <see cref="Enumerate"/> to export them.
+	/// </summary>
+	class WaitStatistics : public Object
+	{
+	private:
+		const wchar_t*								name;
+		WaitStatistics*								previous = nullptr;
+		WaitStatistics*								next = nullptr;
+	public:
+		NOT_COPYABLE(WaitStatistics);
+		/// <summary>Create and register a statistics object.</summary>
+		/// <param name="_name">The name of the statistics object, it should be a string literal.</param>
+		WaitStatistics(const wchar_t* _name);
+		~WaitStatistics();
+
+		/// <summary>The number of waits.</summary>
+		std::atomic<vuint64_t>						waits = 0;
+		/// <summary>The number of waits that failed, including time out.</summary>
+		std::atomic<vuint64_t>						failures = 0;
+		/// <summary>Time in nanoseconds for waiting.</summary>
+		LatencyHistogram							waitTime;
+
+		/// <summary>Record a finished wait.</summary>
+		/// <param name="startedTimestamp">The value of <see cref="threading_internal::GetStatisticsTimestamp"/> before waiting.</param>
+		/// <param name="succeeded">Set to true if the wait succeeded.</param>
+		void										RecordWait(vuint64_t startedTimestamp, bool succeeded);
+
+		/// <summary>Get the name of the statistics object.</summary>
+		/// <returns>The name.</returns>
+		const wchar_t*								GetName();
+		/// <summary>Copy all counters.</summary>
+		/// <param name="snapshot">The snapshot to receive counters.</param>
+		void										GetSnapshot(WaitStatisticsSnapshot& snapshot);
+		/// <summary>Set all counters to 0.</summary>
+		void										Reset();
+
+		/// <summary>Call a callback for all living statistics objects. The callback must not create or destroy any statistics object.</summary>
+		/// <param name="callback">The callback.</param>
+		static void									Enumerate(const Func<void(WaitStatistics*)>& callback);
+	};
+
+/***********************************************************************
+Thread Local Storage
+***********************************************************************/
+
+	/// <summary>Thread local storage operations.</summary>
+	/// <remarks>
+	/// This class is designed to define global variables.
+	/// Dynamically allocation will result in undefined behavior.
+	/// </remarks>
+	class ThreadLocalStorage : public Object
+	{
+		typedef void(*Destructor)(void*);
+	protected:
+		vint									index = 0;
+		Destructor								destructor;
+		volatile bool							disposed = false;
+		
+		static void								PushStorage(ThreadLocalStorage* storage);
+	public:
+		NOT_COPYABLE(ThreadLocalStorage);
+		ThreadLocalStorage(Destructor _destructor);
+		~ThreadLocalStorage();
+
+		void*									Get();
+		void									Set(void* data);
+		void									Clear();
+		void									Dispose();
+
+		/// <summary>Fix all storage creation.</summary>
+		static void								FixStorages();
+		/// <summary>Clear all storages for the current thread. For threads that are created using [T:vl.Thread], this function will be automatically called when before the thread exit. It returns immediately if no storage has been assigned a value since the last call.</summary>
+		static void								ClearStorages();
+		/// <summary>Clear all storages for the current thread (should be the main thread) and clear all records. This function can only be called by the main thread when all other threads are exited. It will reduce noices for detecting memory leaks.</summary>
+		static void								DisposeStorages();
+	};
+
+	/// <summary>Thread local variable. Different threads can store different values to and obtain differnt values from a thread local variable.</summary>
+	/// <typeparam name="T">Type of the storage.</typeparam>
+	/// <remarks>
+	/// This class is designed to define global variables.
+	/// Dynamically allocation will result in undefined behavior.
+	/// </remarks>
+	template<typename T>
+	class ThreadVariable : public Object
+	{
+	protected:
+		ThreadLocalStorage						storage;
+
+		static void Destructor(void* data)
+		{
+			if (data)
+			{
+				delete (T*)data;
+			}
+		}
+	public:
+		NOT_COPYABLE(ThreadVariable);
+
+		/// <summary>Create a thread local variable.</summary>
+		ThreadVariable()
+			:storage(&Destructor)
+		{
+		}
+
+		~ThreadVariable()
+		{
+		}
+
+		/// <summary>Test if the storage has data.</summary>
+		/// <returns>Returns true if the storage has data.</returns>
+		bool HasData()
+		{
+			return storage.Get() != nullptr;
+		}
+
+		/// <summary>Remove the data from this storage.</summary>
+		void Clear()
+		{
+			storage.Clear();
+		}
+
+		/// <summary>Get the stored data.</summary>
+		/// <returns>The stored ata.</returns>
+		T& Get()
+		{
+			return *(T*)storage.Get();
+		}
+
+		/// <summary>Set data to this storage.</summary>
 		/// <param name="value">The data to set.</param>
 		void Set(const T& value)
 		{
@@ -741,26 +1508,1610 @@ RepeatingTaskExecutor
 TaskQueue
 ***********************************************************************/
 
-	/// <summary>A single-threaded blocking task queue.</summary>
+	/// <summary>A single-threaded blocking task queue. Any thread could queue tasks, but only one thread could run them at the same time.</summary>
 	class TaskQueue : public Object
 	{
 	private:
-		SpinLock								lockTasks;
-		Semaphore								semaphoreTasks;
-		collections::List<Func<void()>>			tasks;
-		bool									exitTaskQueued = false;
+		// tasks pushed by any thread, the latest one comes first
+		std::atomic<threading_internal::TaskQueueNode*>	queuedTasks = nullptr;
+		// tasks taken by the running thread, the earliest one comes first
+		threading_internal::TaskQueueNode*		pendingTasks = nullptr;
+		EventObject								eventTasks;
+		std::atomic<bool>						exitTaskQueued = false;
+		std::atomic<TaskStatistics*>			statistics = nullptr;
 
+		void									PushTasks(threading_internal::TaskQueueNode* latest, threading_internal::TaskQueueNode* earliest);
+		bool									RunTasks(vint ms);
 	public:
+		NOT_COPYABLE(TaskQueue);
 		TaskQueue();
 		~TaskQueue();
 
 		/// <summary>Queue a task to be executed by <see cref="RunTaskQueue"/>.</summary>
 		/// <param name="task">The task to execute.</param>
 		void									QueueTask(Func<void()> task);
+		/// <summary>Queue multiple tasks to be executed by <see cref="RunTaskQueue"/> in order. No other task is queued between them.</summary>
+		/// <param name="tasks">The tasks to execute.</param>
+		void									QueueTasks(const collections::IEnumerable<Func<void()>>& tasks);
 		/// <summary>Request <see cref="RunTaskQueue"/> to return after all queued tasks are executed.</summary>
 		void									QueueExitTask();
 		/// <summary>Run queued tasks in the current thread until <see cref="QueueExitTask"/> is called.</summary>
 		void									RunTaskQueue();
+		/// <summary>Run queued tasks in the current thread for a period of time, or until <see cref="QueueExitTask"/> is called. A running task is not interrupted when the time is up, tasks left are executed in the next call.</summary>
+		/// <returns>Returns false if it returns because of <see cref="QueueExitTask"/>.</returns>
+		/// <param name="ms">Time in milliseconds.</param>
+		bool									RunTaskQueueFor(vint ms);
+		/// <summary>Attach a statistics object to record tasks queued to this task queue.</summary>
+		/// <param name="_statistics">The statistics object, which must outlive this task queue. Set to null to stop recording.</param>
+		void									SetStatistics(TaskStatistics* _statistics);
+	};
+
+/***********************************************************************
+Timer
+***********************************************************************/
+
+	/// <summary>
+	/// A one-shot timer in the process-wide timer service.
+	/// All timers share one thread that tracks deadlines in a hierarchical timing wheel, no thread is occupied by a pending timer.
+	/// Callbacks are executed in <see cref="ThreadPoolLite"/>.
+	/// The timer service is stopped by <see cref="FinalizeGlobalStorage"/>, after that timers created before could not be scheduled.
+	/// </summary>
+	class Timer : public Object
+	{
+	private:
+		threading_internal::TimerData*			internalData = nullptr;
+
+	public:
+		NOT_COPYABLE(Timer);
+		/// <summary>Create a timer that is not scheduled.</summary>
+		Timer();
+		/// <summary>Cancel the timer and wait for the running callback to finish.</summary>
+		~Timer();
+
+		/// <summary>Schedule the callback to run once after a period of time.</summary>
+		/// <returns>Returns false if the timer is already scheduled, or the timer service has been stopped.</returns>
+		/// <param name="ms">Time in milliseconds.</param>
+		/// <param name="callback">The callback.</param>
+		bool									Schedule(vint ms, const Func<void()>& callback);
+		/// <summary>Move the deadline of a scheduled timer to the current time plus the period of time passed to <see cref="Schedule"/>. This operation is cheap and could be called frequently.</summary>
+		/// <returns>Returns false if the timer is not scheduled.</returns>
+		bool									Refresh();
+		/// <summary>Cancel the timer. A callback that is already running is not affected.</summary>
+		/// <returns>Returns true if the timer was scheduled and the callback will not run.</returns>
+		bool									Cancel();
+		/// <summary>Cancel the timer and wait for the running callback to finish. When it is called in the callback, it does not wait.</summary>
+		void									CancelAndWait();
+		/// <summary>Test if the timer is scheduled and its callback has not started.</summary>
+		/// <returns>Returns true if the timer is scheduled.</returns>
+		bool									IsScheduled();
+	};
+
+/***********************************************************************
+Task
+***********************************************************************/
+
+	/// <summary>Status of a <see cref="Task`1"/>.</summary>
+	enum class TaskStatus
+	{
+		/// <summary>The task has not completed.</summary>
+		Pending,
+		/// <summary>The task completed with a result.</summary>
+		Succeeded,
+		/// <summary>The task completed with an exception.</summary>
+		Failed,
+		/// <summary>The task is cancelled.</summary>
+		Cancelled,
+	};
+
+	/// <summary>The exception thrown when reading the result of a cancelled task.</summary>
+	class TaskCancelledException : public Exception
+	{
+	public:
+		TaskCancelledException()
+			:Exception(L"The task has been cancelled.")
+		{
+		}
+	};
+
+	/// <summary>A token to observe cancellation requests from a <see cref="CancellationTokenSource"/>. A default constructed token is never cancelled.</summary>
+	class CancellationToken
+	{
+		friend class CancellationTokenSource;
+	private:
+		threading_internal::CancellationData*		internalData = nullptr;
+
+		CancellationToken(threading_internal::CancellationData* _internalData);
+	public:
+		CancellationToken() = default;
+		CancellationToken(const CancellationToken& token);
+		CancellationToken(CancellationToken&& token);
+		~CancellationToken();
+
+		CancellationToken& operator=(const CancellationToken& token);
+		CancellationToken& operator=(CancellationToken&& token);
+
+		/// <summary>Test if cancellation is requested.</summary>
+		/// <returns>Returns true if <see cref="CancellationTokenSource::Cancel"/> has been called.</returns>
+		bool										IsCancellationRequested() const;
+	};
+
+	/// <summary>The source of cancellation requests. Tasks created with its token are cancelled if they have not started when cancellation is requested.</summary>
+	class CancellationTokenSource : public Object
+	{
+	private:
+		threading_internal::CancellationData*		internalData = nullptr;
+	public:
+		NOT_COPYABLE(CancellationTokenSource);
+		CancellationTokenSource();
+		~CancellationTokenSource();
+
+		/// <summary>Get a token observing this source.</summary>
+		/// <returns>The token.</returns>
+		CancellationToken							GetToken() const;
+		/// <summary>Request cancellation.</summary>
+		void										Cancel();
+		/// <summary>Test if cancellation is requested.</summary>
+		/// <returns>Returns true if <see cref="Cancel"/> has been called.</returns>
+		bool										IsCancellationRequested() const;
 	};
+
+	template<typename T>
+	class Task;
+
+	template<typename T>
+	class Promise;
+
+	namespace threading_internal
+	{
+		class TaskStateBase;
+
+		/// <summary>A callback executed when a task completes, it is deleted after it is executed unless it is owned by an awaiter.</summary>
+		class TaskContinuation
+		{
+		public:
+			TaskContinuation*						next = nullptr;
+			TaskStateBase*							antecedent = nullptr;
+			bool									runInline = false;
+			bool									deleteAfterExecute = true;
+
+			virtual ~TaskContinuation() = default;
+			virtual void							Execute(TaskStateBase* completed) = 0;
+		};
+
+		/// <summary>The shared state of a task, reference counted by tasks, promises and continuations.</summary>
+		class TaskStateBase
+		{
+		private:
+			atomic_vint								references = 1;
+			std::atomic<vint>						status = (vint)TaskStatus::Pending;
+			std::atomic<bool>						completing = false;
+			std::atomic<TaskContinuation*>			continuations = nullptr;
+			std::exception_ptr						exception;
+
+		protected:
+			bool									BeginComplete();
+			void									EndComplete(TaskStatus finalStatus);
+			void									EndCompleteWithException(std::exception_ptr _exception);
+
+		public:
+			NOT_COPYABLE(TaskStateBase);
+			TaskStateBase() = default;
+			virtual ~TaskStateBase();
+
+			void									AddRef();
+			void									Release();
+			TaskStatus								GetStatus();
+			std::exception_ptr						GetException();
+			bool									TrySetException(std::exception_ptr _exception);
+			bool									TrySetCancelled();
+			bool									TrySetFailure(TaskStateBase* source);
+			bool									TryAddContinuation(TaskContinuation* continuation);
+			void									AddContinuation(TaskContinuation* continuation);
+			bool									Wait(vint ms);
+			void									RethrowIfNotSucceeded();
+		};
+
+		template<typename T>
+		class TaskState : public TaskStateBase
+		{
+		private:
+			alignas(T) char							storage[sizeof(T)];
+
+		public:
+			~TaskState()
+			{
+				if (GetStatus() == TaskStatus::Succeeded)
+				{
+					GetValue().~T();
+				}
+			}
+
+			template<typename U>
+			bool TrySetResult(U&& value)
+			{
+				if (!BeginComplete()) return false;
+				try
+				{
+					new(storage) T(std::forward<U>(value));
+				}
+				catch (...)
+				{
+					EndCompleteWithException(std::current_exception());
+					return true;
+				}
+				EndComplete(TaskStatus::Succeeded);
+				return true;
+			}
+
+			T& GetValue()
+			{
+				return *reinterpret_cast<T*>(storage);
+			}
+		};
+
+		template<>
+		class TaskState<void> : public TaskStateBase
+		{
+		public:
+			bool TrySetResult()
+			{
+				if (!BeginComplete()) return false;
+				EndComplete(TaskStatus::Succeeded);
+				return true;
+			}
+		};
+
+		struct TaskAccessor;
+
+		template<typename T>
+		class TaskCoroutinePromise;
+
+		template<typename T>
+		class TaskAwaiter;
+
+		extern void									TaskDispatch(TaskStateBase* antecedent, TaskContinuation* continuation);
+	}
+
+	/// <summary>
+	/// A handle to the result of an asynchronous operation. Copying a task shares the same result.
+	/// A task is completed by a <see cref="Promise`1"/>, <see cref="RunTask"/>, <see cref="Task`1::Then"/>, <see cref="WhenAll"/> or <see cref="WhenAny"/>.
+	/// </summary>
+	/// <typeparam name="T">The type of the result, it could be void.</typeparam>
+	template<typename T>
+	class Task
+	{
+		template<typename U>
+		friend class Task;
+		template<typename U>
+		friend class Promise;
+		friend struct threading_internal::TaskAccessor;
+	public:
+		using promise_type = threading_internal::TaskCoroutinePromise<T>;
+
+	private:
+		threading_internal::TaskState<T>*			state = nullptr;
+
+		explicit Task(threading_internal::TaskState<T>* _state)
+			:state(_state)
+		{
+			state->AddRef();
+		}
+
+	public:
+		/// <summary>Create an invalid task.</summary>
+		Task() = default;
+
+		Task(const Task<T>& task)
+			:state(task.state)
+		{
+			if (state) state->AddRef();
+		}
+
+		Task(Task<T>&& task)
+			:state(task.state)
+		{
+			task.state = nullptr;
+		}
+
+		~Task()
+		{
+			if (state) state->Release();
+		}
+
+		Task<T>& operator=(const Task<T>& task)
+		{
+			if (task.state) task.state->AddRef();
+			if (state) state->Release();
+			state = task.state;
+			return *this;
+		}
+
+		Task<T>& operator=(Task<T>&& task)
+		{
+			if (this != &task)
+			{
+				if (state) state->Release();
+				state = task.state;
+				task.state = nullptr;
+			}
+			return *this;
+		}
+
+		/// <summary>Test if the task is associated with a result.</summary>
+		/// <returns>Returns false if the task is default constructed.</returns>
+		bool IsValid() const
+		{
+			return state != nullptr;
+		}
+
+		/// <summary>Get the status of the task.</summary>
+		/// <returns>The status.</returns>
+		TaskStatus GetStatus() const
+		{
+			return state->GetStatus();
+		}
+
+		/// <summary>Test if the task is completed.</summary>
+		/// <returns>Returns true if the task is not <see cref="TaskStatus::Pending"/>.</returns>
+		bool IsCompleted() const
+		{
+			return state->GetStatus() != TaskStatus::Pending;
+		}
+
+		/// <summary>Block the current thread until the task completes. Waiting in a worker of <see cref="ThreadPoolLite"/> for a task that needs a worker to complete could starve the thread pool, use <see cref="Then"/> instead.</summary>
+		/// <returns>Returns true if the task completes in time.</returns>
+		/// <param name="ms">Time in milliseconds, -1 to wait forever.</param>
+		bool Wait(vint ms = -1) const
+		{
+			return state->Wait(ms);
+		}
+
+		/// <summary>Wait until the task completes and get the result.</summary>
+		/// <returns>The result. If the task failed, the exception is rethrown. If the task is cancelled, <see cref="TaskCancelledException"/> is thrown.</returns>
+		decltype(auto) GetResult() const
+		{
+			state->Wait(-1);
+			state->RethrowIfNotSucceeded();
+			if constexpr (!std::is_void_v<T>)
+			{
+				return static_cast<const T&>(state->GetValue());
+			}
+		}
+
+		/// <summary>
+		/// Create a task that runs a callback in <see cref="ThreadPoolLite"/> with the result of this task when it succeeds.
+		/// If this task fails or is cancelled, the new task does the same without running the callback.
+		/// If the callback returns a task, the new task completes with that task.
+		/// </summary>
+		/// <returns>The new task.</returns>
+		/// <typeparam name="F">The type of the callback.</typeparam>
+		/// <param name="callback">The callback, receiving the result of this task if it is not void.</param>
+		/// <param name="token">The new task is cancelled if cancellation is requested before the callback starts.</param>
+		template<typename F>
+		auto										Then(F&& callback, const CancellationToken& token = {}) const;
+
+		/// <summary>Await the task in a coroutine. The coroutine resumes on the thread completing the task, and receives the result like <see cref="GetResult"/>.</summary>
+		/// <returns>The awaiter.</returns>
+		threading_internal::TaskAwaiter<T>			operator co_await() const;
+	};
+
+	/// <summary>The producer side of a <see cref="Task`1"/>. Copying a promise shares the same result, only the first result set to it takes effect.</summary>
+	/// <typeparam name="T">The type of the result, it could be void.</typeparam>
+	template<typename T>
+	class Promise
+	{
+	private:
+		threading_internal::TaskState<T>*			state = nullptr;
+
+	public:
+		/// <summary>Create a promise with a pending task.</summary>
+		Promise()
+			:state(new threading_internal::TaskState<T>)
+		{
+		}
+
+		Promise(const Promise<T>& promise)
+			:state(promise.state)
+		{
+			if (state) state->AddRef();
+		}
+
+		Promise(Promise<T>&& promise)
+			:state(promise.state)
+		{
+			promise.state = nullptr;
+		}
+
+		~Promise()
+		{
+			if (state) state->Release();
+		}
+
+		Promise<T>& operator=(const Promise<T>& promise)
+		{
+			if (promise.state) promise.state->AddRef();
+			if (state) state->Release();
+			state = promise.state;
+			return *this;
+		}
+
+		Promise<T>& operator=(Promise<T>&& promise)
+		{
+			if (this != &promise)
+			{
+				if (state) state->Release();
+				state = promise.state;
+				promise.state = nullptr;
+			}
+			return *this;
+		}
+
+		/// <summary>Get the task completed by this promise.</summary>
+		/// <returns>The task.</returns>
+		Task<T> GetTask() const
+		{
+			return Task<T>(state);
+		}
+
+		/// <summary>Complete the task with a result.</summary>
+		/// <returns>Returns false if the task has already completed.</returns>
+		/// <typeparam name="U">The type of the result.</typeparam>
+		/// <param name="value">The result.</param>
+		template<typename U>
+			requires(!std::is_void_v<T>)
+		bool SetResult(U&& value) const
+		{
+			return state->TrySetResult(std::forward<U>(value));
+		}
+
+		/// <summary>Complete the task.</summary>
+		/// <returns>Returns false if the task has already completed.</returns>
+		bool SetResult() const requires(std::is_void_v<T>)
+		{
+			return state->TrySetResult();
+		}
+
+		/// <summary>Complete the task with an exception.</summary>
+		/// <returns>Returns false if the task has already completed.</returns>
+		/// <param name="exception">The exception, usually from std::current_exception or std::make_exception_ptr.</param>
+		bool SetException(std::exception_ptr exception) const
+		{
+			return state->TrySetException(exception);
+		}
+
+		/// <summary>Cancel the task.</summary>
+		/// <returns>Returns false if the task has already completed.</returns>
+		bool SetCancelled() const
+		{
+			return state->TrySetCancelled();
+		}
+	};
+
+	namespace threading_internal
+	{
+		template<typename T>
+		struct TaskUnwrap
+		{
+			using Type = T;
+			static constexpr bool IsTask = false;
+		};
+
+		template<typename T>
+		struct TaskUnwrap<Task<T>>
+		{
+			using Type = T;
+			static constexpr bool IsTask = true;
+		};
+
+		template<typename T, typename F>
+		struct TaskCallbackResult
+		{
+			using Type = std::invoke_result_t<F&, const T&>;
+		};
+
+		template<typename F>
+		struct TaskCallbackResult<void, F>
+		{
+			using Type = std::invoke_result_t<F&>;
+		};
+
+		struct TaskAccessor
+		{
+			template<typename T>
+			static TaskState<T>* GetState(const Task<T>& task)
+			{
+				return task.state;
+			}
+
+			template<typename T>
+			static Task<T> CreateTask(TaskState<T>* state)
+			{
+				return Task<T>(state);
+			}
+		};
+
+		template<typename T>
+		class TaskForwardContinuation : public TaskContinuation
+		{
+		private:
+			TaskState<T>*							target;
+
+		public:
+			TaskForwardContinuation(TaskState<T>* _target)
+				:target(_target)
+			{
+				runInline = true;
+				target->AddRef();
+			}
+
+			~TaskForwardContinuation()
+			{
+				target->Release();
+			}
+
+			void Execute(TaskStateBase* completed) override
+			{
+				if (!target->TrySetFailure(completed))
+				{
+					if constexpr (std::is_void_v<T>)
+					{
+						target->TrySetResult();
+					}
+					else
+					{
+						target->TrySetResult(static_cast<TaskState<T>*>(completed)->GetValue());
+					}
+				}
+			}
+		};
+
+		template<typename TResult, typename F, typename ...TArgs>
+		void TaskInvoke(TaskState<typename TaskUnwrap<TResult>::Type>* target, F& callback, TArgs& ...args)
+		{
+			try
+			{
+				if constexpr (TaskUnwrap<TResult>::IsTask)
+				{
+					auto inner = callback(args...);
+					if (inner.IsValid())
+					{
+						TaskAccessor::GetState(inner)->AddContinuation(new TaskForwardContinuation<typename TaskUnwrap<TResult>::Type>(target));
+					}
+					else
+					{
+						target->TrySetCancelled();
+					}
+				}
+				else if constexpr (std::is_void_v<TResult>)
+				{
+					callback(args...);
+					target->TrySetResult();
+				}
+				else
+				{
+					target->TrySetResult(callback(args...));
+				}
+			}
+			catch (...)
+			{
+				target->TrySetException(std::current_exception());
+			}
+		}
+
+		template<typename T, typename F, typename TResult>
+		class TaskThenContinuation : public TaskContinuation
+		{
+			using TTarget = typename TaskUnwrap<TResult>::Type;
+		private:
+			TaskState<TTarget>*						target;
+			F										callback;
+			CancellationToken						token;
+
+		public:
+			template<typename G>
+			TaskThenContinuation(TaskState<TTarget>* _target, G&& _callback, const CancellationToken& _token)
+				:target(_target)
+				, callback(std::forward<G>(_callback))
+				, token(_token)
+			{
+				target->AddRef();
+			}
+
+			~TaskThenContinuation()
+			{
+				target->Release();
+			}
+
+			void Execute(TaskStateBase* completed) override
+			{
+				if (target->TrySetFailure(completed)) return;
+				if (token.IsCancellationRequested())
+				{
+					target->TrySetCancelled();
+				}
+				else if constexpr (std::is_void_v<T>)
+				{
+					TaskInvoke<TResult>(target, callback);
+				}
+				else
+				{
+					const T& value = static_cast<TaskState<T>*>(completed)->GetValue();
+					TaskInvoke<TResult>(target, callback, value);
+				}
+			}
+		};
+
+		template<typename F, typename TResult>
+		class TaskRunContinuation : public TaskContinuation
+		{
+			using TTarget = typename TaskUnwrap<TResult>::Type;
+		private:
+			TaskState<TTarget>*						target;
+			F										callback;
+			CancellationToken						token;
+
+		public:
+			template<typename G>
+			TaskRunContinuation(TaskState<TTarget>* _target, G&& _callback, const CancellationToken& _token)
+				:target(_target)
+				, callback(std::forward<G>(_callback))
+				, token(_token)
+			{
+				target->AddRef();
+			}
+
+			~TaskRunContinuation()
+			{
+				target->Release();
+			}
+
+			void Execute(TaskStateBase*) override
+			{
+				if (token.IsCancellationRequested())
+				{
+					target->TrySetCancelled();
+				}
+				else
+				{
+					TaskInvoke<TResult>(target, callback);
+				}
+			}
+		};
+
+		extern Task<void>							TaskWhenAll(TaskStateBase* const* states, vint count);
+		extern Task<vint>							TaskWhenAny(TaskStateBase* const* states, vint count);
+	}
+
+	template<typename T>
+	template<typename F>
+	auto Task<T>::Then(F&& callback, const CancellationToken& token) const
+	{
+		using TCallback = std::remove_cvref_t<F>;
+		using TResult = typename threading_internal::TaskCallbackResult<T, TCallback>::Type;
+		using TTarget = typename threading_internal::TaskUnwrap<TResult>::Type;
+
+		auto target = new threading_internal::TaskState<TTarget>;
+		Task<TTarget> task(target);
+		target->Release();
+		state->AddContinuation(new threading_internal::TaskThenContinuation<T, TCallback, TResult>(target, std::forward<F>(callback), token));
+		return task;
+	}
+
+	/// <summary>Create a task that runs a callback in <see cref="ThreadPoolLite"/>. If the callback returns a task, the new task completes with that task.</summary>
+	/// <returns>The task.</returns>
+	/// <typeparam name="F">The type of the callback.</typeparam>
+	/// <param name="callback">The callback.</param>
+	/// <param name="token">The task is cancelled if cancellation is requested before the callback starts.</param>
+	template<typename F>
+	auto RunTask(F&& callback, const CancellationToken& token = {})
+	{
+		using TCallback = std::remove_cvref_t<F>;
+		using TResult = std::invoke_result_t<TCallback&>;
+		using TTarget = typename threading_internal::TaskUnwrap<TResult>::Type;
+
+		auto target = new threading_internal::TaskState<TTarget>;
+		auto task = threading_internal::TaskAccessor::CreateTask(target);
+		target->Release();
+		threading_internal::TaskDispatch(nullptr, new threading_internal::TaskRunContinuation<TCallback, TResult>(target, std::forward<F>(callback), token));
+		return task;
+	}
+
+	/// <summary>Create a task that completes when all tasks complete. It fails with the first exception if any task fails, otherwise it is cancelled if any task is cancelled.</summary>
+	/// <returns>The task.</returns>
+	/// <typeparam name="TResults">Types of results of tasks.</typeparam>
+	/// <param name="tasks">Tasks to wait.</param>
+	template<typename ...TResults>
+	Task<void> WhenAll(const Task<TResults>& ...tasks)
+	{
+		threading_internal::TaskStateBase* states[] = { threading_internal::TaskAccessor::GetState(tasks)..., nullptr };
+		return threading_internal::TaskWhenAll(states, (vint)sizeof...(TResults));
+	}
+
+	/// <summary>Create a task that completes when all tasks complete. It fails with the first exception if any task fails, otherwise it is cancelled if any task is cancelled.</summary>
+	/// <returns>The task.</returns>
+	/// <typeparam name="T">Type of results of tasks.</typeparam>
+	/// <param name="tasks">Tasks to wait.</param>
+	template<typename T>
+	Task<void> WhenAll(const collections::IEnumerable<Task<T>>& tasks)
+	{
+		collections::List<threading_internal::TaskStateBase*> states;
+		for (auto&& task : tasks)
+		{
+			states.Add(threading_internal::TaskAccessor::GetState(task));
+		}
+		return threading_internal::TaskWhenAll(states.Count() == 0 ? nullptr : &states[0], states.Count());
+	}
+
+	/// <summary>Create a task that completes when any task completes, no matter whether it succeeds.</summary>
+	/// <returns>The task, the result is the index of the first completed task.</returns>
+	/// <typeparam name="TResults">Types of results of tasks.</typeparam>
+	/// <param name="tasks">Tasks to wait, there should be at least one task.</param>
+	template<typename ...TResults>
+	Task<vint> WhenAny(const Task<TResults>& ...tasks)
+	{
+		threading_internal::TaskStateBase* states[] = { threading_internal::TaskAccessor::GetState(tasks)..., nullptr };
+		return threading_internal::TaskWhenAny(states, (vint)sizeof...(TResults));
+	}
+
+	/// <summary>Create a task that completes when any task completes, no matter whether it succeeds.</summary>
+	/// <returns>The task, the result is the index of the first completed task.</returns>
+	/// <typeparam name="T">Type of results of tasks.</typeparam>
+	/// <param name="tasks">Tasks to wait, there should be at least one task.</param>
+	template<typename T>
+	Task<vint> WhenAny(const collections::IEnumerable<Task<T>>& tasks)
+	{
+		collections::List<threading_internal::TaskStateBase*> states;
+		for (auto&& task : tasks)
+		{
+			states.Add(threading_internal::TaskAccessor::GetState(task));
+		}
+		return threading_internal::TaskWhenAny(states.Count() == 0 ? nullptr : &states[0], states.Count());
+	}
+
+/***********************************************************************
+Coroutine
+***********************************************************************/
+
+	namespace threading_internal
+	{
+		template<typename T>
+		class TaskCoroutinePromiseBase
+		{
+		protected:
+			TaskState<T>*							state = new TaskState<T>;
+
+		public:
+			~TaskCoroutinePromiseBase()
+			{
+				state->Release();
+			}
+
+			Task<T> get_return_object()
+			{
+				return TaskAccessor::CreateTask(state);
+			}
+
+			std::suspend_never initial_suspend() noexcept
+			{
+				return {};
+			}
+
+			std::suspend_never final_suspend() noexcept
+			{
+				return {};
+			}
+
+			void unhandled_exception()
+			{
+				state->TrySetException(std::current_exception());
+			}
+		};
+
+		template<typename T>
+		class TaskCoroutinePromise : public TaskCoroutinePromiseBase<T>
+		{
+		public:
+			template<typename U = T>
+			void return_value(U&& value)
+			{
+				this->state->TrySetResult(std::forward<U>(value));
+			}
+		};
+
+		template<>
+		class TaskCoroutinePromise<void> : public TaskCoroutinePromiseBase<void>
+		{
+		public:
+			void return_void()
+			{
+				state->TrySetResult();
+			}
+		};
+
+		template<typename T>
+		class TaskAwaiter : public TaskContinuation
+		{
+		private:
+			Task<T>									task;
+			std::coroutine_handle<>					handle;
+
+		public:
+			TaskAwaiter(const Task<T>& _task)
+				:task(_task)
+			{
+				runInline = true;
+				deleteAfterExecute = false;
+			}
+
+			void Execute(TaskStateBase*) override
+			{
+				handle.resume();
+			}
+
+			bool await_ready() const
+			{
+				return task.IsCompleted();
+			}
+
+			bool await_suspend(std::coroutine_handle<> _handle)
+			{
+				// continue without suspending if the task completes after await_ready, instead of resuming in this call
+				handle = _handle;
+				return TaskAccessor::GetState(task)->TryAddContinuation(this);
+			}
+
+			decltype(auto) await_resume() const
+			{
+				return task.GetResult();
+			}
+		};
+
+		class ThreadPoolAwaiter
+		{
+		private:
+			static void Resume(void* address)
+			{
+				std::coroutine_handle<>::from_address(address).resume();
+			}
+
+		public:
+			bool await_ready() const
+			{
+				return false;
+			}
+
+			bool await_suspend(std::coroutine_handle<> handle)
+			{
+				// continue on the current thread if the thread pool is stopped
+				return ThreadPoolLite::Queue(&Resume, handle.address());
+			}
+
+			void await_resume() const
+			{
+			}
+		};
+
+		class TimerAwaiter
+		{
+		private:
+			vint									ms;
+			Timer									timer;
+
+		public:
+			TimerAwaiter(vint _ms)
+				:ms(_ms)
+			{
+			}
+
+			bool await_ready() const
+			{
+				return ms <= 0;
+			}
+
+			bool await_suspend(std::coroutine_handle<> handle)
+			{
+				// continue on the current thread if the timer service is stopped
+				return timer.Schedule(ms, [handle]() { handle.resume(); });
+			}
+
+			void await_resume() const
+			{
+			}
+		};
+	}
+
+	template<typename T>
+	threading_internal::TaskAwaiter<T> Task<T>::operator co_await() const
+	{
+		return threading_internal::TaskAwaiter<T>(*this);
+	}
+
+	/// <summary>Await in a coroutine to continue in <see cref="ThreadPoolLite"/>. A coroutine returning <see cref="Task`1"/> runs on the calling thread until its first suspension.</summary>
+	/// <returns>The awaiter.</returns>
+	inline threading_internal::ThreadPoolAwaiter SwitchToThreadPool()
+	{
+		return {};
+	}
+
+	/// <summary>Await in a coroutine to continue in <see cref="ThreadPoolLite"/> after a period of time, without occupying any thread while waiting.</summary>
+	/// <returns>The awaiter.</returns>
+	/// <param name="ms">Time in milliseconds.</param>
+	inline threading_internal::TimerAwaiter Delay(vint ms)
+	{
+		return threading_internal::TimerAwaiter(ms);
+	}
+
+/***********************************************************************
+BatchingTaskExecutor
+***********************************************************************/
+
+	/// <summary>
+	/// Coalescing task executor. Inputs are accumulated into a batch, a batch is executed in <see cref="ThreadPoolLite"/> when:
+	/// <ul>
+	///   <li>The number of pending inputs reaches the maximum batch size.</li>
+	///   <li>The maximum delay has passed since an input arrived in an empty batch.</li>
+	///   <li><see cref="Flush"/> or <see cref="DrainAsync"/> is called.</li>
+	/// </ul>
+	/// Batches are executed one by one in the submission order, but not always in the same thread.
+	/// </summary>
+	/// <typeparam name="T">The type of an input.</typeparam>
+	template<typename T>
+	class BatchingTaskExecutor : public Object
+	{
+	private:
+		struct DrainRequest
+		{
+			vuint64_t								target = 0;
+			Promise<void>							promise;
+		};
+
+		Func<void(collections::List<T>&)>			callback;
+		vint										maxBatchSize;
+		vint										maxDelay;
+
+		// covers everything below
+		SpinLock									lockInputs;
+		collections::List<T>						inputs;
+		collections::List<DrainRequest>				drains;
+		vuint64_t									submitted = 0;
+		vuint64_t									executed = 0;
+		bool										executing = false;
+		bool										flushing = false;
+
+		// the number of ExecutingProc that have not returned
+		atomic_vint									runningProcs = 0;
+		Timer										timerDelay;
+
+		bool IsReadyUnsafe()
+		{
+			return inputs.Count() >= maxBatchSize || (flushing && inputs.Count() > 0);
+		}
+
+		void TakeCompletedDrainsUnsafe(collections::List<Promise<void>>& completed)
+		{
+			for (vint i = drains.Count() - 1; i >= 0; i--)
+			{
+				if (drains[i].target <= executed)
+				{
+					completed.Add(drains[i].promise);
+					drains.RemoveAt(i);
+				}
+			}
+		}
+
+		void ScheduleDelayUnsafe()
+		{
+			// it fails when the timer is scheduled or its callback is about to run, and the callback will see this batch in both cases
+			timerDelay.Schedule(maxDelay, [this]() { Flush(); });
+		}
+
+		void ExecutingProcInternal()
+		{
+			collections::List<T> batch;
+			while (true)
+			{
+				bool ready = false;
+				SPIN_LOCK(lockInputs)
+				{
+					ready = IsReadyUnsafe();
+					if (!ready)
+					{
+						executing = false;
+						if (inputs.Count() > 0)
+						{
+							// inputs arriving during the last batch still need the maximum delay to be respected
+							ScheduleDelayUnsafe();
+						}
+					}
+					else if (inputs.Count() <= maxBatchSize)
+					{
+						// swap buffers so that both lists keep their capacity
+						auto taken = std::move(inputs);
+						inputs = std::move(batch);
+						batch = std::move(taken);
+						flushing = false;
+					}
+					else
+					{
+						for (vint i = 0; i < maxBatchSize; i++)
+						{
+							batch.Add(inputs[i]);
+						}
+						inputs.RemoveRange(0, maxBatchSize);
+					}
+				}
+				if (!ready) return;
+
+				callback(batch);
+
+				collections::List<Promise<void>> completed;
+				SPIN_LOCK(lockInputs)
+				{
+					executed += batch.Count();
+					TakeCompletedDrainsUnsafe(completed);
+				}
+				batch.Clear();
+				for (auto&& promise : completed)
+				{
+					promise.SetResult();
+				}
+			}
+		}
+
+		static void ExecutingProc(void* argument)
+		{
+			auto executor = (BatchingTaskExecutor<T>*)argument;
+			executor->ExecutingProcInternal();
+			// the executor could be deleted after this line
+			executor->runningProcs.fetch_sub(1, std::memory_order_release);
+		}
+
+		void StartExecutingUnsafe()
+		{
+			executing = true;
+			runningProcs.fetch_add(1, std::memory_order_relaxed);
+			ThreadPoolLite::Queue(&ExecutingProc, this);
+		}
+
+	public:
+		NOT_COPYABLE(BatchingTaskExecutor);
+
+		/// <summary>Create a task executor.</summary>
+		/// <param name="_callback">The callback to execute a batch, it must not throw. Inputs in the batch could be modified or moved away.</param>
+		/// <param name="_maxBatchSize">The maximum number of inputs in a batch, a batch is executed immediately when it is full.</param>
+		/// <param name="_maxDelay">Time in milliseconds. A batch is executed when it is not full after this period of time since its first input arrived.</param>
+		BatchingTaskExecutor(const Func<void(collections::List<T>&)>& _callback, vint _maxBatchSize, vint _maxDelay)
+			:callback(_callback)
+			, maxBatchSize(_maxBatchSize > 0 ? _maxBatchSize : 1)
+			, maxDelay(_maxDelay > 0 ? _maxDelay : 0)
+		{
+		}
+
+		/// <summary>Execute all submitted inputs and wait for them to finish. It must not be called in the callback.</summary>
+		~BatchingTaskExecutor()
+		{
+			timerDelay.CancelAndWait();
+			DrainAsync().Wait();
+			// the last batch is executed, only a few instructions are left
+			while (runningProcs.load(std::memory_order_acquire) != 0)
+			{
+				Thread::Sleep(0);
+			}
+		}
+
+		/// <summary>Submit an input.</summary>
+		/// <param name="input">The input.</param>
+		void Submit(const T& input)
+		{
+			SPIN_LOCK(lockInputs)
+			{
+				inputs.Add(input);
+				submitted++;
+				if (!executing)
+				{
+					if (IsReadyUnsafe())
+					{
+						StartExecutingUnsafe();
+					}
+					else if (inputs.Count() == 1)
+					{
+						ScheduleDelayUnsafe();
+					}
+				}
+			}
+		}
+
+		/// <summary>Execute all pending inputs without waiting for the batch to be full.</summary>
+		void Flush()
+		{
+			SPIN_LOCK(lockInputs)
+			{
+				if (inputs.Count() > 0)
+				{
+					flushing = true;
+					if (!executing)
+					{
+						StartExecutingUnsafe();
+					}
+				}
+			}
+		}
+
+		/// <summary>Execute all pending inputs without waiting for the batch to be full, and get a task that completes when all inputs submitted before this call are executed.</summary>
+		/// <returns>The task.</returns>
+		Task<void> DrainAsync()
+		{
+			Promise<void> promise;
+			SPIN_LOCK(lockInputs)
+			{
+				if (executed < submitted)
+				{
+					drains.Add({ submitted,promise });
+					if (inputs.Count() > 0)
+					{
+						flushing = true;
+						if (!executing)
+						{
+							StartExecutingUnsafe();
+						}
+					}
+					return promise.GetTask();
+				}
+			}
+			promise.SetResult();
+			return promise.GetTask();
+		}
+	};
+
+/***********************************************************************
+BoundedChannel
+***********************************************************************/
+
+	/// <summary>Result of an operation on a <see cref="BoundedChannel`1"/>.</summary>
+	enum class ChannelStatus
+	{
+		/// <summary>The operation succeeded.</summary>
+		Succeeded,
+		/// <summary>The operation could not complete without waiting, it happens when sending to a full channel or receiving from an empty channel.</summary>
+		WouldBlock,
+		/// <summary>The operation could not complete before the time is out.</summary>
+		TimedOut,
+		/// <summary>The channel is closed. Receiving fails only when all items are received.</summary>
+		Closed,
+	};
+
+	namespace threading_internal
+	{
+		/// <summary>Positions and waiting threads of <see cref="BoundedChannel`1"/>.</summary>
+		class BoundedChannelBase : public Object
+		{
+		protected:
+			struct alignas(64) Position
+			{
+				std::atomic<vuint64_t>				value = 0;
+			};
+
+			struct alignas(64) WaitList
+			{
+				// increased when a waiting thread should check again, threads sleep on it
+				std::atomic<vuint32_t>				version = 0;
+				std::atomic<vuint32_t>				waiters = 0;
+			};
+
+			Position								sendPosition;
+			Position								receivePosition;
+			WaitList								sendWaitList;
+			WaitList								receiveWaitList;
+			std::atomic<bool>						closed = false;
+
+			void									Notify(WaitList& waitList);
+			vuint32_t								BeginWait(WaitList& waitList);
+			bool									EndWait(WaitList& waitList, vuint32_t version, vuint64_t deadline);
+			void									CancelWait(WaitList& waitList);
+			static vuint64_t						GetDeadline(vint ms);
+
+			template<typename TAttempt>
+			ChannelStatus WaitFor(WaitList& waitList, vint ms, TAttempt&& attempt)
+			{
+				auto deadline = GetDeadline(ms);
+				while (true)
+				{
+					auto status = attempt();
+					if (status != ChannelStatus::WouldBlock) return status;
+
+					// register before trying again, so that a thread making progress after the attempt always wakes this thread up
+					auto version = BeginWait(waitList);
+					status = attempt();
+					if (status != ChannelStatus::WouldBlock)
+					{
+						CancelWait(waitList);
+						return status;
+					}
+					if (!EndWait(waitList, version, deadline))
+					{
+						return ChannelStatus::TimedOut;
+					}
+				}
+			}
+
+		public:
+			NOT_COPYABLE(BoundedChannelBase);
+			BoundedChannelBase() = default;
+			~BoundedChannelBase() = default;
+
+			/// <summary>Close the channel. Sending fails after the channel is closed, items in the channel could still be received. All waiting threads are woken up.</summary>
+			void									Close();
+			/// <summary>Test if the channel is closed.</summary>
+			/// <returns>Returns true if the channel is closed.</returns>
+			bool									IsClosed();
+		};
+	}
+
+	/// <summary>
+	/// A fixed capacity channel for passing items between threads. Any number of threads could send and receive at the same time.
+	/// Items are stored in a lock-free ring, a full channel blocks senders, so that producers could not run far ahead of consumers.
+	/// Waiting threads sleep, and a thread that does not need to wait does not make any system call.
+	/// </summary>
+	/// <typeparam name="T">Type of items. Constructing or moving an item must not throw.</typeparam>
+	/// <remarks>
+	/// Items sent by one thread are received in the same order, but items sent by different threads could be interleaved.
+	/// A sending that happens at the same time with <see cref="Close"/> could either succeed or fail.
+	/// </remarks>
+	template<typename T>
+	class BoundedChannel : public threading_internal::BoundedChannelBase
+	{
+	protected:
+		struct Cell
+		{
+			// position: free for the sender at this position, position + 1: filled for the receiver at this position
+			std::atomic<vuint64_t>					sequence;
+			alignas(T) char							storage[sizeof(T)];
+		};
+
+		Cell*										cells = nullptr;
+		vuint64_t									mask = 0;
+
+		// find the number of cells from the position, that are ready for the operation, up to the maximum count
+		vint CountReadyCells(vuint64_t position, vuint64_t offset, vint maxCount)
+		{
+			vint count = 0;
+			while (count < maxCount && cells[(position + count) & mask].sequence.load(std::memory_order_acquire) == position + count + offset)
+			{
+				count++;
+			}
+			return count;
+		}
+
+		// claim cells for an operation with one compare-exchange, returns false if no cell is ready
+		bool ClaimCells(std::atomic<vuint64_t>& claimed, vuint64_t offset, vint maxCount, vuint64_t& position, vint& count)
+		{
+			position = claimed.load(std::memory_order_relaxed);
+			while (true)
+			{
+				count = CountReadyCells(position, offset, maxCount);
+				if (count == 0)
+				{
+					auto sequence = cells[position & mask].sequence.load(std::memory_order_acquire);
+					if ((vint64_t)(sequence - (position + offset)) < 0)
+					{
+						return false;
+					}
+					position = claimed.load(std::memory_order_relaxed);
+				}
+				else if (claimed.compare_exchange_weak(position, position + count, std::memory_order_relaxed))
+				{
+					return true;
+				}
+			}
+		}
+
+		template<typename U>
+		bool TryPush(U&& value)
+		{
+			vuint64_t position = 0;
+			vint count = 0;
+			if (!ClaimCells(sendPosition.value, 0, 1, position, count)) return false;
+
+			auto& cell = cells[position & mask];
+			new(cell.storage) T(std::forward<U>(value));
+			cell.sequence.store(position + 1, std::memory_order_release);
+			Notify(receiveWaitList);
+			return true;
+		}
+
+		vint TryPushMany(const T* values, vint maxCount)
+		{
+			vuint64_t position = 0;
+			vint count = 0;
+			if (!ClaimCells(sendPosition.value, 0, maxCount, position, count)) return 0;
+
+			for (vint i = 0; i < count; i++)
+			{
+				auto& cell = cells[(position + i) & mask];
+				new(cell.storage) T(values[i]);
+				cell.sequence.store(position + i + 1, std::memory_order_release);
+			}
+			Notify(receiveWaitList);
+			return count;
+		}
+
+		vint TryPopMany(collections::List<T>& values, vint maxCount)
+		{
+			vuint64_t position = 0;
+			vint count = 0;
+			if (!ClaimCells(receivePosition.value, 1, maxCount, position, count)) return 0;
+
+			for (vint i = 0; i < count; i++)
+			{
+				auto& cell = cells[(position + i) & mask];
+				auto item = (T*)cell.storage;
+				values.Add(std::move(*item));
+				item->~T();
+				cell.sequence.store(position + i + mask + 1, std::memory_order_release);
+			}
+			Notify(sendWaitList);
+			return count;
+		}
+
+		bool TryPop(T& value)
+		{
+			vuint64_t position = 0;
+			vint count = 0;
+			if (!ClaimCells(receivePosition.value, 1, 1, position, count)) return false;
+
+			auto& cell = cells[position & mask];
+			auto item = (T*)cell.storage;
+			value = std::move(*item);
+			item->~T();
+			cell.sequence.store(position + mask + 1, std::memory_order_release);
+			Notify(sendWaitList);
+			return true;
+		}
+
+	public:
+		NOT_COPYABLE(BoundedChannel);
+
+		/// <summary>Create a channel.</summary>
+		/// <param name="capacity">The minimum number of items that the channel could store, it is rounded up to a power of 2.</param>
+		BoundedChannel(vint capacity)
+		{
+			CHECK_ERROR(capacity > 0, L"vl::BoundedChannel<T>::BoundedChannel(vint)#Capacity must be positive.");
+			vuint64_t size = 2;
+			while (size < (vuint64_t)capacity) size *= 2;
+			mask = size - 1;
+			cells = new Cell[(vint)size];
+			for (vuint64_t i = 0; i < size; i++)
+			{
+				cells[i].sequence.store(i, std::memory_order_relaxed);
+			}
+		}
+
+		~BoundedChannel()
+		{
+			auto end = sendPosition.value.load(std::memory_order_relaxed);
+			for (auto position = receivePosition.value.load(std::memory_order_relaxed); position < end; position++)
+			{
+				auto& cell = cells[position & mask];
+				if (cell.sequence.load(std::memory_order_relaxed) == position + 1)
+				{
+					((T*)cell.storage)->~T();
+				}
+			}
+			delete[] cells;
+		}
+
+		/// <summary>Get the number of items that the channel could store.</summary>
+		/// <returns>The capacity.</returns>
+		vint GetCapacity()
+		{
+			return (vint)(mask + 1);
+		}
+
+		/// <summary>Send an item without waiting.</summary>
+		/// <returns>Returns <see cref="ChannelStatus::WouldBlock"/> if the channel is full. The item is not moved if it fails.</returns>
+		/// <param name="value">The item.</param>
+		template<typename U>
+		ChannelStatus TrySend(U&& value)
+		{
+			if (closed.load(std::memory_order_acquire)) return ChannelStatus::Closed;
+			return TryPush(std::forward<U>(value)) ? ChannelStatus::Succeeded : ChannelStatus::WouldBlock;
+		}
+
+		/// <summary>Send an item, wait for a period of time if the channel is full.</summary>
+		/// <returns>Returns <see cref="ChannelStatus::TimedOut"/> if the channel is still full when the time is out. The item is not moved if it fails.</returns>
+		/// <param name="value">The item.</param>
+		/// <param name="ms">Time in milliseconds, -1 means no time limit.</param>
+		template<typename U>
+		ChannelStatus SendFor(U&& value, vint ms)
+		{
+			return WaitFor(sendWaitList, ms, [&]() { return TrySend(std::forward<U>(value)); });
+		}
+
+		/// <summary>Send an item, wait if the channel is full.</summary>
+		/// <returns>Returns false if the channel is closed.</returns>
+		/// <param name="value">The item.</param>
+		template<typename U>
+		bool Send(U&& value)
+		{
+			return SendFor(std::forward<U>(value), -1) == ChannelStatus::Succeeded;
+		}
+
+		/// <summary>Send as many items as possible without waiting. Items are sent in order and could be received in batches.</summary>
+		/// <returns>The number of items sent, they are always the first items in the array.</returns>
+		/// <param name="values">The items.</param>
+		/// <param name="count">The number of items.</param>
+		vint TrySendMany(const T* values, vint count)
+		{
+			if (count <= 0 || closed.load(std::memory_order_acquire)) return 0;
+			return TryPushMany(values, count);
+		}
+
+		/// <summary>Send all items, wait when the channel is full. Items from one call are kept in order, but items from other senders could be inserted between them.</summary>
+		/// <returns>Returns false if the channel is closed before all items are sent.</returns>
+		/// <param name="values">The items.</param>
+		/// <param name="count">The number of items.</param>
+		bool SendMany(const T* values, vint count)
+		{
+			vint sent = 0;
+			while (sent < count)
+			{
+				auto status = WaitFor(sendWaitList, -1, [&]()
+				{
+					if (closed.load(std::memory_order_acquire)) return ChannelStatus::Closed;
+					vint pushed = TryPushMany(values + sent, count - sent);
+					if (pushed == 0) return ChannelStatus::WouldBlock;
+					sent += pushed;
+					return ChannelStatus::Succeeded;
+				});
+				if (status == ChannelStatus::Closed) return false;
+			}
+			return true;
+		}
+
+		/// <summary>Receive an item without waiting.</summary>
+		/// <returns>Returns <see cref="ChannelStatus::WouldBlock"/> if the channel is empty, or <see cref="ChannelStatus::Closed"/> if the channel is closed and empty.</returns>
+		/// <param name="value">The received item.</param>
+		ChannelStatus TryReceive(T& value)
+		{
+			if (TryPop(value)) return ChannelStatus::Succeeded;
+			if (!closed.load(std::memory_order_acquire)) return ChannelStatus::WouldBlock;
+			// items sent before closing must be received
+			return TryPop(value) ? ChannelStatus::Succeeded : ChannelStatus::Closed;
+		}
+
+		/// <summary>Receive an item, wait for a period of time if the channel is empty.</summary>
+		/// <returns>Returns <see cref="ChannelStatus::TimedOut"/> if the channel is still empty when the time is out, or <see cref="ChannelStatus::Closed"/> if the channel is closed and empty.</returns>
+		/// <param name="value">The received item.</param>
+		/// <param name="ms">Time in milliseconds, -1 means no time limit.</param>
+		ChannelStatus ReceiveFor(T& value, vint ms)
+		{
+			return WaitFor(receiveWaitList, ms, [&]() { return TryReceive(value); });
+		}
+
+		/// <summary>Receive an item, wait if the channel is empty.</summary>
+		/// <returns>Returns false if the channel is closed and empty.</returns>
+		/// <param name="value">The received item.</param>
+		bool Receive(T& value)
+		{
+			return ReceiveFor(value, -1) == ChannelStatus::Succeeded;
+		}
+
+		/// <summary>Receive all available items up to a maximum number without waiting.</summary>
+		/// <returns>The number of received items.</returns>
+		/// <param name="values">The list to append received items.</param>
+		/// <param name="maxCount">The maximum number of items to receive.</param>
+		vint TryReceiveMany(collections::List<T>& values, vint maxCount)
+		{
+			if (maxCount <= 0) return 0;
+			return TryPopMany(values, maxCount);
+		}
+
+		/// <summary>Wait until the channel is not empty, and receive all available items up to a maximum number.</summary>
+		/// <returns>The number of received items. Returns 0 if the channel is closed and empty.</returns>
+		/// <param name="values">The list to append received items.</param>
+		/// <param name="maxCount">The maximum number of items to receive.</param>
+		vint ReceiveMany(collections::List<T>& values, vint maxCount)
+		{
+			if (maxCount <= 0) return 0;
+			vint received = 0;
+			WaitFor(receiveWaitList, -1, [&]()
+			{
+				received = TryPopMany(values, maxCount);
+				if (received > 0) return ChannelStatus::Succeeded;
+				if (!closed.load(std::memory_order_acquire)) return ChannelStatus::WouldBlock;
+				received = TryPopMany(values, maxCount);
+				return received > 0 ? ChannelStatus::Succeeded : ChannelStatus::Closed;
+			});
+			return received;
+		}
+	};
+
+/***********************************************************************
+Parallel Algorithms
+***********************************************************************/
+
+	/// <summary>
+	/// Split [begin, end) into sub ranges and run a function on them in <see cref="ThreadPoolLite"/>.
+	/// The range is split recursively into halves until a sub range is not longer than the grain, and halves are offered to workers.
+	/// The calling thread executes sub ranges too, including those that no worker has started while it is waiting,
+	/// so nested calls in workers do not deadlock the thread pool.
+	/// </summary>
+	/// <remarks>If the function throws, sub ranges that have not started are skipped, and the first exception is rethrown after running sub ranges finish.</remarks>
+	/// <param name="begin">The first index.</param>
+	/// <param name="end">The index after the last one.</param>
+	/// <param name="grain">The maximum length of a sub range that is not split. Set to 0 to choose one according to the number of processors.</param>
+	/// <param name="body">The function receiving the first index and the index after the last one of a sub range.</param>
+	extern void										ParallelForRange(vint begin, vint end, vint grain, const Func<void(vint, vint)>& body);
+
+	/// <summary>Run a function for each index in [begin, end) in parallel. See <see cref="ParallelForRange"/> for details.</summary>
+	/// <typeparam name="F">The type of the function.</typeparam>
+	/// <param name="begin">The first index.</param>
+	/// <param name="end">The index after the last one.</param>
+	/// <param name="grain">The maximum number of indices that are executed in one task. Set to 0 to choose one according to the number of processors.</param>
+	/// <param name="body">The function receiving an index.</param>
+	template<typename F>
+	void ParallelFor(vint begin, vint end, vint grain, const F& body)
+	{
+		ParallelForRange(begin, end, grain, [&body](vint rangeBegin, vint rangeEnd)
+		{
+			for (vint i = rangeBegin; i < rangeEnd; i++)
+			{
+				body(i);
+			}
+		});
+	}
+
+	/// <summary>Map each index in [begin, end) to a value and combine all values in parallel. See <see cref="ParallelForRange"/> for details.</summary>
+	/// <returns>The combined value. Values are combined in the order of indices, so the reduce function only needs to be associative.</returns>
+	/// <typeparam name="T">The type of values.</typeparam>
+	/// <typeparam name="TMap">The type of the map function.</typeparam>
+	/// <typeparam name="TReduce">The type of the reduce function.</typeparam>
+	/// <param name="begin">The first index.</param>
+	/// <param name="end">The index after the last one.</param>
+	/// <param name="grain">The maximum number of indices that are executed in one task. Set to 0 to choose one according to the number of processors.</param>
+	/// <param name="identity">The identity value of the reduce function.</param>
+	/// <param name="map">The function converting an index to a value.</param>
+	/// <param name="reduce">The function combining two values.</param>
+	template<typename T, typename TMap, typename TReduce>
+	T ParallelReduce(vint begin, vint end, vint grain, const T& identity, const TMap& map, const TReduce& reduce)
+	{
+		SpinLock lock;
+		collections::Dictionary<vint, T> partials;
+		ParallelForRange(begin, end, grain, [&](vint rangeBegin, vint rangeEnd)
+		{
+			T partial = identity;
+			for (vint i = rangeBegin; i < rangeEnd; i++)
+			{
+				partial = reduce(partial, map(i));
+			}
+			SPIN_LOCK(lock)
+			{
+				partials.Add(rangeBegin, partial);
+			}
+		});
+
+		T result = identity;
+		for (auto&& partial : partials.Values())
+		{
+			result = reduce(result, partial);
+		}
+		return result;
+	}
+
+	/// <summary>Run functions in parallel and wait until all of them finish. See <see cref="ParallelForRange"/> for details.</summary>
+	/// <typeparam name="TFuncs">Types of functions.</typeparam>
+	/// <param name="funcs">Functions to run.</param>
+	template<typename ...TFuncs>
+	void ParallelInvoke(const TFuncs& ...funcs)
+	{
+		const Func<void()> tasks[] = { Func<void()>(funcs)... };
+		ParallelForRange(0, (vint)sizeof...(TFuncs), 1, [&tasks](vint rangeBegin, vint rangeEnd)
+		{
+			for (vint i = rangeBegin; i < rangeEnd; i++)
+			{
+				tasks[i]();
+			}
+		});
+	}
 }
 #endif
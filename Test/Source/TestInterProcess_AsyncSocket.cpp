@@ -1463,6 +1463,62 @@ namespace async_socket_test
 #endif
 }
 
+namespace async_socket_test
+{
+	class AwaitableTestConnection : public Object, public virtual IAsyncSocketConnection
+	{
+	public:
+		IAsyncSocketCallback*				callback = nullptr;
+		List<Ptr<AsyncSocketBuffer>>		writes;
+
+		void InstallCallback(IAsyncSocketCallback* value) override
+		{
+			callback = value;
+			if (callback) callback->OnInstalled(this);
+		}
+
+		void BeginReadingLoopUnsafe() override
+		{
+		}
+
+		void WriteAsync(Ptr<AsyncSocketBuffer> buffer) override
+		{
+			writes.Add(buffer);
+		}
+
+		void Stop() override
+		{
+			if (auto installed = callback)
+			{
+				installed->OnDisconnected();
+			}
+		}
+
+		void Deliver(const char* text)
+		{
+			callback->OnRead((const vuint8_t*)text, (vint)strlen(text));
+		}
+	};
+
+	Task<vint> EchoUntilStopped(AsyncSocketAwaitableConnection& connection)
+	{
+		vint total = 0;
+		vuint8_t buffer[4];
+		while (true)
+		{
+			vint read = co_await connection.ReadAsync(buffer, sizeof(buffer));
+			if (read == 0) break;
+			total += read;
+
+			auto echo = Ptr(new AsyncSocketBuffer);
+			echo->data.Resize(read);
+			memcpy(&echo->data[0], buffer, read);
+			if (!co_await connection.WriteAsync(echo)) break;
+		}
+		co_return total;
+	}
+}
+
 namespace async_socket_test
 {
 	bool WaitForNativeEvent(EventObject& eventObject, vint timeout)
@@ -1489,6 +1545,30 @@ TEST_FILE
 		TEST_ASSERT(sameEndpointClient->GetStatus() == ClientStatus::Ready);
 	});
 
+	TEST_CASE(L"AsyncSocketAwaitableConnection resumes coroutines on the completion thread")
+	{
+		AwaitableTestConnection fake;
+		AsyncSocketAwaitableConnection connection(&fake);
+		TEST_ASSERT(connection.GetConnection() == &fake);
+
+		auto task = EchoUntilStopped(connection);
+		TEST_ASSERT(!task.IsCompleted());
+
+		// callbacks resume the coroutine before they return, the first 4 bytes complete the pending read and the rest are buffered
+		fake.Deliver("abcdefg");
+		TEST_ASSERT(fake.writes.Count() == 1);
+		TEST_ASSERT(fake.writes[0]->data.Count() == 4);
+		fake.callback->OnWriteCompleted(fake.writes[0]);
+		TEST_ASSERT(fake.writes.Count() == 2);
+		TEST_ASSERT(fake.writes[1]->data.Count() == 3);
+		fake.callback->OnWriteCompleted(fake.writes[1]);
+
+		fake.Stop();
+		TEST_ASSERT(task.IsCompleted());
+		TEST_ASSERT(task.GetResult() == 7);
+		TEST_ASSERT(connection.IsDisconnected());
+	});
+
 	RunAsyncSocketTestCases(65536, WaitForEvent(&WaitForNativeEvent));
 #if defined VCZH_MSVC
 	RunWindowsAsyncSocketServerCallbackTestCases(WaitForEvent(&WaitForNativeEvent));
@@ -5,11 +5,20 @@
 #include "../../Source/Stream/RecorderStream.h"
 #include "../../Source/Stream/BroadcastStream.h"
 #include "../../Source/Stream/CacheStream.h"
+#include "../../Source/Stream/AsyncFile.h"
+#include "../../Source/Stream/EncodingStream.h"
+#include "../../Source/Stream/Accessor.h"
+#include "../../Source/Encoding/CharFormat/UtfEncoding.h"
 
 using namespace vl;
 using namespace vl::stream;
 
 extern WString GetTestOutputPath();
+
+namespace vl::stream
+{
+	extern Ptr<IAsyncFileImpl> CreateThreadPoolAsyncFileImpl(const WString& fileName, FileStream::AccessRight accessRight);
+}
 const vint BUFFER_SIZE = 1024;
 
 /***********************************************************************
@@ -272,6 +281,52 @@ TEST_FILE
 		TestClosedProperty(stream);
 	});
 
+	TEST_CASE(L"Test MemoryStream with Segmented storage")
+	{
+		MemoryStream stream(4, MemoryStream::Segmented);
+		TestBidirectionalUnlimitedStream(stream);
+		stream.Close();
+		TestClosedProperty(stream);
+	});
+
+	TEST_CASE(L"Test MemoryStream storage")
+	{
+		char content[] = "vczh is genius!";
+		for (auto storage : { MemoryStream::Contiguous, MemoryStream::Segmented })
+		{
+			MemoryStream stream(4, storage);
+			stream.Reserve(10);
+			for (vint i = 0; i < 15; i++)
+			{
+				TEST_ASSERT(stream.Write(content + i, 1) == 1);
+			}
+			TEST_ASSERT(stream.Size() == 15);
+
+			char buffer[16] = { 0 };
+			stream.SeekFromBegin(2);
+			TEST_ASSERT(stream.Read(buffer, 15) == 13);
+			TEST_ASSERT(strcmp(buffer, content + 2) == 0);
+
+			stream.SeekFromBegin(2);
+			const void* borrowed = nullptr;
+			vint available = stream.AcquireRead(borrowed, 15);
+			TEST_ASSERT(available == (storage == MemoryStream::Segmented ? 2 : 13));
+			TEST_ASSERT(strncmp((const char*)borrowed, content + 2, available) == 0);
+
+			collections::Array<vuint8_t> taken;
+			stream.TakeBuffer(taken);
+			TEST_ASSERT(taken.Count() == 15);
+			TEST_ASSERT(memcmp(&taken[0], content, 15) == 0);
+			TEST_ASSERT(stream.Size() == 0);
+			TEST_ASSERT(stream.Position() == 0);
+
+			TEST_ASSERT(stream.Write(content, 4) == 4);
+			stream.SeekFromBegin(0);
+			TEST_ASSERT(stream.Read(buffer, 15) == 4);
+			TEST_ASSERT(strncmp(buffer, content, 4) == 0);
+		}
+	});
+
 	TEST_CASE(L"Test FileStream")
 	{
 		FileStream destroyer(GetTestOutputPath() + L"TestFile.ReadWrite.txt", FileStream::WriteOnly);
@@ -300,6 +355,35 @@ TEST_FILE
 		TestClosedProperty(rw);
 	});
 
+	TEST_CASE(L"Test FileStream with ReadOnlyMapped")
+	{
+		FileStream empty(GetTestOutputPath() + L"TestFile.ReadWrite.txt", FileStream::WriteOnly);
+		empty.Close();
+
+		FileStream tryRead(GetTestOutputPath() + L"TestFile.ReadWrite.txt", FileStream::ReadOnlyMapped);
+		TestReadonlySeekableProperty(tryRead, 0, 0);
+		tryRead.Close();
+		TestClosedProperty(tryRead);
+
+		FileStream w(GetTestOutputPath() + L"TestFile.ReadWrite.txt", FileStream::WriteOnly);
+		TestWriteonlySeekableStream(w);
+		w.Close();
+
+		FileStream r(GetTestOutputPath() + L"TestFile.ReadWrite.txt", FileStream::ReadOnlyMapped);
+		TestReadonlylSeekableStreamWithSize15(r);
+		r.SeekFromBegin(5);
+		const void* borrowed = nullptr;
+		TEST_ASSERT(r.AcquireRead(borrowed, 100) == 10);
+		TEST_ASSERT(strncmp((const char*)borrowed, "is genius!", 10) == 0);
+		r.CommitRead(3);
+		TestReadonlySeekableProperty(r, 8, 15);
+		r.Close();
+		TestClosedProperty(r);
+
+		FileStream missing(GetTestOutputPath() + L"TestFile.Missing.txt", FileStream::ReadOnlyMapped);
+		TEST_ASSERT(missing.IsAvailable() == false);
+	});
+
 	TEST_CASE(L"Test RecorderStream")
 	{
 		char reading[] = "vczh is genius!";
@@ -449,4 +533,285 @@ TEST_FILE
 		TEST_ASSERT(memory.Read(buffer, 15) == 15);
 		TEST_ASSERT(strncmp(buffer, "Vczh is genius!", 15) == 0);
 	});
+
+	/***********************************************************************
+	Borrowing
+	***********************************************************************/
+
+	TEST_CASE(L"Test AcquireRead and CommitRead")
+	{
+		char reading[] = "vczh is genius!";
+		const void* borrowed = nullptr;
+
+		auto testBorrowing = [&](IStream& stream)
+		{
+			TEST_ASSERT(stream.AcquireRead(borrowed, 4) == 4);
+			TEST_ASSERT(strncmp((const char*)borrowed, "vczh", 4) == 0);
+			TEST_ASSERT(stream.Position() == 0);
+			stream.CommitRead(3);
+			TEST_ASSERT(stream.Position() == 3);
+
+			char buffer[BUFFER_SIZE];
+			TEST_ASSERT(stream.Read(buffer, 5) == 5);
+			TEST_ASSERT(strncmp(buffer, "h is ", 5) == 0);
+
+			TEST_ASSERT(stream.AcquireRead(borrowed, 100) == 7);
+			TEST_ASSERT(strncmp((const char*)borrowed, "genius!", 7) == 0);
+			stream.CommitRead(7);
+			TEST_ASSERT(stream.AcquireRead(borrowed, 100) == 0);
+		};
+
+		{
+			MemoryWrapperStream stream(reading, 15);
+			testBorrowing(stream);
+		}
+		{
+			MemoryStream stream;
+			stream.Write(reading, 15);
+			stream.SeekFromBegin(0);
+			testBorrowing(stream);
+		}
+		{
+			MemoryStream memory;
+			memory.Write(reading, 15);
+			memory.SeekFromBegin(0);
+			CacheStream stream(memory, 32);
+			testBorrowing(stream);
+		}
+		{
+			MemoryWrapperStream memory(reading, 15);
+			UtfGeneralDecoder<char8_t, char8_t> decoder;
+			DecoderStream stream(memory, decoder);
+			testBorrowing(stream);
+		}
+		{
+			MemoryWrapperStream stream(reading, 15);
+			CacheStream cache(stream, 4);
+			TEST_ASSERT(cache.AcquireRead(borrowed, 100) == 4);
+			TEST_ASSERT(strncmp((const char*)borrowed, "vczh", 4) == 0);
+			cache.CommitRead(4);
+			TEST_ASSERT(cache.AcquireRead(borrowed, 100) == 4);
+			TEST_ASSERT(strncmp((const char*)borrowed, " is ", 4) == 0);
+		}
+		{
+			char writing[BUFFER_SIZE];
+			MemoryWrapperStream readingStream(reading, 15);
+			MemoryWrapperStream writingStream(writing, 15);
+			RecorderStream stream(readingStream, writingStream);
+			TEST_ASSERT(stream.AcquireRead(borrowed, 4) == -1);
+		}
+	});
+
+	TEST_CASE(L"Test StreamSpanReader")
+	{
+		char reading[] = "vczh is genius!";
+		const void* borrowed = nullptr;
+
+		auto testSpanReader = [&](IStream& stream)
+		{
+			StreamSpanReader reader(stream, 8);
+			TEST_ASSERT(reader.Acquire(borrowed, 4) == 4);
+			TEST_ASSERT(strncmp((const char*)borrowed, "vczh", 4) == 0);
+			reader.Commit(3);
+			TEST_ASSERT(reader.Acquire(borrowed, 8) == 8);
+			TEST_ASSERT(strncmp((const char*)borrowed, "h is gen", 8) == 0);
+			reader.Commit(8);
+			TEST_ASSERT(reader.Acquire(borrowed, 100) == 4);
+			TEST_ASSERT(strncmp((const char*)borrowed, "ius!", 4) == 0);
+			reader.Commit(4);
+			TEST_ASSERT(reader.Acquire(borrowed, 100) == 0);
+		};
+
+		{
+			MemoryWrapperStream stream(reading, 15);
+			testSpanReader(stream);
+		}
+		{
+			FileStream w(GetTestOutputPath() + L"TestFile.ReadWrite.txt", FileStream::WriteOnly);
+			w.Write(reading, 15);
+			w.Close();
+			FileStream stream(GetTestOutputPath() + L"TestFile.ReadWrite.txt", FileStream::ReadOnly);
+			testSpanReader(stream);
+			TEST_ASSERT(stream.Position() == 15);
+		}
+		{
+			char writing[BUFFER_SIZE];
+			MemoryWrapperStream readingStream(reading, 15);
+			MemoryWrapperStream writingStream(writing, 15);
+			RecorderStream stream(readingStream, writingStream);
+			testSpanReader(stream);
+		}
+	});
+
+	/***********************************************************************
+	Vectored
+	***********************************************************************/
+
+	TEST_CASE(L"Test ReadV and WriteV")
+	{
+		const vint PayloadSize = 10000;
+		char header[] = "head";
+		char trailer[] = "end";
+		char payload[PayloadSize];
+		for (vint i = 0; i < PayloadSize; i++)
+		{
+			payload[i] = (char)(i % 251);
+		}
+		StreamBuffer writing[] = { {header, 4}, {payload, PayloadSize}, {trailer, 3} };
+
+		char readHeader[4];
+		char readPayload[PayloadSize];
+		char readTrailer[3];
+		StreamBuffer reading[] = { {readHeader, 4}, {readPayload, PayloadSize}, {readTrailer, 3} };
+		auto assertRead = [&]()
+		{
+			TEST_ASSERT(strncmp(readHeader, header, 4) == 0);
+			TEST_ASSERT(memcmp(readPayload, payload, PayloadSize) == 0);
+			TEST_ASSERT(strncmp(readTrailer, trailer, 3) == 0);
+		};
+
+		auto testVectors = [&](IStream& stream)
+		{
+			char c = '<';
+			TEST_ASSERT(stream.Write(&c, 1) == 1);
+			TEST_ASSERT(stream.WriteV(writing, 3) == PayloadSize + 7);
+			c = '>';
+			TEST_ASSERT(stream.Write(&c, 1) == 1);
+			TEST_ASSERT(stream.Position() == PayloadSize + 9);
+
+			stream.SeekFromBegin(0);
+			TEST_ASSERT(stream.Read(&c, 1) == 1 && c == '<');
+			TEST_ASSERT(stream.ReadV(reading, 3) == PayloadSize + 7);
+			assertRead();
+			TEST_ASSERT(stream.Read(&c, 1) == 1 && c == '>');
+			TEST_ASSERT(stream.ReadV(reading, 3) == 0);
+
+			stream.SeekFromEnd(4);
+			TEST_ASSERT(stream.ReadV(reading, 3) == 4);
+			TEST_ASSERT(strncmp(readHeader, "end>", 4) == 0);
+		};
+
+		{
+			MemoryStream stream;
+			testVectors(stream);
+		}
+		{
+			MemoryStream stream(1000, MemoryStream::Segmented);
+			testVectors(stream);
+		}
+		{
+			FileStream stream(GetTestOutputPath() + L"TestFile.ReadWrite.txt", FileStream::ReadWrite);
+			testVectors(stream);
+		}
+		{
+			MemoryStream memory;
+			CacheStream stream(memory, 64);
+			testVectors(stream);
+		}
+		{
+			MemoryStream target1;
+			MemoryStream target2;
+			BroadcastStream stream;
+			stream.Targets().Add(&target1);
+			stream.Targets().Add(&target2);
+			TEST_ASSERT(stream.WriteV(writing, 3) == PayloadSize + 7);
+			TEST_ASSERT(stream.Position() == PayloadSize + 7);
+			for (auto target : { &target1, &target2 })
+			{
+				target->SeekFromBegin(0);
+				TEST_ASSERT(target->ReadV(reading, 3) == PayloadSize + 7);
+				assertRead();
+			}
+		}
+		{
+			MemoryStream input;
+			MemoryStream output;
+			input.WriteV(writing, 3);
+			input.SeekFromBegin(0);
+			RecorderStream stream(input, output);
+			TEST_ASSERT(stream.ReadV(reading, 3) == PayloadSize + 7);
+			assertRead();
+			TEST_ASSERT(output.Size() == PayloadSize + 7);
+			TEST_ASSERT(memcmp((char*)output.GetInternalBuffer() + 4, payload, PayloadSize) == 0);
+		}
+	});
+
+	/***********************************************************************
+	AsyncFile
+	***********************************************************************/
+
+	TEST_CASE(L"Test AsyncFile")
+	{
+		auto testAsyncFile = [](auto&& file)
+		{
+			char buffer[BUFFER_SIZE] = { 0 };
+			TEST_ASSERT(file.WriteAsync(8, "genius!", 7).GetResult() == 7);
+			TEST_ASSERT(file.WriteAsync(0, "vczh is ", 8).GetResult() == 8);
+			TEST_ASSERT(file.Size() == 15);
+
+			AsyncFileRange ranges[] = { { 0, 8 }, { 8, 0 } };
+			file.ReadAheadAsync(ranges, 2).GetResult();
+
+			auto read1 = file.ReadAsync(8, buffer + 8, 100);
+			auto read2 = file.ReadAsync(0, buffer, 8);
+			TEST_ASSERT(read1.GetResult() == 7);
+			TEST_ASSERT(read2.GetResult() == 8);
+			TEST_ASSERT(strncmp(buffer, "vczh is genius!", 15) == 0);
+			TEST_ASSERT(file.ReadAsync(15, buffer, 100).GetResult() == 0);
+			TEST_ASSERT(file.ReadAsync(100, buffer, 100).GetResult() == 0);
+		};
+
+		{
+			AsyncFile file(GetTestOutputPath() + L"TestFile.Async.txt", FileStream::ReadWrite);
+			TEST_ASSERT(file.IsAvailable() && file.CanRead() && file.CanWrite());
+			testAsyncFile(file);
+			file.Close();
+			TEST_ASSERT(!file.IsAvailable() && !file.CanRead() && !file.CanWrite());
+			TEST_ASSERT(file.Size() == -1);
+		}
+		{
+			AsyncFile file(GetTestOutputPath() + L"TestFile.Async.txt", FileStream::ReadOnly);
+			TEST_ASSERT(file.CanRead() && !file.CanWrite());
+			char buffer[BUFFER_SIZE] = { 0 };
+			TEST_ASSERT(file.ReadAsync(5, buffer, 2).GetResult() == 2);
+			TEST_ASSERT(strncmp(buffer, "is", 2) == 0);
+		}
+		{
+			AsyncFile file(GetTestOutputPath() + L"TestFile.Missing.txt", FileStream::ReadOnly);
+			TEST_ASSERT(!file.IsAvailable());
+		}
+		{
+			auto impl = CreateThreadPoolAsyncFileImpl(GetTestOutputPath() + L"TestFile.Async.txt", FileStream::ReadWrite);
+			TEST_ASSERT(impl->Open());
+			testAsyncFile(*impl.Obj());
+
+			// overlapping writes are executed in the submission order
+			const char* letters = "abcdefghijklmnopqrstuvwxyz";
+			collections::List<Task<vint>> writes;
+			for (vint i = 0; i < 100; i++)
+			{
+				writes.Add(impl->WriteAsync(0, letters + i % 26, 1));
+			}
+			for (auto&& write : writes)
+			{
+				TEST_ASSERT(write.GetResult() == 1);
+			}
+			char letter = 0;
+			TEST_ASSERT(impl->ReadAsync(0, &letter, 1).GetResult() == 1);
+			TEST_ASSERT(letter == letters[99 % 26]);
+			impl->Close();
+
+			bool rejected = false;
+			try
+			{
+				char buffer[BUFFER_SIZE];
+				impl->ReadAsync(0, buffer, 1).GetResult();
+			}
+			catch (const AsyncFileException& ex)
+			{
+				rejected = ex.GetErrorCode() == 0;
+			}
+			TEST_ASSERT(rejected);
+		}
+	});
 }
\ No newline at end of file
@@ -1,4 +1,7 @@
 ﻿#include "../../Source/Stream/MemoryWrapperStream.h"
+#include "../../Source/Stream/CacheStream.h"
+#include "../../Source/Stream/MemoryStream.h"
+#include "../../Source/Stream/RecorderStream.h"
 #include "../../Source/Stream/Accessor.h"
 
 using namespace vl;
@@ -103,6 +106,78 @@ TEST_FILE
 		TEST_ASSERT(reader.IsEnd() == true);
 	});
 
+	TEST_CASE(L"Test StreamReader with small blocks")
+	{
+		wchar_t text[] = L"1:Vczh is genius!\r\n2:Vczh is genius!!\r\n3:Vczh is genius!!!\r\n4:Vczh is genius!!!!";
+		const wchar_t* lines[] = {L"1:Vczh is genius!", L"2:Vczh is genius!!", L"3:Vczh is genius!!!", L"4:Vczh is genius!!!!"};
+
+		auto testReader = [&](IStream& stream, vint block)
+		{
+			StreamReader reader(stream, block);
+			for (auto line : lines)
+			{
+				TEST_ASSERT(reader.IsEnd() == false);
+				TEST_ASSERT(reader.ReadLine() == line);
+			}
+			TEST_ASSERT(reader.IsEnd() == true);
+		};
+
+		{
+			MemoryWrapperStream stream(text, sizeof(text) - sizeof(*text));
+			testReader(stream, 6);
+		}
+		{
+			// borrowed blocks from the cache stream end in the middle of characters
+			MemoryWrapperStream stream(text, sizeof(text) - sizeof(*text));
+			CacheStream cacheStream(stream, 7);
+			testReader(cacheStream, 65536);
+		}
+		{
+			MemoryWrapperStream stream(text, sizeof(text) - sizeof(*text));
+			CacheStream cacheStream(stream, 7);
+			testReader(cacheStream, 6);
+		}
+		{
+			// characters borrowed but not consumed are given back to the stream
+			MemoryWrapperStream stream(text, sizeof(text) - sizeof(*text));
+			{
+				StreamReader reader(stream);
+				TEST_ASSERT(reader.ReadLine() == lines[0]);
+				TEST_ASSERT(reader.ReadString(2) == L"2:");
+			}
+			TEST_ASSERT(stream.Position() == (wcslen(lines[0]) + 4) * sizeof(wchar_t));
+		}
+		{
+			// characters copied from unaligned content but not consumed are given back to the stream
+			alignas(wchar_t) char unaligned[sizeof(text) + 1];
+			memcpy(unaligned + 1, text, sizeof(text));
+			MemoryWrapperStream stream(unaligned + 1, sizeof(text) - sizeof(*text));
+			{
+				StreamReader reader(stream);
+				TEST_ASSERT(reader.ReadLine() == lines[0]);
+				TEST_ASSERT(reader.ReadString(2) == L"2:");
+			}
+			TEST_ASSERT(stream.Position() == (wcslen(lines[0]) + 4) * sizeof(wchar_t));
+		}
+		{
+			// characters are not read ahead from a stream that could not give them back
+			wchar_t writing[BUFFER_SIZE];
+			MemoryWrapperStream readingStream(text, sizeof(text) - sizeof(*text));
+			MemoryWrapperStream writingStream(writing, sizeof(writing));
+			RecorderStream stream(readingStream, writingStream);
+			{
+				StreamReader reader(stream);
+				TEST_ASSERT(reader.ReadChar() == L'1');
+				TEST_ASSERT(reader.ReadString(2) == L":V");
+			}
+			TEST_ASSERT(readingStream.Position() == 3 * sizeof(wchar_t));
+			{
+				StreamReader reader(stream);
+				TEST_ASSERT(reader.ReadLine() == lines[0] + 3);
+			}
+		}
+	});
+
 	/***********************************************************************
 	StreamWriter
 	***********************************************************************/
@@ -140,4 +215,39 @@ TEST_FILE
 		wchar_t baseline[] = L"1:Vczh is genius!\r\n2:Vczh is genius!\r\n3:Vczh is genius!\r\n4:Vczh is genius!\r\n";
 		TEST_ASSERT(wcscmp(text, baseline) == 0);
 	});
+
+	TEST_CASE(L"Test StreamWriter with buffer")
+	{
+		auto testWriter = [](vint block)
+		{
+			MemoryStream stream;
+			{
+				StreamWriter writer(stream, block);
+				writer.WriteString(L"1:");
+				writer.WriteInteger(-9223372036854775807LL - 1);
+				writer.WriteChar(L',');
+				writer.WriteInteger(0);
+				writer.WriteChar(L',');
+				writer.WriteUnsignedInteger(18446744073709551615ULL);
+				writer.WriteChar(L',');
+				writer.WriteDouble(-1.5);
+				writer.WriteChar(L',');
+				writer.WriteDouble(100);
+				writer.WriteLine(L"");
+				writer.WriteLine(L"2:Vczh is genius!");
+				TEST_ASSERT(block != 65536 || stream.Size() == 0);
+				writer.Flush();
+				TEST_ASSERT(stream.Size() == 75 * sizeof(wchar_t));
+				writer.WriteLine(L"3:Vczh is genius!");
+			}
+
+			stream.SeekFromBegin(0);
+			StreamReader reader(stream);
+			TEST_ASSERT(reader.ReadToEnd() == L"1:-9223372036854775808,0,18446744073709551615,-1.5,100\r\n2:Vczh is genius!\r\n3:Vczh is genius!\r\n");
+		};
+
+		testWriter(65536);
+		testWriter(8);
+		testWriter(0);
+	});
 }
\ No newline at end of file
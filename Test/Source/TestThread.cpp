@@ -1,4 +1,8 @@
 #include "../../Source/Threading.h"
+#if defined VCZH_GCC && !defined VCZH_APPLE
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 using namespace vl;
 using namespace vl::collections;
@@ -265,6 +269,60 @@ namespace mynamespace
 		}
 	}
 
+	/***********************************************************************
+	ThreadPoolLite
+	***********************************************************************/
+
+	struct TP_ThreadData
+	{
+		EventObject			finished;
+		atomic_vint			counter = 0;
+		vint				total = 0;
+
+		TP_ThreadData(vint _total)
+			:total(_total)
+		{
+			TEST_ASSERT(finished.CreateManualUnsignal(false));
+		}
+
+		void Increase()
+		{
+			if (INCRC(&counter) == total)
+			{
+				TEST_ASSERT(finished.Signal());
+			}
+		}
+	};
+
+	/***********************************************************************
+	Coroutine
+	***********************************************************************/
+
+	Task<vint> CO_Square(vint value)
+	{
+		co_await SwitchToThreadPool();
+		co_return value * value;
+	}
+
+	Task<vint> CO_SumOfSquares(vint count, vint& awaitedThreads)
+	{
+		vint sum = 0;
+		auto caller = Thread::GetCurrentThreadId();
+		for (vint i = 0; i < count; i++)
+		{
+			sum += co_await CO_Square(i);
+		}
+		co_await Delay(10);
+		if (caller != Thread::GetCurrentThreadId()) awaitedThreads++;
+		co_return sum;
+	}
+
+	Task<void> CO_Throw()
+	{
+		co_await Delay(1);
+		throw Exception(L"Coroutine");
+	}
+
 	/***********************************************************************
 	Thread Local Storage
 	***********************************************************************/
@@ -273,6 +331,19 @@ namespace mynamespace
 	ThreadVariable<const wchar_t*> tls2;
 	ThreadVariable<WString> tls3;
 
+	atomic_vint tlsTrackedCounter = 0;
+
+	class TlsTracked : public Object
+	{
+	public:
+		~TlsTracked()
+		{
+			INCRC(&tlsTrackedCounter);
+		}
+	};
+
+	ThreadVariable<Ptr<TlsTracked>> tls4;
+
 	void TlsProc(int i, atomic_vint& counter)
 	{
 		TEST_ASSERT(tls1.HasData() == false);
@@ -331,6 +402,82 @@ TEST_FILE
 		TEST_ASSERT(counter == 1);
 	});
 
+	TEST_CASE(L"Test Thread start options")
+	{
+		// pin to the first processor available to this process
+		vint firstCPU = 0;
+#if defined VCZH_GCC && !defined VCZH_APPLE
+		cpu_set_t cpus;
+		sched_getaffinity(0, sizeof(cpus), &cpus);
+		while (!CPU_ISSET(firstCPU, &cpus)) firstCPU++;
+#endif
+
+		ThreadStartOptions options;
+		options.name = L"vl-test-thread-options";
+		options.stackSize = 4 * 1024 * 1024;
+		options.affinityMask = (vuint64_t)1 << firstCPU;
+		options.policy = ThreadSchedulingPolicy::Batch;
+
+		bool executed = false;
+		WString name;
+		vint cpu = -1;
+		vint stackSize = 0;
+		vint policy = -1;
+		Thread* thread = Thread::CreateAndStart([&]()
+		{
+			executed = true;
+#if defined VCZH_GCC && !defined VCZH_APPLE
+			char buffer[16] = {};
+			pthread_getname_np(pthread_self(), buffer, sizeof(buffer));
+			name = atow(buffer);
+			cpu = sched_getcpu();
+			policy = sched_getscheduler(0);
+			pthread_attr_t attr;
+			size_t size = 0;
+			pthread_getattr_np(pthread_self(), &attr);
+			pthread_attr_getstacksize(&attr, &size);
+			pthread_attr_destroy(&attr);
+			stackSize = (vint)size;
+#endif
+		}, false, options);
+		TEST_ASSERT(thread);
+		TEST_ASSERT(thread->Wait());
+		delete thread;
+		TEST_ASSERT(executed);
+#if defined VCZH_GCC && !defined VCZH_APPLE
+		TEST_ASSERT(name == L"vl-test-thread-");
+		TEST_ASSERT(cpu == firstCPU);
+		TEST_ASSERT(stackSize >= options.stackSize);
+		TEST_ASSERT(policy == SCHED_BATCH);
+
+		// options that could not be applied fail the thread creation
+		ThreadStartOptions invalid;
+		invalid.policy = ThreadSchedulingPolicy::FIFO;
+		invalid.priority = 1000;
+		TEST_ASSERT(Thread::CreateAndStart([]() {}, true, invalid) == nullptr);
+
+		ThreadPoolConfig config;
+		config.maxWorkers = 2;
+		config.workerOptions.name = L"vl-test-pool";
+		config.workerOptions.affinityMask = options.affinityMask;
+		ThreadPool pool(config);
+		EventObject finished;
+		finished.CreateManualUnsignal(false);
+		pool.Queue([&]()
+		{
+			char buffer[16] = {};
+			pthread_getname_np(pthread_self(), buffer, sizeof(buffer));
+			name = atow(buffer);
+			cpu = sched_getcpu();
+			finished.Signal();
+		});
+		TEST_ASSERT(finished.Wait());
+		pool.Stop(false);
+		TEST_ASSERT(name == L"vl-test-pool");
+		TEST_ASSERT(cpu == firstCPU);
+#endif
+	});
+
 	TEST_CASE(L"Test Mutex")
 	{
 		Mutex_ThreadData data;
@@ -441,6 +588,63 @@ TEST_FILE
 		TEST_ASSERT(data.counter == 10);
 	});
 
+	TEST_CASE(L"Test WaitAll and WaitAny")
+	{
+#ifdef VCZH_MSVC
+		const vint count = 62;
+#else
+		const vint count = 256;
+#endif
+		Array<Ptr<EventObject>> events(count);
+		Array<WaitableObject*> objects(count);
+		for (vint i = 0; i < count; i++)
+		{
+			events[i] = Ptr(new EventObject);
+			TEST_ASSERT(events[i]->CreateAutoUnsignal(false));
+			objects[i] = events[i].Obj();
+		}
+
+		bool abandoned = true;
+		TEST_ASSERT(WaitableObject::WaitAnyForTime(&objects[0], count, 10, &abandoned) == -1);
+		auto signaler = Thread::CreateAndStart([&]()
+		{
+			Thread::Sleep(100);
+			events[count / 2 + 1]->Signal();
+		}, false);
+		TEST_ASSERT(WaitableObject::WaitAny(&objects[0], count, &abandoned) == count / 2 + 1);
+		TEST_ASSERT(abandoned == false);
+		TEST_ASSERT(WaitableObject::WaitAnyForTime(&objects[0], count, 10, &abandoned) == -1);
+		TEST_ASSERT(signaler->Wait());
+
+		TEST_ASSERT(events[0]->Signal());
+		TEST_ASSERT(WaitableObject::WaitAllForTime(&objects[0], count, 10) == false);
+		TEST_ASSERT(events[0]->WaitForTime(10));
+
+		Semaphore semaphore;
+		TEST_ASSERT(semaphore.Create(0, 1));
+		Array<WaitableObject*> mixed(count + 2);
+		for (vint i = 0; i < count; i++)
+		{
+			mixed[i] = objects[i];
+		}
+		mixed[count] = &semaphore;
+		mixed[count + 1] = signaler;
+		auto releaser = Thread::CreateAndStart([&]()
+		{
+			for (vint i = count - 1; i >= 0; i--)
+			{
+				events[i]->Signal();
+			}
+			Thread::Sleep(100);
+			semaphore.Release();
+		}, false);
+		TEST_ASSERT(WaitableObject::WaitAll(&mixed[0], count + 2));
+		TEST_ASSERT(WaitableObject::WaitAnyForTime(&objects[0], count, 10, &abandoned) == -1);
+		TEST_ASSERT(releaser->Wait());
+		delete releaser;
+		delete signaler;
+	});
+
 	TEST_CASE(L"Test CriticalSection")
 	{
 		CS_ThreadData data;
@@ -487,6 +691,100 @@ TEST_FILE
 		TEST_ASSERT(data.counter == 100);
 	});
 
+	TEST_CASE(L"Test StripedReaderWriterLock")
+	{
+		StripedReaderWriterLock lock;
+		vint values[2] = { 0,0 };
+		atomic_vint mismatches = 0;
+		List<Thread*> threads;
+		for (vint i = 0; i < 8; i++)
+		{
+			threads.Add(Thread::CreateAndStart([&, i]()
+			{
+				for (vint j = 0; j < 2000; j++)
+				{
+					if (i == 0 && j % 10 == 0)
+					{
+						WRITER_LOCK(lock)
+						{
+							values[0]++;
+							values[1]++;
+						}
+					}
+					else
+					{
+						READER_LOCK(lock)
+						{
+							if (values[0] != values[1]) INCRC(&mismatches);
+						}
+					}
+				}
+			}, false));
+		}
+		for (auto thread : threads)
+		{
+			thread->Wait();
+			delete thread;
+		}
+		TEST_ASSERT(mismatches == 0);
+		TEST_ASSERT(values[0] == 200 && values[1] == 200);
+
+		lock.EnterReader();
+		TEST_ASSERT(lock.TryEnterWriter() == false);
+		lock.LeaveReader();
+		TEST_ASSERT(lock.TryEnterWriter() == true);
+		TEST_ASSERT(lock.TryEnterReader() == false);
+		lock.LeaveWriter();
+		TEST_ASSERT(lock.TryEnterReader() == true);
+		lock.LeaveReader();
+	});
+
+	TEST_CASE(L"Test ReadMostly")
+	{
+		struct Pair
+		{
+			vint first = 0;
+			vint second = 0;
+		};
+
+		ReadMostly<Pair> data;
+		atomic_vint mismatches = 0;
+		List<Thread*> threads;
+		for (vint i = 0; i < 8; i++)
+		{
+			threads.Add(Thread::CreateAndStart([&, i]()
+			{
+				for (vint j = 0; j < 2000; j++)
+				{
+					if (i < 2 && j % 20 == 0)
+					{
+						data.Modify([](Pair& pair)
+						{
+							pair.first++;
+							pair.second++;
+						});
+					}
+					else if (!data.Read([](const Pair& pair) { return pair.first == pair.second; }))
+					{
+						INCRC(&mismatches);
+					}
+				}
+			}, false));
+		}
+		for (auto thread : threads)
+		{
+			thread->Wait();
+			delete thread;
+		}
+		TEST_ASSERT(mismatches == 0);
+		TEST_ASSERT(data.Read([](const Pair& pair) { return pair.first; }) == 200);
+
+		data.Update({ 1,2 });
+		TEST_ASSERT(data.Read([](const Pair& pair) { return pair.second - pair.first; }) == 1);
+		TEST_EXCEPTION(data.Modify([](Pair& pair) { pair.first = 100; throw Exception(L"Modify"); }), Exception, [](const Exception&) {});
+		TEST_ASSERT(data.Read([](const Pair& pair) { return pair.first; }) == 1);
+	});
+
 	TEST_CASE(L"Test SpinLock 1")
 	{
 		SL_ThreadData data;
@@ -549,6 +847,133 @@ TEST_FILE
 		}
 	});
 
+	TEST_CASE(L"Test SpinLock statistics")
+	{
+		SpinLockStatistics statistics(L"Test SpinLock statistics");
+		SL_ThreadData data;
+		data.lock.SetStatistics(&statistics);
+		List<Thread*> threads;
+		{
+			SpinLock::Scope lock(data.lock);
+			for (vint i = 0; i < 10; i++)
+			{
+				threads.Add(Thread::CreateAndStart(SL_ThreadProc, &data, false));
+			}
+			Thread::Sleep(1000);
+			TEST_ASSERT(data.counter == 0);
+		}
+		for (auto thread : threads)
+		{
+			thread->Wait();
+			delete thread;
+		}
+		TEST_ASSERT(data.counter == 10);
+		TEST_ASSERT(statistics.acquisitions == 11);
+		TEST_ASSERT(statistics.contendedAcquisitions == 10);
+		TEST_ASSERT(statistics.parks >= 10);
+		TEST_ASSERT(statistics.spinIterations > 0);
+
+		vint found = 0;
+		SpinLockStatistics::Enumerate([&](SpinLockStatistics* s)
+		{
+			if (s == &statistics)
+			{
+				TEST_ASSERT(WString::Unmanaged(s->GetName()) == L"Test SpinLock statistics");
+				found++;
+			}
+		});
+		TEST_ASSERT(found == 1);
+
+		statistics.Reset();
+		TEST_ASSERT(data.lock.TryEnter());
+		data.lock.Leave();
+		TEST_ASSERT(statistics.acquisitions == 1);
+		TEST_ASSERT(statistics.contendedAcquisitions == 0);
+	});
+
+	TEST_CASE(L"Test ThreadPoolLite")
+	{
+		TP_ThreadData data(100 * 101);
+		for (vint i = 0; i < 100; i++)
+		{
+			TEST_ASSERT(ThreadPoolLite::Queue([&data]()
+			{
+				for (vint j = 0; j < 100; j++)
+				{
+					TEST_ASSERT(ThreadPoolLite::Queue([&data]() { data.Increase(); }));
+				}
+				data.Increase();
+			}));
+		}
+		TEST_ASSERT(data.finished.Wait());
+		TEST_ASSERT(data.counter == 100 * 101);
+	#ifdef VCZH_GCC
+		TEST_ASSERT(ThreadPoolLite::Stop(false));
+		TEST_ASSERT(!ThreadPoolLite::Stop(false));
+	#endif
+	});
+
+	TEST_CASE(L"Test ThreadPool")
+	{
+		ThreadPoolConfig config;
+		config.minWorkers = 1;
+		config.maxWorkers = 2;
+		config.idleTimeout = 100;
+		config.warmUp = true;
+		ThreadPool blockedPool(config);
+		ThreadPool freePool;
+
+		EventObject unblock;
+		TEST_ASSERT(unblock.CreateManualUnsignal(false));
+		TP_ThreadData blocked(10);
+		atomic_vint running = 0;
+		atomic_vint maxRunning = 0;
+		for (vint i = 0; i < 10; i++)
+		{
+			TEST_ASSERT(blockedPool.Queue([&]()
+			{
+				auto current = INCRC(&running);
+				auto expected = maxRunning.load();
+				while (expected < current && !maxRunning.compare_exchange_weak(expected, current));
+				unblock.Wait();
+				DECRC(&running);
+				blocked.Increase();
+			}));
+		}
+
+		TP_ThreadData other(1);
+		TEST_ASSERT(freePool.Queue([&]() { other.Increase(); }));
+		TEST_ASSERT(other.finished.Wait());
+		TEST_ASSERT(blocked.counter == 0);
+
+		// blocked tasks grow the pool to maxWorkers
+		while (running < 2)
+		{
+			Thread::Sleep(1);
+		}
+	#ifdef VCZH_GCC
+		TEST_ASSERT(blockedPool.GetWorkerCount() == 2);
+	#endif
+
+		TEST_ASSERT(unblock.Signal());
+		TEST_ASSERT(blocked.finished.Wait());
+		TEST_ASSERT(maxRunning == 2);
+
+		// idle workers retire down to minWorkers
+		Thread::Sleep(500);
+	#ifdef VCZH_GCC
+		TEST_ASSERT(blockedPool.GetWorkerCount() == 1);
+	#endif
+		TP_ThreadData retired(1);
+		TEST_ASSERT(blockedPool.Queue([&]() { retired.Increase(); }));
+		TEST_ASSERT(retired.finished.Wait());
+
+		TEST_ASSERT(freePool.Stop(false));
+		TEST_ASSERT(blockedPool.Stop(false));
+		TEST_ASSERT(!blockedPool.Stop(false));
+		TEST_ASSERT(!blockedPool.Queue([]() {}));
+	});
+
 	TEST_CASE(L"Test TaskQueue")
 	{
 		TaskQueue queue;
@@ -581,6 +1006,581 @@ TEST_FILE
 		TEST_ASSERT(text == L"first,second");
 	});
 
+	TEST_CASE(L"Test TaskQueue in an external loop")
+	{
+		TaskQueue queue;
+		TEST_ASSERT(queue.RunTaskQueueFor(10) == true);
+
+		List<vint> order;
+		List<Func<void()>> tasks;
+		for (vint i = 0; i < 100; i++)
+		{
+			tasks.Add([&order, i]() { order.Add(i); });
+		}
+		queue.QueueTasks(tasks);
+		// a call returns after the first task that crosses the time limit, so it could take more than one call
+		for (vint i = 0; i < 100 && order.Count() < 100; i++)
+		{
+			TEST_ASSERT(queue.RunTaskQueueFor(0) == true);
+		}
+		TEST_ASSERT(order.Count() == 100);
+		for (vint i = 0; i < 100; i++)
+		{
+			TEST_ASSERT(order[i] == i);
+		}
+
+		atomic_vint counter = 0;
+		List<Thread*> threads;
+		for (vint i = 0; i < 4; i++)
+		{
+			threads.Add(Thread::CreateAndStart([&]()
+			{
+				for (vint j = 0; j < 1000; j++)
+				{
+					queue.QueueTask([&]() { INCRC(&counter); });
+				}
+			}, false));
+		}
+		while (counter != 4000)
+		{
+			TEST_ASSERT(queue.RunTaskQueueFor(10) == true);
+		}
+		for (auto thread : threads)
+		{
+			thread->Wait();
+			delete thread;
+		}
+
+		queue.QueueTask([&]() { INCRC(&counter); });
+		queue.QueueExitTask();
+		TEST_ASSERT(queue.RunTaskQueueFor(1000) == false);
+		TEST_ASSERT(counter == 4001);
+	});
+
+	TEST_CASE(L"Test threading statistics")
+	{
+		TEST_ASSERT(LatencyHistogramSnapshot::GetBucketIndex(0) == 0);
+		TEST_ASSERT(LatencyHistogramSnapshot::GetBucketIndex(15) == 15);
+		TEST_ASSERT(LatencyHistogramSnapshot::GetBucketIndex(~(vuint64_t)0) == LatencyHistogramSnapshot::BucketCount - 1);
+		for (vint i = 1; i < LatencyHistogramSnapshot::BucketCount; i++)
+		{
+			TEST_ASSERT(LatencyHistogramSnapshot::GetBucketLowerBound(i) == LatencyHistogramSnapshot::GetBucketUpperBound(i - 1) + 1);
+			TEST_ASSERT(LatencyHistogramSnapshot::GetBucketIndex(LatencyHistogramSnapshot::GetBucketLowerBound(i)) == i);
+		}
+
+		{
+			LatencyHistogram histogram;
+			for (vuint64_t i = 1; i <= 1000; i++)
+			{
+				histogram.Record(i * 1000);
+			}
+			LatencyHistogramSnapshot snapshot;
+			histogram.GetSnapshot(snapshot);
+			TEST_ASSERT(snapshot.count == 1000);
+			TEST_ASSERT(snapshot.max == 1000000);
+			TEST_ASSERT(snapshot.GetMean() == 500500);
+			auto p50 = snapshot.GetPercentile(50);
+			TEST_ASSERT(500000 <= p50 && p50 <= 500000 + 500000 / 8);
+			TEST_ASSERT(snapshot.GetPercentile(100) == 1000000);
+			histogram.Reset();
+			histogram.GetSnapshot(snapshot);
+			TEST_ASSERT(snapshot.count == 0 && snapshot.GetPercentile(99) == 0);
+		}
+
+		{
+			TaskStatistics statistics(L"Test threading statistics");
+			ThreadPoolConfig config;
+			config.maxWorkers = 1;
+			ThreadPool pool(config);
+			pool.SetStatistics(&statistics);
+
+			EventObject unblock;
+			TEST_ASSERT(unblock.CreateManualUnsignal(false));
+			TEST_ASSERT(pool.Queue([&]() { unblock.Wait(); }));
+			for (vint i = 0; i < 9; i++)
+			{
+				TEST_ASSERT(pool.Queue([]() {}));
+			}
+			Thread::Sleep(100);
+
+			TaskStatisticsSnapshot snapshot;
+			statistics.GetSnapshot(snapshot);
+			TEST_ASSERT(WString::Unmanaged(snapshot.name) == L"Test threading statistics");
+			TEST_ASSERT(snapshot.queued == 10);
+			TEST_ASSERT(snapshot.GetPending() == 9);
+
+			TEST_ASSERT(unblock.Signal());
+			TEST_ASSERT(pool.Stop(false));
+			statistics.GetSnapshot(snapshot);
+			TEST_ASSERT(snapshot.started == 10);
+			TEST_ASSERT(snapshot.completed == 10);
+			TEST_ASSERT(snapshot.GetPending() == 0);
+			TEST_ASSERT(snapshot.waitTime.count == 10);
+			TEST_ASSERT(snapshot.waitTime.max >= 50000000);
+			TEST_ASSERT(snapshot.runTime.GetPercentile(100) >= 50000000);
+
+			vint found = 0;
+			TaskStatistics::Enumerate([&](TaskStatistics* s)
+			{
+				if (s == &statistics) found++;
+			});
+			TEST_ASSERT(found == 1);
+		}
+
+		{
+			TaskStatistics statistics(L"Test threading statistics in TaskQueue");
+			TaskQueue queue;
+			queue.SetStatistics(&statistics);
+			queue.QueueTask([]() {});
+			List<Func<void()>> tasks;
+			tasks.Add([]() { Thread::Sleep(1); });
+			tasks.Add([]() { Thread::Sleep(1); });
+			queue.QueueTasks(tasks);
+			TEST_ASSERT(statistics.queued == 3);
+			TEST_ASSERT(statistics.started == 0);
+			queue.QueueExitTask();
+			queue.RunTaskQueue();
+			TEST_ASSERT(statistics.completed == 3);
+
+			LatencyHistogramSnapshot snapshot;
+			statistics.runTime.GetSnapshot(snapshot);
+			TEST_ASSERT(snapshot.count == 3);
+			TEST_ASSERT(snapshot.max >= 1000000);
+		}
+
+		{
+			WaitStatistics statistics(L"Test threading statistics in waits");
+			EventObject event;
+			TEST_ASSERT(event.CreateAutoUnsignal(false));
+			event.SetStatistics(&statistics);
+			TEST_ASSERT(!event.WaitForTime(10));
+			TEST_ASSERT(event.Signal());
+			TEST_ASSERT(event.Wait());
+
+			CriticalSection cs;
+			ConditionVariable cv;
+			cv.SetStatistics(&statistics);
+			CS_LOCK(cs)
+			{
+				TEST_ASSERT(!cv.SleepWithForTime(cs, 10));
+			}
+
+			WaitStatisticsSnapshot snapshot;
+			statistics.GetSnapshot(snapshot);
+			TEST_ASSERT(snapshot.waits == 3);
+			TEST_ASSERT(snapshot.failures == 2);
+			TEST_ASSERT(snapshot.waitTime.count == 3);
+			TEST_ASSERT(snapshot.waitTime.GetPercentile(100) >= 9000000);
+		}
+	});
+
+	TEST_CASE(L"Test Timer")
+	{
+		Timer early, late, cancelled, far, refreshed, nested;
+		TP_ThreadData fired(2);
+		atomic_vint cancelledCount = 0;
+		vuint64_t earlyTime = 0, lateTime = 0;
+		auto start = DateTime::UtcTime().osMilliseconds;
+		TEST_ASSERT(late.Schedule(300, [&]() { lateTime = DateTime::UtcTime().osMilliseconds; fired.Increase(); }));
+		TEST_ASSERT(early.Schedule(50, [&]() { earlyTime = DateTime::UtcTime().osMilliseconds; fired.Increase(); }));
+		TEST_ASSERT(!early.Schedule(50, []() {}));
+		TEST_ASSERT(cancelled.Schedule(100, [&]() { INCRC(&cancelledCount); }));
+		TEST_ASSERT(far.Schedule(1000000, [&]() { INCRC(&cancelledCount); }));
+		TEST_ASSERT(cancelled.Cancel());
+		TEST_ASSERT(!cancelled.Cancel());
+		TEST_ASSERT(fired.finished.Wait());
+		TEST_ASSERT(earlyTime - start >= 50);
+		TEST_ASSERT(lateTime - start >= 300);
+		TEST_ASSERT(earlyTime <= lateTime);
+		TEST_ASSERT(!early.IsScheduled());
+		TEST_ASSERT(far.IsScheduled());
+		TEST_ASSERT(far.Cancel());
+		TEST_ASSERT(cancelledCount == 0);
+
+		TP_ThreadData refreshedData(1);
+		start = DateTime::UtcTime().osMilliseconds;
+		TEST_ASSERT(refreshed.Schedule(400, [&]() { refreshedData.Increase(); }));
+		Thread::Sleep(200);
+		TEST_ASSERT(refreshed.Refresh());
+		Thread::Sleep(300);
+		TEST_ASSERT(refreshedData.counter == 0);
+		TEST_ASSERT(refreshedData.finished.Wait());
+		TEST_ASSERT(DateTime::UtcTime().osMilliseconds - start >= 600);
+		TEST_ASSERT(!refreshed.Refresh());
+
+		TP_ThreadData nestedData(2);
+		TEST_ASSERT(nested.Schedule(10, [&]()
+		{
+			nested.CancelAndWait();
+			TEST_ASSERT(nested.Schedule(10, [&]() { nestedData.Increase(); }));
+			nestedData.Increase();
+		}));
+		TEST_ASSERT(nestedData.finished.Wait());
+		nested.CancelAndWait();
+	});
+
+	TEST_CASE(L"Test BatchingTaskExecutor")
+	{
+		{
+			List<vint> executed;
+			vint maxBatch = 0;
+			BatchingTaskExecutor<vint> executor([&](List<vint>& batch)
+			{
+				if (maxBatch < batch.Count()) maxBatch = batch.Count();
+				for (auto input : batch) executed.Add(input);
+			}, 10, 100000);
+
+			TEST_ASSERT(executor.DrainAsync().GetStatus() == TaskStatus::Succeeded);
+			for (vint i = 0; i < 95; i++)
+			{
+				executor.Submit(i);
+			}
+			executor.DrainAsync().Wait();
+			TEST_ASSERT(maxBatch == 10);
+			TEST_ASSERT(executed.Count() == 95);
+			for (vint i = 0; i < 95; i++)
+			{
+				TEST_ASSERT(executed[i] == i);
+			}
+		}
+		{
+			atomic_vint executed = 0;
+			BatchingTaskExecutor<vint> executor([&](List<vint>& batch)
+			{
+				executed += batch.Count();
+			}, 1000, 20);
+
+			executor.Submit(1);
+			executor.Submit(2);
+			executor.Submit(3);
+			for (vint i = 0; i < 200 && executed != 3; i++)
+			{
+				Thread::Sleep(10);
+			}
+			TEST_ASSERT(executed == 3);
+		}
+		{
+			atomic_vint executed = 0;
+			atomic_vint concurrent = 0;
+			atomic_vint overlapped = 0;
+			{
+				BatchingTaskExecutor<vint> executor([&](List<vint>& batch)
+				{
+					if (INCRC(&concurrent) != 1) INCRC(&overlapped);
+					executed += batch.Count();
+					DECRC(&concurrent);
+				}, 64, 5);
+
+				List<Thread*> threads;
+				for (vint i = 0; i < 4; i++)
+				{
+					threads.Add(Thread::CreateAndStart([&]()
+					{
+						for (vint j = 0; j < 1000; j++)
+						{
+							executor.Submit(j);
+						}
+					}, false));
+				}
+				for (auto thread : threads)
+				{
+					thread->Wait();
+					delete thread;
+				}
+			}
+			TEST_ASSERT(executed == 4000);
+			TEST_ASSERT(overlapped == 0);
+		}
+	});
+
+	TEST_CASE(L"Test BoundedChannel")
+	{
+		{
+			BoundedChannel<WString> channel(3);
+			TEST_ASSERT(channel.GetCapacity() == 4);
+			WString value;
+			TEST_ASSERT(channel.TryReceive(value) == ChannelStatus::WouldBlock);
+			TEST_ASSERT(channel.ReceiveFor(value, 10) == ChannelStatus::TimedOut);
+			for (vint i = 0; i < 4; i++)
+			{
+				TEST_ASSERT(channel.TrySend(itow(i)) == ChannelStatus::Succeeded);
+			}
+			TEST_ASSERT(channel.TrySend(WString(L"full")) == ChannelStatus::WouldBlock);
+			TEST_ASSERT(channel.SendFor(WString(L"full"), 10) == ChannelStatus::TimedOut);
+
+			TEST_ASSERT(channel.Receive(value) && value == L"0");
+			List<WString> values;
+			TEST_ASSERT(channel.TryReceiveMany(values, 2) == 2);
+			WString more[] = { L"4",L"5",L"6" };
+			TEST_ASSERT(channel.TrySendMany(more, 3) == 3);
+
+			channel.Close();
+			TEST_ASSERT(channel.TrySend(WString(L"closed")) == ChannelStatus::Closed);
+			TEST_ASSERT(!channel.Send(WString(L"closed")));
+			TEST_ASSERT(channel.ReceiveMany(values, 10) == 4);
+			TEST_ASSERT(channel.ReceiveMany(values, 10) == 0);
+			TEST_ASSERT(channel.TryReceive(value) == ChannelStatus::Closed);
+			TEST_ASSERT(!channel.Receive(value));
+			TEST_ASSERT(values.Count() == 6);
+			for (vint i = 0; i < 6; i++)
+			{
+				TEST_ASSERT(values[i] == itow(i + 1));
+			}
+		}
+		{
+			BoundedChannel<WString> channel(4);
+			channel.Send(WString(L"left in the channel"));
+		}
+		{
+			const vint Producers = 4;
+			const vint ItemsPerProducer = 5000;
+			BoundedChannel<vint> channel(16);
+			atomic_vint sum = 0;
+			atomic_vint received = 0;
+			List<Thread*> producers, consumers;
+			for (vint i = 0; i < Producers; i++)
+			{
+				producers.Add(Thread::CreateAndStart([&]()
+				{
+					for (vint j = 0; j < ItemsPerProducer; j += 5)
+					{
+						if (j % 2 == 0)
+						{
+							vint items[] = { j,j + 1,j + 2,j + 3,j + 4 };
+							TEST_ASSERT(channel.SendMany(items, 5));
+						}
+						else
+						{
+							for (vint k = 0; k < 5; k++)
+							{
+								TEST_ASSERT(channel.Send(j + k));
+							}
+						}
+					}
+				}, false));
+			}
+			for (vint i = 0; i < 3; i++)
+			{
+				consumers.Add(Thread::CreateAndStart([&, i]()
+				{
+					List<vint> items;
+					vint value = 0;
+					while (true)
+					{
+						if (i == 0)
+						{
+							if (!channel.Receive(value)) break;
+							sum += value;
+							INCRC(&received);
+						}
+						else
+						{
+							items.Clear();
+							if (channel.ReceiveMany(items, 8) == 0) break;
+							for (auto item : items)
+							{
+								sum += item;
+								INCRC(&received);
+							}
+						}
+					}
+				}, false));
+			}
+			for (auto thread : producers)
+			{
+				thread->Wait();
+				delete thread;
+			}
+			channel.Close();
+			for (auto thread : consumers)
+			{
+				thread->Wait();
+				delete thread;
+			}
+			TEST_ASSERT(received == Producers * ItemsPerProducer);
+			TEST_ASSERT(sum == Producers * (ItemsPerProducer * (ItemsPerProducer - 1) / 2));
+		}
+	});
+
+	TEST_CASE(L"Test parallel algorithms")
+	{
+		Array<vint> squares(1000);
+		ParallelFor(0, squares.Count(), 16, [&](vint i) { squares[i] = i * i; });
+		for (vint i = 0; i < squares.Count(); i++)
+		{
+			TEST_ASSERT(squares[i] == i * i);
+		}
+
+		auto sum = ParallelReduce<vint>(0, 10000, 0, 0, [](vint i) { return i; }, [](vint a, vint b) { return a + b; });
+		TEST_ASSERT(sum == 10000 * 9999 / 2);
+		auto text = ParallelReduce<WString>(0, 100, 3, WString::Empty, [](vint i) { return itow(i % 10); }, [](const WString& a, const WString& b) { return a + b; });
+		TEST_ASSERT(text.Length() == 100);
+		for (vint i = 0; i < 100; i++)
+		{
+			TEST_ASSERT(text[i] == L'0' + i % 10);
+		}
+
+		// nested calls from every worker must not deadlock the thread pool
+		atomic_vint counter = 0;
+		ParallelFor(0, 64, 1, [&](vint)
+		{
+			ParallelFor(0, 64, 1, [&](vint)
+			{
+				ParallelInvoke([&]() { INCRC(&counter); }, [&]() { INCRC(&counter); });
+			});
+		});
+		TEST_ASSERT(counter == 64 * 64 * 2);
+
+		atomic_vint executed = 0;
+		bool thrown = false;
+		try
+		{
+			ParallelFor(0, 1000, 1, [&](vint i)
+			{
+				INCRC(&executed);
+				if (i == 500) throw Exception(L"Parallel");
+			});
+		}
+		catch (const Exception& e)
+		{
+			thrown = e.Message() == L"Parallel";
+		}
+		TEST_ASSERT(thrown);
+		TEST_ASSERT(executed <= 1000);
+	});
+
+	TEST_CASE(L"Test Task and Promise")
+	{
+		// read -> decode -> compress pipeline without a thread per stage
+		auto pipeline = RunTask([]() { return WString(L"abc"); })
+			.Then([](const WString& text) { return text.Length(); })
+			.Then([](vint length) { return RunTask([=]() { return length * 10; }); });
+		TEST_ASSERT(pipeline.GetResult() == 30);
+		TEST_ASSERT(pipeline.GetStatus() == TaskStatus::Succeeded);
+
+		Promise<vint> promise;
+		auto task = promise.GetTask();
+		TEST_ASSERT(!task.Wait(10));
+		TEST_ASSERT(task.GetStatus() == TaskStatus::Pending);
+		atomic_vint continued = 0;
+		auto next = task.Then([&](vint value) { INCRC(&continued); return value + 1; });
+		TEST_ASSERT(promise.SetResult(41));
+		TEST_ASSERT(!promise.SetResult(0));
+		TEST_ASSERT(next.GetResult() == 42);
+		TEST_ASSERT(continued == 1);
+
+		// failures skip continuations and propagate
+		Promise<void> failing;
+		auto skipped = failing.GetTask().Then([&]() { INCRC(&continued); });
+		failing.SetException(std::make_exception_ptr(Exception(L"Task")));
+		bool thrown = false;
+		try
+		{
+			skipped.GetResult();
+		}
+		catch (const Exception& e)
+		{
+			thrown = e.Message() == L"Task";
+		}
+		TEST_ASSERT(thrown);
+		TEST_ASSERT(skipped.GetStatus() == TaskStatus::Failed);
+		TEST_ASSERT(continued == 1);
+
+		// cancellation is observed before a callback starts
+		CancellationTokenSource source;
+		Promise<void> gate;
+		auto cancelled = gate.GetTask().Then([&]() { INCRC(&continued); }, source.GetToken());
+		source.Cancel();
+		gate.SetResult();
+		TEST_ASSERT(cancelled.Wait());
+		TEST_ASSERT(cancelled.GetStatus() == TaskStatus::Cancelled);
+		TEST_ASSERT(continued == 1);
+		thrown = false;
+		try
+		{
+			cancelled.GetResult();
+		}
+		catch (const TaskCancelledException&)
+		{
+			thrown = true;
+		}
+		TEST_ASSERT(thrown);
+
+		List<Task<vint>> tasks;
+		for (vint i = 0; i < 100; i++)
+		{
+			tasks.Add(RunTask([=]() { return i; }));
+		}
+		WhenAll(tasks).GetResult();
+		for (vint i = 0; i < tasks.Count(); i++)
+		{
+			TEST_ASSERT(tasks[i].GetResult() == i);
+		}
+		WhenAll(tasks[0], skipped, cancelled).Wait();
+		TEST_ASSERT(WhenAll(tasks[0], skipped, cancelled).GetStatus() == TaskStatus::Failed);
+		TEST_ASSERT(WhenAll(tasks[0], cancelled).GetStatus() == TaskStatus::Cancelled);
+
+		Promise<void> never;
+		TEST_ASSERT(WhenAny(never.GetTask(), tasks[5]).GetResult() == 1);
+		TEST_ASSERT(!WhenAny(never.GetTask()).Wait(10));
+		never.SetCancelled();
+	});
+
+	TEST_CASE(L"Test coroutines")
+	{
+		vint awaitedThreads = 0;
+		auto task = CO_SumOfSquares(10, awaitedThreads);
+		TEST_ASSERT(task.GetResult() == 285);
+		TEST_ASSERT(awaitedThreads == 1);
+
+		bool thrown = false;
+		try
+		{
+			CO_Throw().GetResult();
+		}
+		catch (const Exception& e)
+		{
+			thrown = e.Message() == L"Coroutine";
+		}
+		TEST_ASSERT(thrown);
+
+		// a coroutine awaiting a promise resumes inside SetResult
+		Promise<WString> promise;
+		vint resumedOn = -1;
+		// the lambda must outlive the coroutine because captures are accessed through it
+		auto coroutine = [&]() -> Task<void>
+		{
+			auto text = co_await promise.GetTask();
+			TEST_ASSERT(text == L"Promise");
+			resumedOn = Thread::GetCurrentThreadId();
+		};
+		auto awaiting = coroutine();
+		TEST_ASSERT(!awaiting.IsCompleted());
+		promise.SetResult(WString(L"Promise"));
+		TEST_ASSERT(awaiting.IsCompleted());
+		TEST_ASSERT(resumedOn == Thread::GetCurrentThreadId());
+	});
+
+	TEST_CASE(L"Test ThreadLocalStorage in thread pool tasks")
+	{
+		const vint TaskCount = 100;
+		atomic_vint dirtyTasks = 0;
+		for (vint i = 0; i < TaskCount; i++)
+		{
+			TEST_ASSERT(ThreadPoolLite::Queue([&dirtyTasks]()
+			{
+				if (tls4.HasData()) INCRC(&dirtyTasks);
+				tls4.Set(Ptr(new TlsTracked));
+			}));
+		}
+		for (vint i = 0; i < 1000 && tlsTrackedCounter < TaskCount; i++)
+		{
+			Thread::Sleep(10);
+		}
+		TEST_ASSERT(tlsTrackedCounter == TaskCount);
+		TEST_ASSERT(dirtyTasks == 0);
+	});
+
 	TEST_CASE(L"Test ThreadLocalStorage")
 	{
 		ThreadLocalStorage::FixStorages();
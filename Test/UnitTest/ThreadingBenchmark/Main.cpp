@@ -0,0 +1,638 @@
+/***********************************************************************
+Author: Zihan Chen (vczh)
+Licensed under https://github.com/vczh-libraries/License
+***********************************************************************/
+
+#include "../../../Source/Threading.h"
+
+using namespace vl;
+using namespace vl::collections;
+using namespace vl::console;
+
+/***********************************************************************
+ThreadingBenchmark
+
+Usage: ThreadingBenchmark [/D:<milliseconds per case>] [/P:<primitive>]...
+
+Each case prints one JSON object in a line:
+  {"primitive":"SpinLock","contention":"high","threads":4,"ops":...,"seconds":...,"opsPerSecond":...,"p50Ns":...,"p99Ns":...,"maxNs":...}
+
+contention:
+  low:  every thread uses its own object, or a thread pool task is queued after the previous one finishes
+  high: all threads share one object, or thread pool tasks are queued in bursts
+
+On Linux and macOS, ThreadPool.Allocations counts memory allocations made by submitting and running inline tasks:
+  {"primitive":"ThreadPool.Allocations","ops":...,"seconds":...,"opsPerSecond":...,"allocations":...}
+It replaces the global operator new, the process returns a non-zero exit code if any allocation is counted.
+***********************************************************************/
+
+namespace
+{
+	enum class Contention
+	{
+		Low,
+		High,
+	};
+
+	struct BenchmarkResult
+	{
+		vuint64_t						ops = 0;
+		vuint64_t						elapsed = 0;
+		LatencyHistogramSnapshot		latency;
+	};
+
+	struct alignas(64) BenchmarkWorker
+	{
+		vuint64_t						ops = 0;
+		LatencyHistogram				latency;
+	};
+
+	class BenchmarkRunner : public Object
+	{
+	public:
+		vint							threadCount = 1;
+		Contention						contention = Contention::Low;
+		vint							duration = 200;
+
+		std::atomic<bool>				stopping = false;
+		atomic_vint						ready = 0;
+		std::atomic<bool>				started = false;
+		Array<BenchmarkWorker*>			workers;
+
+		BenchmarkRunner(vint _threadCount, Contention _contention, vint _duration)
+			:threadCount(_threadCount)
+			, contention(_contention)
+			, duration(_duration)
+			, workers(_threadCount)
+		{
+			for (vint i = 0; i < threadCount; i++)
+			{
+				workers[i] = new BenchmarkWorker;
+			}
+		}
+
+		~BenchmarkRunner()
+		{
+			for (auto worker : workers)
+			{
+				delete worker;
+			}
+		}
+
+		bool IsStopping()
+		{
+			return stopping.load(std::memory_order_relaxed);
+		}
+
+		void WaitForStart()
+		{
+			INCRC(&ready);
+			while (!started.load(std::memory_order_acquire))
+			{
+				Thread::Sleep(0);
+			}
+		}
+
+		BenchmarkResult Run(const Func<void(vint)>& threadProc, const Func<void()>& stopProc = {})
+		{
+			List<Thread*> threads;
+			for (vint i = 0; i < threadCount; i++)
+			{
+				threads.Add(Thread::CreateAndStart([=, this]() { threadProc(i); }, false));
+			}
+			while (ready.load() != threadCount)
+			{
+				Thread::Sleep(0);
+			}
+
+			auto startedTimestamp = threading_internal::GetStatisticsTimestamp();
+			started.store(true, std::memory_order_release);
+			Thread::Sleep(duration);
+			stopping = true;
+			if (stopProc)
+			{
+				stopProc();
+			}
+			for (auto thread : threads)
+			{
+				thread->Wait();
+				delete thread;
+			}
+
+			BenchmarkResult result;
+			result.elapsed = threading_internal::GetStatisticsTimestamp() - startedTimestamp;
+			for (auto worker : workers)
+			{
+				result.ops += worker->ops;
+				LatencyHistogramSnapshot snapshot;
+				worker->latency.GetSnapshot(snapshot);
+				result.latency.count += snapshot.count;
+				result.latency.sum += snapshot.sum;
+				if (result.latency.max < snapshot.max) result.latency.max = snapshot.max;
+				for (vint i = 0; i < LatencyHistogramSnapshot::BucketCount; i++)
+				{
+					result.latency.buckets[i] += snapshot.buckets[i];
+				}
+			}
+			return result;
+		}
+	};
+
+/***********************************************************************
+Locks
+***********************************************************************/
+
+	// a lock is entered, a shared counter is increased and the lock is left, latency covers the whole critical section
+	template<typename TLock, typename TEnter, typename TLeave>
+	BenchmarkResult BenchmarkLock(vint threadCount, Contention contention, vint duration, TEnter&& enter, TLeave&& leave)
+	{
+		struct alignas(64) PaddedLock
+		{
+			TLock						lock;
+			vuint64_t					counter = 0;
+		};
+
+		Array<PaddedLock*> locks(contention == Contention::High ? 1 : threadCount);
+		for (vint i = 0; i < locks.Count(); i++)
+		{
+			locks[i] = new PaddedLock;
+		}
+
+		BenchmarkRunner runner(threadCount, contention, duration);
+		auto result = runner.Run([&](vint index)
+		{
+			auto worker = runner.workers[index];
+			auto padded = locks[index % locks.Count()];
+			runner.WaitForStart();
+			while (!runner.IsStopping())
+			{
+				auto timestamp = threading_internal::GetStatisticsTimestamp();
+				enter(padded->lock);
+				padded->counter++;
+				leave(padded->lock);
+				worker->latency.Record(threading_internal::GetStatisticsTimestamp() - timestamp);
+				worker->ops++;
+			}
+		});
+
+		for (auto padded : locks)
+		{
+			delete padded;
+		}
+		return result;
+	}
+
+	// an auto-reset event or a semaphore with one resource is used as a lock
+	template<typename TObject, typename TCreate, typename TLeave>
+	BenchmarkResult BenchmarkWaitable(vint threadCount, Contention contention, vint duration, TCreate&& create, TLeave&& leave)
+	{
+		Array<TObject*> objects(contention == Contention::High ? 1 : threadCount);
+		for (vint i = 0; i < objects.Count(); i++)
+		{
+			objects[i] = new TObject;
+			CHECK_ERROR(create(*objects[i]), L"ThreadingBenchmark::BenchmarkWaitable#Failed to create a waitable object.");
+		}
+
+		BenchmarkRunner runner(threadCount, contention, duration);
+		auto result = runner.Run([&](vint index)
+		{
+			auto worker = runner.workers[index];
+			auto object = objects[index % objects.Count()];
+			runner.WaitForStart();
+			while (!runner.IsStopping())
+			{
+				auto timestamp = threading_internal::GetStatisticsTimestamp();
+				object->Wait();
+				leave(*object);
+				worker->latency.Record(threading_internal::GetStatisticsTimestamp() - timestamp);
+				worker->ops++;
+			}
+		});
+
+		for (auto object : objects)
+		{
+			delete object;
+		}
+		return result;
+	}
+
+/***********************************************************************
+ConditionVariable
+***********************************************************************/
+
+	// threads in a ring pass a turn to the next thread, latency covers waiting for the turn
+	// high contention puts all threads in one ring, low contention puts every two threads in a ring
+	BenchmarkResult BenchmarkConditionVariable(vint threadCount, Contention contention, vint duration)
+	{
+		struct Ring
+		{
+			CriticalSection				cs;
+			ConditionVariable			cv;
+			vint						size = 0;
+			vint						turn = 0;
+		};
+
+		vint ringSize = contention == Contention::High ? threadCount : 2;
+		Array<Ring*> rings((threadCount + ringSize - 1) / ringSize);
+		for (vint i = 0; i < rings.Count(); i++)
+		{
+			rings[i] = new Ring;
+			rings[i]->size = i == rings.Count() - 1 ? threadCount - i * ringSize : ringSize;
+		}
+
+		BenchmarkRunner runner(threadCount, contention, duration);
+		auto result = runner.Run([&](vint index)
+		{
+			auto worker = runner.workers[index];
+			auto ring = rings[index / ringSize];
+			auto position = index % ringSize;
+			runner.WaitForStart();
+			while (!runner.IsStopping())
+			{
+				auto timestamp = threading_internal::GetStatisticsTimestamp();
+				CS_LOCK(ring->cs)
+				{
+					while (ring->turn != position && !runner.IsStopping())
+					{
+						ring->cv.SleepWith(ring->cs);
+					}
+					ring->turn = (ring->turn + 1) % ring->size;
+				}
+				ring->cv.WakeAllPendings();
+				worker->latency.Record(threading_internal::GetStatisticsTimestamp() - timestamp);
+				worker->ops++;
+			}
+		}, [&]()
+		{
+			for (auto ring : rings)
+			{
+				CS_LOCK(ring->cs)
+				{
+					ring->cv.WakeAllPendings();
+				}
+			}
+		});
+
+		for (auto ring : rings)
+		{
+			delete ring;
+		}
+		return result;
+	}
+
+/***********************************************************************
+ThreadPoolLite
+***********************************************************************/
+
+	// latency covers the time between queuing a task and starting it
+	// high contention queues tasks in bursts, low contention queues a task after the previous one finishes
+	BenchmarkResult BenchmarkThreadPoolLite(vint threadCount, Contention contention, vint duration)
+	{
+		struct Submitter : Object
+		{
+			EventObject					finished;
+			atomic_vint					remaining = 0;
+		};
+
+		vint burst = contention == Contention::High ? 64 : 1;
+		// a task could still be signaling after its submitter wakes up, so tasks share the submitter
+		Array<Ptr<Submitter>> submitters(threadCount);
+		for (vint i = 0; i < threadCount; i++)
+		{
+			submitters[i] = Ptr(new Submitter);
+			CHECK_ERROR(submitters[i]->finished.CreateAutoUnsignal(false), L"ThreadingBenchmark::BenchmarkThreadPoolLite#Failed to create an event.");
+		}
+
+		BenchmarkRunner runner(threadCount, contention, duration);
+		auto result = runner.Run([&](vint index)
+		{
+			auto worker = runner.workers[index];
+			auto submitter = submitters[index];
+			runner.WaitForStart();
+			while (!runner.IsStopping())
+			{
+				submitter->remaining = burst;
+				for (vint i = 0; i < burst; i++)
+				{
+					auto timestamp = threading_internal::GetStatisticsTimestamp();
+					ThreadPoolLite::Queue([=]()
+					{
+						worker->latency.Record(threading_internal::GetStatisticsTimestamp() - timestamp);
+						if (DECRC(&submitter->remaining) == 0)
+						{
+							submitter->finished.Signal();
+						}
+					});
+				}
+				submitter->finished.Wait();
+				worker->ops += burst;
+			}
+		});
+		return result;
+	}
+
+/***********************************************************************
+ThreadPool.Allocations
+***********************************************************************/
+
+#ifdef VCZH_GCC
+	std::atomic<bool>					countAllocations = false;
+	atomic_vint							allocations = 0;
+	thread_local bool					trackAllocations = false;
+
+	struct AllocationBatch
+	{
+		EventObject						finished;
+		atomic_vint						remaining = 0;
+
+		void Complete()
+		{
+			if (DECRC(&remaining) == 0)
+			{
+				finished.Signal();
+			}
+		}
+	};
+
+	void AllocationProc(void* argument)
+	{
+		trackAllocations = true;
+		((AllocationBatch*)argument)->Complete();
+	}
+
+	// half of the tasks are function pointers and the other half are lambda expressions stored inline
+	// events are declared before the pool, the pool is stopped before they are destroyed so no task could touch them afterwards
+	BenchmarkResult BenchmarkThreadPoolAllocations(vint& counted)
+	{
+		const vint Workers = 4;
+		const vint BatchSize = 1000;
+		const vint Batches = 100;
+
+		EventObject unblock;
+		AllocationBatch batch;
+		CHECK_ERROR(unblock.CreateManualUnsignal(false), L"ThreadingBenchmark::BenchmarkThreadPoolAllocations#Failed to create an event.");
+		CHECK_ERROR(batch.finished.CreateAutoUnsignal(false), L"ThreadingBenchmark::BenchmarkThreadPoolAllocations#Failed to create an event.");
+
+		ThreadPoolConfig config;
+		config.minWorkers = Workers;
+		config.maxWorkers = Workers;
+		config.warmUp = true;
+		ThreadPool pool(config);
+
+		auto runBatch = [&](vint size)
+		{
+			batch.remaining = size;
+			for (vint i = 0; i < size; i++)
+			{
+				if (i % 2 == 0)
+				{
+					pool.Queue(&AllocationProc, &batch);
+				}
+				else
+				{
+					pool.Queue(InlineTask([&batch]()
+					{
+						trackAllocations = true;
+						batch.Complete();
+					}));
+				}
+			}
+			batch.finished.Wait();
+		};
+
+		// block all workers and queue more tasks than a batch, so that enough task nodes are recycled for batches
+		atomic_vint blocked = 0;
+		for (vint i = 0; i < Workers; i++)
+		{
+			pool.Queue(InlineTask([&]()
+			{
+				INCRC(&blocked);
+				unblock.Wait();
+			}));
+		}
+		while (blocked != Workers)
+		{
+			Thread::Sleep(1);
+		}
+		batch.remaining = BatchSize * 3;
+		for (vint i = 0; i < BatchSize * 3; i++)
+		{
+			pool.Queue(&AllocationProc, &batch);
+		}
+		unblock.Signal();
+		batch.finished.Wait();
+		for (vint i = 0; i < 10; i++)
+		{
+			runBatch(BatchSize);
+		}
+
+		trackAllocations = true;
+		countAllocations = true;
+		auto startedTimestamp = threading_internal::GetStatisticsTimestamp();
+		for (vint i = 0; i < Batches; i++)
+		{
+			runBatch(BatchSize);
+		}
+		BenchmarkResult result;
+		result.elapsed = threading_internal::GetStatisticsTimestamp() - startedTimestamp;
+		result.ops = Batches * BatchSize;
+		countAllocations = false;
+		trackAllocations = false;
+
+		pool.Stop(false);
+		counted = allocations;
+		return result;
+	}
+#endif
+
+/***********************************************************************
+Main
+***********************************************************************/
+
+	struct BenchmarkCase
+	{
+		const wchar_t*					primitive;
+		Func<BenchmarkResult(vint, Contention, vint)>	run;
+	};
+
+	void PrintResult(const wchar_t* primitive, Contention contention, vint threadCount, const BenchmarkResult& result)
+	{
+		double seconds = result.elapsed / 1e9;
+		Console::WriteLine(
+			WString::Unmanaged(L"{\"primitive\":\"") + WString::Unmanaged(primitive) +
+			WString::Unmanaged(L"\",\"contention\":\"") + (contention == Contention::High ? WString::Unmanaged(L"high") : WString::Unmanaged(L"low")) +
+			WString::Unmanaged(L"\",\"threads\":") + itow(threadCount) +
+			WString::Unmanaged(L",\"ops\":") + u64tow(result.ops) +
+			WString::Unmanaged(L",\"seconds\":") + ftow(seconds) +
+			WString::Unmanaged(L",\"opsPerSecond\":") + ftow(seconds > 0 ? result.ops / seconds : 0) +
+			WString::Unmanaged(L",\"p50Ns\":") + u64tow(result.latency.GetPercentile(50)) +
+			WString::Unmanaged(L",\"p99Ns\":") + u64tow(result.latency.GetPercentile(99)) +
+			WString::Unmanaged(L",\"maxNs\":") + u64tow(result.latency.max) +
+			WString::Unmanaged(L"}")
+		);
+	}
+
+	bool RunBenchmarks(vint duration, const List<WString>& primitives)
+	{
+		List<BenchmarkCase> cases;
+		cases.Add({ L"SpinLock", [](vint t, Contention c, vint d)
+		{
+			return BenchmarkLock<SpinLock>(t, c, d, [](SpinLock& lock) { lock.Enter(); }, [](SpinLock& lock) { lock.Leave(); });
+		} });
+		cases.Add({ L"CriticalSection", [](vint t, Contention c, vint d)
+		{
+			return BenchmarkLock<CriticalSection>(t, c, d, [](CriticalSection& lock) { lock.Enter(); }, [](CriticalSection& lock) { lock.Leave(); });
+		} });
+		cases.Add({ L"ReaderWriterLock.Reader", [](vint t, Contention c, vint d)
+		{
+			return BenchmarkLock<ReaderWriterLock>(t, c, d, [](ReaderWriterLock& lock) { lock.EnterReader(); }, [](ReaderWriterLock& lock) { lock.LeaveReader(); });
+		} });
+		cases.Add({ L"ReaderWriterLock.Writer", [](vint t, Contention c, vint d)
+		{
+			return BenchmarkLock<ReaderWriterLock>(t, c, d, [](ReaderWriterLock& lock) { lock.EnterWriter(); }, [](ReaderWriterLock& lock) { lock.LeaveWriter(); });
+		} });
+		cases.Add({ L"EventObject", [](vint t, Contention c, vint d)
+		{
+			return BenchmarkWaitable<EventObject>(t, c, d, [](EventObject& event) { return event.CreateAutoUnsignal(true); }, [](EventObject& event) { event.Signal(); });
+		} });
+		cases.Add({ L"Semaphore", [](vint t, Contention c, vint d)
+		{
+			return BenchmarkWaitable<Semaphore>(t, c, d, [](Semaphore& semaphore) { return semaphore.Create(1, 1); }, [](Semaphore& semaphore) { semaphore.Release(); });
+		} });
+		cases.Add({ L"ConditionVariable", &BenchmarkConditionVariable });
+		cases.Add({ L"ThreadPoolLite", &BenchmarkThreadPoolLite });
+
+		// at least 4 threads are measured to show contention even on machines with few processors
+		List<vint> threadCounts;
+		auto cpuCount = Thread::GetCPUCount();
+		auto maxThreads = cpuCount > 4 ? cpuCount : 4;
+		for (vint i = 1; i < maxThreads; i *= 2)
+		{
+			threadCounts.Add(i);
+		}
+		threadCounts.Add(maxThreads);
+
+		for (auto&& benchmarkCase : cases)
+		{
+			if (primitives.Count() > 0 && !primitives.Contains(WString::Unmanaged(benchmarkCase.primitive)))
+			{
+				continue;
+			}
+			for (auto contention : { Contention::Low, Contention::High })
+			{
+				for (auto threadCount : threadCounts)
+				{
+					auto result = benchmarkCase.run(threadCount, contention, duration);
+					PrintResult(benchmarkCase.primitive, contention, threadCount, result);
+				}
+			}
+		}
+
+#ifdef VCZH_GCC
+		if (primitives.Count() == 0 || primitives.Contains(WString::Unmanaged(L"ThreadPool.Allocations")))
+		{
+			vint counted = 0;
+			auto result = BenchmarkThreadPoolAllocations(counted);
+			double seconds = result.elapsed / 1e9;
+			Console::WriteLine(
+				WString::Unmanaged(L"{\"primitive\":\"ThreadPool.Allocations\",\"ops\":") + u64tow(result.ops) +
+				WString::Unmanaged(L",\"seconds\":") + ftow(seconds) +
+				WString::Unmanaged(L",\"opsPerSecond\":") + ftow(seconds > 0 ? result.ops / seconds : 0) +
+				WString::Unmanaged(L",\"allocations\":") + itow(counted) +
+				WString::Unmanaged(L"}")
+			);
+			return counted == 0;
+		}
+#endif
+		return true;
+	}
+}
+
+#ifdef VCZH_GCC
+// count allocations made by threads that are submitting or running tasks measured by ThreadPool.Allocations
+void* operator new(std::size_t size)
+{
+	if (trackAllocations && countAllocations)
+	{
+		INCRC(&allocations);
+	}
+	if (auto p = malloc(size == 0 ? 1 : size))
+	{
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+	free(p);
+}
+#endif
+
+#if defined VCZH_MSVC
+int wmain(int argc, wchar_t* argv[])
+#elif defined VCZH_GCC
+int main(int argc, char* argv[])
+#endif
+{
+	vint result = 1;
+	try
+	{
+		vint duration = 200;
+		List<WString> primitives;
+		for (vint i = 1; i < argc; i++)
+		{
+#if defined VCZH_MSVC
+			WString argument = argv[i];
+#elif defined VCZH_GCC
+			WString argument = atow(argv[i]);
+#endif
+			if (argument.Length() > 3 && argument.Left(3) == L"/D:")
+			{
+				duration = wtoi(argument.Sub(3, argument.Length() - 3));
+			}
+			else if (argument.Length() > 3 && argument.Left(3) == L"/P:")
+			{
+				primitives.Add(argument.Sub(3, argument.Length() - 3));
+			}
+			else
+			{
+				Console::WriteLine(L"Usage: ThreadingBenchmark [/D:<milliseconds per case>] [/P:<primitive>]...");
+				duration = -1;
+				break;
+			}
+		}
+
+		if (duration > 0)
+		{
+			result = RunBenchmarks(duration, primitives) ? 0 : 1;
+		}
+	}
+	catch (const Exception& exception)
+	{
+		Console::WriteLine(L"Error: " + exception.Message());
+	}
+	catch (const Error& error)
+	{
+		Console::WriteLine(L"Error: " + WString(error.Description()));
+	}
+	catch (...)
+	{
+		Console::WriteLine(L"Error: Unknown application failure.");
+	}
+
+#ifdef VCZH_GCC
+	ThreadPoolLite::Stop(false);
+#endif
+	ThreadLocalStorage::DisposeStorages();
+	FinalizeGlobalStorage();
+#if defined VCZH_MSVC && defined VCZH_CHECK_MEMORY_LEAKS
+	_CrtDumpMemoryLeaks();
+#endif
+	return (int)result;
+}